@@ -0,0 +1,393 @@
+// Hot path benchmarks for the firmware, run on the host.
+//
+// Every benchmark reports metrics where lower is better:
+//   *_ns       wall time per operation (per pixel for *.pixel_ns) on this
+//              machine, best of several runs
+//   other      simulated device figures (I2C traffic, bus time, samples),
+//              deterministic for a given firmware
+//
+// Results are written as a flat JSON object. With --baseline the run fails
+// when a metric is worse than the baseline by more than the tolerance: the
+// time tolerance for *_ns metrics (machines differ), none for the others.
+//
+//   super_lights_bench --output results.json --baseline bench/baseline.json
+//   super_lights_bench --baseline bench/baseline.json --update-baseline
+
+#include "host_sim.h"
+#include "display_control.h"
+#include "menu_control.h"
+#include "settings_control.h"
+#include "speaker_control.h"
+#include "rgb_led_control.h"
+#include "log_control.h"
+#include "timer_control.h"
+#include "scene_control.h"
+#include "melody_control.h"
+#include "color_control.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_METRICS 64
+#define REPEATS 5
+#define DEFAULT_TIME_TOLERANCE 0.25
+
+typedef struct
+{
+    char name[64];
+    double value;
+} Metric;
+
+static Metric metrics[MAX_METRICS];
+static int metric_count = 0;
+static volatile int sink; // Keeps the optimizer from dropping benchmark work
+
+static void add_metric(const char *bench, const char *metric, double value)
+{
+    Metric *m = &metrics[metric_count++];
+    snprintf(m->name, sizeof(m->name), "%s.%s", bench, metric);
+    m->value = value;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Best per-operation wall time of REPEATS runs of `iterations` calls
+static double time_per_op_ns(void (*op)(int), int iterations)
+{
+    double best = 0;
+    for (int repeat = 0; repeat < REPEATS; repeat++)
+    {
+        double start = now_ns();
+        for (int i = 0; i < iterations; i++)
+        {
+            op(i);
+        }
+        double per_op = (now_ns() - start) / iterations;
+        if (repeat == 0 || per_op < best)
+        {
+            best = per_op;
+        }
+    }
+    return best;
+}
+
+// Wall time plus the I2C traffic and simulated time one call produces
+static void bench_lcd(const char *name, void (*op)(int), int iterations)
+{
+    HostI2cStats i2c;
+    host_i2c_reset_stats();
+    uint64_t sim_start = host_sim_now_us();
+    op(0);
+    uint64_t sim_us = host_sim_now_us() - sim_start;
+    host_i2c_get_stats(&i2c);
+
+    add_metric(name, "wall_ns", time_per_op_ns(op, iterations));
+    add_metric(name, "i2c_transactions", i2c.transactions);
+    add_metric(name, "i2c_bytes", i2c.bytes);
+    add_metric(name, "device_us", sim_us);
+}
+
+static void op_display_render(int i)
+{
+    display_render(i & 1 ? "Brightness: 50% " : "Brightness: 55% ", "Color: Cyan");
+}
+
+// One step of a slider, back and forth across a cell boundary
+static void op_slider_step(int i)
+{
+    display_slider("Set Brightness", DISPLAY_BAR_STEPS / 2 + (i & 1));
+}
+
+static void op_menu_render(int i)
+{
+    menu_render();
+}
+
+static void op_sine_wave(int i)
+{
+    int16_t buffer[44100 / 440 + 1];
+    speaker_generate_sine_wave(buffer, 44100 / 440, 3000);
+    sink = buffer[i % (44100 / 440)];
+}
+
+static void op_tone(int i)
+{
+    speaker_play_tone(1000, 20);
+}
+
+static void op_led_frame(int i)
+{
+    settings_get()->brightness = i % 101;
+    RgbFrame frame;
+    rgb_led_control_compute_frame(&frame);
+    sink = frame.rgb[0][0];
+}
+
+static void op_settings_get_value(int i)
+{
+    sink = settings_get_value(i % SETTING_COUNT)[0];
+}
+
+static void op_settings_update(int i)
+{
+    settings_update(SETTING_BRIGHTNESS, i % 101);
+    settings_update(SETTING_VOLUME, i % 101);
+}
+
+// A whole 32-note melody, as the speaker task reads it
+static const char bench_melody[] = "Bench:d=8,o=5,b=140:c,e,g,c6,p,4g,16a,16b,c6.,d6,e6,4p,c#,d#,f#,g#,"
+                                   "a#,c6,2d6,e,f,g,a,b,c6,d6,e6,f6,g6,a6,b6,1c7";
+
+static void op_melody_parse(int i)
+{
+    MelodyParser parser;
+    MelodyNote note;
+    int total = 0;
+    melody_begin(&parser, bench_melody);
+    while (melody_next(&parser, &note))
+    {
+        total += note.frequency + note.duration_ms;
+    }
+    sink = total;
+}
+
+// Alternate between two scenes, each a real change
+static void op_scene_apply(int i)
+{
+    sink = scene_apply(1 + i % 2);
+}
+
+// A strip's worth of conversions, as an effect runs them every frame; the
+// metrics are per pixel
+#define BENCH_STRIP_PIXELS 64
+
+static void op_hsv_to_rgb(int i)
+{
+    uint8_t rgb[3];
+    int total = 0;
+    for (int pixel = 0; pixel < BENCH_STRIP_PIXELS; pixel++)
+    {
+        color_hsv_to_rgb((i * 7 + pixel * 24) % COLOR_HUE_STEPS, 255 - pixel, 255 - (i & 63), rgb);
+        total += rgb[0] + rgb[1] + rgb[2];
+    }
+    sink = total;
+}
+
+static void op_kelvin_to_rgb(int i)
+{
+    uint8_t rgb[3];
+    int total = 0;
+    for (int pixel = 0; pixel < BENCH_STRIP_PIXELS; pixel++)
+    {
+        color_kelvin_to_rgb(COLOR_KELVIN_MIN + (i * 13 + pixel * 67) % (COLOR_KELVIN_MAX - COLOR_KELVIN_MIN), rgb);
+        total += rgb[0] + rgb[1] + rgb[2];
+    }
+    sink = total;
+}
+
+static void op_log_write(int i)
+{
+    LOG_AT(LOG_LEVEL_INFO, 0, "Selected item: %s (%d)", "Brightness", i);
+}
+
+// Past its per-second budget the call only counts
+static void op_log_suppressed(int i)
+{
+    LOG_AT(LOG_LEVEL_WARN, 1, "Timeout waiting for ECHO to go HIGH");
+}
+
+// Start one job and stop another, with deadlines spread over every wheel level
+static TimerJob bench_jobs[8];
+
+static void bench_job_callback(void *arg)
+{
+}
+
+static void op_timer_start_stop(int i)
+{
+    timer_start_once(&bench_jobs[i & 7], 1 + (uint32_t)i * 7919 % 3600000);
+    timer_stop(&bench_jobs[(i + 4) & 7]);
+}
+
+static void run_benchmarks(void)
+{
+    bench_lcd("display_render", op_display_render, 50);
+    bench_lcd("menu_render", op_menu_render, 50);
+    display_slider("Set Brightness", DISPLAY_BAR_STEPS / 2 + 1); // The screen and glyphs the steps start from
+    bench_lcd("slider_step", op_slider_step, 50);
+
+    add_metric("sine_wave_440hz", "wall_ns", time_per_op_ns(op_sine_wave, 20000));
+
+    add_metric("tone_20ms", "wall_ns", time_per_op_ns(op_tone, 200));
+    add_metric("melody_parse", "wall_ns", time_per_op_ns(op_melody_parse, 20000));
+
+    add_metric("led_frame", "wall_ns", time_per_op_ns(op_led_frame, 200000));
+    add_metric("settings_get_value", "wall_ns", time_per_op_ns(op_settings_get_value, 200000));
+    add_metric("settings_update", "wall_ns", time_per_op_ns(op_settings_update, 200000));
+    add_metric("scene_apply", "wall_ns", time_per_op_ns(op_scene_apply, 20000));
+    add_metric("hsv_to_rgb", "pixel_ns", time_per_op_ns(op_hsv_to_rgb, 20000) / BENCH_STRIP_PIXELS);
+    add_metric("kelvin_to_rgb", "pixel_ns", time_per_op_ns(op_kelvin_to_rgb, 20000) / BENCH_STRIP_PIXELS);
+
+    add_metric("log_write", "wall_ns", time_per_op_ns(op_log_write, 200000));
+    add_metric("log_suppressed", "wall_ns", time_per_op_ns(op_log_suppressed, 200000));
+
+    const TimerJobArgs job_args = {.name = "bench", .callback = bench_job_callback};
+    for (int i = 0; i < 8; i++)
+    {
+        timer_job_init(&bench_jobs[i], &job_args);
+    }
+    add_metric("timer_start_stop", "wall_ns", time_per_op_ns(op_timer_start_stop, 200000));
+}
+
+static int write_results(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+    fprintf(file, "{\n");
+    for (int i = 0; i < metric_count; i++)
+    {
+        fprintf(file, "  \"%s\": %.1f%s\n", metrics[i].name, metrics[i].value, i + 1 < metric_count ? "," : "");
+    }
+    fprintf(file, "}\n");
+    fclose(file);
+    return 0;
+}
+
+// Look a metric up in a flat {"name": number, ...} file
+static bool baseline_value(const char *text, const char *name, double *value)
+{
+    char key[80];
+    snprintf(key, sizeof(key), "\"%s\"", name);
+    const char *found = strstr(text, key);
+    if (found == NULL)
+    {
+        return false;
+    }
+    found = strchr(found + strlen(key), ':');
+    return found != NULL && sscanf(found + 1, "%lf", value) == 1;
+}
+
+static bool is_time_metric(const char *name)
+{
+    size_t length = strlen(name);
+    return length > 3 && strcmp(name + length - 3, "_ns") == 0;
+}
+
+static int compare_baseline(const char *path, double time_tolerance)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+    static char text[16384];
+    size_t length = fread(text, 1, sizeof(text) - 1, file);
+    text[length] = '\0';
+    fclose(file);
+
+    int regressions = 0;
+    for (int i = 0; i < metric_count; i++)
+    {
+        double baseline;
+        if (!baseline_value(text, metrics[i].name, &baseline))
+        {
+            fprintf(stderr, "%-36s %12.1f  (not in baseline)\n", metrics[i].name, metrics[i].value);
+            continue;
+        }
+        double tolerance = is_time_metric(metrics[i].name) ? time_tolerance : 0.0;
+        double limit = baseline * (1.0 + tolerance);
+        bool regressed = metrics[i].value > limit + 1e-9;
+        fprintf(stderr, "%-36s %12.1f  baseline %12.1f  %+6.1f%%%s\n", metrics[i].name, metrics[i].value, baseline,
+                baseline > 0 ? (metrics[i].value / baseline - 1.0) * 100.0 : 0.0, regressed ? "  REGRESSION" : "");
+        regressions += regressed;
+    }
+    if (regressions > 0)
+    {
+        fprintf(stderr, "%d metric(s) regressed\n", regressions);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *output_path = NULL;
+    const char *baseline_path = NULL;
+    bool update_baseline = false;
+    double time_tolerance = DEFAULT_TIME_TOLERANCE;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+        {
+            output_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+        {
+            baseline_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--update-baseline") == 0)
+        {
+            update_baseline = true;
+        }
+        else if (strcmp(argv[i], "--time-tolerance") == 0 && i + 1 < argc)
+        {
+            time_tolerance = atof(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr,
+                    "usage: %s [--output FILE] [--baseline FILE [--update-baseline]] [--time-tolerance FRACTION]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    // The firmware logs every step, keep it out of the measurements
+    fflush(stdout);
+    if (freopen("/dev/null", "w", stdout) == NULL)
+    {
+        return 2;
+    }
+
+    // Benchmarks call the firmware directly from outside any task: blocking
+    // calls then just advance the simulated clock
+    host_sim_init();
+    timer_control_init();
+    display_init();
+    settings_init();
+    scene_control_init();
+    speaker_init();
+    menu_init();
+
+    run_benchmarks();
+
+    if (output_path != NULL && write_results(output_path) != 0)
+    {
+        return 2;
+    }
+    if (baseline_path != NULL && update_baseline)
+    {
+        return write_results(baseline_path) != 0 ? 2 : 0;
+    }
+    if (baseline_path != NULL)
+    {
+        return compare_baseline(baseline_path, time_tolerance);
+    }
+    for (int i = 0; i < metric_count; i++)
+    {
+        fprintf(stderr, "%-36s %12.1f\n", metrics[i].name, metrics[i].value);
+    }
+    return 0;
+}
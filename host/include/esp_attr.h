@@ -0,0 +1,14 @@
+#ifndef HOST_ESP_ATTR_H
+#define HOST_ESP_ATTR_H
+
+// Placement attributes mean nothing on the host
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define RTC_SLOW_ATTR
+#define DMA_ATTR
+#define EXT_RAM_BSS_ATTR
+#define NOINIT_ATTR
+
+#endif // HOST_ESP_ATTR_H
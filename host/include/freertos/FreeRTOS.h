@@ -0,0 +1,65 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+// Host stand-in for the ESP-IDF FreeRTOS port. Tasks are real threads, but only
+// one of them runs at a time and time is virtual (see host_sim.h).
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t; // Stack sizes are in bytes on ESP-IDF
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+#define errQUEUE_FULL ((BaseType_t)0)
+#define errQUEUE_EMPTY ((BaseType_t)0)
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ CONFIG_FREERTOS_HZ
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((TickType_t)(ms) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+#define pdTICKS_TO_MS(ticks) ((TickType_t)(((uint64_t)(ticks) * 1000U) / configTICK_RATE_HZ))
+
+#define configMAX_PRIORITIES 25
+#define configMINIMAL_STACK_SIZE 768
+#define configMAX_TASK_NAME_LEN 16
+#define configTIMER_TASK_PRIORITY 1
+#define tskIDLE_PRIORITY ((UBaseType_t)0)
+#define tskNO_AFFINITY ((BaseType_t)0x7FFFFFFF)
+#define portNUM_PROCESSORS 1
+
+#define configASSERT(x) do { if (!(x)) { host_sim_fatal("configASSERT failed: " #x, __FILE__, __LINE__); } } while (0)
+
+// Critical sections are free: only one simulated task ever runs at a time
+typedef struct { int owner; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux) ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux) ((void)(mux))
+#define portENTER_CRITICAL_SAFE(mux) ((void)(mux))
+#define portEXIT_CRITICAL_SAFE(mux) ((void)(mux))
+#define taskENTER_CRITICAL(mux) ((void)(mux))
+#define taskEXIT_CRITICAL(mux) ((void)(mux))
+
+// portYIELD_FROM_ISR() and portYIELD_FROM_ISR(woken) are both accepted, like on the target
+#define portYIELD_FROM_ISR(...) host_freertos_yield_from_isr()
+#define portYIELD() host_freertos_yield()
+#define taskYIELD() host_freertos_yield()
+
+static inline BaseType_t xPortGetCoreID(void) { return 0; }
+static inline bool xPortInIsrContext(void) { extern bool host_freertos_in_isr(void); return host_freertos_in_isr(); }
+
+void host_freertos_yield(void);
+void host_freertos_yield_from_isr(void);
+void host_sim_fatal(const char *message, const char *file, int line);
+
+#endif // HOST_FREERTOS_H
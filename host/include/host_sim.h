@@ -0,0 +1,104 @@
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+// Control surface of the host build. The stand-in HAL runs the firmware on a
+// virtual clock: time only moves when every task is blocked (it then jumps to
+// the next deadline) or when code busy-waits (GPIO reads, esp_timer_get_time()
+// and esp_rom_delay_us() each cost simulated time). Tests script inputs
+// against that clock and inspect what the firmware produced.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define HOST_LCD_ROWS 2
+#define HOST_LCD_COLS 16
+#define HOST_OLED_PAGES 8
+#define HOST_OLED_WIDTH 128
+#define HOST_LED_MAX 64
+
+// Simulation lifecycle
+void host_sim_init(void);                        // Reset the clock, models and recordings
+void host_sim_start(void (*app_main_fn)(void));  // Create the IDF "main" task running app_main_fn
+void host_sim_run_for_us(uint64_t duration_us);  // Let the firmware run for this much simulated time
+void host_sim_run_until(bool (*condition)(void), uint64_t timeout_us); // Stop early once condition() holds
+uint64_t host_sim_now_us(void);
+void host_sim_set_capture_dir(const char *path); // Write lcd.log, led.log, pcm.raw, pcm.log, uart.log and echo.log into this directory
+
+// Fill a data partition from a file, before host_sim_start(). False if the
+// file is missing or larger than size.
+bool host_sim_load_partition(const char *label, int subtype, uint32_t size, const char *path);
+
+// Scripted GPIO input
+void host_gpio_set_input(int gpio_num, int level);                  // Drive an input right now
+void host_gpio_schedule(uint64_t at_us, int gpio_num, int level);   // Drive an input at an absolute time
+void host_button_press(int gpio_num, uint64_t at_us, uint64_t hold_us); // Active-low press and release
+int host_gpio_get_output(int gpio_num);                             // Level the firmware drives on a pin
+
+// HC-SR04 emulation: a falling edge on trig_pin produces an echo pulse on echo_pin
+void host_echo_attach(int trig_pin, int echo_pin);
+void host_echo_set_distance_cm(float distance_cm); // Negative: no echo at all
+
+// Light on the ADC1 pins (GPIO 32-39), read by the continuous ADC mode as a
+// raw 12 bit level (0-4095) with a few LSB of noise. 1800 until set.
+void host_adc_set_input(int gpio_num, int raw);      // Drive a level right now, ends a replay on that pin
+bool host_adc_replay(int gpio_num, const char *path); // "<ms> <raw>" lines, ms from now, straight lines between
+                                                     // the points; false if the file is unreadable or malformed
+
+// LCD (HD44780 behind a PCF8574 at the usual 0x27 address)
+const char *host_lcd_line(int row);   // Visible text of a row, NUL terminated
+uint32_t host_lcd_frame_count(void);  // Number of visible content changes so far
+bool host_lcd_backlight(void);
+uint8_t host_lcd_cgram(int slot, int row); // Custom glyph bitmap row
+
+// OLED (SSD1306 at 0x3C, for builds with CONFIG_SUPER_LIGHTS_DISPLAY_SSD1306)
+uint8_t host_oled_column(int page, int x); // Display RAM: 8 pixel rows, bit 0 at the top
+bool host_oled_display_on(void);
+
+// I2C traffic counters, all devices
+typedef struct {
+    uint32_t transactions;
+    uint32_t bytes;
+    uint64_t bus_time_us;
+} HostI2cStats;
+void host_i2c_get_stats(HostI2cStats *stats);
+void host_i2c_reset_stats(void);
+void host_i2c_fail_next(uint32_t count); // The next count transactions time out, as on a stuck bus
+
+// LED strip frames
+typedef struct {
+    uint64_t time_us;  // When the refresh started (first RMT bit)
+    uint32_t count;    // Pixels in the frame
+    uint8_t rgb[HOST_LED_MAX][3];
+} HostLedFrame;
+uint32_t host_led_frame_count(void);
+const HostLedFrame *host_led_last_frame(void);
+
+// PCM output
+typedef struct {
+    uint64_t samples;            // Samples written since start
+    uint64_t first_sample_us;    // Time of the first sample ever written, 0 if none
+    uint64_t last_write_us;      // Time of the most recent write
+    int16_t peak;                // Largest absolute sample value seen
+} HostPcmStats;
+void host_pcm_get_stats(HostPcmStats *stats);
+
+// Automatic light sleep, entered when the firmware enabled it, no PM lock is
+// held and the next deadline is far enough away. Deep sleep halts every task
+// and drops pending interrupts; there is no wakeup.
+typedef struct {
+    uint32_t sleeps;
+    uint64_t sleep_us;
+    bool deep_sleep;          // esp_deep_sleep_start() was called
+    uint64_t deep_sleep_at_us;
+    int ext0_gpio;            // Wakeup sources armed for it, -1 / 0 when unused
+    uint64_t ext1_mask;
+} HostPmStats;
+void host_pm_get_stats(HostPmStats *stats);
+
+// The far end of a UART: bytes sent arrive at the configured baud rate, bytes
+// received are the ones the firmware wrote that have fully left the pin by now
+void host_uart_send(int port, const uint8_t *data, size_t size);
+size_t host_uart_receive(int port, uint8_t *data, size_t max);
+
+#endif // HOST_SIM_H
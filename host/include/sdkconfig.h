@@ -0,0 +1,56 @@
+#ifndef HOST_SDKCONFIG_H
+#define HOST_SDKCONFIG_H
+
+// Configuration the host build is compiled with. Mirrors sdkconfig.defaults
+// for the options the application code looks at.
+
+#define CONFIG_IDF_TARGET "linux"
+#define CONFIG_IDF_TARGET_LINUX 1
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_FREERTOS_USE_TRACE_FACILITY 1
+#define CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS 1
+#define CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ 160
+#define CONFIG_PM_ENABLE 1
+#define CONFIG_FREERTOS_USE_TICKLESS_IDLE 1
+#define CONFIG_FREERTOS_IDLE_TIME_BEFORE_SLEEP 3
+#define CONFIG_PM_LIGHT_SLEEP_CALLBACKS 1
+#define CONFIG_ESP_TASK_WDT_EN 1
+#define CONFIG_ESP_TASK_WDT_INIT 1
+#define CONFIG_ESP_TASK_WDT_TIMEOUT_S 5
+#define CONFIG_SUPER_LIGHTS_BOOT_SPLASH 1
+#define CONFIG_SUPER_LIGHTS_LOG_LEVEL 3
+#define CONFIG_SUPER_LIGHTS_PROFILER_PERIOD_MS 1000
+#define CONFIG_SUPER_LIGHTS_ALLOC_TRACKER 1
+#define CONFIG_HEAP_USE_HOOKS 1
+
+// Reference board, every feature: the host CMakeLists compiles all of main/src
+#define CONFIG_SUPER_LIGHTS_BOARD_DEVKITC 1
+#define CONFIG_SUPER_LIGHTS_DISPLAY 1
+#define CONFIG_SUPER_LIGHTS_DISPLAY_LCD1602 1 // Both panels are compiled, the LCD is the one in use
+#define CONFIG_SUPER_LIGHTS_AUDIO 1
+#define CONFIG_SUPER_LIGHTS_ULTRASONIC 1
+#define CONFIG_SUPER_LIGHTS_REMOTE 1
+#define CONFIG_SUPER_LIGHTS_AMBIENT 1
+#define CONFIG_SUPER_LIGHTS_AUDIO_SAMPLE_RATE 44100
+#define CONFIG_SUPER_LIGHTS_LED_COUNT 8
+#define CONFIG_SUPER_LIGHTS_PIN_POWER_LED 4
+#define CONFIG_SUPER_LIGHTS_PIN_POWER_BUTTON 12
+#define CONFIG_SUPER_LIGHTS_PIN_ENTER_BUTTON 15
+#define CONFIG_SUPER_LIGHTS_PIN_BACK_BUTTON 18
+#define CONFIG_SUPER_LIGHTS_PIN_UP_BUTTON 19
+#define CONFIG_SUPER_LIGHTS_PIN_DOWN_BUTTON 21
+#define CONFIG_SUPER_LIGHTS_PIN_IR 27
+#define CONFIG_SUPER_LIGHTS_PIN_LED_STRIP 13
+#define CONFIG_SUPER_LIGHTS_PIN_US_TRIG 26
+#define CONFIG_SUPER_LIGHTS_PIN_US_ECHO 5
+#define CONFIG_SUPER_LIGHTS_PIN_LCD_SDA 22
+#define CONFIG_SUPER_LIGHTS_PIN_LCD_SCL 23
+#define CONFIG_SUPER_LIGHTS_PIN_I2S_BCK 25
+#define CONFIG_SUPER_LIGHTS_PIN_I2S_LCK 32
+#define CONFIG_SUPER_LIGHTS_PIN_I2S_DIN 33
+#define CONFIG_SUPER_LIGHTS_PIN_REMOTE_TX 17
+#define CONFIG_SUPER_LIGHTS_PIN_REMOTE_RX 16
+#define CONFIG_SUPER_LIGHTS_PIN_AMBIENT 36
+// CONFIG_SUPER_LIGHTS_LOG_BINARY left out: the simulator prints plain text
+
+#endif // HOST_SDKCONFIG_H
@@ -0,0 +1,311 @@
+// ADC continuous-mode stand-in for the ESP32's ADC1. While started, a DMA
+// frame completes every conv_frame_size / 2 conversions at the sample rate;
+// it is filled from the level the test drives on the pattern's pin, with a
+// few LSB of noise, and handed to on_conv_done in interrupt context. A level
+// is either set directly or replayed from a recorded curve on the simulated
+// clock. The pool is not modelled, the firmware never reads it.
+
+#include "esp_adc/adc_continuous.h"
+#include "host_internal.h"
+#include "host_sim.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ADC1_CHANNELS 8
+#define ADC_FULL_SCALE 4095
+#define ADC_NOISE_LSB 4          // Peak noise on every conversion
+#define ADC_DEFAULT_RAW 1800     // Indoor light on a divider with the sensor to 3.3 V
+
+// ADC1 channels 0-7 sit on these GPIOs (ESP32)
+static const int8_t adc1_gpio_of_channel[ADC1_CHANNELS] = {36, 37, 38, 39, 32, 33, 34, 35};
+
+typedef struct {
+    uint64_t time_us;
+    int raw;
+} CurvePoint;
+
+typedef struct {
+    int raw;              // Level while no curve plays
+    CurvePoint *curve;    // Replayed from curve_start_us on, the last point holds
+    size_t curve_points;
+    uint64_t curve_start_us;
+} HostAdcInput;
+
+struct adc_continuous_ctx_t
+{
+    uint32_t frame_bytes;
+    uint8_t *frame;
+    uint32_t sample_freq_hz;
+    adc_channel_t channels[ADC1_CHANNELS];
+    uint32_t channel_count;
+    adc_continuous_evt_cbs_t callbacks;
+    void *user_data;
+    bool started;
+};
+
+static HostAdcInput inputs[ADC1_CHANNELS];
+static uint32_t noise_state = 1;
+
+void host_adc_reset(void)
+{
+    for (int channel = 0; channel < ADC1_CHANNELS; channel++)
+    {
+        host_internal_free(inputs[channel].curve);
+        memset(&inputs[channel], 0, sizeof(inputs[channel]));
+        inputs[channel].raw = ADC_DEFAULT_RAW;
+    }
+    noise_state = 1;
+}
+
+// ADC1 channel of a GPIO, -1 for the ones without
+static int channel_of(int gpio_num)
+{
+    for (int channel = 0; channel < ADC1_CHANNELS; channel++)
+    {
+        if (adc1_gpio_of_channel[channel] == gpio_num)
+        {
+            return channel;
+        }
+    }
+    return -1;
+}
+
+static int clamp_raw(int raw)
+{
+    return raw < 0 ? 0 : raw > ADC_FULL_SCALE ? ADC_FULL_SCALE : raw;
+}
+
+// Level on a channel now, straight lines between the points of a curve
+static int input_raw(const HostAdcInput *input)
+{
+    if (input->curve == NULL)
+    {
+        return input->raw;
+    }
+    uint64_t at = host_kernel_now_us() - input->curve_start_us;
+    const CurvePoint *points = input->curve;
+    if (at <= points[0].time_us)
+    {
+        return points[0].raw;
+    }
+    for (size_t i = 1; i < input->curve_points; i++)
+    {
+        if (at <= points[i].time_us)
+        {
+            int64_t span = (int64_t)(points[i].time_us - points[i - 1].time_us);
+            int64_t into = (int64_t)(at - points[i - 1].time_us);
+            return points[i - 1].raw + (int)((points[i].raw - points[i - 1].raw) * into / span);
+        }
+    }
+    return points[input->curve_points - 1].raw;
+}
+
+// Deterministic, so a scenario gives the same readings on every run
+static int noise(void)
+{
+    noise_state = noise_state * 1103515245u + 12345u;
+    return (int)((noise_state >> 16) % (2 * ADC_NOISE_LSB + 1)) - ADC_NOISE_LSB;
+}
+
+static uint64_t frame_time_us(const struct adc_continuous_ctx_t *ctx)
+{
+    return (uint64_t)(ctx->frame_bytes / SOC_ADC_DIGI_RESULT_BYTES) * 1000000ULL / ctx->sample_freq_hz;
+}
+
+static void frame_event(void *arg)
+{
+    struct adc_continuous_ctx_t *ctx = arg;
+    if (!ctx->started)
+    {
+        return;
+    }
+
+    // The pattern repeats over the frame
+    adc_digi_output_data_t *results = (adc_digi_output_data_t *)ctx->frame;
+    uint32_t count = ctx->frame_bytes / SOC_ADC_DIGI_RESULT_BYTES;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        adc_channel_t channel = ctx->channels[i % ctx->channel_count];
+        results[i].val = 0;
+        results[i].type1.channel = channel;
+        results[i].type1.data = clamp_raw(input_raw(&inputs[channel]) + noise());
+    }
+
+    host_kernel_schedule_event(host_kernel_now_us() + frame_time_us(ctx), frame_event, ctx);
+    if (ctx->callbacks.on_conv_done != NULL)
+    {
+        adc_continuous_evt_data_t event = {.conv_frame_buffer = ctx->frame, .size = ctx->frame_bytes};
+        host_kernel_enter_isr();
+        ctx->callbacks.on_conv_done(ctx, &event, ctx->user_data);
+        host_kernel_exit_isr();
+    }
+}
+
+esp_err_t adc_continuous_new_handle(const adc_continuous_handle_cfg_t *hdl_config, adc_continuous_handle_t *ret_handle)
+{
+    if (hdl_config == NULL || ret_handle == NULL || hdl_config->conv_frame_size == 0 ||
+        hdl_config->conv_frame_size % SOC_ADC_DIGI_DATA_BYTES_PER_CONV != 0 ||
+        hdl_config->max_store_buf_size < hdl_config->conv_frame_size)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct adc_continuous_ctx_t *ctx = calloc(1, sizeof(struct adc_continuous_ctx_t));
+    ctx->frame_bytes = hdl_config->conv_frame_size;
+    ctx->frame = calloc(1, ctx->frame_bytes);
+    *ret_handle = ctx;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_config(adc_continuous_handle_t handle, const adc_continuous_config_t *config)
+{
+    if (handle->started)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (config->pattern_num == 0 || config->pattern_num > ADC1_CHANNELS ||
+        config->sample_freq_hz < SOC_ADC_SAMPLE_FREQ_THRES_LOW ||
+        config->sample_freq_hz > SOC_ADC_SAMPLE_FREQ_THRES_HIGH ||
+        config->conv_mode != ADC_CONV_SINGLE_UNIT_1 || config->format != ADC_DIGI_OUTPUT_FORMAT_TYPE1)
+    {
+        return ESP_ERR_INVALID_ARG; // The ESP32 reads ADC1 alone into type 1 results
+    }
+    for (uint32_t i = 0; i < config->pattern_num; i++)
+    {
+        if (config->adc_pattern[i].unit != ADC_UNIT_1 || config->adc_pattern[i].channel >= ADC1_CHANNELS)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+        handle->channels[i] = config->adc_pattern[i].channel;
+    }
+    handle->channel_count = config->pattern_num;
+    handle->sample_freq_hz = config->sample_freq_hz;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_register_event_callbacks(adc_continuous_handle_t handle, const adc_continuous_evt_cbs_t *cbs,
+                                                  void *user_data)
+{
+    if (handle->started)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->callbacks = *cbs;
+    handle->user_data = user_data;
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_start(adc_continuous_handle_t handle)
+{
+    if (handle->started || handle->channel_count == 0)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->started = true;
+    host_pm_driver_lock(true); // Held by the driver until it is stopped
+    host_kernel_schedule_event(host_kernel_now_us() + frame_time_us(handle), frame_event, handle);
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_stop(adc_continuous_handle_t handle)
+{
+    if (!handle->started)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->started = false;
+    host_kernel_cancel_events(handle);
+    host_pm_driver_lock(false);
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_deinit(adc_continuous_handle_t handle)
+{
+    if (handle->started)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    free(handle->frame);
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t adc_continuous_io_to_channel(int io_num, adc_unit_t *unit_id, adc_channel_t *channel)
+{
+    int adc_channel = channel_of(io_num);
+    if (adc_channel < 0)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *unit_id = ADC_UNIT_1;
+    *channel = (adc_channel_t)adc_channel;
+    return ESP_OK;
+}
+
+void host_adc_set_input(int gpio_num, int raw)
+{
+    int channel = channel_of(gpio_num);
+    if (channel < 0)
+    {
+        return;
+    }
+    host_internal_free(inputs[channel].curve);
+    inputs[channel].curve = NULL;
+    inputs[channel].raw = clamp_raw(raw);
+}
+
+bool host_adc_replay(int gpio_num, const char *path)
+{
+    int channel = channel_of(gpio_num);
+    FILE *file = fopen(path, "r");
+    if (channel < 0 || file == NULL)
+    {
+        if (file != NULL)
+        {
+            fclose(file);
+        }
+        return false;
+    }
+
+    CurvePoint *points = NULL;
+    size_t count = 0;
+    char line[128];
+    bool ok = true;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char *comment = strchr(line, '#');
+        if (comment != NULL)
+        {
+            *comment = '\0';
+        }
+        double time_ms;
+        int raw;
+        char extra;
+        int fields = sscanf(line, "%lf %d %c", &time_ms, &raw, &extra);
+        if (fields <= 0)
+        {
+            continue; // Blank or comment
+        }
+        uint64_t time_us = (uint64_t)(time_ms * 1000);
+        if (fields != 2 || time_ms < 0 || (count > 0 && time_us <= points[count - 1].time_us))
+        {
+            ok = false; // Not "<ms> <raw>", or out of order
+            break;
+        }
+        points = host_internal_realloc(points, (count + 1) * sizeof(CurvePoint));
+        points[count].time_us = time_us;
+        points[count].raw = clamp_raw(raw);
+        count++;
+    }
+    fclose(file);
+    if (!ok || count == 0)
+    {
+        host_internal_free(points);
+        return false;
+    }
+
+    host_internal_free(inputs[channel].curve);
+    inputs[channel].curve = points;
+    inputs[channel].curve_points = count;
+    inputs[channel].curve_start_us = host_kernel_now_us();
+    return true;
+}
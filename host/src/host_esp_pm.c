@@ -0,0 +1,267 @@
+// esp_pm stand-in: lock bookkeeping, the light sleep model, deep sleep and the
+// RTC IO bits it needs.
+
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "driver/rtc_io.h"
+#include "host_internal.h"
+#include "host_sim.h"
+#include "sdkconfig.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SLEEP_CALLBACKS 4
+
+// ESP32 pads that have an RTC IO function (ext0/ext1 wakeup, RTC pulls)
+#define RTC_GPIO_MASK                                                                                    \
+    ((1ULL << 0) | (1ULL << 2) | (1ULL << 4) | (1ULL << 12) | (1ULL << 13) | (1ULL << 14) | (1ULL << 15) | \
+     (1ULL << 25) | (1ULL << 26) | (1ULL << 27) | (0xFFULL << 32))
+
+struct esp_pm_lock
+{
+    esp_pm_lock_type_t type;
+    const char *name;
+    uint32_t count;
+};
+
+static esp_pm_config_t config;
+static bool configured = false;
+static uint32_t locks_held = 0;  // Firmware locks plus driver transfers in flight
+static esp_pm_sleep_cbs_register_config_t callbacks[MAX_SLEEP_CALLBACKS];
+static int callback_count = 0;
+static HostPmStats stats;
+
+void host_pm_reset(void)
+{
+    memset(&config, 0, sizeof(config));
+    configured = false;
+    locks_held = 0;
+    callback_count = 0;
+    memset(&stats, 0, sizeof(stats));
+    stats.ext0_gpio = -1;
+}
+
+void host_pm_driver_lock(bool acquire)
+{
+    if (acquire)
+    {
+        locks_held++;
+    }
+    else if (locks_held > 0)
+    {
+        locks_held--;
+    }
+}
+
+void host_pm_idle(uint64_t from_us, uint64_t to_us, uint64_t wake_us)
+{
+    // Tickless idle only sleeps when the next wakeup is far enough away
+    uint64_t threshold_us = (uint64_t)CONFIG_FREERTOS_IDLE_TIME_BEFORE_SLEEP * 1000000 / CONFIG_FREERTOS_HZ;
+    if (!configured || !config.light_sleep_enable || stats.deep_sleep || locks_held > 0 || to_us <= from_us ||
+        wake_us - from_us < threshold_us)
+    {
+        return;
+    }
+
+    int64_t slept_us = (int64_t)(to_us - from_us);
+    for (int i = 0; i < callback_count; i++)
+    {
+        if (callbacks[i].enter_cb != NULL)
+        {
+            callbacks[i].enter_cb(slept_us, callbacks[i].enter_cb_user_arg);
+        }
+    }
+    for (int i = 0; i < callback_count; i++)
+    {
+        if (callbacks[i].exit_cb != NULL)
+        {
+            callbacks[i].exit_cb(slept_us, callbacks[i].exit_cb_user_arg);
+        }
+    }
+    stats.sleeps++;
+    stats.sleep_us += slept_us;
+}
+
+void host_pm_get_stats(HostPmStats *out)
+{
+    *out = stats;
+}
+
+esp_err_t esp_pm_configure(const void *vconfig)
+{
+    const esp_pm_config_t *new_config = vconfig;
+    if (new_config == NULL || new_config->min_freq_mhz > new_config->max_freq_mhz)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    config = *new_config;
+    configured = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_get_configuration(void *vconfig)
+{
+    *(esp_pm_config_t *)vconfig = config;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char *name, esp_pm_lock_handle_t *out_handle)
+{
+    if (out_handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_pm_lock *lock = calloc(1, sizeof(struct esp_pm_lock));
+    lock->type = lock_type;
+    lock->name = name;
+    *out_handle = lock;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_delete(esp_pm_lock_handle_t handle)
+{
+    if (handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handle->count > 0)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle)
+{
+    if (handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    handle->count++;
+    locks_held++;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle)
+{
+    if (handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (handle->count == 0)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->count--;
+    locks_held--;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_dump_locks(FILE *stream)
+{
+    fprintf(stream, "light sleeps %u, %llu us asleep\n", stats.sleeps, (unsigned long long)stats.sleep_us);
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_light_sleep_register_cbs(esp_pm_sleep_cbs_register_config_t *cbs_conf)
+{
+    if (cbs_conf == NULL || callback_count == MAX_SLEEP_CALLBACKS)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    callbacks[callback_count++] = *cbs_conf;
+    return ESP_OK;
+}
+
+esp_err_t esp_pm_light_sleep_unregister_cbs(esp_pm_sleep_cbs_register_config_t *cbs_conf)
+{
+    for (int i = 0; i < callback_count; i++)
+    {
+        if (callbacks[i].enter_cb == cbs_conf->enter_cb && callbacks[i].exit_cb == cbs_conf->exit_cb)
+        {
+            callbacks[i] = callbacks[--callback_count];
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_uart_wakeup(int uart_num)
+{
+    return uart_num >= 0 && uart_num <= 1 ? ESP_OK : ESP_ERR_INVALID_ARG; // UART0 and UART1 only
+}
+
+esp_err_t esp_sleep_enable_ext0_wakeup(gpio_num_t gpio_num, int level)
+{
+    if (gpio_num < 0 || !(RTC_GPIO_MASK & (1ULL << gpio_num)) || (level != 0 && level != 1))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    stats.ext0_gpio = gpio_num;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_ext1_wakeup(uint64_t io_mask, esp_sleep_ext1_wakeup_mode_t level_mode)
+{
+    if ((io_mask & ~RTC_GPIO_MASK) != 0 || level_mode > ESP_EXT1_WAKEUP_ANY_HIGH)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    stats.ext1_mask = io_mask;
+    return ESP_OK;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause(void)
+{
+    return ESP_SLEEP_WAKEUP_UNDEFINED;
+}
+
+void esp_deep_sleep_start(void)
+{
+    stats.deep_sleep = true;
+    stats.deep_sleep_at_us = host_kernel_now_us();
+    host_kernel_halt();
+    abort(); // Not reached from a task
+}
+
+esp_reset_reason_t esp_reset_reason(void)
+{
+    return ESP_RST_POWERON;
+}
+
+static esp_err_t check_rtc_gpio(gpio_num_t gpio_num)
+{
+    return gpio_num >= 0 && (RTC_GPIO_MASK & (1ULL << gpio_num)) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t rtc_gpio_pullup_en(gpio_num_t gpio_num)
+{
+    return check_rtc_gpio(gpio_num);
+}
+
+esp_err_t rtc_gpio_pullup_dis(gpio_num_t gpio_num)
+{
+    return check_rtc_gpio(gpio_num);
+}
+
+esp_err_t rtc_gpio_pulldown_en(gpio_num_t gpio_num)
+{
+    return check_rtc_gpio(gpio_num);
+}
+
+esp_err_t rtc_gpio_pulldown_dis(gpio_num_t gpio_num)
+{
+    return check_rtc_gpio(gpio_num);
+}
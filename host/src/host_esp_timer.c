@@ -0,0 +1,214 @@
+// esp_timer stand-in. Expiries are events on the simulated timeline; task
+// dispatched callbacks run in an "esp_timer" task at the IDF priority.
+
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host_internal.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ESP_TIMER_TASK_PRIORITY 22
+#define ESP_TIMER_READ_COST_US 1
+
+struct esp_timer
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char *name;
+    uint64_t period_us;  // 0 for one-shot timers
+    uint64_t alarm_us;
+    bool active;
+    bool pending;        // Expired, waiting for the esp_timer task
+    struct esp_timer *next_pending;
+};
+
+static TaskHandle_t timer_task = NULL;
+static struct esp_timer *pending_head = NULL;
+static struct esp_timer *pending_tail = NULL;
+
+static void timer_expired(void *arg)
+{
+    struct esp_timer *timer = arg;
+    if (!timer->active)
+    {
+        return;
+    }
+
+    if (timer->period_us > 0)
+    {
+        timer->alarm_us += timer->period_us;
+        host_kernel_schedule_event(timer->alarm_us, timer_expired, timer);
+    }
+    else
+    {
+        timer->active = false;
+    }
+
+    if (timer->dispatch_method == ESP_TIMER_ISR)
+    {
+        timer->callback(timer->arg);
+        return;
+    }
+
+    if (!timer->pending)
+    {
+        timer->pending = true;
+        timer->next_pending = NULL;
+        if (pending_tail != NULL)
+        {
+            pending_tail->next_pending = timer;
+        }
+        else
+        {
+            pending_head = timer;
+        }
+        pending_tail = timer;
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveFromISR(timer_task, &woken);
+    }
+}
+
+static void esp_timer_task(void *arg)
+{
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        while (pending_head != NULL)
+        {
+            struct esp_timer *timer = pending_head;
+            pending_head = timer->next_pending;
+            if (pending_head == NULL)
+            {
+                pending_tail = NULL;
+            }
+            timer->pending = false;
+            timer->callback(timer->arg);
+        }
+    }
+}
+
+static void remove_pending(struct esp_timer *timer)
+{
+    struct esp_timer **link = &pending_head;
+    pending_tail = NULL;
+    while (*link != NULL)
+    {
+        if (*link == timer)
+        {
+            *link = timer->next_pending;
+            continue;
+        }
+        pending_tail = *link;
+        link = &(*link)->next_pending;
+    }
+    timer->pending = false;
+}
+
+void host_esp_timer_start_service(void)
+{
+    xTaskCreate(esp_timer_task, "esp_timer", 3584, NULL, ESP_TIMER_TASK_PRIORITY, &timer_task);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out_handle)
+{
+    if (args == NULL || args->callback == NULL || out_handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct esp_timer *timer = calloc(1, sizeof(struct esp_timer));
+    timer->callback = args->callback;
+    timer->arg = args->arg;
+    timer->dispatch_method = args->dispatch_method;
+    timer->name = args->name;
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t timer_arm(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us)
+{
+    if (timer == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = true;
+    timer->period_us = period_us;
+    timer->alarm_us = host_kernel_now_us() + timeout_us;
+    host_kernel_schedule_event(timer->alarm_us, timer_expired, timer);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer_arm(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    return timer_arm(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    if (timer == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!timer->active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    host_kernel_cancel_events(timer);
+    remove_pending(timer);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_restart(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    uint64_t period_us = timer->period_us;
+    esp_timer_stop(timer);
+    return timer_arm(timer, timeout_us, period_us > 0 ? timeout_us : 0);
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    if (timer == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (timer->active)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    remove_pending(timer);
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer)
+{
+    return timer->active;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    host_kernel_consume_us(ESP_TIMER_READ_COST_US);
+    return (int64_t)host_kernel_now_us();
+}
+
+int64_t esp_timer_get_next_alarm(void)
+{
+    return INT64_MAX;
+}
+
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count(void)
+{
+    return (esp_cpu_cycle_count_t)(host_kernel_now_us() * 240);
+}
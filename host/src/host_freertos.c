@@ -0,0 +1,1419 @@
+// FreeRTOS on a virtual clock.
+//
+// Every task is a pthread, but a single lock decides who owns the simulated
+// CPU: the owner runs until it blocks, yields or is preempted, then hands the
+// CPU to the highest priority ready task (FIFO among equals). When nobody is
+// ready the clock jumps to the next deadline. This makes runs deterministic
+// and lets a test cover minutes of firmware time in milliseconds.
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "freertos/event_groups.h"
+#include "host_internal.h"
+#include "host_sim.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TICK_US (1000000ULL / configTICK_RATE_HZ)
+
+typedef enum { TASK_READY, TASK_RUNNING, TASK_BLOCKED, TASK_SUSPENDED, TASK_DELETED } TaskState;
+typedef enum { NOTIFY_NONE, NOTIFY_WAITING, NOTIFY_RECEIVED } NotifyState;
+
+struct HostTask
+{
+    pthread_t thread;
+    pthread_cond_t cond;
+    char name[configMAX_TASK_NAME_LEN];
+    TaskFunction_t fn;
+    void *arg;
+    UBaseType_t priority;
+    uint32_t stack_depth;
+    UBaseType_t number;
+    TaskState state;
+    uint64_t wake_us;          // Deadline while blocked
+    uint64_t seq;              // Order in which tasks became ready
+    const void *wait_object;   // What a blocked task waits for
+    uint32_t notify_value;
+    NotifyState notify_state;
+    uint64_t run_time_us;      // Simulated CPU time consumed
+    uint64_t switched_in_us;
+    struct HostTask *next;
+};
+
+typedef struct HostEvent
+{
+    uint64_t at_us;
+    uint64_t seq;
+    HostEventFn fn;
+    void *arg;
+    struct HostEvent *next;
+} HostEvent;
+
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t controller_cond = PTHREAD_COND_INITIALIZER;
+static bool sim_initialized = false;
+
+static struct HostTask *task_list = NULL;
+static struct HostTask *current = NULL; // Owner of the simulated CPU, NULL while the controller has it
+static UBaseType_t task_count = 0;
+static uint64_t now_us = 0;
+static uint64_t limit_us = 0;
+static uint64_t ready_seq = 0;
+static bool (*stop_condition)(void) = NULL;
+
+static HostEvent *event_list = NULL;
+static uint64_t event_seq = 0;
+static int isr_depth = 0;
+static bool halted = false; // Deep sleep, nothing runs any more
+
+// ---------------------------------------------------------------------------
+// Scheduler core
+
+static uint64_t deadline_after(TickType_t ticks)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        return HOST_FOREVER;
+    }
+    return now_us + (uint64_t)ticks * TICK_US;
+}
+
+static void make_ready(struct HostTask *task)
+{
+    task->state = TASK_READY;
+    task->seq = ++ready_seq;
+    task->wait_object = NULL;
+}
+
+static struct HostTask *pick_ready(void)
+{
+    struct HostTask *best = NULL;
+    for (struct HostTask *t = task_list; t != NULL; t = t->next)
+    {
+        if (t->state != TASK_READY)
+        {
+            continue;
+        }
+        if (best == NULL || t->priority > best->priority || (t->priority == best->priority && t->seq < best->seq))
+        {
+            best = t;
+        }
+    }
+    return best;
+}
+
+static void run_due_events(void)
+{
+    while (event_list != NULL && event_list->at_us <= now_us)
+    {
+        HostEvent *event = event_list;
+        event_list = event->next;
+        isr_depth++;
+        event->fn(event->arg);
+        isr_depth--;
+        host_internal_free(event);
+    }
+}
+
+static void wake_due_tasks(void)
+{
+    for (struct HostTask *t = task_list; t != NULL; t = t->next)
+    {
+        if (t->state == TASK_BLOCKED && t->wake_us <= now_us)
+        {
+            make_ready(t);
+        }
+    }
+}
+
+static uint64_t next_deadline(void)
+{
+    uint64_t next = event_list != NULL ? event_list->at_us : HOST_FOREVER;
+    for (struct HostTask *t = task_list; t != NULL; t = t->next)
+    {
+        if (t->state == TASK_BLOCKED && t->wake_us < next)
+        {
+            next = t->wake_us;
+        }
+    }
+    return next;
+}
+
+// Charge the CPU time used so far to the running task
+static void account_current(void)
+{
+    if (current != NULL)
+    {
+        current->run_time_us += now_us - current->switched_in_us;
+        current->switched_in_us = now_us;
+    }
+}
+
+static void switch_to(struct HostTask *next)
+{
+    account_current();
+    current = next;
+    if (next != NULL)
+    {
+        next->state = TASK_RUNNING;
+        next->switched_in_us = now_us;
+        pthread_cond_signal(&next->cond);
+    }
+    else
+    {
+        pthread_cond_signal(&controller_cond);
+    }
+}
+
+static bool should_stop(void)
+{
+    return now_us >= limit_us || (stop_condition != NULL && stop_condition());
+}
+
+// Give the CPU to the best ready task, advancing time while nobody is ready.
+// The caller must already have left the RUNNING state.
+static void dispatch(void)
+{
+    account_current(); // Idle time spent below belongs to nobody
+    while (1)
+    {
+        run_due_events();
+        wake_due_tasks();
+        if (should_stop())
+        {
+            switch_to(NULL);
+            return;
+        }
+
+        struct HostTask *next = pick_ready();
+        if (next != NULL)
+        {
+            switch_to(next);
+            return;
+        }
+
+        // Nothing ready: the idle task would run here, possibly in light sleep
+        uint64_t next_time = next_deadline();
+        uint64_t idle_from_us = now_us;
+        now_us = next_time < limit_us ? next_time : limit_us;
+        host_pm_idle(idle_from_us, now_us, next_time);
+        if (current != NULL)
+        {
+            current->switched_in_us = now_us;
+        }
+    }
+}
+
+static void wait_for_cpu(struct HostTask *self)
+{
+    while (current != self)
+    {
+        pthread_cond_wait(&self->cond, &sim_lock);
+    }
+}
+
+// Block the running task until the deadline or until someone readies it
+static void block_current(uint64_t wake_us, const void *wait_object)
+{
+    struct HostTask *self = current;
+    if (self == NULL)
+    {
+        // Called from the controller (direct calls from tests and benchmarks): just let time pass
+        if (wake_us != HOST_FOREVER && wake_us > now_us)
+        {
+            now_us = wake_us;
+            run_due_events();
+        }
+        return;
+    }
+
+    self->state = TASK_BLOCKED;
+    self->wake_us = wake_us;
+    self->wait_object = wait_object;
+    dispatch();
+    wait_for_cpu(self);
+}
+
+static void yield_current(void)
+{
+    struct HostTask *self = current;
+    if (self == NULL)
+    {
+        return;
+    }
+    make_ready(self);
+    dispatch();
+    wait_for_cpu(self);
+}
+
+// After readying other tasks from task context: give way to a higher priority one
+static void preempt_if_needed(void)
+{
+    if (isr_depth > 0 || current == NULL)
+    {
+        return;
+    }
+    struct HostTask *next = pick_ready();
+    if (next != NULL && next->priority > current->priority)
+    {
+        yield_current();
+    }
+}
+
+static void wake_waiters(const void *wait_object)
+{
+    for (struct HostTask *t = task_list; t != NULL; t = t->next)
+    {
+        if (t->state == TASK_BLOCKED && t->wait_object == wait_object)
+        {
+            make_ready(t);
+        }
+    }
+}
+
+static bool woke_higher_priority(void)
+{
+    struct HostTask *next = pick_ready();
+    return next != NULL && (current == NULL || next->priority > current->priority);
+}
+
+// ---------------------------------------------------------------------------
+// Kernel services for the other stand-ins
+
+uint64_t host_kernel_now_us(void)
+{
+    return now_us;
+}
+
+bool host_kernel_in_isr(void)
+{
+    return isr_depth > 0;
+}
+
+bool host_freertos_in_isr(void)
+{
+    return isr_depth > 0;
+}
+
+void host_kernel_consume_us(uint64_t us)
+{
+    if (isr_depth > 0 || current == NULL)
+    {
+        now_us += us;
+        if (isr_depth == 0)
+        {
+            run_due_events();
+        }
+        return;
+    }
+
+    uint64_t target = now_us + us;
+    while (now_us < target)
+    {
+        uint64_t next_time = next_deadline();
+        uint64_t old_tick = now_us / TICK_US;
+        now_us = next_time < target ? (next_time > now_us ? next_time : now_us) : target;
+        run_due_events();
+        wake_due_tasks();
+
+        if (should_stop())
+        {
+            // Park the busy task, the controller decides when it continues
+            struct HostTask *self = current;
+            make_ready(self);
+            switch_to(NULL);
+            wait_for_cpu(self);
+            continue;
+        }
+
+        // Preemption by a higher priority task, time slicing among equals at tick boundaries
+        struct HostTask *next = pick_ready();
+        if (next != NULL && (next->priority > current->priority ||
+                             (next->priority == current->priority && now_us / TICK_US != old_tick)))
+        {
+            yield_current();
+        }
+    }
+}
+
+void host_kernel_sleep_us(uint64_t us)
+{
+    block_current(now_us + us, NULL);
+}
+
+void host_kernel_schedule_event(uint64_t at_us, HostEventFn fn, void *arg)
+{
+    if (halted)
+    {
+        return;
+    }
+    HostEvent *event = host_internal_calloc(1, sizeof(HostEvent));
+    event->at_us = at_us;
+    event->seq = ++event_seq;
+    event->fn = fn;
+    event->arg = arg;
+
+    HostEvent **link = &event_list;
+    while (*link != NULL && (*link)->at_us <= at_us)
+    {
+        link = &(*link)->next;
+    }
+    event->next = *link;
+    *link = event;
+}
+
+void host_kernel_halt(void)
+{
+    halted = true;
+    while (event_list != NULL)
+    {
+        HostEvent *dead = event_list;
+        event_list = dead->next;
+        host_internal_free(dead);
+    }
+    for (struct HostTask *t = task_list; t != NULL; t = t->next)
+    {
+        if (t->state != TASK_DELETED)
+        {
+            t->state = TASK_SUSPENDED;
+        }
+    }
+
+    struct HostTask *self = current;
+    if (self != NULL)
+    {
+        dispatch(); // Nothing is ready any more: time runs to the limit
+        wait_for_cpu(self);
+    }
+}
+
+void host_kernel_cancel_events(void *arg)
+{
+    HostEvent **link = &event_list;
+    while (*link != NULL)
+    {
+        if ((*link)->arg == arg)
+        {
+            HostEvent *dead = *link;
+            *link = dead->next;
+            host_internal_free(dead);
+        }
+        else
+        {
+            link = &(*link)->next;
+        }
+    }
+}
+
+void host_kernel_enter_isr(void)
+{
+    isr_depth++;
+}
+
+void host_kernel_exit_isr(void)
+{
+    isr_depth--;
+    preempt_if_needed();
+}
+
+void host_freertos_yield(void)
+{
+    yield_current();
+}
+
+void host_freertos_yield_from_isr(void)
+{
+    // The switch happens once the simulated interrupt returns
+}
+
+void host_sim_fatal(const char *message, const char *file, int line)
+{
+    fprintf(stderr, "FATAL at %llu us: %s (%s:%d)\n", (unsigned long long)now_us, message, file, line);
+    abort();
+}
+
+// ---------------------------------------------------------------------------
+// Simulation control
+
+static void timer_service_start(void);
+
+void host_sim_init(void)
+{
+    if (!sim_initialized)
+    {
+        // The controller owns the simulated CPU whenever the firmware is not running
+        pthread_mutex_lock(&sim_lock);
+        sim_initialized = true;
+        timer_service_start();
+        host_esp_timer_start_service();
+    }
+    host_gpio_reset();
+    host_i2c_reset();
+    host_i2s_reset();
+    host_adc_reset();
+    host_led_strip_reset();
+    host_pm_reset();
+    host_uart_reset();
+    host_task_wdt_reset();
+}
+
+static void run_controller(void)
+{
+    dispatch();
+    while (current != NULL)
+    {
+        pthread_cond_wait(&controller_cond, &sim_lock);
+    }
+}
+
+void host_sim_run_for_us(uint64_t duration_us)
+{
+    limit_us = now_us + duration_us;
+    stop_condition = NULL;
+    run_controller();
+}
+
+void host_sim_run_until(bool (*condition)(void), uint64_t timeout_us)
+{
+    limit_us = now_us + timeout_us;
+    stop_condition = condition;
+    run_controller();
+    stop_condition = NULL;
+}
+
+uint64_t host_sim_now_us(void)
+{
+    return now_us;
+}
+
+static void app_main_trampoline(void *arg)
+{
+    void (*app_main_fn)(void) = (void (*)(void))arg;
+    app_main_fn();
+    vTaskDelete(NULL);
+}
+
+void host_sim_start(void (*app_main_fn)(void))
+{
+    // Same name, stack and priority as the IDF main task
+    xTaskCreate(app_main_trampoline, "main", 3584, (void *)app_main_fn, 1, NULL);
+}
+
+// ---------------------------------------------------------------------------
+// Tasks
+
+static void *task_thread(void *param)
+{
+    struct HostTask *self = param;
+    pthread_mutex_lock(&sim_lock);
+    wait_for_cpu(self);
+    self->fn(self->arg);
+
+    // Returning from a task function is not allowed on the target either
+    vTaskDelete(NULL);
+    return NULL;
+}
+
+// The static variants keep the TCB in storage the caller owns, so theirs does
+// not come from the firmware's heap
+static BaseType_t task_create(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                              UBaseType_t priority, TaskHandle_t *handle, bool is_static)
+{
+    struct HostTask *task = is_static ? host_internal_calloc(1, sizeof(struct HostTask))
+                                      : calloc(1, sizeof(struct HostTask));
+    if (task == NULL)
+    {
+        return pdFAIL;
+    }
+    pthread_cond_init(&task->cond, NULL);
+    snprintf(task->name, sizeof(task->name), "%s", name);
+    task->fn = fn;
+    task->arg = arg;
+    task->priority = priority < configMAX_PRIORITIES ? priority : configMAX_PRIORITIES - 1;
+    task->stack_depth = stack_depth;
+    task->number = ++task_count;
+    task->notify_state = NOTIFY_NONE;
+
+    // Append so that uxTaskGetSystemState() lists tasks in creation order
+    struct HostTask **link = &task_list;
+    while (*link != NULL)
+    {
+        link = &(*link)->next;
+    }
+    *link = task;
+    make_ready(task);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_create(&task->thread, &attr, task_thread, task);
+    pthread_attr_destroy(&attr);
+
+    if (handle != NULL)
+    {
+        *handle = task;
+    }
+    preempt_if_needed();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core_id)
+{
+    (void)core_id;
+    return task_create(fn, name, stack_depth, arg, priority, handle, false);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle)
+{
+    return xTaskCreatePinnedToCore(fn, name, stack_depth, arg, priority, handle, tskNO_AFFINITY);
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                                           UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb,
+                                           BaseType_t core_id)
+{
+    (void)stack;
+    (void)tcb;
+    (void)core_id;
+    TaskHandle_t handle = NULL;
+    task_create(fn, name, stack_depth, arg, priority, &handle, true);
+    return handle;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                               UBaseType_t priority, StackType_t *stack, StaticTask_t *tcb)
+{
+    return xTaskCreateStaticPinnedToCore(fn, name, stack_depth, arg, priority, stack, tcb, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    struct HostTask *target = task != NULL ? task : current;
+    if (target == NULL)
+    {
+        return;
+    }
+    if (target != current)
+    {
+        target->state = TASK_DELETED; // Its thread stays parked forever
+        return;
+    }
+
+    target->state = TASK_DELETED;
+    dispatch();
+    pthread_mutex_unlock(&sim_lock);
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    if (ticks == 0)
+    {
+        yield_current();
+        return;
+    }
+    block_current(deadline_after(ticks), NULL);
+}
+
+BaseType_t xTaskDelayUntil(TickType_t *previous_wake, TickType_t increment)
+{
+    TickType_t wake = *previous_wake + increment;
+    *previous_wake = wake;
+    uint64_t wake_us = (uint64_t)wake * TICK_US;
+    if (wake_us <= now_us)
+    {
+        yield_current();
+        return pdFALSE;
+    }
+    block_current(wake_us, NULL);
+    return pdTRUE;
+}
+
+void vTaskDelayUntil(TickType_t *previous_wake, TickType_t increment)
+{
+    xTaskDelayUntil(previous_wake, increment);
+}
+
+void vTaskSuspend(TaskHandle_t task)
+{
+    struct HostTask *target = task != NULL ? task : current;
+    if (target == current)
+    {
+        target->state = TASK_SUSPENDED;
+        dispatch();
+        wait_for_cpu(target);
+        return;
+    }
+    target->state = TASK_SUSPENDED;
+}
+
+void vTaskResume(TaskHandle_t task)
+{
+    if (task != NULL && task->state == TASK_SUSPENDED)
+    {
+        make_ready(task);
+        preempt_if_needed();
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(now_us / TICK_US);
+}
+
+TickType_t xTaskGetTickCountFromISR(void)
+{
+    return xTaskGetTickCount();
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return current;
+}
+
+const char *pcTaskGetName(TaskHandle_t task)
+{
+    struct HostTask *target = task != NULL ? task : current;
+    return target != NULL ? target->name : "controller";
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    struct HostTask *target = task != NULL ? task : current;
+    return target != NULL ? target->priority : 0;
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority)
+{
+    struct HostTask *target = task != NULL ? task : current;
+    if (target != NULL)
+    {
+        target->priority = priority;
+        preempt_if_needed();
+    }
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task)
+{
+    // Stack use cannot be observed on the host, report the whole stack as unused
+    struct HostTask *target = task != NULL ? task : current;
+    return target != NULL ? target->stack_depth : 0;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void)
+{
+    UBaseType_t count = 0;
+    for (struct HostTask *t = task_list; t != NULL; t = t->next)
+    {
+        count += t->state != TASK_DELETED;
+    }
+    return count;
+}
+
+eTaskState eTaskGetState(TaskHandle_t task)
+{
+    switch (task->state)
+    {
+    case TASK_RUNNING:
+        return eRunning;
+    case TASK_READY:
+        return eReady;
+    case TASK_BLOCKED:
+        return eBlocked;
+    case TASK_SUSPENDED:
+        return eSuspended;
+    default:
+        return eDeleted;
+    }
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t max_count, uint32_t *total_run_time)
+{
+    UBaseType_t count = 0;
+    account_current(); // Bring the running task's counter up to date
+    for (struct HostTask *t = task_list; t != NULL && count < max_count; t = t->next)
+    {
+        if (t->state == TASK_DELETED)
+        {
+            continue;
+        }
+        status[count].xHandle = t;
+        status[count].pcTaskName = t->name;
+        status[count].xTaskNumber = t->number;
+        status[count].eCurrentState = eTaskGetState(t);
+        status[count].uxCurrentPriority = t->priority;
+        status[count].uxBasePriority = t->priority;
+        status[count].ulRunTimeCounter = (uint32_t)t->run_time_us;
+        status[count].pxStackBase = NULL;
+        status[count].usStackHighWaterMark = t->stack_depth;
+        status[count].xCoreID = 0;
+        count++;
+    }
+    if (total_run_time != NULL)
+    {
+        *total_run_time = (uint32_t)now_us;
+    }
+    return count;
+}
+
+// ---------------------------------------------------------------------------
+// Task notifications
+
+static BaseType_t notify(struct HostTask *task, uint32_t value, eNotifyAction action, uint32_t *previous_value)
+{
+    if (task == NULL)
+    {
+        return pdFAIL;
+    }
+    if (previous_value != NULL)
+    {
+        *previous_value = task->notify_value;
+    }
+
+    NotifyState old_state = task->notify_state;
+    switch (action)
+    {
+    case eSetBits:
+        task->notify_value |= value;
+        break;
+    case eIncrement:
+        task->notify_value++;
+        break;
+    case eSetValueWithOverwrite:
+        task->notify_value = value;
+        break;
+    case eSetValueWithoutOverwrite:
+        if (old_state == NOTIFY_RECEIVED)
+        {
+            return pdFAIL;
+        }
+        task->notify_value = value;
+        break;
+    case eNoAction:
+        break;
+    }
+    task->notify_state = NOTIFY_RECEIVED;
+
+    if (old_state == NOTIFY_WAITING && task->state == TASK_BLOCKED && task->wait_object == &task->notify_state)
+    {
+        make_ready(task);
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskGenericNotify(TaskHandle_t task, uint32_t value, eNotifyAction action, uint32_t *previous_value)
+{
+    BaseType_t result = notify(task, value, action, previous_value);
+    preempt_if_needed();
+    return result;
+}
+
+BaseType_t xTaskGenericNotifyFromISR(TaskHandle_t task, uint32_t value, eNotifyAction action,
+                                     uint32_t *previous_value, BaseType_t *higher_priority_task_woken)
+{
+    BaseType_t result = notify(task, value, action, previous_value);
+    if (higher_priority_task_woken != NULL && woke_higher_priority())
+    {
+        *higher_priority_task_woken = pdTRUE;
+    }
+    return result;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken)
+{
+    xTaskGenericNotifyFromISR(task, 0, eIncrement, NULL, higher_priority_task_woken);
+}
+
+BaseType_t xTaskNotifyWait(uint32_t clear_on_entry, uint32_t clear_on_exit, uint32_t *value, TickType_t ticks)
+{
+    struct HostTask *self = current;
+    if (self == NULL)
+    {
+        return pdFALSE;
+    }
+
+    if (self->notify_state != NOTIFY_RECEIVED)
+    {
+        self->notify_value &= ~clear_on_entry;
+        self->notify_state = NOTIFY_WAITING;
+        if (ticks > 0)
+        {
+            block_current(deadline_after(ticks), &self->notify_state);
+        }
+    }
+
+    if (value != NULL)
+    {
+        *value = self->notify_value;
+    }
+    BaseType_t received = self->notify_state == NOTIFY_RECEIVED;
+    if (received)
+    {
+        self->notify_value &= ~clear_on_exit;
+    }
+    self->notify_state = NOTIFY_NONE;
+    return received ? pdTRUE : pdFALSE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    struct HostTask *self = current;
+    if (self == NULL)
+    {
+        return 0;
+    }
+
+    if (self->notify_value == 0)
+    {
+        self->notify_state = NOTIFY_WAITING;
+        if (ticks > 0)
+        {
+            block_current(deadline_after(ticks), &self->notify_state);
+        }
+    }
+
+    uint32_t value = self->notify_value;
+    if (value != 0)
+    {
+        self->notify_value = clear_on_exit ? 0 : value - 1;
+    }
+    self->notify_state = NOTIFY_NONE;
+    return value;
+}
+
+// ---------------------------------------------------------------------------
+// Queues and semaphores
+
+struct HostQueue
+{
+    uint8_t *storage;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+    bool owns_storage;
+    bool is_static;
+    // Distinct addresses blocked senders and receivers wait on
+    char send_wait;
+    char receive_wait;
+};
+
+static QueueHandle_t queue_create(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, bool is_static)
+{
+    struct HostQueue *queue = is_static ? host_internal_calloc(1, sizeof(struct HostQueue))
+                                        : calloc(1, sizeof(struct HostQueue));
+    queue->is_static = is_static;
+    queue->length = length;
+    queue->item_size = item_size;
+    if (storage != NULL || item_size == 0)
+    {
+        queue->storage = storage;
+    }
+    else
+    {
+        queue->storage = calloc(length, item_size);
+        queue->owns_storage = true;
+    }
+    return queue;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    return queue_create(length, item_size, NULL, false);
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t item_size, uint8_t *storage, StaticQueue_t *buffer)
+{
+    (void)buffer;
+    return queue_create(length, item_size, storage, true);
+}
+
+static bool queue_push(struct HostQueue *queue, const void *item, bool to_front)
+{
+    if (queue->count >= queue->length)
+    {
+        return false;
+    }
+    if (queue->item_size > 0 && item != NULL)
+    {
+        UBaseType_t slot;
+        if (to_front)
+        {
+            queue->head = (queue->head + queue->length - 1) % queue->length;
+            slot = queue->head;
+        }
+        else
+        {
+            slot = (queue->head + queue->count) % queue->length;
+        }
+        memcpy(queue->storage + slot * queue->item_size, item, queue->item_size);
+    }
+    queue->count++;
+    wake_waiters(&queue->receive_wait);
+    return true;
+}
+
+static bool queue_pop(struct HostQueue *queue, void *item, bool peek)
+{
+    if (queue->count == 0)
+    {
+        return false;
+    }
+    if (queue->item_size > 0 && item != NULL)
+    {
+        memcpy(item, queue->storage + queue->head * queue->item_size, queue->item_size);
+    }
+    if (!peek)
+    {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        wake_waiters(&queue->send_wait);
+    }
+    return true;
+}
+
+static BaseType_t queue_send(QueueHandle_t queue, const void *item, TickType_t ticks, bool to_front)
+{
+    uint64_t deadline = deadline_after(ticks);
+    while (1)
+    {
+        if (queue_push(queue, item, to_front))
+        {
+            preempt_if_needed();
+            return pdTRUE;
+        }
+        if (ticks == 0 || now_us >= deadline || current == NULL)
+        {
+            return errQUEUE_FULL;
+        }
+        block_current(deadline, &queue->send_wait);
+    }
+}
+
+static BaseType_t queue_receive(QueueHandle_t queue, void *item, TickType_t ticks, bool peek)
+{
+    uint64_t deadline = deadline_after(ticks);
+    while (1)
+    {
+        if (queue_pop(queue, item, peek))
+        {
+            preempt_if_needed();
+            return pdTRUE;
+        }
+        if (ticks == 0 || now_us >= deadline || current == NULL)
+        {
+            return errQUEUE_EMPTY;
+        }
+        block_current(deadline, &queue->receive_wait);
+    }
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    return queue_send(queue, item, ticks, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    return queue_send(queue, item, ticks, true);
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void *item)
+{
+    queue->count = 0;
+    queue->head = 0;
+    return queue_send(queue, item, 0, false);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void *item, BaseType_t *higher_priority_task_woken)
+{
+    if (!queue_push(queue, item, false))
+    {
+        return errQUEUE_FULL;
+    }
+    if (higher_priority_task_woken != NULL && woke_higher_priority())
+    {
+        *higher_priority_task_woken = pdTRUE;
+    }
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    return queue_receive(queue, item, ticks, false);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    return queue_receive(queue, item, ticks, true);
+}
+
+BaseType_t xQueueReceiveFromISR(QueueHandle_t queue, void *item, BaseType_t *higher_priority_task_woken)
+{
+    if (!queue_pop(queue, item, false))
+    {
+        return pdFALSE;
+    }
+    if (higher_priority_task_woken != NULL && woke_higher_priority())
+    {
+        *higher_priority_task_woken = pdTRUE;
+    }
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue)
+{
+    return queue->length - queue->count;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    queue->count = 0;
+    queue->head = 0;
+    wake_waiters(&queue->send_wait);
+    return pdPASS;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    if (queue->owns_storage)
+    {
+        free(queue->storage);
+    }
+    if (queue->is_static)
+    {
+        host_internal_free(queue);
+    }
+    else
+    {
+        free(queue);
+    }
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return queue_create(1, 0, NULL, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer)
+{
+    (void)buffer;
+    return queue_create(1, 0, NULL, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t mutex = queue_create(1, 0, NULL, false);
+    mutex->count = 1;
+    return mutex;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer)
+{
+    (void)buffer;
+    SemaphoreHandle_t mutex = queue_create(1, 0, NULL, true);
+    mutex->count = 1;
+    return mutex;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    SemaphoreHandle_t semaphore = queue_create(max_count, 0, NULL, false);
+    semaphore->count = initial_count;
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCountingStatic(UBaseType_t max_count, UBaseType_t initial_count,
+                                                 StaticSemaphore_t *buffer)
+{
+    (void)buffer;
+    SemaphoreHandle_t semaphore = queue_create(max_count, 0, NULL, true);
+    semaphore->count = initial_count;
+    return semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+    return queue_receive(semaphore, NULL, ticks, false);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    return queue_send(semaphore, NULL, 0, false);
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t semaphore, BaseType_t *higher_priority_task_woken)
+{
+    return xQueueSendFromISR(semaphore, NULL, higher_priority_task_woken);
+}
+
+BaseType_t xSemaphoreTakeFromISR(SemaphoreHandle_t semaphore, BaseType_t *higher_priority_task_woken)
+{
+    return xQueueReceiveFromISR(semaphore, NULL, higher_priority_task_woken);
+}
+
+UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t semaphore)
+{
+    return semaphore->count;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    vQueueDelete(semaphore);
+}
+
+// ---------------------------------------------------------------------------
+// Event groups
+
+struct HostEventGroup
+{
+    EventBits_t bits;
+    bool is_static;
+};
+
+static EventGroupHandle_t event_group_create(bool is_static)
+{
+    struct HostEventGroup *group = is_static ? host_internal_calloc(1, sizeof(struct HostEventGroup))
+                                             : calloc(1, sizeof(struct HostEventGroup));
+    group->is_static = is_static;
+    return group;
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return event_group_create(false);
+}
+
+EventGroupHandle_t xEventGroupCreateStatic(StaticEventGroup_t *buffer)
+{
+    (void)buffer;
+    return event_group_create(true);
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    group->bits |= bits;
+    EventBits_t result = group->bits;
+    wake_waiters(group); // Each waiter checks its own condition again
+    preempt_if_needed();
+    return result;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits)
+{
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group)
+{
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks)
+{
+    uint64_t deadline = deadline_after(ticks);
+    while (1)
+    {
+        EventBits_t value = group->bits;
+        if (wait_for_all ? (value & bits) == bits : (value & bits) != 0)
+        {
+            if (clear_on_exit)
+            {
+                group->bits &= ~bits;
+            }
+            return value;
+        }
+        if (ticks == 0 || now_us >= deadline || current == NULL)
+        {
+            return value;
+        }
+        block_current(deadline, group);
+    }
+}
+
+void vEventGroupDelete(EventGroupHandle_t group)
+{
+    wake_waiters(group);
+    if (group->is_static)
+    {
+        host_internal_free(group);
+    }
+    else
+    {
+        free(group);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Software timers, run by a timer service task like the real daemon
+
+struct HostTimer
+{
+    char name[configMAX_TASK_NAME_LEN];
+    TickType_t period;
+    bool auto_reload;
+    bool active;
+    bool is_static;
+    void *id;
+    uint64_t expiry_us;
+    TimerCallbackFunction_t callback;
+    struct HostTimer *next;
+};
+
+static struct HostTimer *timer_list = NULL;
+static TaskHandle_t timer_task = NULL;
+static char timer_task_wait;
+
+static void timer_service_task(void *arg)
+{
+    while (1)
+    {
+        struct HostTimer *due = NULL;
+        for (struct HostTimer *t = timer_list; t != NULL; t = t->next)
+        {
+            if (t->active && (due == NULL || t->expiry_us < due->expiry_us))
+            {
+                due = t;
+            }
+        }
+
+        if (due != NULL && due->expiry_us <= now_us)
+        {
+            if (due->auto_reload)
+            {
+                due->expiry_us += (uint64_t)due->period * TICK_US;
+            }
+            else
+            {
+                due->active = false;
+            }
+            due->callback(due);
+            continue;
+        }
+        block_current(due != NULL ? due->expiry_us : HOST_FOREVER, &timer_task_wait);
+    }
+}
+
+static void timer_service_start(void)
+{
+    xTaskCreate(timer_service_task, "Tmr Svc", 2048, NULL, configTIMER_TASK_PRIORITY, &timer_task);
+}
+
+static void timer_service_kick(void)
+{
+    if (timer_task != NULL && timer_task->state == TASK_BLOCKED && timer_task->wait_object == &timer_task_wait)
+    {
+        make_ready(timer_task);
+        preempt_if_needed();
+    }
+}
+
+static TimerHandle_t software_timer_create(const char *name, TickType_t period, UBaseType_t auto_reload, void *id,
+                                           TimerCallbackFunction_t callback, bool is_static)
+{
+    struct HostTimer *timer = is_static ? host_internal_calloc(1, sizeof(struct HostTimer))
+                                        : calloc(1, sizeof(struct HostTimer));
+    timer->is_static = is_static;
+    snprintf(timer->name, sizeof(timer->name), "%s", name);
+    timer->period = period;
+    timer->auto_reload = auto_reload;
+    timer->id = id;
+    timer->callback = callback;
+    timer->next = timer_list;
+    timer_list = timer;
+    return timer;
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *id,
+                           TimerCallbackFunction_t callback)
+{
+    return software_timer_create(name, period, auto_reload, id, callback, false);
+}
+
+TimerHandle_t xTimerCreateStatic(const char *name, TickType_t period, UBaseType_t auto_reload, void *id,
+                                 TimerCallbackFunction_t callback, StaticTimer_t *buffer)
+{
+    (void)buffer;
+    return software_timer_create(name, period, auto_reload, id, callback, true);
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    (void)ticks_to_wait;
+    timer->active = true;
+    timer->expiry_us = now_us + (uint64_t)timer->period * TICK_US;
+    timer_service_kick();
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    return xTimerStart(timer, ticks_to_wait);
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    (void)ticks_to_wait;
+    timer->active = false;
+    timer_service_kick();
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t ticks_to_wait)
+{
+    timer->period = period;
+    return xTimerStart(timer, ticks_to_wait);
+}
+
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    (void)ticks_to_wait;
+    struct HostTimer **link = &timer_list;
+    while (*link != NULL && *link != timer)
+    {
+        link = &(*link)->next;
+    }
+    if (*link != NULL)
+    {
+        *link = timer->next;
+        if (timer->is_static)
+        {
+            host_internal_free(timer);
+        }
+        else
+        {
+            free(timer);
+        }
+    }
+    timer_service_kick();
+    return pdPASS;
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+    return timer->active ? pdTRUE : pdFALSE;
+}
+
+TickType_t xTimerGetExpiryTime(TimerHandle_t timer)
+{
+    return (TickType_t)(timer->expiry_us / TICK_US);
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->id;
+}
@@ -0,0 +1,380 @@
+// GPIO matrix stand-in: pin levels, pulls, edge and level interrupts,
+// scripted input and the HC-SR04 echo model.
+
+#include "driver/gpio.h"
+#include "esp_rom_sys.h"
+#include "host_internal.h"
+#include "host_sim.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define GPIO_READ_COST_US 1 // Every register read costs a little simulated time
+
+// A level interrupt the ISR leaves enabled fires again after this long
+// instead of locking up the simulated CPU
+#define LEVEL_RETRIGGER_US 50
+
+// Timing of the emulated HC-SR04
+#define ECHO_START_DELAY_US 450
+#define SOUND_SPEED_CM_PER_US 0.0343f
+
+typedef struct
+{
+    gpio_mode_t mode;
+    bool pull_up;
+    bool pull_down;
+    int out_level;     // What the firmware drives
+    int ext_level;     // What the outside world drives, -1 when floating
+    int level;         // Effective level last seen by the edge detector
+    gpio_int_type_t intr_type;
+    bool intr_enabled;
+    gpio_isr_t isr;
+    void *isr_arg;
+    bool level_pending; // A level re-evaluation is scheduled
+} HostPin;
+
+typedef struct
+{
+    int gpio_num;
+    int level;
+} ScriptedLevel;
+
+static HostPin pins[GPIO_NUM_MAX];
+static bool isr_service_installed = false;
+static int echo_trig_pin = -1;
+static int echo_echo_pin = -1;
+static float echo_distance_cm = -1.0f;
+
+static int effective_level(const HostPin *pin)
+{
+    if (pin->mode == GPIO_MODE_OUTPUT)
+    {
+        return 0; // Input buffer disabled
+    }
+    if (pin->mode == GPIO_MODE_INPUT_OUTPUT || pin->mode == GPIO_MODE_INPUT_OUTPUT_OD)
+    {
+        return pin->out_level;
+    }
+    if (pin->ext_level >= 0)
+    {
+        return pin->ext_level;
+    }
+    return pin->pull_up ? 1 : 0;
+}
+
+static bool edge_matches(gpio_int_type_t type, int old_level, int new_level)
+{
+    switch (type)
+    {
+    case GPIO_INTR_POSEDGE:
+        return old_level == 0 && new_level == 1;
+    case GPIO_INTR_NEGEDGE:
+        return old_level == 1 && new_level == 0;
+    case GPIO_INTR_ANYEDGE:
+        return old_level != new_level;
+    default:
+        return false;
+    }
+}
+
+static bool level_asserted(const HostPin *pin)
+{
+    return (pin->intr_type == GPIO_INTR_LOW_LEVEL && pin->level == 0) ||
+           (pin->intr_type == GPIO_INTR_HIGH_LEVEL && pin->level == 1);
+}
+
+static void echo_level_event(void *arg);
+static void level_event(void *arg);
+
+static void raise_interrupt(HostPin *pin)
+{
+    host_kernel_enter_isr();
+    pin->isr(pin->isr_arg);
+    host_kernel_exit_isr();
+}
+
+// A level interrupt keeps firing for as long as the level holds, the ISR is
+// expected to disable it or to change the trigger level
+static void schedule_level_check(HostPin *pin, uint64_t delay_us)
+{
+    if (!pin->level_pending && isr_service_installed && pin->isr != NULL && pin->intr_enabled &&
+        level_asserted(pin))
+    {
+        pin->level_pending = true;
+        host_kernel_schedule_event(host_kernel_now_us() + delay_us, level_event, pin);
+    }
+}
+
+static void level_event(void *arg)
+{
+    HostPin *pin = arg;
+    pin->level_pending = false;
+    if (isr_service_installed && pin->isr != NULL && pin->intr_enabled && level_asserted(pin))
+    {
+        raise_interrupt(pin);
+        schedule_level_check(pin, LEVEL_RETRIGGER_US);
+    }
+}
+
+// Re-evaluate a pin and raise its interrupt if the edge or level matches
+static void update_pin(int gpio_num)
+{
+    HostPin *pin = &pins[gpio_num];
+    int new_level = effective_level(pin);
+    int old_level = pin->level;
+    pin->level = new_level;
+
+    if (!isr_service_installed || pin->isr == NULL || !pin->intr_enabled)
+    {
+        return;
+    }
+    if (edge_matches(pin->intr_type, old_level, new_level))
+    {
+        raise_interrupt(pin);
+    }
+    else if (level_asserted(pin) && !pin->level_pending)
+    {
+        raise_interrupt(pin);
+        schedule_level_check(pin, LEVEL_RETRIGGER_US);
+    }
+}
+
+static void scripted_level_event(void *arg)
+{
+    ScriptedLevel *scripted = arg;
+    pins[scripted->gpio_num].ext_level = scripted->level;
+    update_pin(scripted->gpio_num);
+    host_internal_free(scripted);
+}
+
+void host_gpio_reset(void)
+{
+    for (int i = 0; i < GPIO_NUM_MAX; i++)
+    {
+        host_kernel_cancel_events(&pins[i]);
+        memset(&pins[i], 0, sizeof(HostPin));
+        pins[i].ext_level = -1;
+    }
+    isr_service_installed = false;
+    echo_trig_pin = -1;
+    echo_echo_pin = -1;
+    echo_distance_cm = -1.0f;
+}
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    for (int i = 0; i < GPIO_NUM_MAX; i++)
+    {
+        if (!(config->pin_bit_mask & (1ULL << i)))
+        {
+            continue;
+        }
+        if ((config->mode & GPIO_MODE_OUTPUT) && !GPIO_IS_VALID_OUTPUT_GPIO(i))
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+        pins[i].mode = config->mode;
+        pins[i].pull_up = config->pull_up_en;
+        pins[i].pull_down = config->pull_down_en;
+        pins[i].intr_type = config->intr_type;
+        pins[i].intr_enabled = config->intr_type != GPIO_INTR_DISABLE;
+        pins[i].level = effective_level(&pins[i]);
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t gpio_num)
+{
+    pins[gpio_num].mode = GPIO_MODE_INPUT;
+    pins[gpio_num].pull_up = true;
+    pins[gpio_num].intr_enabled = false;
+    update_pin(gpio_num);
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (!GPIO_IS_VALID_GPIO(gpio_num))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int old_out = pins[gpio_num].out_level;
+    pins[gpio_num].out_level = level ? 1 : 0;
+    update_pin(gpio_num);
+
+    // A falling TRIG edge fires the emulated ultrasonic burst
+    bool trig_fell = gpio_num == echo_trig_pin && old_out == 1 && level == 0;
+    FILE *echo_log = trig_fell ? host_capture_file("echo.log") : NULL;
+    if (echo_log != NULL)
+    {
+        fprintf(echo_log, "%llu\n", (unsigned long long)host_kernel_now_us());
+    }
+    if (trig_fell && echo_distance_cm >= 0.0f)
+    {
+        uint64_t start = host_kernel_now_us() + ECHO_START_DELAY_US;
+        uint64_t width = (uint64_t)(echo_distance_cm * 2.0f / SOUND_SPEED_CM_PER_US);
+        host_kernel_schedule_event(start, echo_level_event, (void *)(intptr_t)1);
+        host_kernel_schedule_event(start + width, echo_level_event, (void *)(intptr_t)2);
+    }
+    return ESP_OK;
+}
+
+static void echo_level_event(void *arg)
+{
+    if (echo_echo_pin >= 0)
+    {
+        pins[echo_echo_pin].ext_level = (intptr_t)arg == 1 ? 1 : 0;
+        update_pin(echo_echo_pin);
+    }
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    if (!GPIO_IS_VALID_GPIO(gpio_num))
+    {
+        return 0;
+    }
+    host_kernel_consume_us(GPIO_READ_COST_US);
+    return effective_level(&pins[gpio_num]);
+}
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode)
+{
+    pins[gpio_num].mode = mode;
+    update_pin(gpio_num);
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t gpio_num, gpio_pull_mode_t pull)
+{
+    pins[gpio_num].pull_up = pull == GPIO_PULLUP_ONLY || pull == GPIO_PULLUP_PULLDOWN;
+    pins[gpio_num].pull_down = pull == GPIO_PULLDOWN_ONLY || pull == GPIO_PULLUP_PULLDOWN;
+    update_pin(gpio_num);
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type)
+{
+    pins[gpio_num].intr_type = intr_type;
+    schedule_level_check(&pins[gpio_num], 0);
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_enable(gpio_num_t gpio_num)
+{
+    pins[gpio_num].intr_enabled = true;
+    schedule_level_check(&pins[gpio_num], 0);
+    return ESP_OK;
+}
+
+esp_err_t gpio_intr_disable(gpio_num_t gpio_num)
+{
+    pins[gpio_num].intr_enabled = false;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    (void)intr_alloc_flags;
+    if (isr_service_installed)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    isr_service_installed = true;
+    return ESP_OK;
+}
+
+void gpio_uninstall_isr_service(void)
+{
+    isr_service_installed = false;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args)
+{
+    if (!isr_service_installed)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    pins[gpio_num].isr = isr_handler;
+    pins[gpio_num].isr_arg = args;
+    schedule_level_check(&pins[gpio_num], 0);
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num)
+{
+    pins[gpio_num].isr = NULL;
+    return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t intr_type)
+{
+    if (intr_type != GPIO_INTR_LOW_LEVEL && intr_type != GPIO_INTR_HIGH_LEVEL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Like the IDF driver, the wakeup level doubles as the interrupt type
+    pins[gpio_num].intr_type = intr_type;
+    schedule_level_check(&pins[gpio_num], 0);
+    return ESP_OK;
+}
+
+esp_err_t gpio_wakeup_disable(gpio_num_t gpio_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_hold_en(gpio_num_t gpio_num)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_hold_dis(gpio_num_t gpio_num)
+{
+    return ESP_OK;
+}
+
+void esp_rom_delay_us(uint32_t us)
+{
+    host_kernel_consume_us(us);
+}
+
+// ---------------------------------------------------------------------------
+// Test-facing scripting
+
+void host_gpio_set_input(int gpio_num, int level)
+{
+    pins[gpio_num].ext_level = level;
+    update_pin(gpio_num);
+}
+
+void host_gpio_schedule(uint64_t at_us, int gpio_num, int level)
+{
+    ScriptedLevel *scripted = host_internal_malloc(sizeof(ScriptedLevel));
+    scripted->gpio_num = gpio_num;
+    scripted->level = level;
+    host_kernel_schedule_event(at_us, scripted_level_event, scripted);
+}
+
+void host_button_press(int gpio_num, uint64_t at_us, uint64_t hold_us)
+{
+    host_gpio_schedule(at_us, gpio_num, 0);
+    host_gpio_schedule(at_us + hold_us, gpio_num, 1);
+}
+
+int host_gpio_get_output(int gpio_num)
+{
+    return pins[gpio_num].out_level;
+}
+
+void host_echo_attach(int trig_pin, int echo_pin)
+{
+    echo_trig_pin = trig_pin;
+    echo_echo_pin = echo_pin;
+    pins[echo_pin].ext_level = 0;
+}
+
+void host_echo_set_distance_cm(float distance_cm)
+{
+    echo_distance_cm = distance_cm;
+}
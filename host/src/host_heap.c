@@ -0,0 +1,77 @@
+// Heap hooks: the image links with --wrap for malloc, calloc, realloc and
+// free, so every allocation the firmware makes reaches
+// esp_heap_trace_alloc_hook() and esp_heap_trace_free_hook() as it does with
+// CONFIG_HEAP_USE_HOOKS on the chip. The stand-ins use host_internal_*() for
+// bookkeeping the chip does not have (events, scripted input, static objects).
+
+#include "esp_heap_caps.h"
+#include "host_internal.h"
+#include <stddef.h>
+#include <stdint.h>
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+// Weak, an image without the allocation tracker does not define them
+void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps) __attribute__((weak));
+void esp_heap_trace_free_hook(void *ptr) __attribute__((weak));
+
+static void *traced(void *ptr, size_t size)
+{
+    if (ptr != NULL && esp_heap_trace_alloc_hook != NULL)
+    {
+        esp_heap_trace_alloc_hook(ptr, size, MALLOC_CAP_DEFAULT);
+    }
+    return ptr;
+}
+
+void *__wrap_malloc(size_t size)
+{
+    return traced(__real_malloc(size), size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    return traced(__real_calloc(n, size), n * size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    // A move is a free and an allocation on the ESP-IDF heap too
+    if (ptr != NULL && esp_heap_trace_free_hook != NULL)
+    {
+        esp_heap_trace_free_hook(ptr);
+    }
+    return traced(__real_realloc(ptr, size), size);
+}
+
+void __wrap_free(void *ptr)
+{
+    if (ptr != NULL && esp_heap_trace_free_hook != NULL)
+    {
+        esp_heap_trace_free_hook(ptr);
+    }
+    __real_free(ptr);
+}
+
+void *host_internal_malloc(size_t size)
+{
+    return __real_malloc(size);
+}
+
+void *host_internal_calloc(size_t n, size_t size)
+{
+    return __real_calloc(n, size);
+}
+
+void *host_internal_realloc(void *ptr, size_t size)
+{
+    return __real_realloc(ptr, size);
+}
+
+void host_internal_free(void *ptr)
+{
+    __real_free(ptr);
+}
@@ -0,0 +1,606 @@
+// Legacy I2C master stand-in with models of the 1602 LCD (HD44780 driven
+// through a PCF8574 expander) and of the SSD1306 OLED. Bus time is charged at
+// the configured clock.
+
+#include "driver/i2c.h"
+#include "host_internal.h"
+#include "host_sim.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LCD_I2C_ADDR 0x27
+#define OLED_I2C_ADDR 0x3C
+#define CMD_LINK_MAX_OPS 256
+
+// PCF8574 bits as wired on the common LCD backpacks
+#define PCF_RS 0x01
+#define PCF_EN 0x04
+#define PCF_BACKLIGHT 0x08
+
+typedef enum { OP_START, OP_WRITE, OP_READ, OP_STOP } CmdOpType;
+
+typedef struct
+{
+    CmdOpType type;
+    uint8_t byte;
+    uint8_t *read_target;
+} CmdOp;
+
+typedef struct
+{
+    CmdOp ops[CMD_LINK_MAX_OPS];
+    int count;
+    bool is_static;
+} CmdLink;
+
+typedef struct
+{
+    bool four_bit;
+    bool have_high_nibble;
+    uint8_t high_nibble;
+    uint8_t last_port;
+    uint8_t address;       // DDRAM or CGRAM address counter
+    bool cgram_selected;
+    char ddram[0x80];
+    uint8_t cgram[64];
+    char visible[HOST_LCD_ROWS][HOST_LCD_COLS + 1];
+    uint32_t frames;
+} Hd44780;
+
+// SSD1306 in horizontal addressing mode, the only one the firmware uses
+typedef struct
+{
+    bool control_next;    // The next byte of the transfer is a control byte
+    bool data;            // D/C of the bytes after the last control byte
+    bool single;          // Co: one byte, then another control byte
+    uint8_t command[3];   // Command being collected, with its arguments
+    int command_length;
+    uint8_t column, column_first, column_last;
+    uint8_t page, page_first, page_last;
+    bool on;
+    uint8_t ram[HOST_OLED_PAGES][HOST_OLED_WIDTH];
+} Ssd1306;
+
+static uint32_t clock_hz[I2C_NUM_MAX] = {100000, 100000};
+static bool installed[I2C_NUM_MAX] = {false, false};
+static HostI2cStats stats;
+static uint32_t fail_count = 0; // Transactions left to fail
+static Hd44780 lcd;
+static Ssd1306 oled;
+
+static void lcd_reset(void)
+{
+    memset(&lcd, 0, sizeof(lcd));
+    memset(lcd.ddram, ' ', sizeof(lcd.ddram));
+    for (int row = 0; row < HOST_LCD_ROWS; row++)
+    {
+        memset(lcd.visible[row], ' ', HOST_LCD_COLS);
+        lcd.visible[row][HOST_LCD_COLS] = '\0';
+    }
+}
+
+static void oled_reset(void)
+{
+    memset(&oled, 0, sizeof(oled));
+    oled.column_last = HOST_OLED_WIDTH - 1;
+    oled.page_last = HOST_OLED_PAGES - 1;
+}
+
+void host_i2c_reset(void)
+{
+    memset(&stats, 0, sizeof(stats));
+    fail_count = 0;
+    lcd_reset();
+    oled_reset();
+}
+
+// A custom character (codes 0x00-0x0F, 8 CGRAM glyphs twice over) shows as
+// the number of its lit pixel columns, '0' to '5': a bar reads as digits
+static char lcd_glyph_char(uint8_t code)
+{
+    const uint8_t *bitmap = &lcd.cgram[(code & 0x07) * 8];
+    uint8_t columns = 0;
+    for (int row = 0; row < 8; row++)
+    {
+        columns |= bitmap[row];
+    }
+    return '0' + __builtin_popcount(columns);
+}
+
+// Snapshot the visible area and log a frame if it changed
+static void lcd_refresh_visible(void)
+{
+    bool changed = false;
+    for (int row = 0; row < HOST_LCD_ROWS; row++)
+    {
+        const char *src = &lcd.ddram[row * 0x40];
+        for (int col = 0; col < HOST_LCD_COLS; col++)
+        {
+            char c = (uint8_t)src[col] < 0x10 ? lcd_glyph_char(src[col]) : src[col];
+            if (lcd.visible[row][col] != c)
+            {
+                lcd.visible[row][col] = c;
+                changed = true;
+            }
+        }
+    }
+    if (!changed)
+    {
+        return;
+    }
+    lcd.frames++;
+    FILE *log = host_capture_file("lcd.log");
+    if (log != NULL)
+    {
+        fprintf(log, "%llu|%s|%s\n", (unsigned long long)host_kernel_now_us(), lcd.visible[0], lcd.visible[1]);
+    }
+}
+
+static void lcd_instruction(uint8_t value)
+{
+    if (value & 0x80)
+    {
+        lcd.address = value & 0x7F; // Set DDRAM address
+        lcd.cgram_selected = false;
+    }
+    else if (value & 0x40)
+    {
+        lcd.address = value & 0x3F; // Set CGRAM address
+        lcd.cgram_selected = true;
+    }
+    else if (value & 0x20)
+    {
+        lcd.four_bit = !(value & 0x10); // Function set
+    }
+    else if (value == 0x01)
+    {
+        memset(lcd.ddram, ' ', sizeof(lcd.ddram)); // Clear display
+        lcd.address = 0;
+        lcd.cgram_selected = false;
+        lcd_refresh_visible();
+    }
+    else if ((value & 0xFE) == 0x02)
+    {
+        lcd.address = 0; // Return home
+        lcd.cgram_selected = false;
+    }
+    // Entry mode and display control do not change what the model records
+}
+
+static void lcd_data(uint8_t value)
+{
+    if (lcd.cgram_selected)
+    {
+        lcd.cgram[lcd.address & 0x3F] = value & 0x1F;
+        lcd.address = (lcd.address + 1) & 0x3F;
+        return;
+    }
+    lcd.ddram[lcd.address & 0x7F] = (char)value;
+    lcd.address = (lcd.address + 1) & 0x7F;
+    lcd_refresh_visible();
+}
+
+// The HD44780 latches on the falling edge of EN
+static void lcd_port_write(uint8_t port)
+{
+    bool falling_enable = (lcd.last_port & PCF_EN) && !(port & PCF_EN);
+    uint8_t latched = lcd.last_port;
+    lcd.last_port = port;
+    if (!falling_enable)
+    {
+        return;
+    }
+
+    uint8_t nibble = latched & 0xF0;
+    bool is_data = latched & PCF_RS;
+    uint8_t value;
+    if (!lcd.four_bit)
+    {
+        value = nibble; // 8-bit mode, the low data lines are not wired
+        lcd.have_high_nibble = false;
+    }
+    else if (!lcd.have_high_nibble)
+    {
+        lcd.high_nibble = nibble;
+        lcd.have_high_nibble = true;
+        return;
+    }
+    else
+    {
+        value = lcd.high_nibble | (nibble >> 4);
+        lcd.have_high_nibble = false;
+    }
+
+    if (is_data)
+    {
+        lcd_data(value);
+    }
+    else
+    {
+        lcd_instruction(value);
+    }
+}
+
+// Argument bytes of the SSD1306 commands the firmware sends
+static int oled_command_length(uint8_t command)
+{
+    switch (command)
+    {
+    case 0x21: // Column range
+    case 0x22: // Page range
+        return 3;
+    case 0x20: // Addressing mode
+    case 0x81: // Contrast
+    case 0x8D: // Charge pump
+    case 0xA8: // Multiplex ratio
+    case 0xD3: // Display offset
+    case 0xD5: // Clock divider
+    case 0xD9: // Precharge
+    case 0xDA: // COM pins
+    case 0xDB: // VCOMH level
+        return 2;
+    default:
+        return 1;
+    }
+}
+
+static void oled_command_byte(uint8_t byte)
+{
+    oled.command[oled.command_length++] = byte;
+    if (oled.command_length < oled_command_length(oled.command[0]))
+    {
+        return;
+    }
+    oled.command_length = 0;
+    switch (oled.command[0])
+    {
+    case 0x21:
+        oled.column_first = oled.command[1] & 0x7F;
+        oled.column_last = oled.command[2] & 0x7F;
+        oled.column = oled.column_first;
+        break;
+    case 0x22:
+        oled.page_first = oled.command[1] & 0x07;
+        oled.page_last = oled.command[2] & 0x07;
+        oled.page = oled.page_first;
+        break;
+    case 0xAE:
+        oled.on = false;
+        break;
+    case 0xAF:
+        oled.on = true;
+        break;
+    }
+}
+
+static void oled_data_byte(uint8_t byte)
+{
+    oled.ram[oled.page][oled.column] = byte;
+    if (oled.column < oled.column_last)
+    {
+        oled.column++;
+        return;
+    }
+    oled.column = oled.column_first;
+    oled.page = oled.page < oled.page_last ? oled.page + 1 : oled.page_first;
+}
+
+static void oled_write(uint8_t byte)
+{
+    if (oled.control_next)
+    {
+        oled.single = byte & 0x80;
+        oled.data = byte & 0x40;
+        oled.control_next = false;
+        return;
+    }
+    if (oled.data)
+    {
+        oled_data_byte(byte);
+    }
+    else
+    {
+        oled_command_byte(byte);
+    }
+    oled.control_next = oled.single;
+}
+
+static void device_start(uint8_t address)
+{
+    if (address == OLED_I2C_ADDR)
+    {
+        oled.control_next = true;
+    }
+}
+
+static void device_write(uint8_t address, uint8_t byte)
+{
+    if (address == LCD_I2C_ADDR)
+    {
+        lcd_port_write(byte);
+    }
+    else if (address == OLED_I2C_ADDR)
+    {
+        oled_write(byte);
+    }
+}
+
+// Charge the bus time of a transaction and let other tasks run meanwhile
+static void charge_bus_time(i2c_port_t port, uint32_t bytes)
+{
+    // 9 clocks per byte plus start and stop
+    uint64_t bits = (uint64_t)bytes * 9 + 2;
+    uint64_t us = (bits * 1000000ULL + clock_hz[port] - 1) / clock_hz[port];
+    stats.transactions++;
+    stats.bytes += bytes;
+    stats.bus_time_us += us;
+    host_pm_driver_lock(true); // The driver holds its APB lock for the transaction
+    host_kernel_sleep_us(us);
+    host_pm_driver_lock(false);
+}
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *config)
+{
+    if (port >= I2C_NUM_MAX || config == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    clock_hz[port] = config->master.clk_speed > 0 ? config->master.clk_speed : 100000;
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t rx_buf_len, size_t tx_buf_len, int intr_alloc_flags)
+{
+    if (port >= I2C_NUM_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (installed[port])
+    {
+        return ESP_FAIL;
+    }
+    installed[port] = true;
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_delete(i2c_port_t port)
+{
+    installed[port] = false;
+    return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create(void)
+{
+    return calloc(1, sizeof(CmdLink));
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *buffer, uint32_t size)
+{
+    // The real driver carves the link out of the caller's buffer; the model is
+    // bigger than I2C_LINK_RECOMMENDED_SIZE, so it lives in a small pool instead
+    static CmdLink pool[4];
+    static int next = 0;
+    (void)buffer;
+    (void)size;
+    CmdLink *link = &pool[next];
+    next = (next + 1) % 4;
+    memset(link, 0, sizeof(CmdLink));
+    link->is_static = true;
+    return link;
+}
+
+void i2c_cmd_link_delete(i2c_cmd_handle_t cmd)
+{
+    free(cmd);
+}
+
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd)
+{
+    (void)cmd;
+}
+
+static esp_err_t add_op(i2c_cmd_handle_t cmd, CmdOpType type, uint8_t byte, uint8_t *read_target)
+{
+    CmdLink *link = cmd;
+    if (link->count >= CMD_LINK_MAX_OPS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    link->ops[link->count].type = type;
+    link->ops[link->count].byte = byte;
+    link->ops[link->count].read_target = read_target;
+    link->count++;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd)
+{
+    return add_op(cmd, OP_START, 0, NULL);
+}
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack_en)
+{
+    return add_op(cmd, OP_WRITE, data, NULL);
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, const uint8_t *data, size_t data_len, bool ack_en)
+{
+    for (size_t i = 0; i < data_len; i++)
+    {
+        esp_err_t err = add_op(cmd, OP_WRITE, data[i], NULL);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd, uint8_t *data, size_t data_len, i2c_ack_type_t ack)
+{
+    for (size_t i = 0; i < data_len; i++)
+    {
+        esp_err_t err = add_op(cmd, OP_READ, 0, &data[i]);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd, uint8_t *data, i2c_ack_type_t ack)
+{
+    return add_op(cmd, OP_READ, 0, data);
+}
+
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd)
+{
+    return add_op(cmd, OP_STOP, 0, NULL);
+}
+
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks_to_wait)
+{
+    CmdLink *link = cmd;
+    if (port >= I2C_NUM_MAX || !installed[port])
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (fail_count > 0)
+    {
+        // Nothing reaches the devices; the driver gives up after the timeout
+        fail_count--;
+        charge_bus_time(port, 1);
+        return ESP_ERR_TIMEOUT;
+    }
+
+    uint32_t bytes = 0;
+    int address = -1;
+    bool expect_address = false;
+    for (int i = 0; i < link->count; i++)
+    {
+        CmdOp *op = &link->ops[i];
+        switch (op->type)
+        {
+        case OP_START:
+            expect_address = true;
+            break;
+        case OP_WRITE:
+            bytes++;
+            if (expect_address)
+            {
+                address = op->byte >> 1;
+                expect_address = false;
+                device_start((uint8_t)address);
+            }
+            else if (address >= 0)
+            {
+                device_write((uint8_t)address, op->byte);
+            }
+            break;
+        case OP_READ:
+            bytes++;
+            *op->read_target = 0xFF; // Nothing else on the bus answers yet
+            break;
+        case OP_STOP:
+            break;
+        }
+    }
+    charge_bus_time(port, bytes);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write_to_device(i2c_port_t port, uint8_t device_address, const uint8_t *write_buffer,
+                                     size_t write_size, TickType_t ticks_to_wait)
+{
+    CmdLink link = {0};
+    i2c_master_start(&link);
+    i2c_master_write_byte(&link, (device_address << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_write(&link, write_buffer, write_size, true);
+    i2c_master_stop(&link);
+    return i2c_master_cmd_begin(port, &link, ticks_to_wait);
+}
+
+esp_err_t i2c_master_read_from_device(i2c_port_t port, uint8_t device_address, uint8_t *read_buffer,
+                                      size_t read_size, TickType_t ticks_to_wait)
+{
+    CmdLink link = {0};
+    i2c_master_start(&link);
+    i2c_master_write_byte(&link, (device_address << 1) | I2C_MASTER_READ, true);
+    i2c_master_read(&link, read_buffer, read_size, I2C_MASTER_LAST_NACK);
+    i2c_master_stop(&link);
+    return i2c_master_cmd_begin(port, &link, ticks_to_wait);
+}
+
+esp_err_t i2c_master_write_read_device(i2c_port_t port, uint8_t device_address, const uint8_t *write_buffer,
+                                       size_t write_size, uint8_t *read_buffer, size_t read_size,
+                                       TickType_t ticks_to_wait)
+{
+    CmdLink link = {0};
+    i2c_master_start(&link);
+    i2c_master_write_byte(&link, (device_address << 1) | I2C_MASTER_WRITE, true);
+    i2c_master_write(&link, write_buffer, write_size, true);
+    i2c_master_start(&link);
+    i2c_master_write_byte(&link, (device_address << 1) | I2C_MASTER_READ, true);
+    i2c_master_read(&link, read_buffer, read_size, I2C_MASTER_LAST_NACK);
+    i2c_master_stop(&link);
+    return i2c_master_cmd_begin(port, &link, ticks_to_wait);
+}
+
+esp_err_t i2c_reset_tx_fifo(i2c_port_t port)
+{
+    return ESP_OK;
+}
+
+esp_err_t i2c_reset_rx_fifo(i2c_port_t port)
+{
+    return ESP_OK;
+}
+
+// ---------------------------------------------------------------------------
+// Test-facing accessors
+
+const char *host_lcd_line(int row)
+{
+    return lcd.visible[row];
+}
+
+uint32_t host_lcd_frame_count(void)
+{
+    return lcd.frames;
+}
+
+bool host_lcd_backlight(void)
+{
+    return lcd.last_port & PCF_BACKLIGHT;
+}
+
+uint8_t host_lcd_cgram(int slot, int row)
+{
+    return lcd.cgram[(slot & 7) * 8 + (row & 7)];
+}
+
+uint8_t host_oled_column(int page, int x)
+{
+    return oled.ram[page & (HOST_OLED_PAGES - 1)][x & (HOST_OLED_WIDTH - 1)];
+}
+
+bool host_oled_display_on(void)
+{
+    return oled.on;
+}
+
+void host_i2c_get_stats(HostI2cStats *out)
+{
+    *out = stats;
+}
+
+void host_i2c_reset_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+void host_i2c_fail_next(uint32_t count)
+{
+    fail_count = count;
+}
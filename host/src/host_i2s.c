@@ -0,0 +1,201 @@
+// I2S standard-mode TX stand-in. Samples are captured to pcm.raw, with one
+// line per write (time, sample count, peak) in pcm.log. The DMA ring is
+// modelled as a queue that drains at the sample rate, so writes block the way
+// they do on the chip once the descriptors are full.
+
+#include "driver/i2s_std.h"
+#include "host_internal.h"
+#include "host_sim.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct i2s_channel_obj_t
+{
+    uint32_t sample_rate_hz;
+    uint32_t bytes_per_frame;
+    uint32_t dma_capacity_frames;
+    bool enabled;
+    bool playing;           // Data has been written since the channel was enabled
+    uint64_t drained_at_us; // When everything written so far has been played out
+    i2s_event_callbacks_t callbacks;
+    void *user_data;
+};
+
+static HostPcmStats pcm_stats;
+
+void host_i2s_reset(void)
+{
+    memset(&pcm_stats, 0, sizeof(pcm_stats));
+}
+
+esp_err_t i2s_new_channel(const i2s_chan_config_t *chan_cfg, i2s_chan_handle_t *ret_tx_handle, i2s_chan_handle_t *ret_rx_handle)
+{
+    if (chan_cfg == NULL || ret_tx_handle == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct i2s_channel_obj_t *channel = calloc(1, sizeof(struct i2s_channel_obj_t));
+    channel->dma_capacity_frames = chan_cfg->dma_desc_num * chan_cfg->dma_frame_num;
+    *ret_tx_handle = channel;
+    if (ret_rx_handle != NULL)
+    {
+        *ret_rx_handle = NULL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2s_del_channel(i2s_chan_handle_t handle)
+{
+    if (handle->enabled)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    free(handle);
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_init_std_mode(i2s_chan_handle_t handle, const i2s_std_config_t *std_cfg)
+{
+    if (std_cfg->clk_cfg.sample_rate_hz == 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    handle->sample_rate_hz = std_cfg->clk_cfg.sample_rate_hz;
+    handle->bytes_per_frame = (std_cfg->slot_cfg.data_bit_width / 8) * std_cfg->slot_cfg.slot_mode;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_enable(i2s_chan_handle_t handle)
+{
+    if (handle->enabled)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->enabled = true;
+    handle->playing = false;
+    host_pm_driver_lock(true); // Held by the driver until the channel is disabled
+    handle->drained_at_us = host_kernel_now_us();
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_disable(i2s_chan_handle_t handle)
+{
+    if (!handle->enabled)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->enabled = false;
+    host_pm_driver_lock(false);
+    return ESP_OK;
+}
+
+static uint64_t frames_to_us(const struct i2s_channel_obj_t *channel, uint64_t frames)
+{
+    return frames * 1000000ULL / channel->sample_rate_hz;
+}
+
+static void record_samples(const void *src, size_t size)
+{
+    const int16_t *samples = src;
+    size_t count = size / sizeof(int16_t);
+    if (pcm_stats.samples == 0 && count > 0)
+    {
+        pcm_stats.first_sample_us = host_kernel_now_us();
+    }
+    int16_t write_peak = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        int16_t magnitude = samples[i] < 0 ? (int16_t)-(samples[i] + 1) : samples[i];
+        if (magnitude > write_peak)
+        {
+            write_peak = magnitude;
+        }
+    }
+    if (write_peak > pcm_stats.peak)
+    {
+        pcm_stats.peak = write_peak;
+    }
+    pcm_stats.samples += count;
+    pcm_stats.last_write_us = host_kernel_now_us();
+
+    FILE *raw = host_capture_file("pcm.raw");
+    if (raw != NULL)
+    {
+        fwrite(src, 1, size, raw);
+    }
+    FILE *log = host_capture_file("pcm.log");
+    if (log != NULL)
+    {
+        fprintf(log, "%llu %u %d\n", (unsigned long long)host_kernel_now_us(), (unsigned)count, write_peak);
+    }
+}
+
+esp_err_t i2s_channel_write(i2s_chan_handle_t handle, const void *src, size_t size, size_t *bytes_written, uint32_t timeout_ms)
+{
+    if (bytes_written != NULL)
+    {
+        *bytes_written = 0;
+    }
+    if (!handle->enabled)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint64_t now = host_kernel_now_us();
+    if (handle->drained_at_us < now)
+    {
+        // Underrun, playback restarts with this buffer
+        if (handle->playing && handle->callbacks.on_send_q_ovf != NULL)
+        {
+            i2s_event_data_t event = {0};
+            host_kernel_enter_isr();
+            handle->callbacks.on_send_q_ovf(handle, &event, handle->user_data);
+            host_kernel_exit_isr();
+        }
+        handle->drained_at_us = now;
+    }
+    handle->playing = true;
+
+    // Block until the data fits into the DMA ring
+    uint64_t frames = size / handle->bytes_per_frame;
+    uint64_t ring_us = frames_to_us(handle, handle->dma_capacity_frames);
+    uint64_t end_us = handle->drained_at_us + frames_to_us(handle, frames);
+    if (end_us > now + ring_us)
+    {
+        host_kernel_sleep_us(end_us - ring_us - now);
+    }
+
+    handle->drained_at_us = end_us;
+    record_samples(src, size);
+    if (bytes_written != NULL)
+    {
+        *bytes_written = size;
+    }
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_register_event_callback(i2s_chan_handle_t handle, const i2s_event_callbacks_t *callbacks, void *user_data)
+{
+    if (handle->enabled)
+    {
+        return ESP_ERR_INVALID_STATE; // Same rule as the driver
+    }
+    handle->callbacks = *callbacks;
+    handle->user_data = user_data;
+    return ESP_OK;
+}
+
+esp_err_t i2s_channel_preload_data(i2s_chan_handle_t tx_handle, const void *src, size_t size, size_t *bytes_loaded)
+{
+    record_samples(src, size);
+    if (bytes_loaded != NULL)
+    {
+        *bytes_loaded = size;
+    }
+    return ESP_OK;
+}
+
+void host_pcm_get_stats(HostPcmStats *out)
+{
+    *out = pcm_stats;
+}
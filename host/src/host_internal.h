@@ -0,0 +1,63 @@
+#ifndef HOST_INTERNAL_H
+#define HOST_INTERNAL_H
+
+// Shared between the stand-in modules. Every function here expects the
+// simulation lock to be held, which is always the case: the controller thread
+// holds it except while the firmware runs, and a firmware task holds it for as
+// long as it owns the simulated CPU.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define HOST_FOREVER UINT64_MAX
+
+uint64_t host_kernel_now_us(void);
+
+// Let simulated time pass while the caller keeps the CPU (busy-wait, ROM delay)
+void host_kernel_consume_us(uint64_t us);
+
+// Block the caller for a while, other tasks get to run (driver waits, DMA)
+void host_kernel_sleep_us(uint64_t us);
+
+// Interrupt-context events on the simulated timeline
+typedef void (*HostEventFn)(void *arg);
+void host_kernel_schedule_event(uint64_t at_us, HostEventFn fn, void *arg);
+void host_kernel_cancel_events(void *arg);
+bool host_kernel_in_isr(void);
+void host_kernel_enter_isr(void);
+void host_kernel_exit_isr(void); // Switches to a task the interrupt woke, if it outranks the caller
+
+// Deep sleep: stop every task for good, drop pending and future events. Never
+// returns to a calling task.
+void host_kernel_halt(void);
+
+// Model hooks reset by host_sim_init()
+void host_gpio_reset(void);
+void host_i2c_reset(void);
+void host_i2s_reset(void);
+void host_adc_reset(void);
+void host_led_strip_reset(void);
+void host_pm_reset(void);
+void host_uart_reset(void);
+void host_task_wdt_reset(void);
+void host_esp_timer_start_service(void);
+
+// Power management: drivers hold the clock up while a transfer is in flight,
+// the scheduler reports every stretch of time in which no task was ready (up to
+// to_us, with nothing due before wake_us)
+void host_pm_driver_lock(bool acquire);
+void host_pm_idle(uint64_t from_us, uint64_t to_us, uint64_t wake_us);
+
+// Heap for the stand-ins' own bookkeeping, invisible to the heap hooks
+// (host_heap.c): what the chip keeps in static storage or does not have
+void *host_internal_malloc(size_t size);
+void *host_internal_calloc(size_t n, size_t size);
+void *host_internal_realloc(void *ptr, size_t size);
+void host_internal_free(void *ptr);
+
+// Recording sinks, NULL when host_sim_set_capture_dir() was not called
+FILE *host_capture_file(const char *name);
+
+#endif // HOST_INTERNAL_H
@@ -0,0 +1,100 @@
+// led_strip stand-in. Every refresh is recorded as a frame and takes the time
+// the RMT peripheral needs to clock the pixels out.
+
+#include "led_strip.h"
+#include "host_internal.h"
+#include "host_sim.h"
+#include <stdlib.h>
+#include <string.h>
+
+// WS2812: 24 bits of 1.25 us each, plus the 50 us reset gap
+#define WS2812_BIT_NS 1250
+#define WS2812_RESET_US 50
+
+struct led_strip_t
+{
+    uint32_t count;
+    uint8_t pixels[HOST_LED_MAX][3];
+};
+
+static HostLedFrame last_frame;
+static uint32_t frame_count = 0;
+
+void host_led_strip_reset(void)
+{
+    memset(&last_frame, 0, sizeof(last_frame));
+    frame_count = 0;
+}
+
+esp_err_t led_strip_new_rmt_device(const led_strip_config_t *led_config, const led_strip_rmt_config_t *rmt_config,
+                                   led_strip_handle_t *ret_strip)
+{
+    if (led_config == NULL || ret_strip == NULL || led_config->max_leds == 0 || led_config->max_leds > HOST_LED_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct led_strip_t *strip = calloc(1, sizeof(struct led_strip_t));
+    strip->count = led_config->max_leds;
+    *ret_strip = strip;
+    return ESP_OK;
+}
+
+esp_err_t led_strip_set_pixel(led_strip_handle_t strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue)
+{
+    if (index >= strip->count)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    strip->pixels[index][0] = red;
+    strip->pixels[index][1] = green;
+    strip->pixels[index][2] = blue;
+    return ESP_OK;
+}
+
+esp_err_t led_strip_refresh(led_strip_handle_t strip)
+{
+    last_frame.time_us = host_kernel_now_us();
+    last_frame.count = strip->count;
+    memcpy(last_frame.rgb, strip->pixels, sizeof(strip->pixels));
+    frame_count++;
+
+    FILE *log = host_capture_file("led.log");
+    if (log != NULL)
+    {
+        fprintf(log, "%llu", (unsigned long long)last_frame.time_us);
+        for (uint32_t i = 0; i < strip->count; i++)
+        {
+            fprintf(log, " %02x%02x%02x", strip->pixels[i][0], strip->pixels[i][1], strip->pixels[i][2]);
+        }
+        fprintf(log, "\n");
+    }
+
+    // led_strip_refresh() waits for the transfer to finish, the RMT driver
+    // keeps the chip awake meanwhile
+    host_pm_driver_lock(true);
+    host_kernel_sleep_us((uint64_t)strip->count * 24 * WS2812_BIT_NS / 1000 + WS2812_RESET_US);
+    host_pm_driver_lock(false);
+    return ESP_OK;
+}
+
+esp_err_t led_strip_clear(led_strip_handle_t strip)
+{
+    memset(strip->pixels, 0, sizeof(strip->pixels));
+    return led_strip_refresh(strip);
+}
+
+esp_err_t led_strip_del(led_strip_handle_t strip)
+{
+    free(strip);
+    return ESP_OK;
+}
+
+uint32_t host_led_frame_count(void)
+{
+    return frame_count;
+}
+
+const HostLedFrame *host_led_last_frame(void)
+{
+    return &last_frame;
+}
@@ -0,0 +1,180 @@
+// Error helpers, recording files and heap figures.
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "host_internal.h"
+#include "host_sim.h"
+#include "nvs.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CAPTURE_MAX_FILES 8
+
+typedef struct
+{
+    char name[32];
+    FILE *file;
+} CaptureFile;
+
+static char capture_dir[256] = "";
+static CaptureFile capture_files[CAPTURE_MAX_FILES];
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE:
+        return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC:
+        return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_INVALID_VERSION:
+        return "ESP_ERR_INVALID_VERSION";
+    case ESP_ERR_NVS_NOT_INITIALIZED:
+        return "ESP_ERR_NVS_NOT_INITIALIZED";
+    case ESP_ERR_NVS_NOT_FOUND:
+        return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_NVS_TYPE_MISMATCH:
+        return "ESP_ERR_NVS_TYPE_MISMATCH";
+    case ESP_ERR_NVS_NOT_ENOUGH_SPACE:
+        return "ESP_ERR_NVS_NOT_ENOUGH_SPACE";
+    case ESP_ERR_NVS_INVALID_HANDLE:
+        return "ESP_ERR_NVS_INVALID_HANDLE";
+    case ESP_ERR_NVS_KEY_TOO_LONG:
+        return "ESP_ERR_NVS_KEY_TOO_LONG";
+    case ESP_ERR_NVS_INVALID_LENGTH:
+        return "ESP_ERR_NVS_INVALID_LENGTH";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+void host_esp_error_check_failed(esp_err_t rc, const char *file, int line, const char *expression)
+{
+    fprintf(stderr, "ESP_ERROR_CHECK failed: esp_err_t 0x%x (%s) at %s:%d\nexpression: %s\n", rc,
+            esp_err_to_name(rc), file, line, expression);
+    abort();
+}
+
+void host_sim_set_capture_dir(const char *path)
+{
+    for (int i = 0; i < CAPTURE_MAX_FILES; i++)
+    {
+        if (capture_files[i].file != NULL)
+        {
+            fclose(capture_files[i].file);
+            capture_files[i].file = NULL;
+        }
+    }
+    snprintf(capture_dir, sizeof(capture_dir), "%s", path != NULL ? path : "");
+}
+
+FILE *host_capture_file(const char *name)
+{
+    if (capture_dir[0] == '\0')
+    {
+        return NULL;
+    }
+    for (int i = 0; i < CAPTURE_MAX_FILES; i++)
+    {
+        if (capture_files[i].file != NULL && strcmp(capture_files[i].name, name) == 0)
+        {
+            return capture_files[i].file;
+        }
+    }
+    for (int i = 0; i < CAPTURE_MAX_FILES; i++)
+    {
+        if (capture_files[i].file == NULL)
+        {
+            char path[320];
+            snprintf(path, sizeof(path), "%s/%s", capture_dir, name);
+            capture_files[i].file = fopen(path, "wb");
+            if (capture_files[i].file == NULL)
+            {
+                return NULL;
+            }
+            snprintf(capture_files[i].name, sizeof(capture_files[i].name), "%s", name);
+            return capture_files[i].file;
+        }
+    }
+    return NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Heap figures of an idle ESP32 (DRAM heap, DMA-capable part of it)
+
+#define HOST_HEAP_TOTAL 300000
+#define HOST_HEAP_DMA_TOTAL 180000
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    return (caps & MALLOC_CAP_DMA) ? HOST_HEAP_DMA_TOTAL : HOST_HEAP_TOTAL;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps)
+{
+    return heap_caps_get_free_size(caps);
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    return heap_caps_get_free_size(caps) / 2;
+}
+
+size_t heap_caps_get_total_size(uint32_t caps)
+{
+    return heap_caps_get_free_size(caps);
+}
+
+static esp_alloc_failed_hook_t alloc_failed_callback = NULL;
+
+esp_err_t heap_caps_register_failed_alloc_callback(esp_alloc_failed_hook_t callback)
+{
+    if (callback == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    alloc_failed_callback = callback;
+    return ESP_OK;
+}
+
+static void *checked(void *ptr, size_t size, uint32_t caps, const char *function_name)
+{
+    if (ptr == NULL && alloc_failed_callback != NULL)
+    {
+        alloc_failed_callback(size, caps, function_name);
+    }
+    return ptr;
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps)
+{
+    return checked(malloc(size), size, caps, __func__);
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps)
+{
+    return checked(calloc(n, size), n * size, caps, __func__);
+}
+
+void heap_caps_free(void *ptr)
+{
+    free(ptr);
+}
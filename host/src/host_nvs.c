@@ -0,0 +1,339 @@
+// NVS stand-in: a fixed table of typed entries and blobs per namespace, in static
+// storage like the chip's page cache. Writing an entry costs flash time,
+// writing the value it already holds costs nothing (the IDF compares first).
+
+#include "nvs_flash.h"
+#include "nvs.h"
+#include "host_internal.h"
+#include <string.h>
+
+#define NVS_MAX_NAMESPACES 8
+#define NVS_MAX_ENTRIES 64
+#define NVS_WRITE_US 120 // One 32-byte entry to flash, plus the page header update
+#define NVS_BLOB_MAX 128 // Enough for the firmware's blobs, the IDF allows far more
+
+typedef enum {
+    NVS_TYPE_U8 = 1,
+    NVS_TYPE_U16 = 2,
+    NVS_TYPE_U32 = 4,
+    NVS_TYPE_BLOB = 0x42,
+} NvsType;
+
+typedef struct
+{
+    bool used;
+    uint8_t ns; // Index into namespaces[]
+    NvsType type;
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint32_t value;          // Length for a blob
+    uint8_t blob[NVS_BLOB_MAX];
+} NvsEntry;
+
+typedef struct
+{
+    bool used;
+    bool writable;
+    uint8_t ns;
+} NvsOpenHandle;
+
+static bool initialized = false;
+static char namespaces[NVS_MAX_NAMESPACES][NVS_KEY_NAME_MAX_SIZE];
+static NvsEntry entries[NVS_MAX_ENTRIES];
+static NvsOpenHandle handles[NVS_MAX_NAMESPACES]; // Handle n is handles[n - 1]
+
+esp_err_t nvs_flash_init(void)
+{
+    initialized = true;
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    memset(namespaces, 0, sizeof(namespaces));
+    memset(entries, 0, sizeof(entries));
+    memset(handles, 0, sizeof(handles));
+    initialized = false;
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    if (!initialized)
+    {
+        return ESP_ERR_NVS_NOT_INITIALIZED;
+    }
+    if (strlen(namespace_name) >= NVS_KEY_NAME_MAX_SIZE)
+    {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+
+    int ns = -1;
+    for (int i = 0; i < NVS_MAX_NAMESPACES && ns < 0; i++)
+    {
+        if (strcmp(namespaces[i], namespace_name) == 0)
+        {
+            ns = i;
+        }
+    }
+    for (int i = 0; i < NVS_MAX_NAMESPACES && ns < 0; i++)
+    {
+        if (namespaces[i][0] == '\0')
+        {
+            if (open_mode == NVS_READONLY)
+            {
+                return ESP_ERR_NVS_NOT_FOUND;
+            }
+            strcpy(namespaces[i], namespace_name);
+            ns = i;
+        }
+    }
+    if (ns < 0)
+    {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+
+    for (int i = 0; i < NVS_MAX_NAMESPACES; i++)
+    {
+        if (!handles[i].used)
+        {
+            handles[i] = (NvsOpenHandle){true, open_mode == NVS_READWRITE, ns};
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+}
+
+static NvsOpenHandle *find_handle(nvs_handle_t handle)
+{
+    if (handle == 0 || handle > NVS_MAX_NAMESPACES || !handles[handle - 1].used)
+    {
+        return NULL;
+    }
+    return &handles[handle - 1];
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+    NvsOpenHandle *open = find_handle(handle);
+    if (open != NULL)
+    {
+        open->used = false;
+    }
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    // Entries are written by the set calls already
+    return find_handle(handle) != NULL ? ESP_OK : ESP_ERR_NVS_INVALID_HANDLE;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+    NvsOpenHandle *open = find_handle(handle);
+    if (open == NULL || !open->writable)
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    for (int i = 0; i < NVS_MAX_ENTRIES; i++)
+    {
+        if (entries[i].used && entries[i].ns == open->ns)
+        {
+            entries[i].used = false;
+            host_kernel_consume_us(NVS_WRITE_US);
+        }
+    }
+    return ESP_OK;
+}
+
+static NvsEntry *find_entry(uint8_t ns, const char *key)
+{
+    for (int i = 0; i < NVS_MAX_ENTRIES; i++)
+    {
+        if (entries[i].used && entries[i].ns == ns && strcmp(entries[i].key, key) == 0)
+        {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+static esp_err_t get_value(nvs_handle_t handle, const char *key, NvsType type, uint32_t *out_value)
+{
+    NvsOpenHandle *open = find_handle(handle);
+    if (open == NULL)
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    NvsEntry *entry = find_entry(open->ns, key);
+    if (entry == NULL)
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (entry->type != type)
+    {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    *out_value = entry->value;
+    return ESP_OK;
+}
+
+// The entry for a key, a free one if the key is new. NULL when out of space.
+static NvsEntry *claim_entry(uint8_t ns, const char *key)
+{
+    NvsEntry *entry = find_entry(ns, key);
+    for (int i = 0; i < NVS_MAX_ENTRIES && entry == NULL; i++)
+    {
+        if (!entries[i].used)
+        {
+            entry = &entries[i];
+            *entry = (NvsEntry){.used = true, .ns = ns};
+            strcpy(entry->key, key);
+        }
+    }
+    return entry;
+}
+
+static NvsOpenHandle *writable_handle(nvs_handle_t handle, const char *key, esp_err_t *err)
+{
+    NvsOpenHandle *open = find_handle(handle);
+    if (open == NULL || !open->writable)
+    {
+        *err = ESP_ERR_NVS_INVALID_HANDLE;
+        return NULL;
+    }
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE)
+    {
+        *err = ESP_ERR_NVS_KEY_TOO_LONG;
+        return NULL;
+    }
+    return open;
+}
+
+static esp_err_t set_value(nvs_handle_t handle, const char *key, NvsType type, uint32_t value)
+{
+    esp_err_t err;
+    NvsOpenHandle *open = writable_handle(handle, key, &err);
+    if (open == NULL)
+    {
+        return err;
+    }
+
+    NvsEntry *entry = find_entry(open->ns, key);
+    if (entry != NULL && entry->type == type && entry->value == value)
+    {
+        return ESP_OK;
+    }
+    entry = claim_entry(open->ns, key);
+    if (entry == NULL)
+    {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    entry->type = type;
+    entry->value = value;
+    host_kernel_consume_us(NVS_WRITE_US);
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out_value)
+{
+    uint32_t value;
+    esp_err_t err = get_value(handle, key, NVS_TYPE_U8, &value);
+    if (err == ESP_OK)
+    {
+        *out_value = value;
+    }
+    return err;
+}
+
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char *key, uint16_t *out_value)
+{
+    uint32_t value;
+    esp_err_t err = get_value(handle, key, NVS_TYPE_U16, &value);
+    if (err == ESP_OK)
+    {
+        *out_value = value;
+    }
+    return err;
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out_value)
+{
+    return get_value(handle, key, NVS_TYPE_U32, out_value);
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value)
+{
+    return set_value(handle, key, NVS_TYPE_U8, value);
+}
+
+esp_err_t nvs_set_u16(nvs_handle_t handle, const char *key, uint16_t value)
+{
+    return set_value(handle, key, NVS_TYPE_U16, value);
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value)
+{
+    return set_value(handle, key, NVS_TYPE_U32, value);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    NvsOpenHandle *open = find_handle(handle);
+    if (open == NULL)
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    NvsEntry *entry = find_entry(open->ns, key);
+    if (entry == NULL)
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (entry->type != NVS_TYPE_BLOB)
+    {
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+    }
+    if (out_value == NULL)
+    {
+        *length = entry->value;
+        return ESP_OK;
+    }
+    if (*length < entry->value)
+    {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out_value, entry->blob, entry->value);
+    *length = entry->value;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    esp_err_t err;
+    NvsOpenHandle *open = writable_handle(handle, key, &err);
+    if (open == NULL)
+    {
+        return err;
+    }
+    if (length > NVS_BLOB_MAX)
+    {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    NvsEntry *entry = find_entry(open->ns, key);
+    if (entry != NULL && entry->type == NVS_TYPE_BLOB && entry->value == length &&
+        memcmp(entry->blob, value, length) == 0)
+    {
+        return ESP_OK;
+    }
+    entry = claim_entry(open->ns, key);
+    if (entry == NULL)
+    {
+        return ESP_ERR_NVS_NOT_ENOUGH_SPACE;
+    }
+    entry->type = NVS_TYPE_BLOB;
+    entry->value = length;
+    memcpy(entry->blob, value, length);
+    host_kernel_consume_us(NVS_WRITE_US * (1 + length / 32)); // One entry per 32 bytes
+    return ESP_OK;
+}
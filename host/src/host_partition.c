@@ -0,0 +1,97 @@
+// Partition stand-in: data partitions filled from files before the firmware
+// starts, erased flash (0xFF) past the end of the file.
+
+#include "esp_partition.h"
+#include "host_internal.h"
+#include "host_sim.h"
+#include <string.h>
+
+#define PARTITION_MAX 4
+#define PARTITION_BASE 0x110000 // After the factory app of partitions.csv
+
+typedef struct
+{
+    esp_partition_t info;
+    uint8_t *data;
+} HostPartition;
+
+static HostPartition partitions[PARTITION_MAX];
+static int partition_count = 0;
+
+bool host_sim_load_partition(const char *label, int subtype, uint32_t size, const char *path)
+{
+    if (partition_count == PARTITION_MAX || strlen(label) >= sizeof(partitions[0].info.label))
+    {
+        return false;
+    }
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    HostPartition *partition = &partitions[partition_count];
+    partition->data = host_internal_malloc(size);
+    memset(partition->data, 0xff, size);
+    size_t read = fread(partition->data, 1, size, file);
+    bool fits = fgetc(file) == EOF;
+    fclose(file);
+    if (!fits)
+    {
+        fprintf(stderr, "%s does not fit the %u byte partition %s\n", path, (unsigned)size, label);
+        host_internal_free(partition->data);
+        return false;
+    }
+
+    uint32_t address = PARTITION_BASE;
+    for (int i = 0; i < partition_count; i++)
+    {
+        address += partitions[i].info.size;
+    }
+    partition->info = (esp_partition_t){.type = ESP_PARTITION_TYPE_DATA, .subtype = subtype, .address = address,
+                                        .size = size};
+    strcpy(partition->info.label, label);
+    partition_count++;
+    (void)read;
+    return true;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label)
+{
+    for (int i = 0; i < partition_count && i < PARTITION_MAX; i++)
+    {
+        const esp_partition_t *info = &partitions[i].info;
+        if ((type == ESP_PARTITION_TYPE_ANY || info->type == type) &&
+            (subtype == ESP_PARTITION_SUBTYPE_ANY || info->subtype == subtype) &&
+            (label == NULL || strcmp(info->label, label) == 0))
+        {
+            return info;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *partition, size_t offset, size_t size,
+                             esp_partition_mmap_memory_t memory, const void **out_ptr,
+                             esp_partition_mmap_handle_t *out_handle)
+{
+    for (int i = 0; i < partition_count; i++)
+    {
+        if (&partitions[i].info == partition)
+        {
+            if (offset + size > partition->size)
+            {
+                return ESP_ERR_INVALID_ARG;
+            }
+            *out_ptr = partitions[i].data + offset;
+            *out_handle = i + 1;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle)
+{
+}
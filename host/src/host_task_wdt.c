@@ -0,0 +1,165 @@
+// Task watchdog stand-in: one expiry event on the simulated timeline for the
+// entry that was reset longest ago, moved whenever an entry is reset.
+
+#include "esp_task_wdt.h"
+#include "host_internal.h"
+#include "sdkconfig.h"
+#include <stdio.h>
+#include <string.h>
+
+#define TWDT_MAX_ENTRIES 16
+#define TWDT_TIMEOUT_US ((uint64_t)CONFIG_ESP_TASK_WDT_TIMEOUT_S * 1000000)
+
+struct esp_task_wdt_user_handle_s
+{
+    bool used;
+    TaskHandle_t task; // NULL for a user
+    const char *name;
+    uint64_t reset_us;
+};
+
+static struct esp_task_wdt_user_handle_s entries[TWDT_MAX_ENTRIES];
+static char expiry_event; // Address the expiry event is scheduled with
+
+static void twdt_expired(void *arg);
+
+static void schedule_expiry(void)
+{
+    host_kernel_cancel_events(&expiry_event);
+    uint64_t oldest = HOST_FOREVER;
+    for (int i = 0; i < TWDT_MAX_ENTRIES; i++)
+    {
+        if (entries[i].used && entries[i].reset_us < oldest)
+        {
+            oldest = entries[i].reset_us;
+        }
+    }
+    if (oldest != HOST_FOREVER)
+    {
+        host_kernel_schedule_event(oldest + TWDT_TIMEOUT_US, twdt_expired, &expiry_event);
+    }
+}
+
+static void twdt_expired(void *arg)
+{
+    uint64_t now = host_kernel_now_us();
+    printf("E (%llu) task_wdt: Task watchdog got triggered. The following tasks/users did not reset the watchdog in "
+           "time:\n", (unsigned long long)(now / 1000));
+    for (int i = 0; i < TWDT_MAX_ENTRIES; i++)
+    {
+        if (entries[i].used && now - entries[i].reset_us >= TWDT_TIMEOUT_US)
+        {
+            printf("E (%llu) task_wdt:  - %s\n", (unsigned long long)(now / 1000), entries[i].name);
+        }
+    }
+    printf("E (%llu) task_wdt: Aborting.\n", (unsigned long long)(now / 1000));
+    host_kernel_halt(); // The chip would reset here
+}
+
+static esp_err_t add_entry(TaskHandle_t task, const char *name, esp_task_wdt_user_handle_t *handle)
+{
+    for (int i = 0; i < TWDT_MAX_ENTRIES; i++)
+    {
+        if (!entries[i].used)
+        {
+            entries[i] = (struct esp_task_wdt_user_handle_s){true, task, name, host_kernel_now_us()};
+            if (handle != NULL)
+            {
+                *handle = &entries[i];
+            }
+            schedule_expiry();
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+static struct esp_task_wdt_user_handle_s *find_task(TaskHandle_t task)
+{
+    if (task == NULL)
+    {
+        task = xTaskGetCurrentTaskHandle();
+    }
+    for (int i = 0; i < TWDT_MAX_ENTRIES; i++)
+    {
+        if (entries[i].used && entries[i].task == task)
+        {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_task_wdt_add(TaskHandle_t task_handle)
+{
+    if (task_handle == NULL)
+    {
+        task_handle = xTaskGetCurrentTaskHandle();
+    }
+    if (find_task(task_handle) != NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return add_entry(task_handle, pcTaskGetName(task_handle), NULL);
+}
+
+esp_err_t esp_task_wdt_reset(void)
+{
+    struct esp_task_wdt_user_handle_s *entry = find_task(NULL);
+    if (entry == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    entry->reset_us = host_kernel_now_us();
+    schedule_expiry();
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_delete(TaskHandle_t task_handle)
+{
+    struct esp_task_wdt_user_handle_s *entry = find_task(task_handle);
+    if (entry == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    entry->used = false;
+    schedule_expiry();
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_add_user(const char *user_name, esp_task_wdt_user_handle_t *user_handle_ret)
+{
+    if (user_name == NULL || user_handle_ret == NULL)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return add_entry(NULL, user_name, user_handle_ret);
+}
+
+esp_err_t esp_task_wdt_reset_user(esp_task_wdt_user_handle_t user_handle)
+{
+    if (user_handle == NULL || !user_handle->used)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    user_handle->reset_us = host_kernel_now_us();
+    schedule_expiry();
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_delete_user(esp_task_wdt_user_handle_t user_handle)
+{
+    if (user_handle == NULL || !user_handle->used)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    user_handle->used = false;
+    schedule_expiry();
+    return ESP_OK;
+}
+
+void host_task_wdt_reset(void)
+{
+    host_kernel_cancel_events(&expiry_event);
+    memset(entries, 0, sizeof(entries));
+}
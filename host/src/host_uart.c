@@ -0,0 +1,338 @@
+// UART stand-in. Bytes from the outside (host_uart_send()) arrive at the
+// configured baud rate and are announced the way the driver does: a UART_DATA
+// event once the RX FIFO reaches its full threshold, or once the line has been
+// idle for the RX timeout. What the firmware writes is kept with the time its
+// last bit leaves the pin, host_uart_receive() only hands out bytes that did.
+// Both directions go to uart.log (time, direction, port, hex).
+
+#include "driver/uart.h"
+#include "host_internal.h"
+#include "host_sim.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BITS_PER_BYTE 10       // 8N1
+#define RX_FULL_THRESHOLD 120  // Driver default of the FIFO full interrupt
+#define RX_TIMEOUT_SYMBOLS 10  // Line idle this many byte times ends a chunk
+#define TX_FIFO_SIZE 128
+
+typedef struct
+{
+    int port;
+    size_t size;
+    uint8_t data[RX_FULL_THRESHOLD];
+} RxChunk;
+
+typedef struct
+{
+    bool installed;
+    uint32_t baud_rate;
+    QueueHandle_t queue;
+
+    uint8_t *rx_buffer; // Ring the driver copies the FIFO into
+    size_t rx_capacity;
+    size_t rx_head;
+    size_t rx_count;
+    uint64_t rx_line_free_us; // When the last byte sent to the firmware has arrived
+
+    uint8_t *tx_data;         // Written by the firmware, not yet taken by host_uart_receive()
+    uint64_t *tx_done_us;     // When each of those bytes has left the pin
+    size_t tx_count;
+    size_t tx_capacity;
+    uint64_t tx_line_free_us;
+} HostUart;
+
+static HostUart uarts[UART_NUM_MAX];
+
+static void free_port(HostUart *uart)
+{
+    free(uart->rx_buffer);
+    host_internal_free(uart->tx_data);
+    host_internal_free(uart->tx_done_us);
+    memset(uart, 0, sizeof(*uart));
+    uart->baud_rate = 115200;
+}
+
+void host_uart_reset(void)
+{
+    for (int i = 0; i < UART_NUM_MAX; i++)
+    {
+        free_port(&uarts[i]);
+    }
+}
+
+static uint64_t byte_us(const HostUart *uart)
+{
+    return (BITS_PER_BYTE * 1000000ULL + uart->baud_rate - 1) / uart->baud_rate;
+}
+
+static void log_bytes(const char *direction, int port, const uint8_t *data, size_t size)
+{
+    FILE *log = host_capture_file("uart.log");
+    if (log == NULL)
+    {
+        return;
+    }
+    fprintf(log, "%llu %s %d ", (unsigned long long)host_kernel_now_us(), direction, port);
+    for (size_t i = 0; i < size; i++)
+    {
+        fprintf(log, "%02x", data[i]);
+    }
+    fputc('\n', log);
+}
+
+static bool valid_port(uart_port_t uart_num)
+{
+    return uart_num >= 0 && uart_num < UART_NUM_MAX;
+}
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size, int queue_size, QueueHandle_t *uart_queue, int intr_alloc_flags)
+{
+    if (!valid_port(uart_num) || rx_buffer_size <= TX_FIFO_SIZE)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    HostUart *uart = &uarts[uart_num];
+    if (uart->installed)
+    {
+        return ESP_FAIL;
+    }
+    uart->installed = true;
+    uart->rx_buffer = malloc(rx_buffer_size);
+    uart->rx_capacity = rx_buffer_size;
+    uart->rx_line_free_us = host_kernel_now_us();
+    uart->tx_line_free_us = host_kernel_now_us();
+    if (uart_queue != NULL && queue_size > 0)
+    {
+        uart->queue = xQueueCreate(queue_size, sizeof(uart_event_t));
+        *uart_queue = uart->queue;
+    }
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_delete(uart_port_t uart_num)
+{
+    if (!valid_port(uart_num) || !uarts[uart_num].installed)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    free_port(&uarts[uart_num]);
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t *uart_config)
+{
+    if (!valid_port(uart_num) || uart_config->baud_rate <= 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uarts[uart_num].baud_rate = uart_config->baud_rate;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num, int rts_io_num, int cts_io_num)
+{
+    return valid_port(uart_num) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+static void post_event(HostUart *uart, uart_event_type_t type, size_t size, bool timeout)
+{
+    if (uart->queue == NULL)
+    {
+        return;
+    }
+    uart_event_t event = {.type = type, .size = size, .timeout_flag = timeout};
+    BaseType_t woken = pdFALSE;
+    xQueueSendFromISR(uart->queue, &event, &woken);
+}
+
+static void rx_chunk_arrived(void *arg)
+{
+    RxChunk *chunk = arg;
+    HostUart *uart = &uarts[chunk->port];
+    if (!uart->installed)
+    {
+        host_internal_free(chunk);
+        return;
+    }
+
+    host_kernel_enter_isr();
+    size_t room = uart->rx_capacity - uart->rx_count;
+    size_t stored = chunk->size < room ? chunk->size : room;
+    for (size_t i = 0; i < stored; i++)
+    {
+        uart->rx_buffer[(uart->rx_head + uart->rx_count + i) % uart->rx_capacity] = chunk->data[i];
+    }
+    uart->rx_count += stored;
+    if (stored < chunk->size)
+    {
+        post_event(uart, UART_BUFFER_FULL, 0, false); // The rest is lost, as on the chip
+    }
+    else
+    {
+        post_event(uart, UART_DATA, stored, chunk->size < RX_FULL_THRESHOLD);
+    }
+    host_internal_free(chunk);
+    host_kernel_exit_isr();
+}
+
+void host_uart_send(int port, const uint8_t *data, size_t size)
+{
+    if (port < 0 || port >= UART_NUM_MAX || size == 0)
+    {
+        return;
+    }
+    HostUart *uart = &uarts[port];
+    log_bytes("rx", port, data, size);
+
+    uint64_t now = host_kernel_now_us();
+    uint64_t start = uart->rx_line_free_us > now ? uart->rx_line_free_us : now;
+    for (size_t offset = 0; offset < size; offset += RX_FULL_THRESHOLD)
+    {
+        RxChunk *chunk = host_internal_calloc(1, sizeof(RxChunk));
+        chunk->port = port;
+        chunk->size = size - offset < RX_FULL_THRESHOLD ? size - offset : RX_FULL_THRESHOLD;
+        memcpy(chunk->data, data + offset, chunk->size);
+
+        uint64_t arrived = start + (offset + chunk->size) * byte_us(uart);
+        uint64_t announce = chunk->size < RX_FULL_THRESHOLD ? arrived + RX_TIMEOUT_SYMBOLS * byte_us(uart) : arrived;
+        host_kernel_schedule_event(announce, rx_chunk_arrived, chunk);
+    }
+    uart->rx_line_free_us = start + size * byte_us(uart);
+}
+
+size_t host_uart_receive(int port, uint8_t *data, size_t max)
+{
+    if (port < 0 || port >= UART_NUM_MAX)
+    {
+        return 0;
+    }
+    HostUart *uart = &uarts[port];
+    uint64_t now = host_kernel_now_us();
+    size_t count = 0;
+    while (count < max && count < uart->tx_count && uart->tx_done_us[count] <= now)
+    {
+        count++;
+    }
+    memcpy(data, uart->tx_data, count);
+    memmove(uart->tx_data, uart->tx_data + count, uart->tx_count - count);
+    memmove(uart->tx_done_us, uart->tx_done_us + count, (uart->tx_count - count) * sizeof(uint64_t));
+    uart->tx_count -= count;
+    return count;
+}
+
+static uint64_t ticks_to_us(TickType_t ticks)
+{
+    return ticks == portMAX_DELAY ? HOST_FOREVER : (uint64_t)ticks * (1000000ULL / configTICK_RATE_HZ);
+}
+
+int uart_read_bytes(uart_port_t uart_num, void *buf, uint32_t length, TickType_t ticks_to_wait)
+{
+    if (!valid_port(uart_num) || !uarts[uart_num].installed)
+    {
+        return -1;
+    }
+    HostUart *uart = &uarts[uart_num];
+    uint64_t deadline = ticks_to_us(ticks_to_wait);
+    if (deadline != HOST_FOREVER)
+    {
+        deadline += host_kernel_now_us();
+    }
+
+    // The driver blocks on its ring buffer, a tick at a time is close enough
+    while (uart->rx_count < length && host_kernel_now_us() < deadline)
+    {
+        uint64_t step = ticks_to_us(1);
+        uint64_t left = deadline - host_kernel_now_us();
+        host_kernel_sleep_us(step < left ? step : left);
+    }
+
+    size_t count = uart->rx_count < length ? uart->rx_count : length;
+    uint8_t *out = buf;
+    for (size_t i = 0; i < count; i++)
+    {
+        out[i] = uart->rx_buffer[(uart->rx_head + i) % uart->rx_capacity];
+    }
+    uart->rx_head = (uart->rx_head + count) % uart->rx_capacity;
+    uart->rx_count -= count;
+    return (int)count;
+}
+
+int uart_write_bytes(uart_port_t uart_num, const void *src, size_t size)
+{
+    if (!valid_port(uart_num) || !uarts[uart_num].installed)
+    {
+        return -1;
+    }
+    HostUart *uart = &uarts[uart_num];
+    if (uart->tx_count + size > uart->tx_capacity)
+    {
+        uart->tx_capacity = (uart->tx_count + size) * 2;
+        uart->tx_data = host_internal_realloc(uart->tx_data, uart->tx_capacity);
+        uart->tx_done_us = host_internal_realloc(uart->tx_done_us, uart->tx_capacity * sizeof(uint64_t));
+    }
+
+    uint64_t now = host_kernel_now_us();
+    uint64_t start = uart->tx_line_free_us > now ? uart->tx_line_free_us : now;
+    for (size_t i = 0; i < size; i++)
+    {
+        uart->tx_data[uart->tx_count + i] = ((const uint8_t *)src)[i];
+        uart->tx_done_us[uart->tx_count + i] = start + (i + 1) * byte_us(uart);
+    }
+    uart->tx_count += size;
+    uart->tx_line_free_us = start + size * byte_us(uart);
+    log_bytes("tx", uart_num, src, size);
+
+    // Without a TX ring buffer the call returns once the rest fits into the FIFO
+    uint64_t fifo_us = TX_FIFO_SIZE * byte_us(uart);
+    if (uart->tx_line_free_us > now + fifo_us)
+    {
+        host_kernel_sleep_us(uart->tx_line_free_us - fifo_us - now);
+    }
+    return (int)size;
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t uart_num, TickType_t ticks_to_wait)
+{
+    if (!valid_port(uart_num) || !uarts[uart_num].installed)
+    {
+        return ESP_FAIL;
+    }
+    HostUart *uart = &uarts[uart_num];
+    uint64_t now = host_kernel_now_us();
+    if (uart->tx_line_free_us <= now)
+    {
+        return ESP_OK;
+    }
+    uint64_t wait = uart->tx_line_free_us - now;
+    uint64_t limit = ticks_to_us(ticks_to_wait);
+    host_kernel_sleep_us(wait < limit ? wait : limit);
+    return wait <= limit ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t uart_flush_input(uart_port_t uart_num)
+{
+    if (!valid_port(uart_num) || !uarts[uart_num].installed)
+    {
+        return ESP_FAIL;
+    }
+    uarts[uart_num].rx_head = 0;
+    uarts[uart_num].rx_count = 0;
+    return ESP_OK;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t *size)
+{
+    if (!valid_port(uart_num) || !uarts[uart_num].installed)
+    {
+        return ESP_FAIL;
+    }
+    *size = uarts[uart_num].rx_count;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_wakeup_threshold(uart_port_t uart_num, int wakeup_threshold)
+{
+    // Light sleep is not modelled deep enough to lose bytes, so any threshold wakes in time
+    return valid_port(uart_num) && wakeup_threshold > 2 && wakeup_threshold < 1024 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
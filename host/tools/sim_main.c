@@ -0,0 +1,408 @@
+// Runs the firmware on the host with scripted input.
+//
+// Script lines are "<time_ms> <command> [arguments]", sorted by time, '#'
+// starts a comment. Pins are GPIO numbers or POWER, ENTER, BACK, UP, DOWN, IR.
+//
+//   8000 press DOWN 150     press a button for 150 ms
+//   9000 gpio IR 1          drive an input level
+//   9500 echo 12.5          HC-SR04 distance in cm, negative for no echo
+//   10000 i2c_fail 3        the next 3 I2C transactions time out
+//   11000 light 3200        ambient light sensor, raw ADC level 0-4095
+//   11000 light_curve d.txt replay "<ms> <raw>" lines from now on
+//   12000 show              print the LCD, the LED strip and the counters
+//
+// With --uart-socket the remote UART is bridged to a Unix socket, for
+// tools/remote_client.py --socket. The simulation then runs no faster than
+// real time, so a client's timeouts mean the same as on the chip.
+//
+// With --melodies, the file is the "melodies" data partition (RTTTL lines,
+// see melody_control.h).
+//
+// With --capture, alloc.log gets a "<time_us> <subsystem> <bytes>" line for
+// every allocation the firmware makes after boot (tools/run_scenarios.py
+// checks them against "expect allocs"), and fastpath.log the presence fast
+// path figures at the end of the run, "<events> <over budget> <max_us>
+// <budget_us>" (checked against "expect fastpath").
+
+#include "host_sim.h"
+#include "gpio_control.h"
+#include "remote_control.h"
+#include "board_control.h"
+#include "alloc_control.h"
+#include "melody_control.h"
+#include "rgb_led_control.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define IR_SENSOR_PIN BOARD_IR_GPIO
+#define US_TRIG_PIN BOARD_US_TRIG_GPIO
+#define US_ECHO_PIN BOARD_US_ECHO_GPIO
+#define AMBIENT_PIN BOARD_AMBIENT_GPIO
+
+// Simulated time between two looks at the socket
+#define BRIDGE_STEP_US 1000
+
+void app_main(void);
+
+static FILE *alloc_log = NULL;
+
+static int bridge_listener = -1;
+static int bridge_client = -1;
+static uint64_t bridge_start_ns; // Wall clock at simulated time 0
+
+static uint64_t wall_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+static int bridge_open(const char *path)
+{
+    struct sockaddr_un address = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "%s: socket path too long\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+    unlink(path);
+    bridge_listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (bridge_listener < 0 || bind(bridge_listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(bridge_listener, 1) != 0)
+    {
+        perror(path);
+        return -1;
+    }
+    fcntl(bridge_listener, F_SETFL, O_NONBLOCK);
+    bridge_start_ns = wall_ns() - host_sim_now_us() * 1000ULL;
+    return 0;
+}
+
+// Move bytes both ways between the socket and the remote UART
+static void bridge_poll(void)
+{
+    if (bridge_client < 0)
+    {
+        bridge_client = accept(bridge_listener, NULL, NULL);
+        if (bridge_client < 0)
+        {
+            return;
+        }
+        fcntl(bridge_client, F_SETFL, O_NONBLOCK);
+    }
+
+    uint8_t buffer[256];
+    ssize_t count = read(bridge_client, buffer, sizeof(buffer));
+    if (count > 0)
+    {
+        host_uart_send(REMOTE_UART_NUM, buffer, count);
+    }
+    else if (count == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+        close(bridge_client); // Disconnected, wait for the next client
+        bridge_client = -1;
+        return;
+    }
+
+    size_t pending;
+    while ((pending = host_uart_receive(REMOTE_UART_NUM, buffer, sizeof(buffer))) > 0)
+    {
+        if (write(bridge_client, buffer, pending) < 0)
+        {
+            break;
+        }
+    }
+}
+
+// Every advance of the simulated clock goes through here
+static void run_until_us(uint64_t at_us)
+{
+    if (bridge_listener < 0)
+    {
+        if (at_us > host_sim_now_us())
+        {
+            host_sim_run_for_us(at_us - host_sim_now_us());
+        }
+        return;
+    }
+    while (host_sim_now_us() < at_us)
+    {
+        uint64_t step = at_us - host_sim_now_us() < BRIDGE_STEP_US ? at_us - host_sim_now_us() : BRIDGE_STEP_US;
+        host_sim_run_for_us(step);
+        bridge_poll();
+        uint64_t due_ns = bridge_start_ns + host_sim_now_us() * 1000ULL;
+        uint64_t now_ns = wall_ns();
+        if (due_ns > now_ns)
+        {
+            struct timespec pause = {.tv_sec = (due_ns - now_ns) / 1000000000ULL,
+                                     .tv_nsec = (due_ns - now_ns) % 1000000000ULL};
+            nanosleep(&pause, NULL);
+        }
+    }
+}
+
+static int parse_pin(const char *text)
+{
+    static const struct {
+        const char *name;
+        int pin;
+    } names[] = {
+        {"POWER", POWER_BUTTON_GPIO}, {"ENTER", ENTER_BUTTON_GPIO}, {"BACK", BACK_BUTTON_GPIO},
+        {"UP", UP_BUTTON_GPIO},       {"DOWN", DOWN_BUTTON_GPIO},   {"IR", IR_SENSOR_PIN},
+    };
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+    {
+        if (strcasecmp(text, names[i].name) == 0)
+        {
+            return names[i].pin;
+        }
+    }
+    return atoi(text);
+}
+
+static void show_state(void)
+{
+    printf("[%8.3f ms] LCD |%s|%s| frames %u%s\n", host_sim_now_us() / 1000.0, host_lcd_line(0), host_lcd_line(1),
+           host_lcd_frame_count(), host_lcd_backlight() ? "" : ", backlight off");
+
+    const HostLedFrame *frame = host_led_last_frame();
+    printf("             LED frames %u, last:", host_led_frame_count());
+    for (uint32_t i = 0; i < frame->count; i++)
+    {
+        printf(" %02x%02x%02x", frame->rgb[i][0], frame->rgb[i][1], frame->rgb[i][2]);
+    }
+    printf("\n");
+
+    HostI2cStats i2c;
+    host_i2c_get_stats(&i2c);
+    HostPcmStats pcm;
+    host_pcm_get_stats(&pcm);
+    printf("             I2C %u transactions, %u bytes, %llu us on the bus; PCM %llu samples, peak %d\n",
+           i2c.transactions, i2c.bytes, (unsigned long long)i2c.bus_time_us, (unsigned long long)pcm.samples,
+           pcm.peak);
+
+    HostPmStats pm;
+    host_pm_get_stats(&pm);
+    printf("             Light sleep %u times, %llu ms asleep\n", pm.sleeps, (unsigned long long)(pm.sleep_us / 1000));
+    if (pm.deep_sleep)
+    {
+        printf("             Deep sleep since %.3f ms, ext0 GPIO %d, ext1 mask 0x%llx\n", pm.deep_sleep_at_us / 1000.0,
+               pm.ext0_gpio, (unsigned long long)pm.ext1_mask);
+    }
+}
+
+static int run_script(FILE *script)
+{
+    char line[512];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), script) != NULL)
+    {
+        line_number++;
+        char *comment = strchr(line, '#');
+        if (comment != NULL)
+        {
+            *comment = '\0';
+        }
+
+        double time_ms;
+        char command[32], arg1[256] = "", arg2[32] = "";
+        int fields = sscanf(line, "%lf %31s %255s %31s", &time_ms, command, arg1, arg2);
+        if (fields <= 0)
+        {
+            continue;
+        }
+        if (fields < 2)
+        {
+            fprintf(stderr, "line %d: expected \"<time_ms> <command>\"\n", line_number);
+            return 1;
+        }
+
+        run_until_us((uint64_t)(time_ms * 1000.0));
+
+        if (strcmp(command, "press") == 0)
+        {
+            int hold_ms = fields >= 4 ? atoi(arg2) : 150;
+            host_button_press(parse_pin(arg1), host_sim_now_us(), (uint64_t)hold_ms * 1000);
+        }
+        else if (strcmp(command, "gpio") == 0 && fields >= 4)
+        {
+            host_gpio_set_input(parse_pin(arg1), atoi(arg2));
+        }
+        else if (strcmp(command, "echo") == 0 && fields >= 3)
+        {
+            host_echo_set_distance_cm(atof(arg1));
+        }
+        else if (strcmp(command, "i2c_fail") == 0 && fields >= 3)
+        {
+            host_i2c_fail_next(atoi(arg1));
+        }
+        else if (strcmp(command, "light") == 0 && fields >= 3)
+        {
+            host_adc_set_input(AMBIENT_PIN, atoi(arg1));
+        }
+        else if (strcmp(command, "light_curve") == 0 && fields >= 3)
+        {
+            if (!host_adc_replay(AMBIENT_PIN, arg1))
+            {
+                fprintf(stderr, "line %d: cannot replay light curve \"%s\"\n", line_number, arg1);
+                return 1;
+            }
+        }
+        else if (strcmp(command, "show") == 0)
+        {
+            show_state();
+        }
+        else
+        {
+            fprintf(stderr, "line %d: unknown command \"%s\"\n", line_number, command);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void log_alloc(AllocTag tag, size_t size)
+{
+    fprintf(alloc_log, "%llu %s %zu\n", (unsigned long long)host_sim_now_us(), alloc_tag_name(tag), size);
+}
+
+static int write_fast_path(const char *capture_dir)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/fastpath.log", capture_dir);
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        perror(path);
+        return 2;
+    }
+    FastPathStats stats;
+    rgb_led_control_get_fast_path_stats(&stats);
+    fprintf(file, "%lu %lu %lld %d\n", (unsigned long)stats.count, (unsigned long)stats.over_budget,
+            (long long)stats.max_us, RGB_LED_FAST_PATH_BUDGET_US);
+    fclose(file);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    double duration_ms = 10000;
+    const char *script_path = NULL;
+    const char *capture_dir = NULL;
+    const char *uart_socket = NULL;
+    const char *melodies_path = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--duration-ms") == 0 && i + 1 < argc)
+        {
+            duration_ms = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc)
+        {
+            script_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+        {
+            capture_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--uart-socket") == 0 && i + 1 < argc)
+        {
+            uart_socket = argv[++i];
+        }
+        else if (strcmp(argv[i], "--melodies") == 0 && i + 1 < argc)
+        {
+            melodies_path = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr,
+                    "usage: %s [--duration-ms N] [--script FILE] [--capture DIR] [--uart-socket PATH] "
+                    "[--melodies FILE]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    host_sim_init();
+    if (melodies_path != NULL &&
+        !host_sim_load_partition(MELODY_PARTITION_LABEL, MELODY_PARTITION_SUBTYPE, MELODY_PARTITION_SIZE,
+                                 melodies_path))
+    {
+        fprintf(stderr, "cannot load %s\n", melodies_path);
+        return 2;
+    }
+    if (capture_dir != NULL)
+    {
+        host_sim_set_capture_dir(capture_dir);
+        char path[512];
+        snprintf(path, sizeof(path), "%s/alloc.log", capture_dir);
+        alloc_log = fopen(path, "w");
+        if (alloc_log == NULL)
+        {
+            perror(path);
+            return 2;
+        }
+        alloc_set_sink(log_alloc);
+    }
+
+    // Idle hardware: buttons released (pulled up), no motion, nothing in front of the sensor
+    const int buttons[] = {POWER_BUTTON_GPIO, ENTER_BUTTON_GPIO, BACK_BUTTON_GPIO, UP_BUTTON_GPIO, DOWN_BUTTON_GPIO};
+    for (size_t i = 0; i < sizeof(buttons) / sizeof(buttons[0]); i++)
+    {
+        host_gpio_set_input(buttons[i], 1);
+    }
+    host_gpio_set_input(IR_SENSOR_PIN, 0);
+    host_echo_attach(US_TRIG_PIN, US_ECHO_PIN);
+    host_echo_set_distance_cm(200.0f);
+
+    host_sim_start(app_main);
+    if (uart_socket != NULL && bridge_open(uart_socket) != 0)
+    {
+        return 2;
+    }
+
+    if (script_path != NULL)
+    {
+        FILE *script = fopen(script_path, "r");
+        if (script == NULL)
+        {
+            perror(script_path);
+            return 2;
+        }
+        int result = run_script(script);
+        fclose(script);
+        if (result != 0)
+        {
+            return result;
+        }
+    }
+
+    run_until_us((uint64_t)(duration_ms * 1000.0));
+    show_state();
+    host_sim_set_capture_dir(NULL); // Flush the recordings
+    if (alloc_log != NULL)
+    {
+        alloc_set_sink(NULL);
+        fclose(alloc_log);
+    }
+    if (capture_dir != NULL && write_fast_path(capture_dir) != 0)
+    {
+        return 2;
+    }
+    if (uart_socket != NULL)
+    {
+        unlink(uart_socket);
+    }
+    fflush(stdout);
+    return 0;
+}
@@ -0,0 +1,59 @@
+#ifndef ALLOC_CONTROL_H
+#define ALLOC_CONTROL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "sdkconfig.h"
+
+// Subsystem an allocation is charged to, by the task that made it
+typedef enum {
+    ALLOC_TAG_BOOT,    // Boot workers, and the main task until boot is done
+    ALLOC_TAG_UI,      // Main task after boot: buttons, menu, LCD
+    ALLOC_TAG_LED,     // LED task: frames and effects
+    ALLOC_TAG_AUDIO,   // Speaker task
+    ALLOC_TAG_SENSORS, // Ultrasonic task and esp_timer callbacks (PIR hold, ranging)
+    ALLOC_TAG_REMOTE,  // Remote UART task
+    ALLOC_TAG_DIAG,    // Profiler and log drain
+    ALLOC_TAG_SYSTEM,  // Everything else: IDF tasks, timer service, before the scheduler
+    ALLOC_TAG_COUNT,
+} AllocTag;
+
+typedef struct {
+    uint32_t count;        // Allocations since boot
+    uint32_t bytes;        // Bytes requested by them
+    uint32_t frees;
+    uint32_t failures;     // Requests the heap could not satisfy
+    uint32_t steady_count; // Allocations since alloc_control_mark_steady()
+    uint32_t steady_bytes;
+} AllocStats;
+
+// Sees every allocation after boot, in the context that made it. Must not
+// allocate or block.
+typedef void (*AllocSink)(AllocTag tag, size_t size);
+
+#if CONFIG_SUPER_LIGHTS_ALLOC_TRACKER
+
+// Register the failed allocation callback, the heap hooks work from the start
+void alloc_control_init(void);
+
+// Boot is done: from now on every allocation counts as steady state
+void alloc_control_mark_steady(void);
+
+void alloc_get_stats(AllocTag tag, AllocStats *stats);
+const char *alloc_tag_name(AllocTag tag);
+void alloc_set_sink(AllocSink sink);
+void alloc_print_stats(void);
+
+#else
+
+// Compiled out (CONFIG_SUPER_LIGHTS_ALLOC_TRACKER)
+static inline void alloc_control_init(void) {}
+static inline void alloc_control_mark_steady(void) {}
+static inline void alloc_get_stats(AllocTag tag, AllocStats *stats) { memset(stats, 0, sizeof(*stats)); }
+static inline void alloc_set_sink(AllocSink sink) {}
+static inline void alloc_print_stats(void) {}
+
+#endif
+
+#endif // ALLOC_CONTROL_H
@@ -0,0 +1,53 @@
+#ifndef AMBIENT_CONTROL_H
+#define AMBIENT_CONTROL_H
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+// Ambient light level: the ADC's 12 bits oversampled to 16 (0-65535). Shift
+// right by AMBIENT_EXTRA_BITS for the ADC's own scale.
+#define AMBIENT_LEVEL_MAX 65535
+#define AMBIENT_EXTRA_BITS 4
+
+#if CONFIG_SUPER_LIGHTS_AMBIENT
+
+// Figures since boot
+typedef struct {
+    uint32_t bursts;   // Bursts of conversions started
+    uint32_t missed;   // Bursts that had not finished when the next was due
+    uint32_t samples;  // Conversions of the sensor's channel averaged
+    uint32_t changes;  // Times the brightness scale moved
+} AmbientStats;
+
+// Set up the continuous ADC on the sensor's pin and the sampling jobs
+void ambient_init(void);
+
+// Start or stop the periodic sampling to match the light state
+void ambient_update_sampling(void);
+
+// The user's brightness (0-100%) with the auto brightness curve applied, when
+// the setting is on and a reading was made
+int ambient_scale_brightness(int brightness);
+
+// Filtered level, -1 until sampling has produced one
+int ambient_get_level(void);
+
+// Scale the curve gives at the filtered level (percent)
+int ambient_get_scale(void);
+
+void ambient_get_stats(AmbientStats *stats);
+void ambient_print_stats(void);
+
+#else
+
+// Compiled out (CONFIG_SUPER_LIGHTS_AMBIENT)
+static inline void ambient_init(void) {}
+static inline void ambient_update_sampling(void) {}
+static inline int ambient_scale_brightness(int brightness) { return brightness; }
+static inline int ambient_get_level(void) { return -1; }
+static inline int ambient_get_scale(void) { return 100; }
+static inline void ambient_print_stats(void) {}
+
+#endif
+
+#endif // AMBIENT_CONTROL_H
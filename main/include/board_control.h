@@ -0,0 +1,76 @@
+#ifndef BOARD_CONTROL_H
+#define BOARD_CONTROL_H
+
+#include "sdkconfig.h"
+
+// Pin map of the board profile picked in menuconfig ("Super Lights" > "Board").
+// Functions of a feature that is compiled out are -1 (GPIO_NUM_NC).
+// board_control.c checks the map at build time.
+
+#if CONFIG_SUPER_LIGHTS_BOARD_DEVKITC
+#define BOARD_NAME "ESP32-DevKitC"
+#elif CONFIG_SUPER_LIGHTS_BOARD_WROVER
+#define BOARD_NAME "ESP32-WROVER"
+#else
+#define BOARD_NAME "custom"
+#endif
+
+#define BOARD_POWER_LED_GPIO CONFIG_SUPER_LIGHTS_PIN_POWER_LED
+#define BOARD_POWER_BUTTON_GPIO CONFIG_SUPER_LIGHTS_PIN_POWER_BUTTON
+#define BOARD_IR_GPIO CONFIG_SUPER_LIGHTS_PIN_IR
+#define BOARD_LED_STRIP_GPIO CONFIG_SUPER_LIGHTS_PIN_LED_STRIP
+#define BOARD_LED_COUNT CONFIG_SUPER_LIGHTS_LED_COUNT
+
+#if CONFIG_SUPER_LIGHTS_DISPLAY
+#define BOARD_ENTER_BUTTON_GPIO CONFIG_SUPER_LIGHTS_PIN_ENTER_BUTTON
+#define BOARD_BACK_BUTTON_GPIO CONFIG_SUPER_LIGHTS_PIN_BACK_BUTTON
+#define BOARD_UP_BUTTON_GPIO CONFIG_SUPER_LIGHTS_PIN_UP_BUTTON
+#define BOARD_DOWN_BUTTON_GPIO CONFIG_SUPER_LIGHTS_PIN_DOWN_BUTTON
+#define BOARD_LCD_SDA_GPIO CONFIG_SUPER_LIGHTS_PIN_LCD_SDA
+#define BOARD_LCD_SCL_GPIO CONFIG_SUPER_LIGHTS_PIN_LCD_SCL
+#else
+#define BOARD_ENTER_BUTTON_GPIO (-1)
+#define BOARD_BACK_BUTTON_GPIO (-1)
+#define BOARD_UP_BUTTON_GPIO (-1)
+#define BOARD_DOWN_BUTTON_GPIO (-1)
+#define BOARD_LCD_SDA_GPIO (-1)
+#define BOARD_LCD_SCL_GPIO (-1)
+#endif
+
+#if CONFIG_SUPER_LIGHTS_ULTRASONIC
+#define BOARD_US_TRIG_GPIO CONFIG_SUPER_LIGHTS_PIN_US_TRIG
+#define BOARD_US_ECHO_GPIO CONFIG_SUPER_LIGHTS_PIN_US_ECHO
+#else
+#define BOARD_US_TRIG_GPIO (-1)
+#define BOARD_US_ECHO_GPIO (-1)
+#endif
+
+#if CONFIG_SUPER_LIGHTS_AUDIO
+#define BOARD_I2S_BCK_GPIO CONFIG_SUPER_LIGHTS_PIN_I2S_BCK
+#define BOARD_I2S_LCK_GPIO CONFIG_SUPER_LIGHTS_PIN_I2S_LCK
+#define BOARD_I2S_DIN_GPIO CONFIG_SUPER_LIGHTS_PIN_I2S_DIN
+#define BOARD_AUDIO_SAMPLE_RATE CONFIG_SUPER_LIGHTS_AUDIO_SAMPLE_RATE
+#else
+#define BOARD_I2S_BCK_GPIO (-1)
+#define BOARD_I2S_LCK_GPIO (-1)
+#define BOARD_I2S_DIN_GPIO (-1)
+#endif
+
+#if CONFIG_SUPER_LIGHTS_REMOTE
+#define BOARD_REMOTE_TX_GPIO CONFIG_SUPER_LIGHTS_PIN_REMOTE_TX
+#define BOARD_REMOTE_RX_GPIO CONFIG_SUPER_LIGHTS_PIN_REMOTE_RX
+#else
+#define BOARD_REMOTE_TX_GPIO (-1)
+#define BOARD_REMOTE_RX_GPIO (-1)
+#endif
+
+#if CONFIG_SUPER_LIGHTS_AMBIENT
+#define BOARD_AMBIENT_GPIO CONFIG_SUPER_LIGHTS_PIN_AMBIENT
+#else
+#define BOARD_AMBIENT_GPIO (-1)
+#endif
+
+// Print the pin map and the compiled-in features
+void board_print_pin_map(void);
+
+#endif // BOARD_CONTROL_H
@@ -0,0 +1,45 @@
+#ifndef BOOT_CONTROL_H
+#define BOOT_CONTROL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BOOT_MAX_STAGES 16
+
+#define BOOT_STAGE_BIT(stage) (1UL << (stage))
+
+// One init step of the boot graph
+typedef struct {
+    const char *name;
+    void (*init)(void);
+    uint32_t deps;  // BOOT_STAGE_BIT()s of the stages that have to finish first
+    bool presence;  // Needed before motion can turn the light on
+} BootStage;
+
+// When each stage ran, in esp_timer time (from application start)
+typedef struct {
+    int64_t start_us;
+    int64_t end_us;
+} BootStageTiming;
+
+typedef struct {
+    int stage_count;
+    BootStageTiming stages[BOOT_MAX_STAGES];
+    int64_t presence_ready_us; // Every presence stage done
+    int64_t done_us;           // Every stage done
+} BootReport;
+
+// Run the stages, each as soon as its dependencies are done, on the calling
+// task plus a few short-lived workers. Returns once every stage finished.
+// Stages are claimed in table order, so list the urgent ones first.
+void boot_run(const BootStage *stages, int count);
+
+// For stages that follow the others (progress display): the stages finished
+// so far, and a wait for one outside seen to finish, returning the new mask
+uint32_t boot_done_mask(void);
+uint32_t boot_wait_for_progress(uint32_t seen);
+
+void boot_get_report(BootReport *report);
+void boot_print_report(void);
+
+#endif // BOOT_CONTROL_H
@@ -1,6 +1,46 @@
 #ifndef BUTTON_CONTROL_H
 #define BUTTON_CONTROL_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+// A button held longer than this counts as stuck
+#define BUTTON_STUCK_MS 2000
+
+// Accelerated key repeat for editors: one step on the press, then after
+// BUTTON_REPEAT_DELAY_MS one step per call, growing the longer it is held.
+// Past BUTTON_STUCK_MS the button counts as stuck and stops repeating.
+#define BUTTON_REPEAT_DELAY_MS 400
+#define BUTTON_REPEAT_FAST_MS 1000   // Held this long: BUTTON_REPEAT_FAST_STEP a call
+#define BUTTON_REPEAT_FASTER_MS 1500 // Held this long: BUTTON_REPEAT_FASTER_STEP a call
+#define BUTTON_REPEAT_FAST_STEP 5
+#define BUTTON_REPEAT_FASTER_STEP 20
+
+// Steps one hold covers before it counts as stuck, with the editors' 100 ms
+// rounds: 6 single steps, 5 fast and 5 faster ones. The fast steps grow with
+// the editor's span so that a single hold sweeps all of it, hue included.
+#define BUTTON_REPEAT_POLL_MS 100
+#define BUTTON_REPEAT_SPAN 100
+
+// Where a held button is in its repeat, one per editor
+typedef struct {
+    int gpio_num;          // Button held, -1 for none
+    int64_t down_since_us; // When the press was first seen
+    int scale;             // Fast steps are this many times the default ones
+} ButtonRepeat;
+
 int button_is_pressed(int gpio_num); // Check if a specific button is pressed
 
-#endif 
\ No newline at end of file
+// Wait for a button to come up, yielding meanwhile. A button stuck down for
+// BUTTON_STUCK_MS reads as released until it really is, returns false then.
+bool button_wait_release(int gpio_num);
+
+// Start with no button held, for an editor over span steps
+void button_repeat_init(ButtonRepeat *repeat, int span);
+
+// Steps to move for a button this round of the editor loop, 0 while it is up
+// or waiting for the repeat to start. Call once a round for each button the
+// editor reads; a press of another button starts over.
+int button_repeat_steps(ButtonRepeat *repeat, int gpio_num);
+
+#endif
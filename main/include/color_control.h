@@ -0,0 +1,24 @@
+#ifndef COLOR_CONTROL_H
+#define COLOR_CONTROL_H
+
+#include <stdint.h>
+
+// Integer color conversions, cheap enough to run per pixel per frame in the
+// LED task
+
+// Hue in 1/256 of a sixth of the color wheel: red 0, yellow 256, green 512,
+// cyan 768, blue 1024, magenta 1280
+#define COLOR_HUE_STEPS 1536
+#define COLOR_HUE_FROM_DEGREES(degrees) ((uint32_t)(degrees) * COLOR_HUE_STEPS / 360)
+
+// Color temperature range of the white axis, warm to cool
+#define COLOR_KELVIN_MIN 2200
+#define COLOR_KELVIN_MAX 6500
+
+// hue 0 to COLOR_HUE_STEPS - 1, saturation and value 0 to 255
+void color_hsv_to_rgb(uint16_t hue, uint8_t saturation, uint8_t value, uint8_t rgb[3]);
+
+// White of a black body at that temperature, clamped to the range above
+void color_kelvin_to_rgb(uint16_t kelvin, uint8_t rgb[3]);
+
+#endif // COLOR_CONTROL_H
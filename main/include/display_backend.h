@@ -0,0 +1,50 @@
+#ifndef DISPLAY_BACKEND_H
+#define DISPLAY_BACKEND_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "display_control.h"
+
+// What display_control.c needs from a panel driver. It keeps the text of
+// every cell, works out which ones change and hands only those to draw();
+// flush() then sends whatever the driver still holds back. The panel in use
+// is picked in menuconfig ("Super Lights" > "Features" > "Display panel").
+
+// Rows of the glyph bitmaps, 5 pixels wide (bit 4 is the leftmost column)
+#define DISPLAY_GLYPH_ROWS 8
+
+typedef enum {
+    DISPLAY_CURSOR_OFF,
+    DISPLAY_CURSOR_LINE,  // Underline
+    DISPLAY_CURSOR_BLINK, // Blinking block (an inverted cell where the panel cannot blink)
+} DisplayCursor;
+
+typedef struct {
+    uint8_t rows;    // Text cells, at most DISPLAY_ROWS_MAX by DISPLAY_COLS
+    uint8_t cols;
+    uint32_t bus_hz; // I2C clock the controller takes, the bus runs at the slowest
+    uint8_t clear_cost; // What clear() costs, counted in cells drawn
+
+    void (*init)(void);    // Reset the controller, the screen is blank afterwards
+    void (*resume)(void);  // The panel stayed powered through deep sleep
+    void (*standby)(void); // Screen off ahead of deep sleep
+    void (*set_backlight)(bool on);
+    void (*clear)(void);
+
+    // Put count characters at row, col. Codes from glyph() are glyphs.
+    void (*draw)(int row, int col, const char *text, int count);
+    // Send what draw() left in the driver's buffer, if anything
+    void (*flush)(void);
+    // Cursor at the start of row, or where it is for row -1
+    void (*set_cursor)(int row, DisplayCursor cursor);
+    // Character code of a glyph, as display_glyph()
+    char (*glyph)(DisplayGlyph glyph);
+} DisplayBackend;
+
+extern const DisplayBackend display_hd44780; // 1602 LCD behind a PCF8574, display_hd44780.c
+extern const DisplayBackend display_ssd1306; // 128x64 OLED, display_ssd1306.c
+
+// Bitmaps of the glyphs, shared by the drivers
+extern const uint8_t display_glyph_bitmaps[DISPLAY_GLYPH_COUNT][DISPLAY_GLYPH_ROWS];
+
+#endif // DISPLAY_BACKEND_H
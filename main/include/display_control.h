@@ -1,13 +1,70 @@
 #ifndef DISPLAY_CONTROL_H
 #define DISPLAY_CONTROL_H
 
+#include <stdbool.h>
+#include "sdkconfig.h"
+
+#define DISPLAY_ROWS_MAX 8 // A 128x64 OLED, the 1602 LCD has 2
+#define DISPLAY_COLS 16     // On every panel
+#define DISPLAY_BAR_STEPS (DISPLAY_COLS * 5) // A bar fills a cell one pixel column at a time
+
+// Custom characters, kept in the LCD's CGRAM (8 at a time) or drawn into the
+// OLED's framebuffer
+typedef enum {
+    DISPLAY_GLYPH_BAR_1, // 1 to 5 pixel columns lit from the left
+    DISPLAY_GLYPH_BAR_2,
+    DISPLAY_GLYPH_BAR_3,
+    DISPLAY_GLYPH_BAR_4,
+    DISPLAY_GLYPH_BAR_5,
+    DISPLAY_GLYPH_SUN,
+    DISPLAY_GLYPH_SPEAKER,
+    DISPLAY_GLYPH_EYE,
+    DISPLAY_GLYPH_WAVE,
+    DISPLAY_GLYPH_COUNT,
+} DisplayGlyph;
+
+#if CONFIG_SUPER_LIGHTS_DISPLAY
+
 void display_init(void); // Initialize the display
+void display_resume(void); // Reattach to a panel that was configured before deep sleep
+void display_reinit(void); // Run the panel's init sequence again, the screen is blank afterwards
+void display_standby(void); // Display and backlight off
+void display_set_backlight(bool on);
+int display_get_rows(void); // Text rows of the panel, 2 to DISPLAY_ROWS_MAX
 void display_clear(void); // Clear the display
-void display_render(const char *line1, const char *line2); // Render two lines of text
+void display_render(const char *line1, const char *line2); // Render two lines of text, blank the rest
+
+// Bring every row to its line (blank past count), sending only the cells
+// that change
+void display_render_lines(const char *const *lines, int count);
 void display_enable_cursor(void); // Enable the cursor
 void display_disable_cursor(void); // Disable the cursor
 void display_highlight_row(int row); // Highlight a specific row
-void display_loading_animation(const char *message);
+void display_progress(const char *title, int done, int total); // Title and a progress bar
+
+// Character code of a glyph, to put in the text of a row. On the LCD it is
+// uploaded on first use, then cached; a ninth glyph replaces the least
+// recently used one, so draw a screen's glyphs each time it is drawn in full.
+char display_glyph(DisplayGlyph glyph);
+
+// Bring a row to the text (padded with spaces) without clearing the screen,
+// writing only the characters that differ from what the panel shows
+void display_write_row(int row, const char *text);
+
+// Title on the first row and a bar at level (0 to DISPLAY_BAR_STEPS) on the
+// second, written in place: moving the bar by one step rewrites one character.
+// Rows below those are blanked.
+void display_slider(const char *title, int level);
+
+#else
+
+// Headless build (CONFIG_SUPER_LIGHTS_DISPLAY off)
+static inline void display_init(void) {}
+static inline void display_resume(void) {}
+static inline void display_standby(void) {}
+static inline void display_progress(const char *title, int done, int total) {}
+
+#endif
 
 
 #endif // DISPLAY_CONTROL_H
\ No newline at end of file
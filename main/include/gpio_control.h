@@ -2,17 +2,21 @@
 #define GPIO_CONTROL_H
 
 #include "driver/gpio.h"
+#include "board_control.h"
 
-// GPIO pin definitions
-#define POWER_LED_GPIO GPIO_NUM_4 
-#define POWER_BUTTON_GPIO GPIO_NUM_12 // Used for debugging
-#define ENTER_BUTTON_GPIO GPIO_NUM_15
-#define BACK_BUTTON_GPIO GPIO_NUM_18
-#define UP_BUTTON_GPIO GPIO_NUM_19
-#define DOWN_BUTTON_GPIO GPIO_NUM_21
+// GPIO pin definitions, the menu buttons are -1 on headless builds
+#define POWER_LED_GPIO BOARD_POWER_LED_GPIO
+#define POWER_BUTTON_GPIO BOARD_POWER_BUTTON_GPIO // Used for debugging
+#define ENTER_BUTTON_GPIO BOARD_ENTER_BUTTON_GPIO
+#define BACK_BUTTON_GPIO BOARD_BACK_BUTTON_GPIO
+#define UP_BUTTON_GPIO BOARD_UP_BUTTON_GPIO
+#define DOWN_BUTTON_GPIO BOARD_DOWN_BUTTON_GPIO
 
 void gpio_init(void);
 void gpio_set_led(int state);
 int gpio_get_button_state(int gpio_num);
 
+// Report a stuck button as released (1) until it reads released by itself
+void gpio_ignore_until_released(int gpio_num);
+
 #endif // GPIO_CONTROL_H
\ No newline at end of file
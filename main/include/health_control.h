@@ -0,0 +1,47 @@
+#ifndef HEALTH_CONTROL_H
+#define HEALTH_CONTROL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Long-running tasks the health monitor watches. Each one is a task watchdog
+// user of its own, fed by the monitor while the task keeps its deadline.
+typedef enum {
+    HEALTH_TASK_MAIN,     // Main loop, menu actions and editors
+    HEALTH_TASK_LED,
+    HEALTH_TASK_SPEAKER,
+    HEALTH_TASK_US,
+    HEALTH_TASK_REMOTE,
+    HEALTH_TASK_LOG,
+    HEALTH_TASK_PROFILER,
+    HEALTH_TASK_COUNT,
+} HealthTask;
+
+// Soft recovery, called once from the monitor task when its task stalls
+typedef void (*HealthRecovery)(void);
+
+typedef struct {
+    uint32_t stalls;          // Deadlines missed since boot
+    uint32_t recoveries;      // Stalls that ended after the recovery hook ran
+    uint32_t longest_ms;      // Longest time without a heartbeat
+    char last_where[16];      // Heartbeat before the last stall
+} HealthStats;
+
+// Start the monitor task. Reports a stall that made the watchdog reset the chip.
+void health_control_init(void);
+
+// Called by the task itself once it enters its loop: no heartbeat for longer
+// than deadline_ms counts as a stall. recovery may be NULL.
+void health_register(HealthTask task, uint32_t deadline_ms, HealthRecovery recovery);
+
+// Progress at the named point (a string literal). Cheap enough for any loop.
+void health_beat(HealthTask task, const char *where);
+
+// About to block on input that may take forever, the deadline starts again
+// with the next health_beat()
+void health_wait(HealthTask task);
+
+void health_get_stats(HealthTask task, HealthStats *stats);
+void health_print_report(void);
+
+#endif // HEALTH_CONTROL_H
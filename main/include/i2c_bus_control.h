@@ -0,0 +1,79 @@
+#ifndef I2C_BUS_CONTROL_H
+#define I2C_BUS_CONTROL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+// The one owner of I2C_NUM_0, shared by every device on it (the display
+// today, sensors later). A transaction runs on the caller's task once the
+// bus is granted to it. While the bus is busy, callers queue by priority
+// class, first come first served within a class.
+//
+// Writes longer than I2C_BUS_CHUNK_BYTES go out in chunks. Each chunk is a
+// transaction of its own that repeats the head bytes (an SSD1306 control
+// byte, a register address), and the bus goes to anyone queued in a more
+// urgent class in between. A device that cannot take its data in pieces
+// keeps its writes shorter than a chunk.
+//
+// A failed transaction (a device holding SDA low, a glitch on the lines) is
+// retried once after a bus recovery: SCL is pulsed until SDA comes free,
+// then a STOP is sent and the driver is installed again.
+
+#define I2C_BUS_CHUNK_BYTES 32
+#define I2C_BUS_MAX_DEVICES 4
+#define I2C_BUS_MAX_WAITERS 8 // Tasks queued at once
+#define I2C_BUS_TIMEOUT_MS 50 // A transaction that takes longer has failed
+
+typedef enum {
+    I2C_BUS_PRIORITY_SENSOR,  // Short reads with a deadline, served first
+    I2C_BUS_PRIORITY_DISPLAY, // Refreshes, they can wait a chunk
+    I2C_BUS_PRIORITY_COUNT,
+} I2cBusPriority;
+
+// Figures of one device since boot
+typedef struct {
+    uint32_t transactions;
+    uint32_t bytes;          // Address bytes included
+    uint32_t errors;         // Failed transactions, retries included
+    uint64_t busy_us;        // Time on the bus
+    uint64_t wait_us;        // Time queued for it
+    uint32_t max_wait_us;
+    uint32_t max_latency_us; // Queued plus on the bus, worst call
+} I2cBusStats;
+
+typedef struct {
+    const char *name;
+    uint8_t address; // 7 bit
+    I2cBusPriority priority;
+    I2cBusStats stats;
+} I2cBusDevice;
+
+#define I2C_BUS_DEVICE(device_name, device_address, device_priority) \
+    {.name = (device_name), .address = (device_address), .priority = (device_priority)}
+
+// Install the driver on the board's I2C pins. Called again, it only lowers
+// the clock if a slower device asks for one.
+void i2c_bus_init(uint32_t clock_hz);
+
+// List a device in the report; transactions work without it
+void i2c_bus_add_device(I2cBusDevice *device);
+
+// Write head, then data, to the device. data is split into chunks as above.
+esp_err_t i2c_bus_write(I2cBusDevice *device, const uint8_t *head, size_t head_length, const uint8_t *data,
+                        size_t length);
+
+// Write command, then read length bytes, in one transaction (repeated start)
+esp_err_t i2c_bus_write_read(I2cBusDevice *device, const uint8_t *command, size_t command_length, uint8_t *data,
+                             size_t length);
+
+// Keep the bus across several transactions, for a device whose commands
+// span more than one (nests, releases with the last unlock)
+void i2c_bus_lock(I2cBusDevice *device);
+void i2c_bus_unlock(void);
+
+uint32_t i2c_bus_get_recoveries(void);
+void i2c_bus_print_stats(void);
+
+#endif // I2C_BUS_CONTROL_H
@@ -1,11 +1,26 @@
 #ifndef IR_CONTROL_H
 #define IR_CONTROL_H
 
+#include <stdbool.h>
+#include "driver/gpio.h"
+#include "board_control.h"
+
+// GPIO pin for the IR sensor (an RTC GPIO, it wakes the chip from standby)
+#define IR_SENSOR_GPIO BOARD_IR_GPIO
+
 // Initialize the IR sensor
 void ir_sensor_init(void);
 
-// Control the IR sensor (check for motion and activate light if needed)
+// Whether the PIR currently sees someone (false while IR is disabled)
+bool ir_sensor_is_occupied(void);
+
+// Keep the interrupt driven motion detection in line with the IR settings
 void ir_sensor_control(void);
 
+// Progress of the motion being confirmed: the sensitivity pulses the signal
+// has been high for so far (0 while low), and how many confirm it
+int ir_sensor_get_pulses(void);
+int ir_sensor_get_required_pulses(void);
+
 
 #endif // IR_CONTROL_H
\ No newline at end of file
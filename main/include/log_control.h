@@ -0,0 +1,84 @@
+#ifndef LOG_CONTROL_H
+#define LOG_CONTROL_H
+
+#include <stdint.h>
+#include "sdkconfig.h"
+
+// Log levels, CONFIG_SUPER_LIGHTS_LOG_LEVEL is the most verbose one compiled in
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifdef CONFIG_SUPER_LIGHTS_LOG_LEVEL
+#define LOG_COMPILED_LEVEL CONFIG_SUPER_LIGHTS_LOG_LEVEL
+#else
+#define LOG_COMPILED_LEVEL LOG_LEVEL_INFO
+#endif
+
+// Records per call site and second unless the site says otherwise, the rest
+// is counted and reported with the next record that gets through
+#define LOG_DEFAULT_RATE 20
+
+// Room for the arguments of one record. Strings are copied up to
+// LOG_MAX_STRING characters, whatever does not fit is cut.
+#define LOG_ARGS_SIZE 24
+#define LOG_MAX_STRING 15
+#define LOG_MAX_ARGS 8
+
+// One log statement. The macros below keep one per call site in static memory,
+// the record only points at it.
+typedef struct {
+    const char *format;    // printf style, no '*' widths
+    const char *file;
+    uint16_t line;
+    uint8_t level;
+    uint8_t rate;          // Records per second, 0 for no limit
+    uint32_t signature;    // Argument kinds, parsed from the format on first use
+    int64_t window_us;     // Start of the current rate window
+    uint16_t window_count; // Records in it so far
+    uint16_t suppressed;   // Dropped by the limit since the last record
+    uint16_t id;           // Number the drain announced the site under, 0 until then
+} LogSite;
+
+// Figures of the backend since boot
+typedef struct {
+    uint32_t written;     // Records put into the ring
+    uint32_t suppressed;  // Dropped by the per-site rate limits
+    uint32_t overwritten; // Lost because the drain fell a ring behind
+    uint32_t sites;       // Call sites seen by the drain
+} LogStats;
+
+#define LOG_AT(level_, rate_, format_, ...)                                                        \
+    do                                                                                             \
+    {                                                                                              \
+        if ((level_) <= LOG_COMPILED_LEVEL)                                                        \
+        {                                                                                          \
+            static LogSite log_site_ = {.format = (format_), .file = __FILE__, .line = __LINE__,   \
+                                        .level = (level_), .rate = (rate_)};                       \
+            log_write(&log_site_, ##__VA_ARGS__);                                                  \
+        }                                                                                          \
+    } while (0)
+
+#define LOG_ERROR(format, ...) LOG_AT(LOG_LEVEL_ERROR, LOG_DEFAULT_RATE, format, ##__VA_ARGS__)
+#define LOG_WARN(format, ...) LOG_AT(LOG_LEVEL_WARN, LOG_DEFAULT_RATE, format, ##__VA_ARGS__)
+#define LOG_INFO(format, ...) LOG_AT(LOG_LEVEL_INFO, LOG_DEFAULT_RATE, format, ##__VA_ARGS__)
+#define LOG_DEBUG(format, ...) LOG_AT(LOG_LEVEL_DEBUG, LOG_DEFAULT_RATE, format, ##__VA_ARGS__)
+
+// Start the drain task. Records written before are kept (up to a ring's worth).
+void log_control_init(void);
+
+// Put one record into the ring: no formatting, no locks, no UART. Safe from
+// tasks and (non-IRAM) interrupts on either core. Use the macros rather than
+// calling it.
+void log_write(LogSite *site, ...);
+
+// Print everything still in the ring from the calling task (before standby
+// and before the diagnostic dumps, so the order on the console holds)
+void log_flush(void);
+
+void log_get_stats(LogStats *stats);
+void log_print_stats(void);
+
+#endif // LOG_CONTROL_H
@@ -0,0 +1,59 @@
+#ifndef MELODY_CONTROL_H
+#define MELODY_CONTROL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Signals are melodies in RTTTL, one string each, read straight from flash:
+//
+//   Chime:d=4,o=5,b=120:b4,f,a
+//
+// name, then the defaults (d = note length as a fraction of a whole note,
+// o = octave, b = quarter notes per minute), then the notes: an optional
+// length, a-g or p (rest), an optional #, an optional dot (half as long
+// again) and an optional octave (4-7). A melody can be as long as it likes,
+// the parser keeps no more than its position.
+
+#define MELODY_BUILTIN_COUNT 5
+#define MELODY_USER_MAX 8 // Melodies read from the "melodies" data partition
+#define MELODY_COUNT_MAX (MELODY_BUILTIN_COUNT + MELODY_USER_MAX)
+#define MELODY_NAME_LEN 16 // Longest name kept, with the terminator
+
+// Data partition with user melodies: RTTTL strings, one per line, ending at
+// the first NUL or erased (0xFF) byte
+#define MELODY_PARTITION_LABEL "melodies"
+#define MELODY_PARTITION_SUBTYPE 0x40
+#define MELODY_PARTITION_SIZE 0x4000 // As in partitions.csv
+
+typedef struct {
+    uint16_t frequency; // Hz, 0 for a rest
+    uint16_t duration_ms;
+} MelodyNote;
+
+// Where a melody is being read, on the stack of whoever plays it
+typedef struct {
+    const char *at;
+    uint8_t length;     // Default note length (d)
+    uint8_t octave;     // Default octave (o)
+    uint32_t whole_ms;  // A whole note at the tempo (b)
+} MelodyParser;
+
+// Map the user melodies, before the settings are loaded (they select one)
+void melody_control_init(void);
+
+// Built-in melodies, then the user ones
+int melody_count(void);
+const char *melody_get(int index); // NULL if there is no such melody
+
+// Copy the melody's name into name (cut to size)
+void melody_get_name(const char *melody, char *name, size_t size);
+
+// Read the header. False if the melody is malformed, melody_next() then
+// returns false right away.
+bool melody_begin(MelodyParser *parser, const char *melody);
+
+// The next note, false at the end of the melody or at a malformed note
+bool melody_next(MelodyParser *parser, MelodyNote *note);
+
+#endif // MELODY_CONTROL_H
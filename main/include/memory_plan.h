@@ -0,0 +1,93 @@
+#ifndef MEMORY_PLAN_H
+#define MEMORY_PLAN_H
+
+#include "sdkconfig.h"
+#include "board_control.h"
+
+// All the RAM the application asks for, in one place.
+//
+// Tasks, timers and mutexes are created with the static FreeRTOS calls on
+// storage their module owns, so they show up in the linked image. The drivers
+// take their buffers from the heap once, in the init functions, and never
+// again; they are listed below as PLAN_DMA_*_BYTES (DMA capable memory) and
+// PLAN_HEAP_*_BYTES (any internal RAM). tools/memory_report.py adds both to
+// the image and checks the sum against main/memory_budget.json on every build.
+
+// Task stacks in bytes (StackType_t is a byte on ESP-IDF)
+#define PLAN_STACK_LED 3072
+#define PLAN_STACK_SPEAKER 4096
+#define PLAN_STACK_US 3072
+#define PLAN_STACK_REMOTE 3072
+#define PLAN_STACK_PROFILER 3072
+#define PLAN_STACK_LOG 3072
+#define PLAN_STACK_BOOT_WORKER 4096 // Each of the boot workers, idle once boot is done
+#define PLAN_STACK_SCENARIO 3072
+#define PLAN_STACK_HEALTH 3072
+
+// One cycle of the lowest tone speaker_play_tone() can synthesize
+#define PLAN_TONE_SAMPLES 1024
+
+// I2S: the DMA ring the speaker feeds, 16 bit mono frames
+#if CONFIG_SUPER_LIGHTS_AUDIO
+#define PLAN_I2S_DMA_DESC_NUM 16
+#define PLAN_I2S_DMA_FRAME_NUM 1024
+#define PLAN_DMA_I2S_BYTES (PLAN_I2S_DMA_DESC_NUM * PLAN_I2S_DMA_FRAME_NUM * 2)
+#else
+#define PLAN_DMA_I2S_BYTES 0
+#endif
+
+// led_strip: the pixel buffer (3 bytes per LED) and the RMT encoder. The RMT
+// symbols live in the peripheral's own memory block.
+#define PLAN_HEAP_LED_STRIP_BYTES (BOARD_LED_COUNT * 3 + 256)
+
+// UART of the remote link: the RX ring and the event queue (12 byte events)
+#if CONFIG_SUPER_LIGHTS_REMOTE
+#define PLAN_UART_RX_BYTES 512
+#define PLAN_UART_EVENT_QUEUE_LENGTH 16
+#define PLAN_HEAP_UART_BYTES (PLAN_UART_RX_BYTES + PLAN_UART_EVENT_QUEUE_LENGTH * 12 + 256)
+#else
+#define PLAN_HEAP_UART_BYTES 0
+#endif
+
+// I2C driver state, no transmit or receive buffers in master mode. A bus
+// recovery (i2c_bus_control.c) frees it and allocates it again.
+#if CONFIG_SUPER_LIGHTS_DISPLAY
+#define PLAN_HEAP_I2C_BYTES 256
+#else
+#define PLAN_HEAP_I2C_BYTES 0
+#endif
+
+// ADC continuous mode of the ambient light sensor: the driver's DMA buffers
+// (five frames and their descriptors), and the pool it copies every frame to
+// along with its state and its own pm lock. The pool is never read, it only
+// has to hold a frame.
+#if CONFIG_SUPER_LIGHTS_AMBIENT
+#define PLAN_ADC_FRAME_BYTES 200 // 100 conversions of 2 bytes, 5 ms at 20 kHz
+#define PLAN_ADC_POOL_BYTES (2 * PLAN_ADC_FRAME_BYTES)
+#define PLAN_DMA_ADC_BYTES (5 * (PLAN_ADC_FRAME_BYTES + 12))
+#define PLAN_HEAP_ADC_BYTES (PLAN_ADC_POOL_BYTES + 320)
+#else
+#define PLAN_DMA_ADC_BYTES 0
+#define PLAN_HEAP_ADC_BYTES 0
+#endif
+
+// esp_timer handles (the timer service, its jobs are static) and one esp_pm
+// lock per PmLock, about 64 bytes each. ESP-IDF has no static variant of either.
+#define PLAN_ESP_TIMERS 1
+#define PLAN_PM_LOCKS 4
+#define PLAN_HEAP_ESP_TIMER_BYTES (PLAN_ESP_TIMERS * 64)
+#define PLAN_HEAP_PM_LOCK_BYTES (PLAN_PM_LOCKS * 64)
+
+// Task watchdog entries: one user per watched task and the health monitor
+// itself, about 32 bytes each
+#define PLAN_TASK_WDT_ENTRIES 8
+#define PLAN_HEAP_TASK_WDT_BYTES (PLAN_TASK_WDT_ENTRIES * 32)
+
+// NVS: the page cache and entry hash list of the one open namespace, held
+// from the first settings load or save on
+#define PLAN_HEAP_NVS_BYTES 2048
+
+// The flash mapping of the melodies partition, kept for good
+#define PLAN_HEAP_FLASH_MMAP_BYTES 64
+
+#endif // MEMORY_PLAN_H
@@ -2,6 +2,9 @@
 #define MENU_CONTROL_H
 
 #include <stdbool.h> // Include for the bool type
+#include "sdkconfig.h"
+
+#if CONFIG_SUPER_LIGHTS_DISPLAY
 
 extern bool is_in_special_mode; // Declare the variable as extern
 extern bool is_in_special_mode_lr;
@@ -12,12 +15,33 @@ void menu_scroll_down(void); // Scroll down in the menu
 void menu_select(void); // Select the current menu item
 void menu_back(void); // Go back to the parent menu
 void menu_render(void); // Render the current menu
+void menu_request_render(void); // Flag the menu for a redraw (safe from any task)
+void menu_render_if_requested(void); // Redraw if flagged and the light state changed
+void menu_recover(void); // Leave the open editor, reset the LCD and redraw (health monitor)
 void toggle_sound(void); // Toggle sound setting
 void adjust_brightness(void); // Adjust brightness setting
 void toggle_light(void); // Toggle light setting
 void about_page(void); // Display about page
 void select_color(void); // Select color setting
+void adjust_hue(void); // Adjust the hue, with a live preview
+void adjust_saturation(void); // Adjust the saturation of the hue
+void adjust_color_temp(void); // Adjust the white's color temperature
 void toggle_ir(void); // Toggle IR setting
+void toggle_auto_brightness(void); // Toggle auto brightness setting
 void toggle_auto_unplug(void); // Toggle auto unplug setting
+void apply_scene(void); // Pick a scene and apply it
+void save_scene(void); // Store the current settings as a scene
+void dashboard_page(void); // Live sensor readings
+
+#else
+
+// Headless build (CONFIG_SUPER_LIGHTS_DISPLAY off)
+static inline void menu_init(void) {}
+static inline void menu_request_render(void) {}
+static inline void menu_render_if_requested(void) {}
+static inline void menu_recover(void) {}
+static inline void menu_render(void) {}
+
+#endif
 
 #endif // MENU_CONTROL_H
\ No newline at end of file
@@ -0,0 +1,56 @@
+#ifndef PM_CONTROL_H
+#define PM_CONTROL_H
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+// Typical ESP32 supply current per state (datasheet figures, chip only: the
+// LEDs, the LCD backlight and the amplifier come on top)
+#define PM_CURRENT_ACTIVE_UA 40000     // CPU at 160 MHz
+#define PM_CURRENT_IDLE_UA 15000       // Awake at the 40 MHz XTAL clock, waiting in WAITI
+#define PM_CURRENT_LIGHT_SLEEP_UA 800
+
+// Transfers that keep the CPU at full clock and the chip out of light sleep
+typedef enum {
+    PM_LOCK_LCD,    // A display_render() burst, instead of a clock switch per I2C nibble
+    PM_LOCK_LED,    // Frame computation and the RMT refresh
+    PM_LOCK_AUDIO,  // Tone synthesis and the I2S writes of a signal
+    PM_LOCK_REMOTE, // A controller is talking on the remote UART
+    PM_LOCK_COUNT,
+} PmLock;
+
+typedef enum {
+    PM_STATE_ACTIVE,      // At least one PmLock held
+    PM_STATE_IDLE,        // Awake, nothing held (the drivers may still raise the clock briefly)
+    PM_STATE_LIGHT_SLEEP, // Automatic light sleep
+    PM_STATE_COUNT,
+} PmState;
+
+// Time spent per power state since pm_control_init()
+typedef struct {
+    uint64_t total_us;
+    uint64_t state_us[PM_STATE_COUNT];
+    uint32_t sleep_count;               // Light sleep entries
+    uint32_t lock_count[PM_LOCK_COUNT]; // Acquisitions per lock
+    uint32_t average_ua;                // Estimated from the PM_CURRENT_* figures
+} PmReport;
+
+// Enable frequency scaling and automatic light sleep, create the locks
+void pm_control_init(void);
+
+// Hold the CPU at full clock around a transfer (nests, safe from any task)
+void pm_control_acquire(PmLock lock);
+void pm_control_release(PmLock lock);
+
+// Block the calling task until pm_control_signal_work() or the timeout; the
+// main loop sleeps here instead of polling
+#define PM_WAIT_FOREVER UINT32_MAX
+void pm_control_wait_for_work(uint32_t timeout_ms);
+void pm_control_signal_work(void);
+void pm_control_signal_work_from_isr(BaseType_t *higher_priority_task_woken);
+
+// Power state figures
+void pm_control_get_report(PmReport *report);
+void pm_control_print_report(void);
+
+#endif // PM_CONTROL_H
@@ -1,7 +1,35 @@
 #ifndef POWER_CONTROL_H
 #define POWER_CONTROL_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+// Standby figures, kept in RTC slow memory across deep sleep
+typedef struct {
+    uint32_t boot_count;    // Boots since power-on, standby wakeups included
+    uint32_t resume_count;  // Boots that resumed from standby
+    int64_t last_resume_us; // From the wakeup to the light being usable, last resume
+    int64_t max_resume_us;
+    int wake_cause;         // esp_sleep_wakeup_cause_t of this boot
+} PowerStats;
+
 void power_control_init(void);
 void power_control_toggle(void);
 
-#endif // POWER_CONTROL_H
\ No newline at end of file
+// True when this boot is a wakeup from standby with a valid saved state
+bool power_control_is_resuming(void);
+
+// Replace the default settings with the ones saved on the way into standby
+void power_control_restore_settings(void);
+
+// Boot finished on the resume path: record the time, handle a motion wakeup
+void power_control_resume_done(void);
+
+// Save the state, turn everything off and deep sleep until POWER or the PIR
+// wakes the chip. Does not return.
+void power_control_enter_standby(void);
+
+void power_control_get_stats(PowerStats *stats);
+void power_control_print_stats(void);
+
+#endif // POWER_CONTROL_H
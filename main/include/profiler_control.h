@@ -0,0 +1,91 @@
+#ifndef PROFILER_CONTROL_H
+#define PROFILER_CONTROL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+#include "alloc_control.h"
+
+// Time between two snapshots unless a subscriber asks for another, 0 disables sampling
+#ifdef CONFIG_SUPER_LIGHTS_PROFILER_PERIOD_MS
+#define PROFILER_DEFAULT_PERIOD_MS CONFIG_SUPER_LIGHTS_PROFILER_PERIOD_MS
+#else
+#define PROFILER_DEFAULT_PERIOD_MS 1000
+#endif
+
+#define PROFILER_SNAPSHOT_VERSION 4
+#define PROFILER_MAX_TASKS 16
+#define PROFILER_TASK_NAME_LEN 8
+
+// Event counters kept by the modules, cumulative since boot
+typedef enum {
+    PROFILER_COUNTER_I2C_TRANSACTIONS,
+    PROFILER_COUNTER_I2C_BYTES,
+    PROFILER_COUNTER_US_TIMEOUTS,
+    PROFILER_COUNTER_IR_PULSES,
+    PROFILER_COUNTER_LED_REFRESHES,
+    PROFILER_COUNTER_I2S_UNDERRUNS,
+    PROFILER_COUNTER_COUNT,
+} ProfilerCounter;
+
+// Durations measured by the modules, summarised per snapshot period
+typedef enum {
+    PROFILER_TIMING_MAIN_LOOP,  // Busy part of one main loop iteration
+    PROFILER_TIMING_US_RANGING, // One ultrasonic measurement
+    PROFILER_TIMING_LCD_RENDER, // One display_render()
+    PROFILER_TIMING_TIMER_LATE, // How late a timer job ran after its deadline
+    PROFILER_TIMING_COUNT,
+} ProfilerTiming;
+
+// Binary snapshot, little endian and packed. Only the first task_count
+// entries of tasks[] are published.
+typedef struct __attribute__((packed)) {
+    uint8_t version;          // PROFILER_SNAPSHOT_VERSION
+    uint8_t task_count;
+    uint32_t period_ms;       // Window the CPU figures and timings cover
+    uint32_t uptime_ms;
+    uint32_t heap_free;       // Default heap, bytes
+    uint32_t heap_min_free;   // Low-water mark since boot
+    uint32_t dma_free;        // DMA-capable heap, bytes
+    uint32_t dma_min_free;
+    uint16_t overhead_ppm;    // CPU share the profiler itself used, parts per million
+    uint32_t counters[PROFILER_COUNTER_COUNT];
+    struct __attribute__((packed)) {
+        uint16_t count;
+        uint32_t avg_us;
+        uint32_t max_us;
+    } timings[PROFILER_TIMING_COUNT];
+    struct __attribute__((packed)) {
+        uint32_t count;                    // Allocations since boot was done, 0 without the tracker
+        uint32_t bytes;
+    } allocs[ALLOC_TAG_COUNT];
+    struct __attribute__((packed)) {
+        char name[PROFILER_TASK_NAME_LEN]; // Not NUL terminated when the name fills it
+        uint8_t priority;
+        uint16_t cpu_permille;             // Of the total CPU time of all cores
+        uint16_t stack_free;               // Stack high-water mark, bytes never used
+    } tasks[PROFILER_MAX_TASKS];
+} ProfilerSnapshot;
+
+// Receives every published snapshot, called from the profiler task
+typedef void (*ProfilerSnapshotSink)(const uint8_t *data, size_t size);
+
+// Start the sampling task. With the remote link compiled in, snapshots go to
+// a controller subscribed to REMOTE_STREAM_PROFILER.
+void profiler_init(void);
+
+// Module instrumentation, safe from tasks and interrupts
+void profiler_count(ProfilerCounter counter, uint32_t amount);
+void profiler_time(ProfilerTiming timing, uint32_t duration_us);
+
+// Snapshot rate and destination
+void profiler_set_period(uint32_t period_ms);
+void profiler_set_sink(ProfilerSnapshotSink sink);
+
+// Copy the latest snapshot, returns its published size (0 before the first one)
+size_t profiler_get_snapshot(ProfilerSnapshot *snapshot);
+
+// Print the latest snapshot in human readable form
+void profiler_dump(void);
+
+#endif // PROFILER_CONTROL_H
@@ -0,0 +1,93 @@
+#ifndef REMOTE_CONTROL_H
+#define REMOTE_CONTROL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "driver/gpio.h"
+#include "driver/uart.h"
+#include "board_control.h"
+
+// Serial link to a home controller, see tools/remote_client.py for the other end
+#define REMOTE_UART_NUM UART_NUM_1
+#define REMOTE_TX_GPIO BOARD_REMOTE_TX_GPIO
+#define REMOTE_RX_GPIO BOARD_REMOTE_RX_GPIO
+#define REMOTE_BAUD_RATE 460800
+
+// Frames are COBS encoded and end with a 0x00 byte. Decoded, a frame is
+//
+//     [type] [seq] [body ...] [CRC-16/CCITT-FALSE of type..body, little endian]
+//
+// Multi-byte values are little endian. Every request gets exactly one response
+// with the type | REMOTE_RESPONSE, the same seq and a RemoteStatus as the
+// first body byte. Frames with a bad CRC are dropped without a response, the
+// client retries.
+#define REMOTE_PROTOCOL_VERSION 1
+#define REMOTE_MAX_PAYLOAD 96 // type, seq and body
+#define REMOTE_RESPONSE 0x80
+
+typedef enum {
+    REMOTE_PING = 0x01,      // -> version u8, setting count u8, uptime ms u32
+    REMOTE_GET = 0x02,       // key u8 ... (none for all) -> (key u8, value i32) ...
+    REMOTE_SET = 0x03,       // (key u8, value i32) ..., applied all or nothing
+    REMOTE_SIGNAL = 0x04,    // signal index u8, played even with the sound off
+    REMOTE_EFFECT = 0x05,    // RgbLedEffect u8
+    REMOTE_SUBSCRIBE = 0x06, // stream u8, period ms u16 (0 stops the stream)
+    REMOTE_TELEMETRY = 0xC0, // Unsolicited: stream u8, time ms u32, sample (seq counts per stream)
+} RemoteType;
+
+typedef enum {
+    REMOTE_OK,
+    REMOTE_ERR_TYPE,   // Unknown request type
+    REMOTE_ERR_LENGTH, // Body too short or too long for the request
+    REMOTE_ERR_KEY,    // No such setting, signal, effect or stream
+    REMOTE_ERR_VALUE,  // Value out of range for the setting, or a bad period
+    REMOTE_ERR_ABSENT, // Signal or distance request, audio or ultrasonic compiled out
+} RemoteStatus;
+
+// Telemetry streams and their samples
+typedef enum {
+    REMOTE_STREAM_OCCUPANCY, // PIR sees someone u8
+    REMOTE_STREAM_DISTANCE,  // Latest ultrasonic range in mm i16, -1 for none
+    REMOTE_STREAM_LIGHT,     // Light on u8, brightness u8, color index u8
+    REMOTE_STREAM_PROFILER,  // ProfilerSnapshot in pieces: offset u16, size u16, bytes
+    REMOTE_STREAM_COUNT,
+} RemoteStream;
+
+// The profiler stream's period is the profiler's snapshot rate. Each snapshot
+// goes out as soon as it is taken, split over as many samples as it needs;
+// unsubscribing puts the profiler back to PROFILER_DEFAULT_PERIOD_MS.
+#define REMOTE_PROFILER_PIECE (REMOTE_MAX_PAYLOAD - 11) // After type, seq, stream, time, offset, size
+
+#define REMOTE_MIN_PERIOD_MS 10
+#define REMOTE_MIN_PROFILER_PERIOD_MS 100 // A snapshot takes a few ms on the wire
+
+// Link figures since boot
+typedef struct {
+    uint32_t requests;      // Frames answered
+    uint32_t telemetry;     // Stream samples sent
+    uint32_t crc_errors;    // Frames dropped for their CRC or their COBS encoding
+    uint32_t overruns;      // Frames lost to a too long frame or a full RX buffer
+    int64_t last_service_us; // Frame end to response written, most recent request
+    int64_t max_service_us;  // Same, worst since boot
+} RemoteStats;
+
+#if CONFIG_SUPER_LIGHTS_REMOTE
+
+// Install the UART driver and start the remote task
+void remote_control_init(void);
+
+void remote_control_get_stats(RemoteStats *stats);
+void remote_control_print_stats(void);
+
+// Profiler snapshot sink, sends to a subscriber if there is one
+void remote_control_send_snapshot(const uint8_t *data, size_t size);
+
+#else
+
+// Compiled out (CONFIG_SUPER_LIGHTS_REMOTE)
+static inline void remote_control_init(void) {}
+static inline void remote_control_print_stats(void) {}
+
+#endif
+
+#endif // REMOTE_CONTROL_H
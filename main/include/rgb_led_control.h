@@ -1,15 +1,58 @@
 #ifndef RGB_LED_CONTROL_H
 #define RGB_LED_CONTROL_H
 
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
 #include "settings_control.h"
+#include "board_control.h"
 
-// Initialize the RGB LED control
+#define RGB_LED_COUNT BOARD_LED_COUNT // Number of LEDs in the module
+
+// Pixel values of one strip refresh
+typedef struct {
+    uint8_t rgb[RGB_LED_COUNT][3];
+} RgbFrame;
+
+// Short animations in the selected color, e.g. to acknowledge a remote command
+typedef enum {
+    RGB_LED_EFFECT_BLINK, // Three flashes at full brightness
+    RGB_LED_EFFECT_PULSE, // Fade up and down once over a second
+    RGB_LED_EFFECT_COUNT,
+} RgbLedEffect;
+
+// Target time from a qualifying presence event to the first RMT bit
+#define RGB_LED_FAST_PATH_BUDGET_US 5000
+
+// Sensor-to-strip latency figures for the presence fast path
+typedef struct {
+    uint32_t count;       // Presence events that reached the strip
+    uint32_t over_budget; // Events slower than RGB_LED_FAST_PATH_BUDGET_US
+    int64_t last_us;      // Latency of the most recent event
+    int64_t max_us;       // Worst latency seen since boot
+} FastPathStats;
+
+// Initialize the RGB LED control and start the LED task
 void rgb_led_control_init(void);
 
-// Update the RGB LED state based on settings
-void rgb_led_control_update(void);
+// Compute the pixels the current settings ask for (the light is assumed on)
+void rgb_led_control_compute_frame(RgbFrame *frame);
+
+// Ask the LED task to update the LEDs based on settings
+void rgb_led_control_request_update(void);
+
+// Motion confirmed: turn the light on through the high priority fast path
+void rgb_led_control_signal_presence(int64_t event_time_us);
+void rgb_led_control_signal_presence_from_isr(int64_t event_time_us, BaseType_t *higher_priority_task_woken);
+
+// Play an effect, the strip returns to the settings afterwards. Presence and
+// standby cut it short.
+void rgb_led_control_play_effect(RgbLedEffect effect);
+
+// Turn the strip off for deep sleep, the LED task takes no more requests
+void rgb_led_control_standby(void);
 
-// Turn off the RGB LEDs
-void rgb_led_control_turn_off(void);
+// Fetch and print the presence fast path latency figures
+void rgb_led_control_get_fast_path_stats(FastPathStats *stats);
+void rgb_led_control_print_fast_path_stats(void);
 
-#endif // RGB_LED_CONTROL_H
\ No newline at end of file
+#endif // RGB_LED_CONTROL_H
@@ -0,0 +1,14 @@
+#ifndef SCENARIO_CONTROL_H
+#define SCENARIO_CONTROL_H
+
+// Stimulus and capture shim for scenario runs under QEMU, built only with
+// CONFIG_SUPER_LIGHTS_SCENARIO_SHIM. The emulated ESP32 has no buttons, PIR,
+// HC-SR04, PCF8574, WS2812 or speaker attached, so the GPIO, I2C, led_strip and
+// I2S calls of the firmware are linker-wrapped: input levels come from commands
+// on the console UART and everything sent to the peripherals is printed as
+// timestamped "@" records. See tools/run_scenarios.py for both formats.
+
+// Set the idle input levels and start reading stimulus from UART0
+void scenario_init(void);
+
+#endif // SCENARIO_CONTROL_H
@@ -0,0 +1,59 @@
+#ifndef SCENE_CONTROL_H
+#define SCENE_CONTROL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "settings_control.h"
+
+// Named snapshots of the persistent settings, applied in one step
+#define SCENE_COUNT 4
+#define SCENE_NAME_LEN 12 // Including the terminator, fits the LCD next to "< >"
+
+// Scenes are kept in NVS (namespace "scenes", key "scene<n>") as blobs:
+//
+//   byte 0       SCENE_BLOB_VERSION
+//   bytes 1-11   name, NUL padded
+//   then         per setting: the SettingKey, then the value in the setting's
+//                size (settings_get_size()), little endian
+//
+// A blob only lists the settings the scene sets, the others are left alone
+// when it is applied. SettingKey numbers never change, so a blob stays valid
+// when the schema grows.
+#define SCENE_BLOB_VERSION 1
+#define SCENE_BLOB_MAX (1 + (SCENE_NAME_LEN - 1) + SETTING_COUNT * (1 + sizeof(uint32_t)))
+
+typedef struct {
+    char name[SCENE_NAME_LEN];
+    uint8_t count;                  // Settings the scene sets, 0 for an empty slot
+    SettingKey keys[SETTING_COUNT];
+    int values[SETTING_COUNT];
+} Scene;
+
+// Read the saved scenes over the built-in ones (Day, Evening, Night, Custom).
+// The first call below does it otherwise, so neither boot nor a resume from
+// standby waits on NVS for them. Scenes are used from the main task only.
+void scene_control_init(void);
+
+const char *scene_get_name(int index);
+
+// Apply a scene as one settings batch: one LED update, and one NVS write once
+// the settings have settled. The caller redraws the menu. False for an empty
+// slot or a scene with a value out of range, nothing changes then.
+bool scene_apply(int index);
+
+// Apply the scene after the last one applied (POWER double press)
+int scene_apply_next(void);
+
+// Capture the persistent settings into a slot, keeping its name, and store it
+bool scene_save(int index);
+
+// Last scene applied since boot, -1 if none
+int scene_get_active(void);
+
+// Encode and decode the blob format above. pack returns the blob's length,
+// unpack false for a blob it cannot read.
+size_t scene_pack(const Scene *scene, uint8_t *blob, size_t size);
+bool scene_unpack(const uint8_t *blob, size_t length, Scene *scene);
+
+#endif // SCENE_CONTROL_H
@@ -1,21 +1,19 @@
 #ifndef SETTINGS_CONTROL_H
 #define SETTINGS_CONTROL_H
 
-// Enum for settings
+#include <stdbool.h>
+#include <stddef.h>
+#include "settings_schema.h"
+
+// Quiet time before changed settings go to flash, and how late the write may be
+#define SETTINGS_SAVE_DELAY_MS 5000
+#define SETTINGS_SAVE_SLACK_MS 60
+
+// Enum for settings, from the schema
 typedef enum {
-    SETTING_BRIGHTNESS,
-    SETTING_COLOR,
-    SETTING_IR,
-    SETTING_US,
-    SETTING_SENSITIVITY_IR,
-    SETTING_SENSITIVITY_UR,
-    SETTING_TIMING_IR,
-    SETTING_TIMING_UR,
-    SETTING_LIGHT,
-    SETTING_LIGHT_AUTO_TURN_OFF,
-    SETTING_SOUND,
-    SETTING_VOLUME,
-    SETTING_SELECTED_SIGNAL,
+#define SETTING_KEY(key, ...) SETTING_##key,
+    SETTINGS_SCHEMA(SETTING_KEY)
+#undef SETTING_KEY
     SETTING_COUNT,
 } SettingKey;
 
@@ -27,30 +25,11 @@ typedef struct {
     int b; // Blue component (0-255)
 } Color;
 
+// Settings structure, one small unsigned field per schema entry
 typedef struct {
-    const char *name;       // Name of the signal
-    struct {
-        int frequency;      // Frequency of the tone (in Hz)
-        int duration;       // Duration of the tone (in ms)
-    } tones[10];            // Array of tones (up to 10 tones per signal)
-    int tone_count;         // Number of tones in the signal
-} Signal;
-
-// Settings structure
-typedef struct {
-    int brightness; // Brightness: 0-100%
-    int selected_color; // Index of the selected color
-    int sensitivity_ir; // IR sensitivity: 0-100%
-    int sensitivity_ur; // UR sensitivity: 0-100%
-    int timing_ir; // IR timing: 0-100%
-    int timing_ur; // UR timing: 0-100%
-    int light; // Light: 1 = On, 0 = Off
-    int light_auto_turn_off; // Auto turn off: 0 = off, 1+ = seconds until the light turns off automatically
-    int ir; // IR: 1 = On, 0 = Off
-    int us; // US: 1 = On, 0 = Off
-    int sound_on; // Sound: 1 = On, 0 = Off
-    int volume; // Volume: 0-100%
-    int selected_signal; // Choose signal to play
+#define SETTING_FIELD(key, field, type, ...) type field;
+    SETTINGS_SCHEMA(SETTING_FIELD)
+#undef SETTING_FIELD
 } Settings;
 
 // Initialize settings with default values
@@ -59,35 +38,92 @@ void settings_init(void);
 // Get a pointer to the settings structure
 Settings *settings_get(void);
 
-// Get the selected signal to play
-const Signal *get_selected_signal(void);
+// Get the selected signal to play, a melody (melody_control.h)
+const char *get_selected_signal(void);
+
+// Get a signal by index, NULL if out of range
+const char *settings_get_signal(int index);
 
 // Fetch color names
 const char **settings_get_color_names(void);
 
-// Fetch signal names
-const char **settings_get_signal_names(void);
-
 // Fetch the name of a setting by key
 const char *settings_get_name(SettingKey key);
 
 // Fetch the value of a setting by key as a string
 const char *settings_get_value(SettingKey key);
 
-// Fetch the RGB values of the selected color
+// Format the value of a setting into a buffer, as settings_get_value() does
+void settings_format(SettingKey key, char *buffer, size_t size);
+
+// Short name of a setting (NVS key, remote client name)
+const char *settings_get_id(SettingKey key);
+
+// Whether a setting is kept in NVS (all but the light state)
+bool settings_is_persistent(SettingKey key);
+
+// Bytes of a setting's field in Settings, and in NVS
+size_t settings_get_size(SettingKey key);
+
+// Range of a setting, from the schema
+int settings_get_min(SettingKey key);
+int settings_get_max(SettingKey key);
+
+// Fetch the RGB values of the light's color: the selected palette entry, the
+// hue and saturation, or the white's color temperature (SETTING_COLOR_MODE)
 Color settings_get_color(void);
+Color settings_color_of(const Settings *settings);
+
+// settings_get() reads the live fields and can catch a batch midway, say a new
+// color mode with the old hue. That is fine for a reader the writer wakes up
+// afterwards. Fields that have to agree are read between these two, again as
+// long as retry says a batch came in between:
+//     do { generation = settings_read_begin(); ... } while (settings_read_retry(generation));
+unsigned settings_read_begin(void);
+bool settings_read_retry(unsigned generation);
+
+// Fetch the value of a setting by key as a number
+int settings_get_int(SettingKey key);
+
+// Whether a value is in range for a setting
+bool settings_is_valid(SettingKey key, int value);
 
 // Update a setting by key
 void settings_update(SettingKey key, int value);
 
+// Update several settings at once, all or nothing. Returns false, and changes
+// nothing, if any value is out of range. A read section (settings_read_begin)
+// sees all of the values or none.
+bool settings_update_batch(const SettingKey *keys, const int *values, int count);
+
 // Reset all settings to default values
 void settings_reset(void);
 
+// Initialize the NVS partition, once, for the settings and the other modules
+// that keep data in it. False if it cannot be used.
+bool settings_storage_init(void);
+
+// Read the persistent settings from NVS over the defaults (cold boot)
+void settings_load(void);
+
+// Called from the main loop: writes the persistent settings to NVS once they
+// have stopped changing for SETTINGS_SAVE_DELAY_MS
+void settings_save_if_due(void);
+
+// Write pending changes to NVS right away (before standby)
+void settings_save(void);
+
 // Print all settings to the console
 void settings_print_all(void);
 
 // Initialize the auto turn-off timer
 void auto_turn_off_init(void);
 
+// Start or stop the auto turn-off timer when the light changes
+void auto_turn_off_update(void);
+
+// Seconds until the auto turn-off, rounded up; -1 while it is not counting
+int auto_turn_off_remaining_s(void);
+
 
 #endif // SETTINGS_CONTROL_H
\ No newline at end of file
@@ -0,0 +1,69 @@
+#ifndef SETTINGS_SCHEMA_H
+#define SETTINGS_SCHEMA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "color_control.h"
+
+// Entries of the colors[] table in settings_control.c, and the most signals
+// there can be: the built-in melodies and the user ones (melody_control.h)
+#define SETTINGS_COLOR_COUNT 7
+#define SETTINGS_SIGNAL_COUNT 13
+
+// Where the light's color comes from (SETTING_COLOR_MODE)
+#define SETTINGS_COLOR_MODE_PALETTE 0 // The colors[] entry SETTING_COLOR selects
+#define SETTINGS_COLOR_MODE_HUE 1     // SETTING_HUE and SETTING_SATURATION
+#define SETTINGS_COLOR_MODE_WHITE 2   // SETTING_COLOR_TEMP
+
+// How a value is shown on the console and in the menu
+typedef enum {
+    SETTING_FORMAT_PERCENT, // "50%"
+    SETTING_FORMAT_CM,      // "50 cm"
+    SETTING_FORMAT_SECONDS, // "30s", 0 is "Off"
+    SETTING_FORMAT_SWITCH,  // "On" or "Off"; any value is accepted, stored as 0 or 1
+    SETTING_FORMAT_COLOR,   // Name of the color at that index
+    SETTING_FORMAT_SIGNAL,  // Name of the signal at that index; only signals that exist are accepted
+    SETTING_FORMAT_COLOR_MODE, // "Palette", "Hue" or "White"
+    SETTING_FORMAT_DEGREES, // "30 deg"
+    SETTING_FORMAT_KELVIN,  // "2700K"
+} SettingFormat;
+
+// Every setting, in one place. The SettingKey enum, the Settings struct, the
+// range checks, the formatting and the NVS storage are generated from it.
+//
+//   X(key, field, type, min, max, default, name, id, format, persist)
+//
+// key      SETTING_<key>; the order is the remote protocol's key numbering,
+//          append new settings at the end
+// field    member of Settings
+// type     unsigned, as small as the range allows
+// name     shown on the console
+// id       the NVS key and the remote client's name, up to 15 characters
+// persist  kept in NVS across power cycles
+#define SETTINGS_SCHEMA(X)                                                                                           \
+    X(BRIGHTNESS, brightness, uint8_t, 0, 100, 50, "Brightness", "brightness", SETTING_FORMAT_PERCENT, true)         \
+    X(COLOR, selected_color, uint8_t, 0, SETTINGS_COLOR_COUNT - 1, 5, "Color", "color", SETTING_FORMAT_COLOR, true)  \
+    X(IR, ir, uint8_t, 0, 1, 1, "IR", "ir", SETTING_FORMAT_SWITCH, true)                                             \
+    X(US, us, uint8_t, 0, 1, 1, "US", "us", SETTING_FORMAT_SWITCH, true)                                             \
+    X(SENSITIVITY_IR, sensitivity_ir, uint8_t, 1, 100, 90, "IR Sensitivity", "sensitivity_ir",                       \
+      SETTING_FORMAT_PERCENT, true)                                                                                  \
+    X(SENSITIVITY_UR, sensitivity_ur, uint8_t, 1, 100, 50, "UR Sensitivity", "sensitivity_ur", SETTING_FORMAT_CM,    \
+      true)                                                                                                          \
+    X(TIMING_IR, timing_ir, uint8_t, 0, 100, 50, "IR Timing", "timing_ir", SETTING_FORMAT_PERCENT, true)             \
+    X(TIMING_UR, timing_ur, uint8_t, 0, 100, 50, "UR Timing", "timing_ur", SETTING_FORMAT_PERCENT, true)             \
+    X(LIGHT, light, uint8_t, 0, 1, 0, "Light", "light", SETTING_FORMAT_SWITCH, false)                                \
+    X(LIGHT_AUTO_TURN_OFF, light_auto_turn_off, uint16_t, 0, 600, 0, "Auto unplug", "auto_turn_off",                 \
+      SETTING_FORMAT_SECONDS, true)                                                                                  \
+    X(SOUND, sound_on, uint8_t, 0, 1, 1, "Sound", "sound", SETTING_FORMAT_SWITCH, true)                              \
+    X(VOLUME, volume, uint8_t, 0, 100, 100, "Volume", "volume", SETTING_FORMAT_PERCENT, true)                        \
+    X(SELECTED_SIGNAL, selected_signal, uint8_t, 0, SETTINGS_SIGNAL_COUNT - 1, 2, "Signal", "signal",                \
+      SETTING_FORMAT_SIGNAL, true)                                                                                   \
+    X(COLOR_MODE, color_mode, uint8_t, 0, 2, SETTINGS_COLOR_MODE_PALETTE, "Color mode", "color_mode",                \
+      SETTING_FORMAT_COLOR_MODE, true)                                                                               \
+    X(HUE, hue, uint16_t, 0, 359, 30, "Hue", "hue", SETTING_FORMAT_DEGREES, true)                                    \
+    X(SATURATION, saturation, uint8_t, 0, 100, 100, "Saturation", "saturation", SETTING_FORMAT_PERCENT, true)        \
+    X(COLOR_TEMP, color_temp, uint16_t, COLOR_KELVIN_MIN, COLOR_KELVIN_MAX, 2700, "White", "color_temp",            \
+      SETTING_FORMAT_KELVIN, true)                                                                                   \
+    X(AUTO_BRIGHTNESS, auto_brightness, uint8_t, 0, 1, 0, "Auto bright", "auto_bright", SETTING_FORMAT_SWITCH, true)
+
+#endif // SETTINGS_SCHEMA_H
@@ -1,20 +1,44 @@
 #ifndef SPEAKER_CONTROL_H
 #define SPEAKER_CONTROL_H
 
+#include <stdint.h>
+#include "sdkconfig.h"
 #include "settings_control.h"
 
+#if CONFIG_SUPER_LIGHTS_AUDIO
+
 // Initialize the speaker
 void speaker_init(void);
 
+// Fill one period of a sine wave (samples_per_cycle samples)
+void speaker_generate_sine_wave(int16_t *buffer, int samples_per_cycle, int amplitude);
+
 // Play a tone with a specific frequency and duration
 void speaker_play_tone(int frequency, int duration_ms);
 
-// Play the currently selected signal
-void speaker_play_signal(const Signal *signal);
+// Play a signal, a melody in the format of melody_control.h
+void speaker_play_signal(const char *melody);
 
 // Stop any ongoing audio playback
 void speaker_stop(void);
 
+// Disable the I2S channel if a signal left it on (deep sleep)
+void speaker_standby(void);
+
 void speaker_update(void); // Update the speaker state based on settings
 
+void speaker_request_update(void); // Run speaker_update() from the speaker task
+
+void speaker_request_signal(const char *melody); // Play a signal from the speaker task
+
+#else
+
+// Compiled out (CONFIG_SUPER_LIGHTS_AUDIO): what the rest of the firmware calls does nothing
+static inline void speaker_init(void) {}
+static inline void speaker_standby(void) {}
+static inline void speaker_request_update(void) {}
+static inline void speaker_request_signal(const char *melody) {}
+
+#endif
+
 #endif // SPEAKER_CONTROL_H
\ No newline at end of file
@@ -0,0 +1,75 @@
+#ifndef TIMER_CONTROL_H
+#define TIMER_CONTROL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Every periodic and delayed job of the application runs off one esp_timer,
+// through a hierarchical timing wheel: starting and stopping a job take
+// constant time, and jobs due within each other's slack share a wakeup.
+
+// Runs in the esp_timer task: short, must not block
+typedef void (*TimerCallback)(void *arg);
+
+typedef struct {
+    const char *name;
+    TimerCallback callback;  // Either a callback...
+    void *arg;
+    TaskHandle_t owner;      // ...or a task that gets a notification (ulTaskNotifyTake) per expiry
+    uint32_t slack_ms;       // How late the job may run (up to 63), lets it share a wakeup with others
+} TimerJobArgs;
+
+typedef struct {
+    uint32_t runs;
+    uint32_t overruns;       // Periods skipped because the job fell a whole period behind
+    uint32_t late_avg_us;    // Lateness against the requested deadline
+    uint32_t late_max_us;
+} TimerJobStats;
+
+// One job, in static storage of the module that owns it. The fields are
+// private to timer_control.c.
+typedef struct TimerJob {
+    struct TimerJob *next;   // Wheel slot or due list
+    struct TimerJob **prev;  // Link that points here, NULL while not queued
+    struct TimerJob *next_job; // All initialized jobs, for the report
+    TimerJobArgs args;
+    int64_t due_us;          // Requested deadline
+    uint32_t period_ms;      // 0 for one-shot jobs
+    uint32_t due_tick;       // Deadline in wheel ticks
+    uint32_t tick;           // End of the slack, where the job sits in the wheel
+    uint8_t level;
+    uint8_t slot;
+    bool active;
+    uint64_t late_total_us;
+    TimerJobStats stats;
+} TimerJob;
+
+// Figures of the service since boot
+typedef struct {
+    uint32_t wakeups;        // esp_timer expiries
+    uint32_t dispatched;     // Job expiries
+    uint32_t shared;         // Expiries that shared their wakeup with an earlier one
+    uint32_t cascades;       // Jobs moved down a wheel level
+} TimerStats;
+
+// Create the esp_timer, before any module starts a job
+void timer_control_init(void);
+
+void timer_job_init(TimerJob *job, const TimerJobArgs *args);
+
+// (Re)start a job, replacing a pending expiry. Safe from tasks and interrupts.
+void timer_start_once(TimerJob *job, uint32_t delay_ms);
+void timer_start_periodic(TimerJob *job, uint32_t period_ms);
+void timer_stop(TimerJob *job);
+bool timer_is_active(const TimerJob *job);
+
+// Time left until the job's next expiry, -1 while it is stopped
+int32_t timer_get_remaining_ms(const TimerJob *job);
+
+void timer_get_job_stats(const TimerJob *job, TimerJobStats *stats);
+void timer_get_stats(TimerStats *stats);
+void timer_print_report(void);
+
+#endif // TIMER_CONTROL_H
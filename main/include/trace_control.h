@@ -0,0 +1,48 @@
+#ifndef TRACE_CONTROL_H
+#define TRACE_CONTROL_H
+
+#include <stdint.h>
+
+// Stages of the user-visible reactions that carry a tracepoint
+typedef enum {
+    TRACE_BUTTON_EDGE,          // A button went down (interrupt)
+    TRACE_MENU_SELECT,          // menu_select() entered
+    TRACE_DISPLAY_RENDER_START, // display_render() entered
+    TRACE_DISPLAY_RENDER_END,   // Last character sent to the LCD
+    TRACE_IR_EDGE,              // Rising IR edge while the light is off (interrupt)
+    TRACE_US_ECHO,              // Ultrasonic echo measured
+    TRACE_SETTINGS_UPDATE,      // settings_update() applied a value
+    TRACE_LED_REFRESH_ISSUE,    // led_strip_refresh() called
+    TRACE_LED_REFRESH_DONE,     // led_strip_refresh() returned
+    TRACE_I2S_FIRST_SAMPLE,     // First buffer of a tone handed to I2S
+    TRACE_EVENT_COUNT,
+} TraceEvent;
+
+// Latency figures of one event chain, in microseconds
+typedef struct {
+    const char *name;
+    uint32_t count;
+    uint32_t p50_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} TraceChainStats;
+
+// Number of event chains analysed (button-to-lcd, motion-to-light, ...)
+#define TRACE_CHAIN_COUNT 6
+
+// Record a tracepoint. Lock-free, safe from tasks and interrupts on either core.
+void trace_point(TraceEvent event);
+
+// Move recorded events into the chain histograms (called from the main loop)
+void trace_process(void);
+
+// Fetch the figures of one chain, index < TRACE_CHAIN_COUNT
+void trace_get_chain_stats(int chain, TraceChainStats *stats);
+
+// Print the latency histograms summary
+void trace_dump(void);
+
+// Forget everything recorded so far
+void trace_reset(void);
+
+#endif // TRACE_CONTROL_H
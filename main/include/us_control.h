@@ -1,6 +1,10 @@
 #ifndef US_CONTROL_H
 #define US_CONTROL_H
 
+#include "sdkconfig.h"
+
+#if CONFIG_SUPER_LIGHTS_ULTRASONIC
+
 // Initialize the ultrasonic sensor
 void us_sensor_init(void);
 
@@ -10,4 +14,24 @@ float us_sensor_get_distance(void);
 // Control the ultrasonic sensor
 void us_sensor_control(void);
 
+// Latest ranging result in cm, negative when there is none
+float us_sensor_get_last_distance(void);
+
+// Distance smoothed over the recent results (failed ones skipped), in cm;
+// negative until sampling has produced one
+float us_sensor_get_filtered_distance(void);
+
+// Start or stop the periodic sampling to match the light state
+void us_sensor_update_sampling(void);
+
+#else
+
+// Compiled out (CONFIG_SUPER_LIGHTS_ULTRASONIC)
+static inline void us_sensor_init(void) {}
+static inline float us_sensor_get_last_distance(void) { return -1; }
+static inline float us_sensor_get_filtered_distance(void) { return -1; }
+static inline void us_sensor_update_sampling(void) {}
+
+#endif
+
 #endif // US_CONTROL_H
\ No newline at end of file
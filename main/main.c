@@ -12,98 +12,297 @@
 #include "ir_control.h"      // For IR control
 #include "us_control.h"      // For ultrasonic sensor control
 #include "speaker_control.h"  // For speaker control
+#include "trace_control.h"    // For latency tracing
+#include "profiler_control.h" // For runtime stats
+#include "esp_timer.h"        // For loop timing
+#include "scenario_control.h" // For scenario runs under QEMU
+#include "pm_control.h"       // For light sleep between events
+#include "boot_control.h"     // For the boot stages
+#include "log_control.h"       // For the deferred console output
+#include "remote_control.h"    // For the home controller link
+#include "board_control.h"     // For the pin map
+#include "alloc_control.h"     // For the allocation counts
+#include "health_control.h"    // For the stall detector
+#include "timer_control.h"     // For the periodic and delayed jobs
+#include "scene_control.h"     // For the light scenes
+#include "melody_control.h"    // For the user melodies
+#include "i2c_bus_control.h"   // For the I2C bus figures
+#include "ambient_control.h"   // For the auto brightness
+
+// Holding POWER this long prints the profiler instead of the settings
+#define POWER_LONG_PRESS_MS 1000
+
+// Holding it on this long puts the light into standby (deep sleep)
+#define POWER_STANDBY_PRESS_MS 3000
+
+// A second short press within this time switches to the next scene
+#define POWER_DOUBLE_PRESS_MS 400
+
+// The loop runs on button presses and redraw requests, this is only the
+// fallback for the housekeeping below. It has plenty of slack to share its
+// wakeup with the profiler and the log drain.
+#define MAIN_LOOP_IDLE_MS 1000
+#define MAIN_LOOP_IDLE_SLACK_MS 60
+
+// Longest the loop may go without a heartbeat: an idle round, or an editor
+// round that waited for a stuck button to give up (BUTTON_STUCK_MS)
+#define MAIN_HEALTH_DEADLINE_MS 3000
+
+// Boot stages, see boot_stages[] for the order and the dependencies
+typedef enum {
+    STAGE_SETTINGS,
+    STAGE_AUTO_OFF,
+    STAGE_LED,
+    STAGE_IR,
+    STAGE_US,
+    STAGE_AMBIENT,
+    STAGE_SPEAKER,
+    STAGE_REMOTE,
+    STAGE_DISPLAY,
+    STAGE_SPLASH,
+    STAGE_MENU,
+    STAGE_PROFILER,
+    STAGE_COUNT,
+} Stage;
+
+// The splash screen follows everything but itself and the menu
+#define SPLASH_AWAITED_STAGES (BOOT_STAGE_BIT(STAGE_COUNT) - 1 - BOOT_STAGE_BIT(STAGE_SPLASH) - BOOT_STAGE_BIT(STAGE_MENU))
+
+static bool resuming = false; // Waking from standby: no splash, settings from RTC memory
+static TimerJob idle_job;
+
+static void stage_settings(void)
+{
+    melody_control_init(); // The signal setting may select a user melody
+    settings_init();
+    if (resuming)
+    {
+        power_control_restore_settings();
+    }
+    else
+    {
+        settings_load();
+    }
+}
+
+// What do you think darling ? -_-
+static void stage_display(void)
+{
+    if (resuming)
+    {
+        display_resume();
+    }
+    else
+    {
+        display_init();
+    }
+}
+
+// Super_Lights screen, with a bar that fills as the other stages finish
+static void stage_splash(void)
+{
+#if CONFIG_SUPER_LIGHTS_BOOT_SPLASH
+    if (resuming)
+    {
+        return;
+    }
+
+    int total = __builtin_popcount(SPLASH_AWAITED_STAGES);
+    uint32_t done = boot_done_mask();
+    while (1)
+    {
+        uint32_t awaited = done & SPLASH_AWAITED_STAGES;
+        display_progress("  Super_Lights", __builtin_popcount(awaited), total);
+        if (awaited == SPLASH_AWAITED_STAGES)
+        {
+            break;
+        }
+        done = boot_wait_for_progress(done);
+    }
+#endif
+}
+
+// Presence detection (settings, LED task, IR) comes first, the display and the
+// splash overlap with the rest
+static const BootStage boot_stages[STAGE_COUNT] = {
+    [STAGE_SETTINGS] = {"settings", stage_settings, 0, true},
+    [STAGE_AUTO_OFF] = {"auto_off", auto_turn_off_init, 0, true},
+    [STAGE_LED] = {"led", rgb_led_control_init, BOOT_STAGE_BIT(STAGE_SETTINGS) | BOOT_STAGE_BIT(STAGE_AUTO_OFF), true},
+    [STAGE_IR] = {"ir", ir_sensor_init, BOOT_STAGE_BIT(STAGE_SETTINGS) | BOOT_STAGE_BIT(STAGE_LED), true},
+    [STAGE_US] = {"us", us_sensor_init, BOOT_STAGE_BIT(STAGE_SETTINGS), false},
+    [STAGE_AMBIENT] = {"ambient", ambient_init, BOOT_STAGE_BIT(STAGE_SETTINGS), false},
+    [STAGE_SPEAKER] = {"speaker", speaker_init, BOOT_STAGE_BIT(STAGE_SETTINGS), false},
+    [STAGE_REMOTE] = {"remote", remote_control_init,
+                      BOOT_STAGE_BIT(STAGE_LED) | BOOT_STAGE_BIT(STAGE_IR) | BOOT_STAGE_BIT(STAGE_US) | BOOT_STAGE_BIT(STAGE_SPEAKER),
+                      false},
+    [STAGE_DISPLAY] = {"display", stage_display, 0, false},
+    [STAGE_SPLASH] = {"splash", stage_splash, BOOT_STAGE_BIT(STAGE_DISPLAY), false},
+    [STAGE_MENU] = {"menu", menu_init,
+                    BOOT_STAGE_BIT(STAGE_SETTINGS) | BOOT_STAGE_BIT(STAGE_DISPLAY) | BOOT_STAGE_BIT(STAGE_SPLASH), false},
+    [STAGE_PROFILER] = {"profiler", profiler_init, SPLASH_AWAITED_STAGES & ~BOOT_STAGE_BIT(STAGE_PROFILER), false},
+};
 
 void app_main(void)
 {
-    // Initialize GPIOs
-    gpio_init();
+    // Failed allocations are counted from the first one on
+    alloc_control_init();
 
-    // Debug button for now, maybe I'll use it at some point though
-    power_control_init();
+#if CONFIG_SUPER_LIGHTS_SCENARIO_SHIM
+    // Emulated inputs have to be in place before the drivers look at them
+    scenario_init();
+#endif
 
-    // What do you think darling ? -_-
-    display_init();
+    // Timer service, every periodic and delayed job runs off it
+    timer_control_init();
 
-    // Initialize auto unplug timer
-    auto_turn_off_init(); 
+    // Deferred console output, the stages log from their own tasks
+    log_control_init();
 
-    // Super_Lights screen
-    display_render("  Super_Lights", "    V 0.0.4    ");
-    vTaskDelay(pdMS_TO_TICKS(1000)); // Display for 2 seconds
+    // Stall detection, the tasks register as they start
+    health_control_init();
 
-    settings_init();  // Initialize settings
+    // Frequency scaling and light sleep, before anyone creates a driver
+    pm_control_init();
 
-    speaker_init(); // Initialize speaker
+    // Initialize GPIOs
+    gpio_init();
+
+    // Standby and resume. A wakeup from standby skips the splash screen and
+    // takes the settings from RTC memory.
+    power_control_init();
+    resuming = power_control_is_resuming();
+
+    boot_run(boot_stages, STAGE_COUNT);
+    boot_print_report();
 
-    us_sensor_init(); // Initialize ultrasonic sensor
-    
-    rgb_led_control_init(); 
+    // A stalled main loop gets its editor cancelled and the LCD reset first
+    health_register(HEALTH_TASK_MAIN, MAIN_HEALTH_DEADLINE_MS, menu_recover);
 
-    ir_sensor_init(); 
-    // Loading screen
-    display_loading_animation("Loading awesome");
+    // Anything allocated from here on is steady state, which should be nothing
+    alloc_control_mark_steady();
 
-    menu_init(); // Initialize the menu system
+    if (resuming)
+    {
+        power_control_resume_done();
+    }
 
-    vTaskDelay(pdMS_TO_TICKS(500));
+    const TimerJobArgs idle_job_args = {
+        .name = "main_idle",
+        .owner = xTaskGetCurrentTaskHandle(),
+        .slack_ms = MAIN_LOOP_IDLE_SLACK_MS,
+    };
+    timer_job_init(&idle_job, &idle_job_args);
+    timer_start_periodic(&idle_job, MAIN_LOOP_IDLE_MS);
 
     while (1)
     {
-        extern bool is_in_special_mode;
-        extern bool is_in_special_mode_lr;
+        int64_t loop_start = esp_timer_get_time();
+        health_beat(HEALTH_TASK_MAIN, "main loop");
+
         // Check if the power button is pressed
         if (gpio_get_button_state(POWER_BUTTON_GPIO) == 0)
         {
-            settings_print_all();
-
-            // Wait for the button to be released
+            // Wait for the button to be released, a long press dumps the profiler
+            // right away and an even longer one enters standby
+            int held_ms = 0;
             while (gpio_get_button_state(POWER_BUTTON_GPIO) == 0)
+            {
                 vTaskDelay(pdMS_TO_TICKS(100)); // Debounce delay
+                held_ms += 100;
+                health_beat(HEALTH_TASK_MAIN, "power held");
+                if (held_ms == POWER_LONG_PRESS_MS)
+                {
+                    log_flush();
+                    profiler_dump();
+                }
+                else if (held_ms == POWER_STANDBY_PRESS_MS)
+                {
+                    power_control_enter_standby();
+                }
+            }
+
+            // A short press followed by another one is the scene shortcut
+            bool double_press = false;
+            for (int waited_ms = 0; held_ms < POWER_LONG_PRESS_MS && waited_ms < POWER_DOUBLE_PRESS_MS;
+                 waited_ms += 50)
+            {
+                vTaskDelay(pdMS_TO_TICKS(50));
+                if (gpio_get_button_state(POWER_BUTTON_GPIO) == 0)
+                {
+                    double_press = true;
+                    button_wait_release(POWER_BUTTON_GPIO);
+                    break;
+                }
+            }
+
+            if (double_press)
+            {
+                scene_apply_next();
+                menu_render();
+            }
+            else if (held_ms < POWER_LONG_PRESS_MS)
+            {
+                log_flush(); // Pending records first, the dumps print directly
+                board_print_pin_map();
+                settings_print_all();
+                rgb_led_control_print_fast_path_stats();
+                trace_dump();
+                pm_control_print_report();
+                power_control_print_stats();
+                remote_control_print_stats();
+                i2c_bus_print_stats();
+                ambient_print_stats();
+                log_print_stats();
+                alloc_print_stats();
+                health_print_report();
+                timer_print_report();
+            }
+            loop_start = esp_timer_get_time(); // The wait is not loop work
         }
 
+#if CONFIG_SUPER_LIGHTS_DISPLAY
         // If in special mode, skip the rest of the loop
         if (!is_in_special_mode || !is_in_special_mode_lr)
         {
             // Check if the enter button is pressed
             if (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
             {
-                printf("Enter button has been pressed\n");
+                LOG_INFO("Enter button has been pressed");
                 menu_select();
-                while (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
-                    ; // Wait for release
+                button_wait_release(ENTER_BUTTON_GPIO);
             }
 
             // Check if the back button is pressed
             if (gpio_get_button_state(BACK_BUTTON_GPIO) == 0)
             {
-                printf("Back button has been pressed\n");
+                LOG_INFO("Back button has been pressed");
                 menu_back(); // Go back one step in the menu
-                while (gpio_get_button_state(BACK_BUTTON_GPIO) == 0)
-                    ; // Wait for release
+                button_wait_release(BACK_BUTTON_GPIO);
             }
 
             // Check if the up button is pressed
             if (gpio_get_button_state(UP_BUTTON_GPIO) == 0)
             {
-                printf("Up button has been pressed\n");
+                LOG_INFO("Up button has been pressed");
                 menu_scroll_up(); // Scroll up in the menu
-                while (gpio_get_button_state(UP_BUTTON_GPIO) == 0)
-                    ; // Wait for release
+                button_wait_release(UP_BUTTON_GPIO);
             }
 
             // Check if the down button is pressed
             if (gpio_get_button_state(DOWN_BUTTON_GPIO) == 0)
             {
-                printf("Down button has been pressed\n");
+                LOG_INFO("Down button has been pressed");
                 menu_scroll_down(); // Scroll down in the menu
-                while (gpio_get_button_state(DOWN_BUTTON_GPIO) == 0)
-                    ; // Wait for release
+                button_wait_release(DOWN_BUTTON_GPIO);
             }
         }
-        us_sensor_control(); // Check for ultrasonic sensor activity
-        ir_sensor_control(); // Check for IR sensor activity
-        rgb_led_control_update();
-        speaker_update(); 
-        vTaskDelay(pdMS_TO_TICKS(100));
+#endif
+        ir_sensor_control(); // Keep the IR hold window in line with the settings
+        rgb_led_control_request_update(); // Apply menu changes, the LED task skips unchanged frames
+        menu_render_if_requested(); // Redraw if a sensor or timer changed the light
+        settings_save_if_due(); // Changed settings go to flash once they stop changing
+        trace_process(); // Fold the tracepoints into the latency histograms
+        profiler_time(PROFILER_TIMING_MAIN_LOOP, esp_timer_get_time() - loop_start);
+        pm_control_wait_for_work(PM_WAIT_FOREVER); // Light sleep until a button, a redraw request or the idle job
     }
 }
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "alloc_control.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_err.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// The heap calls esp_heap_trace_alloc_hook() and esp_heap_trace_free_hook()
+// for every allocation and free (CONFIG_HEAP_USE_HOOKS, selected by the
+// tracker). They run inside malloc() and free(), so they only look up the
+// calling task and bump counters.
+
+typedef struct {
+    const char *task_name;
+    AllocTag tag;
+} AllocTaskTag;
+
+// Tasks not listed here count as ALLOC_TAG_SYSTEM
+static const AllocTaskTag task_tags[] = {
+    {"main", ALLOC_TAG_UI},
+    {"BootWorker", ALLOC_TAG_BOOT},
+    {"RgbLedTask", ALLOC_TAG_LED},
+    {"SpeakerTask", ALLOC_TAG_AUDIO},
+    {"UsSampleTask", ALLOC_TAG_SENSORS},
+    {"esp_timer", ALLOC_TAG_SENSORS},
+    {"RemoteTask", ALLOC_TAG_REMOTE},
+    {"ProfilerTask", ALLOC_TAG_DIAG},
+    {"LogTask", ALLOC_TAG_DIAG},
+};
+
+static const char *const tag_names[ALLOC_TAG_COUNT] = {"boot", "ui", "led", "audio", "sensors", "remote", "diag", "system"};
+
+static atomic_uint counts[ALLOC_TAG_COUNT];
+static atomic_uint bytes[ALLOC_TAG_COUNT];
+static atomic_uint frees[ALLOC_TAG_COUNT];
+static atomic_uint failures[ALLOC_TAG_COUNT];
+static atomic_uint steady_counts[ALLOC_TAG_COUNT];
+static atomic_uint steady_bytes[ALLOC_TAG_COUNT];
+static atomic_bool steady;
+static AllocSink sink = NULL;
+
+static AllocTag current_tag(void)
+{
+    if (xPortInIsrContext() || xTaskGetCurrentTaskHandle() == NULL)
+    {
+        return ALLOC_TAG_SYSTEM;
+    }
+    const char *name = pcTaskGetName(NULL);
+    for (size_t i = 0; i < sizeof(task_tags) / sizeof(task_tags[0]); i++)
+    {
+        if (strcmp(name, task_tags[i].task_name) == 0)
+        {
+            // The main task runs boot stages too until boot_run() returns
+            if (task_tags[i].tag == ALLOC_TAG_UI && !atomic_load_explicit(&steady, memory_order_relaxed))
+            {
+                return ALLOC_TAG_BOOT;
+            }
+            return task_tags[i].tag;
+        }
+    }
+    return ALLOC_TAG_SYSTEM;
+}
+
+void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    AllocTag tag = current_tag();
+    atomic_fetch_add_explicit(&counts[tag], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&bytes[tag], size, memory_order_relaxed);
+    if (atomic_load_explicit(&steady, memory_order_relaxed))
+    {
+        atomic_fetch_add_explicit(&steady_counts[tag], 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&steady_bytes[tag], size, memory_order_relaxed);
+        AllocSink current_sink = sink;
+        if (current_sink != NULL)
+        {
+            current_sink(tag, size);
+        }
+    }
+}
+
+void esp_heap_trace_free_hook(void *ptr)
+{
+    atomic_fetch_add_explicit(&frees[current_tag()], 1, memory_order_relaxed);
+}
+
+static void alloc_failed_callback(size_t size, uint32_t caps, const char *function_name)
+{
+    atomic_fetch_add_explicit(&failures[current_tag()], 1, memory_order_relaxed);
+}
+
+void alloc_control_init(void)
+{
+    ESP_ERROR_CHECK(heap_caps_register_failed_alloc_callback(alloc_failed_callback));
+}
+
+void alloc_control_mark_steady(void)
+{
+    atomic_store_explicit(&steady, true, memory_order_relaxed);
+}
+
+void alloc_get_stats(AllocTag tag, AllocStats *stats)
+{
+    stats->count = atomic_load_explicit(&counts[tag], memory_order_relaxed);
+    stats->bytes = atomic_load_explicit(&bytes[tag], memory_order_relaxed);
+    stats->frees = atomic_load_explicit(&frees[tag], memory_order_relaxed);
+    stats->failures = atomic_load_explicit(&failures[tag], memory_order_relaxed);
+    stats->steady_count = atomic_load_explicit(&steady_counts[tag], memory_order_relaxed);
+    stats->steady_bytes = atomic_load_explicit(&steady_bytes[tag], memory_order_relaxed);
+}
+
+const char *alloc_tag_name(AllocTag tag)
+{
+    return tag < ALLOC_TAG_COUNT ? tag_names[tag] : "?";
+}
+
+void alloc_set_sink(AllocSink new_sink)
+{
+    sink = new_sink;
+}
+
+void alloc_print_stats(void)
+{
+    printf("Allocations  count    bytes  frees  failed  after boot (count, bytes)\n");
+    for (int i = 0; i < ALLOC_TAG_COUNT; i++)
+    {
+        AllocStats stats;
+        alloc_get_stats(i, &stats);
+        printf("%-9s  %7lu  %7lu  %5lu  %6lu  %lu, %lu\n", tag_names[i], (unsigned long)stats.count,
+               (unsigned long)stats.bytes, (unsigned long)stats.frees, (unsigned long)stats.failures,
+               (unsigned long)stats.steady_count, (unsigned long)stats.steady_bytes);
+    }
+}
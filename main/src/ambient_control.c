@@ -0,0 +1,271 @@
+#include "ambient_control.h"
+#include "settings_control.h"
+#include "rgb_led_control.h"
+#include "timer_control.h"
+#include "log_control.h"
+#include "board_control.h"
+#include "memory_plan.h"
+#include "esp_adc/adc_continuous.h"
+#include "esp_err.h"
+#include "esp_attr.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define AMBIENT_PIN BOARD_AMBIENT_GPIO
+
+// The sensor is read in bursts of the continuous (DMA) ADC mode: once a period
+// while the light is on, the ADC converts for AMBIENT_BURST_FRAMES frames and
+// is stopped again. The conversions are summed in the DMA callback as the
+// frames come in, nothing copies or reads them afterwards, and the chip may
+// sleep between bursts (the driver holds its own pm lock while it runs).
+#define AMBIENT_SAMPLE_RATE_HZ 20000 // The slowest the ESP32's ADC DMA runs
+#define AMBIENT_BURST_FRAMES 4 // 20 ms: whole periods of lamp flicker on 50 Hz mains
+#define AMBIENT_PERIOD_MS 1000
+#define AMBIENT_SLACK_MS 50
+
+// 400 conversions averaged give about four more bits than the ADC has
+_Static_assert(AMBIENT_EXTRA_BITS == 16 - SOC_ADC_DIGI_MAX_BITWIDTH, "the level is not 16 bits wide");
+#define AMBIENT_FILTER_SHIFT 2 // Each burst moves the filtered level a quarter of the way
+#define AMBIENT_HYSTERESIS 2   // Percent the curve has to move before the strip follows
+
+#define AMBIENT_LEVEL(raw) ((raw) << AMBIENT_EXTRA_BITS) // From the ADC's 12 bit scale
+
+typedef struct {
+    int level;
+    int percent;
+} AmbientCurvePoint;
+
+// Brightness scale against the level, straight lines between the points
+static const AmbientCurvePoint ambient_curve[] = {
+    {AMBIENT_LEVEL(0), 40},     // Dark: a night light, it would glare at full power
+    {AMBIENT_LEVEL(300), 40},
+    {AMBIENT_LEVEL(1200), 100}, // Dim to bright indoor light: the brightness as set
+    {AMBIENT_LEVEL(2400), 100},
+    {AMBIENT_LEVEL(3600), 25},  // Daylight: the strip is hardly seen, save the power
+    {AMBIENT_LEVEL(4095), 25},
+};
+#define AMBIENT_CURVE_POINTS (sizeof(ambient_curve) / sizeof(ambient_curve[0]))
+
+static adc_continuous_handle_t adc_handle = NULL;
+static adc_channel_t adc_channel;
+
+static TimerJob burst_job; // Periodic while the light is on, starts a burst
+static TimerJob done_job;  // Started by the DMA callback when a burst is complete
+static bool jobs_ready = false;
+static bool burst_running = false; // Only touched by the jobs, in the esp_timer task
+
+// Summed by the DMA callback, reset by the burst job while the ADC is stopped
+static volatile uint32_t burst_sum;
+static volatile uint32_t burst_count;
+static volatile uint8_t burst_frames;
+
+static int filtered_level = -1;            // Exponential average of the bursts
+static volatile int shown_level = -1;      // filtered_level for other tasks
+static volatile uint8_t applied_scale = 100; // What the strip uses, follows the curve with hysteresis
+static AmbientStats stats;
+
+// Runs in the ADC's interrupt with every DMA frame. Each result is tagged with
+// its channel, only the sensor's are counted.
+static bool IRAM_ATTR ambient_conv_done(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata,
+                                        void *user_data)
+{
+    if (burst_frames >= AMBIENT_BURST_FRAMES)
+    {
+        return false; // Complete, the done job stops the ADC
+    }
+
+    const adc_digi_output_data_t *results = (const adc_digi_output_data_t *)edata->conv_frame_buffer;
+    uint32_t count = edata->size / SOC_ADC_DIGI_RESULT_BYTES;
+    uint32_t sum = 0;
+    uint32_t matched = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (results[i].type1.channel == adc_channel)
+        {
+            sum += results[i].type1.data;
+            matched++;
+        }
+    }
+    burst_sum += sum;
+    burst_count += matched;
+
+    if (++burst_frames == AMBIENT_BURST_FRAMES)
+    {
+        timer_start_once(&done_job, 0);
+    }
+    return false;
+}
+
+// Scale of the curve at a level
+static int curve_percent(int level)
+{
+    for (int i = 1; i < (int)AMBIENT_CURVE_POINTS; i++)
+    {
+        const AmbientCurvePoint *low = &ambient_curve[i - 1];
+        const AmbientCurvePoint *high = &ambient_curve[i];
+        if (level <= high->level)
+        {
+            return low->percent + (level - low->level) * (high->percent - low->percent) / (high->level - low->level);
+        }
+    }
+    return ambient_curve[AMBIENT_CURVE_POINTS - 1].percent;
+}
+
+static void burst_job_callback(void *arg)
+{
+    if (!settings_get()->auto_brightness)
+    {
+        // Start over when it is switched on again
+        filtered_level = -1;
+        shown_level = -1;
+        applied_scale = 100;
+        return;
+    }
+
+    if (burst_running)
+    {
+        // The last burst never completed, the ADC is started afresh
+        adc_continuous_stop(adc_handle);
+        stats.missed++;
+    }
+    burst_sum = 0;
+    burst_count = 0;
+    burst_frames = 0;
+    burst_running = true;
+    stats.bursts++;
+    if (adc_continuous_start(adc_handle) != ESP_OK)
+    {
+        burst_running = false;
+    }
+}
+
+// Decimate the burst to one level, smooth it and move the strip along the curve
+static void done_job_callback(void *arg)
+{
+    if (!burst_running || burst_frames < AMBIENT_BURST_FRAMES)
+    {
+        return; // A burst that was started over since
+    }
+    adc_continuous_stop(adc_handle);
+    burst_running = false;
+    if (burst_count == 0)
+    {
+        return;
+    }
+
+    int level = (int)(((uint64_t)burst_sum << AMBIENT_EXTRA_BITS) / burst_count);
+    stats.samples += burst_count;
+    filtered_level = filtered_level < 0 ? level : filtered_level + ((level - filtered_level) >> AMBIENT_FILTER_SHIFT);
+    shown_level = filtered_level;
+
+    int scale = curve_percent(filtered_level);
+    if (abs(scale - applied_scale) >= AMBIENT_HYSTERESIS)
+    {
+        applied_scale = scale;
+        stats.changes++;
+        LOG_DEBUG("Ambient level %d, brightness scale %d%%", filtered_level, scale);
+        rgb_led_control_request_update();
+    }
+}
+
+void ambient_init(void)
+{
+    const adc_continuous_handle_cfg_t handle_config = {
+        .max_store_buf_size = PLAN_ADC_POOL_BYTES,
+        .conv_frame_size = PLAN_ADC_FRAME_BYTES,
+        .flags.flush_pool = true, // Nothing reads the pool, old frames make room
+    };
+    ESP_ERROR_CHECK(adc_continuous_new_handle(&handle_config, &adc_handle));
+
+    adc_unit_t unit;
+    ESP_ERROR_CHECK(adc_continuous_io_to_channel(AMBIENT_PIN, &unit, &adc_channel));
+    adc_digi_pattern_config_t pattern = {
+        .atten = ADC_ATTEN_DB_12, // Full range, up to about 3.1 V
+        .channel = adc_channel,
+        .unit = unit,
+        .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+    };
+    const adc_continuous_config_t config = {
+        .pattern_num = 1,
+        .adc_pattern = &pattern,
+        .sample_freq_hz = AMBIENT_SAMPLE_RATE_HZ,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+    };
+    ESP_ERROR_CHECK(adc_continuous_config(adc_handle, &config));
+
+    const adc_continuous_evt_cbs_t callbacks = {
+        .on_conv_done = ambient_conv_done,
+    };
+    ESP_ERROR_CHECK(adc_continuous_register_event_callbacks(adc_handle, &callbacks, NULL));
+
+    const TimerJobArgs burst_job_args = {
+        .name = "ambient",
+        .callback = burst_job_callback,
+        .slack_ms = AMBIENT_SLACK_MS,
+    };
+    timer_job_init(&burst_job, &burst_job_args);
+    const TimerJobArgs done_job_args = {
+        .name = "ambient_done",
+        .callback = done_job_callback,
+    };
+    timer_job_init(&done_job, &done_job_args);
+    jobs_ready = true;
+    ambient_update_sampling();
+
+    printf("Ambient light sensor initialized (GPIO %d, ADC1 channel %d)\n", AMBIENT_PIN, (int)adc_channel);
+}
+
+// Sample while the light is on, stop the timer job otherwise. A burst under
+// way is finished by the done job.
+void ambient_update_sampling(void)
+{
+    if (!jobs_ready)
+    {
+        return;
+    }
+
+    bool running = timer_is_active(&burst_job);
+    if (settings_get()->light == 1 && !running)
+    {
+        timer_start_periodic(&burst_job, AMBIENT_PERIOD_MS);
+    }
+    else if (settings_get()->light == 0 && running)
+    {
+        timer_stop(&burst_job);
+    }
+}
+
+int ambient_scale_brightness(int brightness)
+{
+    if (!settings_get()->auto_brightness)
+    {
+        return brightness;
+    }
+    return brightness * applied_scale / 100;
+}
+
+int ambient_get_level(void)
+{
+    return shown_level;
+}
+
+int ambient_get_scale(void)
+{
+    return applied_scale;
+}
+
+void ambient_get_stats(AmbientStats *out)
+{
+    *out = stats;
+}
+
+void ambient_print_stats(void)
+{
+    AmbientStats snapshot;
+    ambient_get_stats(&snapshot);
+    printf("Ambient: level %d, scale %d%% (auto %s), %lu bursts, %lu missed, %lu samples, %lu changes\n",
+           ambient_get_level(), ambient_get_scale(), settings_get()->auto_brightness ? "on" : "off",
+           (unsigned long)snapshot.bursts, (unsigned long)snapshot.missed, (unsigned long)snapshot.samples,
+           (unsigned long)snapshot.changes);
+}
@@ -0,0 +1,163 @@
+#include "board_control.h"
+#include <stdio.h>
+
+// GPIOs an ESP32 has: 0-5, 12-19, 21-23, 25-27, 32-39 (6-11 belong to the flash)
+#define GPIO_EXISTING_MASK 0xFF0EEFF03FULL
+
+// The PSRAM of a WROVER module sits on GPIO 16 and 17
+#if CONFIG_SUPER_LIGHTS_BOARD_WROVER || CONFIG_SPIRAM
+#define GPIO_RESERVED_MASK ((1ULL << 16) | (1ULL << 17))
+#else
+#define GPIO_RESERVED_MASK 0ULL
+#endif
+
+// RTC GPIOs, the only ones EXT0/EXT1 can wake the chip from deep sleep with
+#define GPIO_RTC_MASK 0xFF0E00F015ULL
+
+// ADC1 inputs, the only ones the continuous (DMA) ADC mode reads
+#define GPIO_ADC1_MASK 0xFF00000000ULL
+
+// 34-39 are input only and have no internal pull resistors
+#define GPIO_FIRST_INPUT_ONLY 34
+
+#define PIN_BIT(gpio) ((gpio) < 0 ? 0ULL : 1ULL << ((gpio) & 63))
+#define PIN_USABLE(gpio) ((PIN_BIT(gpio) & GPIO_EXISTING_MASK & ~GPIO_RESERVED_MASK) != 0)
+
+// -1 means the function is compiled out and passes every check
+#define CHECK_INPUT(gpio, name) \
+    _Static_assert((gpio) < 0 || PIN_USABLE(gpio), name ": no such GPIO, or it belongs to the flash or PSRAM")
+#define CHECK_OUTPUT(gpio, name)                                                 \
+    _Static_assert((gpio) < 0 || (PIN_USABLE(gpio) && (gpio) < GPIO_FIRST_INPUT_ONLY), \
+                   name ": needs a GPIO that can drive an output (not 34-39)")
+#define CHECK_PULL_UP(gpio, name)                                                \
+    _Static_assert((gpio) < 0 || (PIN_USABLE(gpio) && (gpio) < GPIO_FIRST_INPUT_ONLY), \
+                   name ": needs a GPIO with an internal pull-up (not 34-39)")
+#define CHECK_RTC(gpio, name) \
+    _Static_assert((PIN_BIT(gpio) & GPIO_RTC_MASK) != 0, name ": has to be an RTC GPIO to wake the chip from standby")
+#define CHECK_ADC1(gpio, name) \
+    _Static_assert((gpio) < 0 || (PIN_BIT(gpio) & GPIO_ADC1_MASK) != 0, name ": has to be an ADC1 GPIO (32-39)")
+#define CHECK_FREE(gpio, used, name) \
+    _Static_assert((PIN_BIT(gpio) & (used)) == 0, name ": GPIO already taken by a function claimed before it below")
+
+CHECK_OUTPUT(BOARD_POWER_LED_GPIO, "Power LED");
+CHECK_PULL_UP(BOARD_POWER_BUTTON_GPIO, "POWER button");
+CHECK_RTC(BOARD_POWER_BUTTON_GPIO, "POWER button");
+CHECK_PULL_UP(BOARD_ENTER_BUTTON_GPIO, "ENTER button");
+CHECK_PULL_UP(BOARD_BACK_BUTTON_GPIO, "BACK button");
+CHECK_PULL_UP(BOARD_UP_BUTTON_GPIO, "UP button");
+CHECK_PULL_UP(BOARD_DOWN_BUTTON_GPIO, "DOWN button");
+CHECK_INPUT(BOARD_IR_GPIO, "PIR");
+CHECK_RTC(BOARD_IR_GPIO, "PIR");
+CHECK_OUTPUT(BOARD_LED_STRIP_GPIO, "LED strip");
+CHECK_OUTPUT(BOARD_US_TRIG_GPIO, "Ultrasonic TRIG");
+CHECK_INPUT(BOARD_US_ECHO_GPIO, "Ultrasonic ECHO");
+CHECK_OUTPUT(BOARD_LCD_SDA_GPIO, "LCD SDA");
+CHECK_OUTPUT(BOARD_LCD_SCL_GPIO, "LCD SCL");
+CHECK_OUTPUT(BOARD_I2S_BCK_GPIO, "Amplifier BCK");
+CHECK_OUTPUT(BOARD_I2S_LCK_GPIO, "Amplifier LCK");
+CHECK_OUTPUT(BOARD_I2S_DIN_GPIO, "Amplifier DIN");
+CHECK_OUTPUT(BOARD_REMOTE_TX_GPIO, "Remote TX");
+CHECK_INPUT(BOARD_REMOTE_RX_GPIO, "Remote RX");
+CHECK_INPUT(BOARD_AMBIENT_GPIO, "Ambient light");
+CHECK_ADC1(BOARD_AMBIENT_GPIO, "Ambient light");
+
+// Every function claims its pin in turn
+#define USED_1 PIN_BIT(BOARD_POWER_LED_GPIO)
+CHECK_FREE(BOARD_POWER_BUTTON_GPIO, USED_1, "POWER button");
+#define USED_2 (USED_1 | PIN_BIT(BOARD_POWER_BUTTON_GPIO))
+CHECK_FREE(BOARD_ENTER_BUTTON_GPIO, USED_2, "ENTER button");
+#define USED_3 (USED_2 | PIN_BIT(BOARD_ENTER_BUTTON_GPIO))
+CHECK_FREE(BOARD_BACK_BUTTON_GPIO, USED_3, "BACK button");
+#define USED_4 (USED_3 | PIN_BIT(BOARD_BACK_BUTTON_GPIO))
+CHECK_FREE(BOARD_UP_BUTTON_GPIO, USED_4, "UP button");
+#define USED_5 (USED_4 | PIN_BIT(BOARD_UP_BUTTON_GPIO))
+CHECK_FREE(BOARD_DOWN_BUTTON_GPIO, USED_5, "DOWN button");
+#define USED_6 (USED_5 | PIN_BIT(BOARD_DOWN_BUTTON_GPIO))
+CHECK_FREE(BOARD_IR_GPIO, USED_6, "PIR");
+#define USED_7 (USED_6 | PIN_BIT(BOARD_IR_GPIO))
+CHECK_FREE(BOARD_LED_STRIP_GPIO, USED_7, "LED strip");
+#define USED_8 (USED_7 | PIN_BIT(BOARD_LED_STRIP_GPIO))
+CHECK_FREE(BOARD_US_TRIG_GPIO, USED_8, "Ultrasonic TRIG");
+#define USED_9 (USED_8 | PIN_BIT(BOARD_US_TRIG_GPIO))
+CHECK_FREE(BOARD_US_ECHO_GPIO, USED_9, "Ultrasonic ECHO");
+#define USED_10 (USED_9 | PIN_BIT(BOARD_US_ECHO_GPIO))
+CHECK_FREE(BOARD_LCD_SDA_GPIO, USED_10, "LCD SDA");
+#define USED_11 (USED_10 | PIN_BIT(BOARD_LCD_SDA_GPIO))
+CHECK_FREE(BOARD_LCD_SCL_GPIO, USED_11, "LCD SCL");
+#define USED_12 (USED_11 | PIN_BIT(BOARD_LCD_SCL_GPIO))
+CHECK_FREE(BOARD_I2S_BCK_GPIO, USED_12, "Amplifier BCK");
+#define USED_13 (USED_12 | PIN_BIT(BOARD_I2S_BCK_GPIO))
+CHECK_FREE(BOARD_I2S_LCK_GPIO, USED_13, "Amplifier LCK");
+#define USED_14 (USED_13 | PIN_BIT(BOARD_I2S_LCK_GPIO))
+CHECK_FREE(BOARD_I2S_DIN_GPIO, USED_14, "Amplifier DIN");
+#define USED_15 (USED_14 | PIN_BIT(BOARD_I2S_DIN_GPIO))
+CHECK_FREE(BOARD_REMOTE_TX_GPIO, USED_15, "Remote TX");
+#define USED_16 (USED_15 | PIN_BIT(BOARD_REMOTE_TX_GPIO))
+CHECK_FREE(BOARD_REMOTE_RX_GPIO, USED_16, "Remote RX");
+#define USED_17 (USED_16 | PIN_BIT(BOARD_REMOTE_RX_GPIO))
+CHECK_FREE(BOARD_AMBIENT_GPIO, USED_17, "Ambient light");
+
+#if CONFIG_SUPER_LIGHTS_DISPLAY
+#define FEATURE_DISPLAY " display"
+#else
+#define FEATURE_DISPLAY ""
+#endif
+#if CONFIG_SUPER_LIGHTS_AUDIO
+#define FEATURE_AUDIO " audio"
+#else
+#define FEATURE_AUDIO ""
+#endif
+#if CONFIG_SUPER_LIGHTS_ULTRASONIC
+#define FEATURE_ULTRASONIC " ultrasonic"
+#else
+#define FEATURE_ULTRASONIC ""
+#endif
+#if CONFIG_SUPER_LIGHTS_REMOTE
+#define FEATURE_REMOTE " remote"
+#else
+#define FEATURE_REMOTE ""
+#endif
+#if CONFIG_SUPER_LIGHTS_AMBIENT
+#define FEATURE_AMBIENT " ambient"
+#else
+#define FEATURE_AMBIENT ""
+#endif
+
+typedef struct {
+    const char *name;
+    int gpio;
+} BoardPin;
+
+static const BoardPin board_pins[] = {
+    {"Power LED", BOARD_POWER_LED_GPIO},
+    {"POWER button", BOARD_POWER_BUTTON_GPIO},
+    {"ENTER button", BOARD_ENTER_BUTTON_GPIO},
+    {"BACK button", BOARD_BACK_BUTTON_GPIO},
+    {"UP button", BOARD_UP_BUTTON_GPIO},
+    {"DOWN button", BOARD_DOWN_BUTTON_GPIO},
+    {"PIR", BOARD_IR_GPIO},
+    {"LED strip", BOARD_LED_STRIP_GPIO},
+    {"Ultrasonic TRIG", BOARD_US_TRIG_GPIO},
+    {"Ultrasonic ECHO", BOARD_US_ECHO_GPIO},
+    {"LCD SDA", BOARD_LCD_SDA_GPIO},
+    {"LCD SCL", BOARD_LCD_SCL_GPIO},
+    {"Amplifier BCK", BOARD_I2S_BCK_GPIO},
+    {"Amplifier LCK", BOARD_I2S_LCK_GPIO},
+    {"Amplifier DIN", BOARD_I2S_DIN_GPIO},
+    {"Remote TX", BOARD_REMOTE_TX_GPIO},
+    {"Remote RX", BOARD_REMOTE_RX_GPIO},
+    {"Ambient light", BOARD_AMBIENT_GPIO},
+};
+
+void board_print_pin_map(void)
+{
+    printf("Board %s, features:%s, %d LEDs\n", BOARD_NAME,
+           FEATURE_DISPLAY FEATURE_AUDIO FEATURE_ULTRASONIC FEATURE_REMOTE FEATURE_AMBIENT, BOARD_LED_COUNT);
+    for (int i = 0; i < (int)(sizeof(board_pins) / sizeof(board_pins[0])); i++)
+    {
+        if (board_pins[i].gpio >= 0)
+        {
+            printf("  %-16s GPIO %d\n", board_pins[i].name, board_pins[i].gpio);
+        }
+    }
+}
@@ -0,0 +1,167 @@
+#include "boot_control.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "esp_timer.h"
+#include "memory_plan.h"
+#include <stdio.h>
+
+// Stages mostly wait on the I2C bus or on their own delays, two helpers next to
+// the calling task are enough to overlap them. Same priority as app_main.
+#define BOOT_WORKER_COUNT 2
+#define BOOT_WORKER_PRIORITY 1
+
+static const BootStage *boot_stages = NULL;
+static int boot_stage_count = 0;
+static uint32_t all_mask = 0;
+static uint32_t presence_mask = 0;
+
+static portMUX_TYPE boot_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t started_mask = 0;
+static uint32_t done_mask = 0;
+
+// One bit per finished stage, for the runners and the progress display. Not a
+// task notification, stages are free to use those themselves.
+_Static_assert(BOOT_MAX_STAGES <= 24, "event groups have 24 usable bits");
+static StaticEventGroup_t progress_buffer;
+static EventGroupHandle_t progress;
+
+static StackType_t worker_stacks[BOOT_WORKER_COUNT][PLAN_STACK_BOOT_WORKER];
+static StaticTask_t worker_tcbs[BOOT_WORKER_COUNT];
+
+static BootReport report;
+
+// Take the first stage whose dependencies are met, -1 if there is none right now.
+// seen gets the finished stages the choice was made on.
+static int claim_stage(uint32_t *seen)
+{
+    int claimed = -1;
+    portENTER_CRITICAL(&boot_lock);
+    for (int i = 0; i < boot_stage_count; i++)
+    {
+        if (!(started_mask & BOOT_STAGE_BIT(i)) && (boot_stages[i].deps & ~done_mask) == 0)
+        {
+            started_mask |= BOOT_STAGE_BIT(i);
+            claimed = i;
+            break;
+        }
+    }
+    *seen = done_mask;
+    portEXIT_CRITICAL(&boot_lock);
+    return claimed;
+}
+
+static void finish_stage(int stage)
+{
+    int64_t now_us = esp_timer_get_time();
+    report.stages[stage].end_us = now_us;
+
+    portENTER_CRITICAL(&boot_lock);
+    done_mask |= BOOT_STAGE_BIT(stage);
+    bool presence_ready = (done_mask & presence_mask) == presence_mask && report.presence_ready_us == 0;
+    portEXIT_CRITICAL(&boot_lock);
+
+    if (presence_ready)
+    {
+        report.presence_ready_us = now_us;
+    }
+    xEventGroupSetBits(progress, BOOT_STAGE_BIT(stage));
+}
+
+// Run stages until none is left to claim
+static void run_stages(void)
+{
+    while (1)
+    {
+        uint32_t seen;
+        int stage = claim_stage(&seen);
+        if (stage >= 0)
+        {
+            report.stages[stage].start_us = esp_timer_get_time();
+            boot_stages[stage].init();
+            finish_stage(stage);
+            continue;
+        }
+
+        portENTER_CRITICAL(&boot_lock);
+        bool all_claimed = started_mask == all_mask;
+        portEXIT_CRITICAL(&boot_lock);
+        if (all_claimed)
+        {
+            return;
+        }
+        boot_wait_for_progress(seen); // A finished stage may unblock another
+    }
+}
+
+static void boot_worker(void *pvParameters)
+{
+    run_stages();
+    vTaskDelete(NULL);
+}
+
+void boot_run(const BootStage *stages, int count)
+{
+    boot_stages = stages;
+    boot_stage_count = count;
+    all_mask = BOOT_STAGE_BIT(count) - 1;
+    presence_mask = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (stages[i].presence)
+        {
+            presence_mask |= BOOT_STAGE_BIT(i);
+        }
+    }
+    report.stage_count = count;
+    progress = xEventGroupCreateStatic(&progress_buffer);
+
+    // The caller is a runner too
+    for (int i = 0; i < BOOT_WORKER_COUNT; i++)
+    {
+        xTaskCreateStatic(boot_worker, "BootWorker", sizeof(worker_stacks[i]), NULL, BOOT_WORKER_PRIORITY,
+                          worker_stacks[i], &worker_tcbs[i]);
+    }
+
+    run_stages();
+
+    // Stages still running on the workers
+    xEventGroupWaitBits(progress, all_mask, pdFALSE, pdTRUE, portMAX_DELAY);
+    report.done_us = esp_timer_get_time();
+}
+
+uint32_t boot_done_mask(void)
+{
+    portENTER_CRITICAL(&boot_lock);
+    uint32_t mask = done_mask;
+    portEXIT_CRITICAL(&boot_lock);
+    return mask;
+}
+
+uint32_t boot_wait_for_progress(uint32_t seen)
+{
+    if (seen == all_mask)
+    {
+        return seen;
+    }
+    // The bits trail done_mask by a moment, keep what the caller already saw
+    return seen | (xEventGroupWaitBits(progress, all_mask & ~seen, pdFALSE, pdFALSE, portMAX_DELAY) & all_mask);
+}
+
+void boot_get_report(BootReport *out)
+{
+    *out = report;
+}
+
+void boot_print_report(void)
+{
+    printf("Boot: presence ready at %lld us, done at %lld us\n", (long long)report.presence_ready_us,
+           (long long)report.done_us);
+    printf("Stage          start us   time us\n");
+    for (int i = 0; i < report.stage_count; i++)
+    {
+        const BootStageTiming *timing = &report.stages[i];
+        printf("%-14s %8lld  %8lld\n", boot_stages[i].name, (long long)timing->start_us,
+               (long long)(timing->end_us - timing->start_us));
+    }
+}
@@ -1,6 +1,10 @@
 #include "button_control.h"
 #include "gpio_control.h"
+#include "log_control.h"
 #include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 int button_is_pressed(int gpio_num)
 {
@@ -10,13 +14,78 @@ int button_is_pressed(int gpio_num)
         esp_rom_delay_us(5000); // Delay for 5 milliseconds
         if (gpio_get_button_state(gpio_num) == 0)
         {
-            // Wait for button to be released (debouncing)
-            while (gpio_get_button_state(gpio_num) == 0)
-            {
-                esp_rom_delay_us(1000); // Delay for 1 millisecond
-            }
+            button_wait_release(gpio_num); // Debouncing
             return 1; // Button press confirmed
         }
     }
     return 0; // Button not pressed
-}
\ No newline at end of file
+}
+
+bool button_wait_release(int gpio_num)
+{
+    int64_t give_up_us = esp_timer_get_time() + BUTTON_STUCK_MS * 1000LL;
+    while (gpio_get_button_state(gpio_num) == 0)
+    {
+        if (esp_timer_get_time() >= give_up_us)
+        {
+            LOG_WARN("Button on GPIO %d stuck, ignored until released", gpio_num);
+            gpio_ignore_until_released(gpio_num);
+            return false;
+        }
+        vTaskDelay(1); // Let everything else run while the button is down
+    }
+    return true;
+}
+
+// The fast steps alone sweep BUTTON_REPEAT_SPAN, so scaling them covers any span.
+// Rounds run a little longer than BUTTON_REPEAT_POLL_MS, count one less of each.
+_Static_assert(((BUTTON_REPEAT_FASTER_MS - BUTTON_REPEAT_FAST_MS) / BUTTON_REPEAT_POLL_MS - 1) * BUTTON_REPEAT_FAST_STEP +
+                       ((BUTTON_STUCK_MS - BUTTON_REPEAT_FASTER_MS) / BUTTON_REPEAT_POLL_MS - 1) *
+                           BUTTON_REPEAT_FASTER_STEP >=
+                   BUTTON_REPEAT_SPAN,
+               "a hold does not sweep BUTTON_REPEAT_SPAN before it counts as stuck");
+
+void button_repeat_init(ButtonRepeat *repeat, int span)
+{
+    repeat->gpio_num = -1;
+    repeat->down_since_us = 0;
+    repeat->scale = span > BUTTON_REPEAT_SPAN ? (span + BUTTON_REPEAT_SPAN - 1) / BUTTON_REPEAT_SPAN : 1;
+}
+
+int button_repeat_steps(ButtonRepeat *repeat, int gpio_num)
+{
+    if (gpio_get_button_state(gpio_num) != 0)
+    {
+        if (repeat->gpio_num == gpio_num)
+        {
+            repeat->gpio_num = -1; // Released, the next press steps at once
+        }
+        return 0;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (repeat->gpio_num != gpio_num)
+    {
+        repeat->gpio_num = gpio_num;
+        repeat->down_since_us = now;
+        return 1;
+    }
+
+    int64_t held_ms = (now - repeat->down_since_us) / 1000;
+    if (held_ms >= BUTTON_STUCK_MS)
+    {
+        LOG_WARN("Button on GPIO %d stuck, ignored until released", gpio_num);
+        gpio_ignore_until_released(gpio_num);
+        repeat->gpio_num = -1;
+        return 0;
+    }
+    if (held_ms < BUTTON_REPEAT_DELAY_MS)
+    {
+        return 0;
+    }
+    if (held_ms < BUTTON_REPEAT_FAST_MS)
+    {
+        return 1;
+    }
+    return repeat->scale * (held_ms < BUTTON_REPEAT_FASTER_MS ? BUTTON_REPEAT_FAST_STEP : BUTTON_REPEAT_FASTER_STEP);
+}
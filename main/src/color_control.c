@@ -0,0 +1,92 @@
+#include "color_control.h"
+#include "esp_attr.h"
+
+// Black body colors every 100 K from COLOR_KELVIN_MIN, interpolated in between
+#define KELVIN_STEP 100
+#define KELVIN_ENTRIES ((COLOR_KELVIN_MAX - COLOR_KELVIN_MIN) / KELVIN_STEP + 1)
+
+static const DRAM_ATTR uint8_t kelvin_lut[KELVIN_ENTRIES][3] = {
+    {255, 146, 39}, {255, 151, 50}, {255, 155, 61}, {255, 159, 70},
+    {255, 163, 79}, {255, 167, 87}, {255, 170, 95}, {255, 174, 103},
+    {255, 177, 110}, {255, 180, 117}, {255, 184, 123}, {255, 187, 129},
+    {255, 190, 135}, {255, 193, 141}, {255, 195, 146}, {255, 198, 151},
+    {255, 201, 157}, {255, 203, 161}, {255, 206, 166}, {255, 208, 171},
+    {255, 211, 175}, {255, 213, 179}, {255, 215, 183}, {255, 218, 187},
+    {255, 220, 191}, {255, 222, 195}, {255, 224, 199}, {255, 226, 202},
+    {255, 228, 206}, {255, 230, 209}, {255, 232, 213}, {255, 234, 216},
+    {255, 236, 219}, {255, 237, 222}, {255, 239, 225}, {255, 241, 228},
+    {255, 243, 231}, {255, 244, 234}, {255, 246, 237}, {255, 248, 240},
+    {255, 249, 242}, {255, 251, 245}, {255, 253, 248}, {255, 254, 250},
+};
+
+_Static_assert(KELVIN_ENTRIES == sizeof(kelvin_lut) / sizeof(kelvin_lut[0]), "kelvin_lut does not cover the range");
+
+// a * b / 255, exact for 8 bit operands, without a division
+static inline uint8_t scale8(uint32_t a, uint32_t b)
+{
+    uint32_t product = a * b + 128;
+    return (product + (product >> 8)) >> 8;
+}
+
+void color_hsv_to_rgb(uint16_t hue, uint8_t saturation, uint8_t value, uint8_t rgb[3])
+{
+    if (hue >= COLOR_HUE_STEPS)
+    {
+        hue %= COLOR_HUE_STEPS;
+    }
+    uint8_t sector = hue >> 8;
+    uint8_t rising = hue & 0xff;      // Of the component coming in
+    uint8_t falling = 255 - rising;   // Of the one going out
+
+    // Components at full saturation and value, then pulled towards white
+    // (saturation) and scaled (value)
+    uint8_t bottom = 255 - saturation;
+    uint8_t up = 255 - scale8(saturation, falling);
+    uint8_t down = 255 - scale8(saturation, rising);
+    uint8_t r, g, b;
+    switch (sector)
+    {
+    case 0:
+        r = 255, g = up, b = bottom;
+        break;
+    case 1:
+        r = down, g = 255, b = bottom;
+        break;
+    case 2:
+        r = bottom, g = 255, b = up;
+        break;
+    case 3:
+        r = bottom, g = down, b = 255;
+        break;
+    case 4:
+        r = up, g = bottom, b = 255;
+        break;
+    default:
+        r = 255, g = bottom, b = down;
+        break;
+    }
+    rgb[0] = scale8(r, value);
+    rgb[1] = scale8(g, value);
+    rgb[2] = scale8(b, value);
+}
+
+void color_kelvin_to_rgb(uint16_t kelvin, uint8_t rgb[3])
+{
+    if (kelvin <= COLOR_KELVIN_MIN)
+    {
+        kelvin = COLOR_KELVIN_MIN;
+    }
+    else if (kelvin >= COLOR_KELVIN_MAX)
+    {
+        kelvin = COLOR_KELVIN_MAX - 1; // Interpolates to the last entry
+    }
+    uint32_t offset = kelvin - COLOR_KELVIN_MIN;
+    uint32_t index = offset / KELVIN_STEP;
+    uint32_t fraction = offset - index * KELVIN_STEP; // 0 to 99
+    const uint8_t *low = kelvin_lut[index];
+    const uint8_t *high = kelvin_lut[index + 1];
+    for (int i = 0; i < 3; i++)
+    {
+        rgb[i] = low[i] + ((int)(high[i] - low[i]) * (int)fraction + KELVIN_STEP / 2) / KELVIN_STEP;
+    }
+}
@@ -1,169 +1,261 @@
 #include "display_control.h"
-#include "driver/i2c.h"
+#include "display_backend.h"
+#include "i2c_bus_control.h"
+#include "trace_control.h"
+#include "profiler_control.h"
+#include "pm_control.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include <string.h>
 
-#define I2C_MASTER_NUM I2C_NUM_0 // I2C port number
-#define I2C_MASTER_SDA_IO 22     // GPIO for SDA
-#define I2C_MASTER_SCL_IO 23     // GPIO for SCL
-#define I2C_MASTER_FREQ_HZ 100000 // I2C clock frequency
+#if CONFIG_SUPER_LIGHTS_DISPLAY_SSD1306
+static const DisplayBackend *const backend = &display_ssd1306;
+#else
+static const DisplayBackend *const backend = &display_hd44780;
+#endif
 
-// I2C address of the 1602IIC display
-#define LCD_ADDR 0x27
+// What the panel shows, so a partial update only sends the cells that change.
+// A row is only compared once it is known (after a resume the LCD kept rows
+// this side never saw).
+static char shown[DISPLAY_ROWS_MAX][DISPLAY_COLS];
+static uint8_t shown_valid = 0; // One bit per row
 
-// LCD commands
-#define LCD_CMD_CLEAR_DISPLAY 0x01
-#define LCD_CMD_RETURN_HOME 0x02
-#define LCD_CMD_FUNCTION_SET 0x28 // 4-bit mode, 2 lines, 5x8 dots
-#define LCD_CMD_DISPLAY_ON 0x0C   // Display ON, cursor OFF, blink OFF
-#define LCD_CMD_ENTRY_MODE 0x06   // Increment cursor, no display shift
+// Glyphs for the bars (rows 0-6, row 7 is the cursor's) and icons
+const uint8_t display_glyph_bitmaps[DISPLAY_GLYPH_COUNT][DISPLAY_GLYPH_ROWS] = {
+    [DISPLAY_GLYPH_BAR_1] = {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00},
+    [DISPLAY_GLYPH_BAR_2] = {0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x00},
+    [DISPLAY_GLYPH_BAR_3] = {0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x1C, 0x00},
+    [DISPLAY_GLYPH_BAR_4] = {0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x1E, 0x00},
+    [DISPLAY_GLYPH_BAR_5] = {0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x00},
+    [DISPLAY_GLYPH_SUN] = {0x00, 0x15, 0x0E, 0x1B, 0x0E, 0x15, 0x00, 0x00},
+    [DISPLAY_GLYPH_SPEAKER] = {0x02, 0x06, 0x1E, 0x1E, 0x1E, 0x06, 0x02, 0x00},
+    [DISPLAY_GLYPH_EYE] = {0x00, 0x0E, 0x11, 0x15, 0x11, 0x0E, 0x00, 0x00},
+    [DISPLAY_GLYPH_WAVE] = {0x00, 0x12, 0x09, 0x05, 0x09, 0x12, 0x00, 0x00},
+};
 
-// Control bits for PCF8574
-#define LCD_BACKLIGHT 0x08 // Backlight ON
-#define LCD_ENABLE    0x04 // Enable bit
-#define LCD_RW        0x02 // Read/Write bit (0 = Write)
-#define LCD_RS        0x01 // Register Select bit (0 = Command, 1 = Data)
-
-// Helper function to send a nibble (4 bits) to the LCD via PCF8574
-static esp_err_t lcd_send_nibble(uint8_t nibble, uint8_t control)
+static void shown_reset(void)
 {
-    uint8_t data = (nibble & 0xF0) | control | LCD_BACKLIGHT; // Combine nibble, control bits, and backlight
-    i2c_cmd_handle_t cmd = i2c_cmd_link_create();
-    i2c_master_start(cmd);
-    i2c_master_write_byte(cmd, (LCD_ADDR << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write_byte(cmd, data, true); // Send data with Enable LOW
-    i2c_master_write_byte(cmd, data | LCD_ENABLE, true); // Pulse Enable HIGH
-    i2c_master_write_byte(cmd, data, true); // Pulse Enable LOW
-    i2c_master_stop(cmd);
-    esp_err_t ret = i2c_master_cmd_begin(I2C_MASTER_NUM, cmd, pdMS_TO_TICKS(1000));
-    i2c_cmd_link_delete(cmd);
-    return ret;
+    memset(shown, ' ', sizeof(shown));
+    shown_valid = (1 << backend->rows) - 1;
 }
 
-// Helper function to send a command to the LCD
-static esp_err_t lcd_send_command(uint8_t command)
+void display_init(void)
 {
-    // Send the high nibble (upper 4 bits)
-    lcd_send_nibble(command & 0xF0, 0x00); // RS = 0, RW = 0 (Command mode)
+    i2c_bus_init(backend->bus_hz);
 
-    // Send the low nibble (lower 4 bits)
-    lcd_send_nibble((command << 4) & 0xF0, 0x00); // RS = 0, RW = 0 (Command mode)
+    // Wait for the panel to power up
+    vTaskDelay(pdMS_TO_TICKS(50));
 
-    vTaskDelay(pdMS_TO_TICKS(2)); // Wait for the command to complete
-    return ESP_OK;
+    backend->init();
+    shown_reset();
 }
 
-// Helper function to send data (characters) to the LCD
-static esp_err_t lcd_send_data(uint8_t data)
+// A glitch on the bus can leave the LCD out of step with the nibbles (8-bit
+// mode, half a byte behind); the init sequence gets it back
+void display_reinit(void)
 {
-    // Send the high nibble (upper 4 bits)
-    lcd_send_nibble(data & 0xF0, LCD_RS); // RS = 1, RW = 0 (Data mode)
-
-    // Send the low nibble (lower 4 bits)
-    lcd_send_nibble((data << 4) & 0xF0, LCD_RS); // RS = 1, RW = 0 (Data mode)
+    backend->init();
+    shown_reset();
+}
 
-    vTaskDelay(pdMS_TO_TICKS(2)); // Wait for the data to be written
-    return ESP_OK;
+// The panel stays powered through deep sleep and keeps its configuration,
+// only the bus needs setting up again
+void display_resume(void)
+{
+    i2c_bus_init(backend->bus_hz);
+    shown_valid = 0; // The panel kept its contents, this side did not
+    backend->resume();
 }
 
-void display_init(void)
+// Blank the panel and switch the backlight off ahead of deep sleep
+void display_standby(void)
 {
-    // Configure I2C
-    i2c_config_t conf = {
-        .mode = I2C_MODE_MASTER,
-        .sda_io_num = I2C_MASTER_SDA_IO,
-        .scl_io_num = I2C_MASTER_SCL_IO,
-        .sda_pullup_en = GPIO_PULLUP_ENABLE,
-        .scl_pullup_en = GPIO_PULLUP_ENABLE,
-        .master.clk_speed = I2C_MASTER_FREQ_HZ,
-    };
-    i2c_param_config(I2C_MASTER_NUM, &conf);
-    i2c_driver_install(I2C_MASTER_NUM, conf.mode, 0, 0, 0);
-
-    // Wait for the LCD to power up
-    vTaskDelay(pdMS_TO_TICKS(50));
+    backend->standby();
+}
 
-    // Initialize the LCD in 4-bit mode
-    lcd_send_nibble(0x30, 0x00); // Function set (8-bit mode)
-    vTaskDelay(pdMS_TO_TICKS(5));
-    lcd_send_nibble(0x30, 0x00); // Function set (8-bit mode)
-    vTaskDelay(pdMS_TO_TICKS(1));
-    lcd_send_nibble(0x20, 0x00); // Function set (4-bit mode)
+void display_set_backlight(bool on)
+{
+    backend->set_backlight(on);
+}
 
-    // Send initialization commands
-    lcd_send_command(LCD_CMD_FUNCTION_SET); // 4-bit mode, 2 lines, 5x8 dots
-    lcd_send_command(LCD_CMD_DISPLAY_ON);   // Display ON, cursor OFF, blink OFF
-    lcd_send_command(LCD_CMD_CLEAR_DISPLAY); // Clear the display
-    lcd_send_command(LCD_CMD_ENTRY_MODE);   // Increment cursor, no display shift
+int display_get_rows(void)
+{
+    return backend->rows;
 }
 
 void display_clear(void)
 {
-    // Send the clear display command
-    lcd_send_command(LCD_CMD_CLEAR_DISPLAY);
-    vTaskDelay(pdMS_TO_TICKS(2)); // Wait for the command to complete
+    backend->clear();
+    shown_reset();
 }
 
-void display_render(const char *line1, const char *line2)
+// Text padded with spaces to the width of a row
+static void pad_row(const char *text, char *cells)
 {
-    // Clear the display first
-    display_clear();
+    bool ended = false;
+    for (int col = 0; col < DISPLAY_COLS; col++)
+    {
+        ended = ended || text[col] == '\0';
+        cells[col] = ended ? ' ' : text[col];
+    }
+}
 
-    // Set cursor to the beginning of the first line
-    lcd_send_command(0x80); // DDRAM address 0x00
-    for (size_t i = 0; i < strlen(line1); i++)
+// Hand the backend the runs of cells that differ from what the panel shows
+static void draw_row(int row, const char *cells)
+{
+    bool valid = shown_valid & (1 << row);
+    int col = 0;
+    while (col < DISPLAY_COLS)
     {
-        lcd_send_data(line1[i]);
+        if (valid && shown[row][col] == cells[col])
+        {
+            col++;
+            continue;
+        }
+        int start = col;
+        while (col < DISPLAY_COLS && !(valid && shown[row][col] == cells[col]))
+        {
+            shown[row][col] = cells[col];
+            col++;
+        }
+        backend->draw(row, start, &cells[start], col - start);
     }
+    shown_valid |= 1 << row;
+}
+
+static void write_row_cells(int row, const char *text)
+{
+    char cells[DISPLAY_COLS];
+    pad_row(text, cells);
+    draw_row(row, cells);
+}
+
+// Cells drawn, plus one per run (the backend positions each), to bring a row
+// from what it shows (NULL: not known) to cells
+static int row_cost(const char *shows, const char *cells)
+{
+    int cost = 0;
+    bool in_run = false;
+    for (int col = 0; col < DISPLAY_COLS; col++)
+    {
+        bool differs = shows == NULL || shows[col] != cells[col];
+        cost += differs + (differs && !in_run);
+        in_run = differs;
+    }
+    return cost;
+}
 
-    // Set cursor to the beginning of the second line
-    lcd_send_command(0xC0); // DDRAM address 0x40
-    for (size_t i = 0; i < strlen(line2); i++)
+void display_render_lines(const char *const *lines, int count)
+{
+    trace_point(TRACE_DISPLAY_RENDER_START);
+    pm_control_acquire(PM_LOCK_LCD); // One clock raise for the whole burst
+    int64_t start_time = esp_timer_get_time();
+
+    // Overwrite what the panel shows, or clear it and draw the text alone,
+    // whichever sends less
+    static const char blank[DISPLAY_COLS] = "                ";
+    char cells[DISPLAY_ROWS_MAX][DISPLAY_COLS];
+    int overwrite_cost = 0;
+    int clear_cost = backend->clear_cost;
+    for (int row = 0; row < backend->rows; row++)
+    {
+        pad_row(row < count ? lines[row] : "", cells[row]);
+        overwrite_cost += row_cost(shown_valid & (1 << row) ? shown[row] : NULL, cells[row]);
+        clear_cost += row_cost(blank, cells[row]);
+    }
+    if (clear_cost < overwrite_cost)
     {
-        lcd_send_data(line2[i]);
+        display_clear();
     }
+    for (int row = 0; row < backend->rows; row++)
+    {
+        draw_row(row, cells[row]);
+    }
+    backend->flush();
+
+    profiler_time(PROFILER_TIMING_LCD_RENDER, esp_timer_get_time() - start_time);
+    pm_control_release(PM_LOCK_LCD);
+    trace_point(TRACE_DISPLAY_RENDER_END);
+}
+
+void display_render(const char *line1, const char *line2)
+{
+    const char *lines[] = {line1, line2};
+    display_render_lines(lines, 2);
 }
 
 void display_enable_cursor(void)
 {
-    lcd_send_command(0x0E); // Display ON, Cursor ON, Blink OFF
+    backend->set_cursor(-1, DISPLAY_CURSOR_LINE);
 }
 
 void display_disable_cursor(void)
 {
-    lcd_send_command(0x0C); // Display ON, Cursor OFF, Blink OFF
-    vTaskDelay(pdMS_TO_TICKS(2));
+    backend->set_cursor(-1, DISPLAY_CURSOR_OFF);
 }
 
 void display_highlight_row(int row)
 {
-    if (row == 1)
+    if (row >= 1 && row <= backend->rows)
     {
-        lcd_send_command(0x80); // Move cursor to the first row (DDRAM address 0x00)
+        backend->set_cursor(row - 1, DISPLAY_CURSOR_BLINK);
     }
-    else if (row == 2)
+}
+
+char display_glyph(DisplayGlyph glyph)
+{
+    return backend->glyph(glyph);
+}
+
+// Bring a row to text (padded with spaces), sending only the cells that differ
+void display_write_row(int row, const char *text)
+{
+    if (row < 0 || row >= backend->rows)
     {
-        lcd_send_command(0xC0); // Move cursor to the second row (DDRAM address 0x40)
+        return;
     }
+    pm_control_acquire(PM_LOCK_LCD);
+    write_row_cells(row, text);
+    backend->flush();
+    pm_control_release(PM_LOCK_LCD);
+}
 
-    // Enable blinking for the selected row
-    lcd_send_command(0x0F); // Display ON, Cursor ON, Blink ON
+// Cells of a bar at a level, DISPLAY_COLS wide, 5 steps a cell
+static void format_bar(int level, char *bar)
+{
+    for (int col = 0; col < DISPLAY_COLS; col++)
+    {
+        int fill = level - col * 5;
+        fill = fill < 0 ? 0 : fill > 5 ? 5 : fill;
+        bar[col] = fill == 0 ? ' ' : display_glyph(DISPLAY_GLYPH_BAR_1 + fill - 1);
+    }
+    bar[DISPLAY_COLS] = '\0';
 }
 
-void display_loading_animation(const char *message)
+void display_slider(const char *title, int level)
 {
-    display_clear();
-    display_render(message, ""); // Display the loading message
+    trace_point(TRACE_DISPLAY_RENDER_START);
+    int64_t start_time = esp_timer_get_time();
 
-    char loading_bar[17] = ""; // 16 characters max for the second line
-    for (int i = 0; i < 16; i++)
+    char bar[DISPLAY_COLS + 1];
+    format_bar(level, bar);
+    pm_control_acquire(PM_LOCK_LCD); // One clock raise for all rows
+    write_row_cells(0, title);
+    write_row_cells(1, bar);
+    for (int row = 2; row < backend->rows; row++)
     {
-        loading_bar[i] = '#'; // Add a block to the loading bar
-        loading_bar[i + 1] = '\0'; // Null-terminate the string
-        display_render(message, loading_bar); // Update the display
-        vTaskDelay(pdMS_TO_TICKS(125)); // Wait for 125ms (16 steps * 125ms = 2 seconds)
+        write_row_cells(row, ""); // Whatever a taller panel showed below
     }
-    vTaskDelay(pdMS_TO_TICKS(1500)); // Wait for 500ms before clearing the display
-    display_clear(); // Clear the display after the loading animation
-    display_render("All ready", "to go!!"); // Display completion message
-    vTaskDelay(pdMS_TO_TICKS(2500)); 
-}
\ No newline at end of file
+    backend->flush();
+    pm_control_release(PM_LOCK_LCD);
+
+    profiler_time(PROFILER_TIMING_LCD_RENDER, esp_timer_get_time() - start_time);
+    trace_point(TRACE_DISPLAY_RENDER_END);
+}
+
+// Title on the first row, a bar filled to done/total on the second
+void display_progress(const char *title, int done, int total)
+{
+    display_slider(title, total > 0 ? done * DISPLAY_BAR_STEPS / total : DISPLAY_BAR_STEPS);
+}
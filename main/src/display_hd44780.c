@@ -0,0 +1,232 @@
+#include "display_backend.h"
+#include "i2c_bus_control.h"
+#include "pm_control.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+
+// I2C address of the 1602IIC display
+#define LCD_ADDR 0x27
+
+// LCD commands
+#define LCD_CMD_CLEAR_DISPLAY 0x01
+#define LCD_CMD_RETURN_HOME 0x02
+#define LCD_CMD_FUNCTION_SET 0x28 // 4-bit mode, 2 lines, 5x8 dots
+#define LCD_CMD_DISPLAY_ON 0x0C   // Display ON, cursor OFF, blink OFF
+#define LCD_CMD_DISPLAY_OFF 0x08  // Display OFF, DDRAM kept
+#define LCD_CMD_ENTRY_MODE 0x06   // Increment cursor, no display shift
+#define LCD_CURSOR_ON 0x02        // | LCD_CMD_DISPLAY_ON
+#define LCD_BLINK_ON 0x01         // | LCD_CMD_DISPLAY_ON
+
+// Control bits for PCF8574
+#define LCD_BACKLIGHT 0x08 // Backlight ON
+#define LCD_ENABLE    0x04 // Enable bit
+#define LCD_RW        0x02 // Read/Write bit (0 = Write)
+#define LCD_RS        0x01 // Register Select bit (0 = Command, 1 = Data)
+
+#define LCD_CMD_SET_CGRAM 0x40 // | slot << 3
+#define LCD_CMD_SET_DDRAM 0x80 // | address
+#define LCD_ROW_ADDRESS(row) ((row) * 0x40)
+
+// CGRAM holds 8 glyphs of 5x8 pixels. Their character codes are 0x08-0x0F
+// (0x00-0x07 show the same glyphs), so they can sit in C strings.
+#define LCD_GLYPH_SLOTS 8
+#define LCD_GLYPH_CODE(slot) (0x08 + (slot))
+
+static uint8_t backlight = LCD_BACKLIGHT; // Goes out with every port write
+
+// Glyph in each CGRAM slot (DISPLAY_GLYPH_COUNT when empty), and when it was
+// last asked for: a new glyph replaces the least recently used one
+static uint8_t slot_glyph[LCD_GLYPH_SLOTS];
+static uint32_t slot_used[LCD_GLYPH_SLOTS];
+static uint32_t glyph_clock = 0;
+
+static I2cBusDevice lcd_device = I2C_BUS_DEVICE("lcd", LCD_ADDR, I2C_BUS_PRIORITY_DISPLAY);
+
+// Helper function to send a nibble (4 bits) to the LCD via PCF8574
+static esp_err_t lcd_send_nibble(uint8_t nibble, uint8_t control)
+{
+    uint8_t data = (nibble & 0xF0) | control | backlight; // Combine nibble, control bits, and backlight
+    const uint8_t port_writes[] = {
+        data,              // Send data with Enable LOW
+        data | LCD_ENABLE, // Pulse Enable HIGH
+        data,              // Pulse Enable LOW
+    };
+    return i2c_bus_write(&lcd_device, NULL, 0, port_writes, sizeof(port_writes));
+}
+
+// Helper function to send a command to the LCD
+static esp_err_t lcd_send_command(uint8_t command)
+{
+    // The two halves go out back to back, nothing else on the bus between them
+    i2c_bus_lock(&lcd_device);
+
+    // Send the high nibble (upper 4 bits)
+    lcd_send_nibble(command & 0xF0, 0x00); // RS = 0, RW = 0 (Command mode)
+
+    // Send the low nibble (lower 4 bits)
+    lcd_send_nibble((command << 4) & 0xF0, 0x00); // RS = 0, RW = 0 (Command mode)
+
+    i2c_bus_unlock();
+    vTaskDelay(pdMS_TO_TICKS(2)); // Wait for the command to complete
+    return ESP_OK;
+}
+
+// Helper function to send data (characters) to the LCD
+static esp_err_t lcd_send_data(uint8_t data)
+{
+    i2c_bus_lock(&lcd_device);
+
+    // Send the high nibble (upper 4 bits)
+    lcd_send_nibble(data & 0xF0, LCD_RS); // RS = 1, RW = 0 (Data mode)
+
+    // Send the low nibble (lower 4 bits)
+    lcd_send_nibble((data << 4) & 0xF0, LCD_RS); // RS = 1, RW = 0 (Data mode)
+
+    i2c_bus_unlock();
+
+    vTaskDelay(pdMS_TO_TICKS(2)); // Wait for the data to be written
+    return ESP_OK;
+}
+
+// Set the PCF8574 port without pulsing Enable, the LCD ignores it
+static esp_err_t lcd_write_port(uint8_t data)
+{
+    return i2c_bus_write(&lcd_device, NULL, 0, &data, 1);
+}
+
+// Forget the uploaded glyphs, so they are sent again when next used
+static void glyph_cache_reset(void)
+{
+    memset(slot_glyph, DISPLAY_GLYPH_COUNT, sizeof(slot_glyph));
+    memset(slot_used, 0, sizeof(slot_used));
+}
+
+// HD44780 reset by instruction, brings it to 4-bit mode from any state
+static void hd44780_init(void)
+{
+    i2c_bus_add_device(&lcd_device);
+
+    // Initialize the LCD in 4-bit mode
+    lcd_send_nibble(0x30, 0x00); // Function set (8-bit mode)
+    vTaskDelay(pdMS_TO_TICKS(5));
+    lcd_send_nibble(0x30, 0x00); // Function set (8-bit mode)
+    vTaskDelay(pdMS_TO_TICKS(1));
+    lcd_send_nibble(0x20, 0x00); // Function set (4-bit mode)
+
+    // Send initialization commands
+    lcd_send_command(LCD_CMD_FUNCTION_SET); // 4-bit mode, 2 lines, 5x8 dots
+    lcd_send_command(LCD_CMD_DISPLAY_ON);   // Display ON, cursor OFF, blink OFF
+    lcd_send_command(LCD_CMD_CLEAR_DISPLAY); // Clear the display
+    lcd_send_command(LCD_CMD_ENTRY_MODE);   // Increment cursor, no display shift
+    glyph_cache_reset(); // CGRAM may have been lost with whatever upset the LCD
+}
+
+static void hd44780_set_backlight(bool on)
+{
+    backlight = on ? LCD_BACKLIGHT : 0;
+    lcd_write_port(backlight);
+}
+
+// The LCD keeps its 4-bit configuration through deep sleep
+static void hd44780_resume(void)
+{
+    glyph_cache_reset();
+    hd44780_set_backlight(true);
+    lcd_send_command(LCD_CMD_DISPLAY_ON);
+}
+
+static void hd44780_standby(void)
+{
+    lcd_send_command(LCD_CMD_DISPLAY_OFF);
+    hd44780_set_backlight(false);
+}
+
+static void hd44780_clear(void)
+{
+    lcd_send_command(LCD_CMD_CLEAR_DISPLAY);
+    vTaskDelay(pdMS_TO_TICKS(2)); // Wait for the command to complete
+}
+
+// The LCD has its own RAM, characters go out as they are drawn
+static void hd44780_draw(int row, int col, const char *text, int count)
+{
+    lcd_send_command(LCD_CMD_SET_DDRAM | (LCD_ROW_ADDRESS(row) + col));
+    for (int i = 0; i < count; i++)
+    {
+        lcd_send_data(text[i]);
+    }
+}
+
+static void hd44780_flush(void)
+{
+}
+
+static void hd44780_set_cursor(int row, DisplayCursor cursor)
+{
+    if (row >= 0)
+    {
+        lcd_send_command(LCD_CMD_SET_DDRAM | LCD_ROW_ADDRESS(row));
+    }
+    switch (cursor)
+    {
+    case DISPLAY_CURSOR_OFF:
+        lcd_send_command(LCD_CMD_DISPLAY_ON);
+        vTaskDelay(pdMS_TO_TICKS(2));
+        break;
+    case DISPLAY_CURSOR_LINE:
+        lcd_send_command(LCD_CMD_DISPLAY_ON | LCD_CURSOR_ON);
+        break;
+    case DISPLAY_CURSOR_BLINK:
+        lcd_send_command(LCD_CMD_DISPLAY_ON | LCD_CURSOR_ON | LCD_BLINK_ON);
+        break;
+    }
+}
+
+static char hd44780_glyph(DisplayGlyph glyph)
+{
+    glyph_clock++;
+    int victim = 0;
+    for (int slot = 0; slot < LCD_GLYPH_SLOTS; slot++)
+    {
+        if (slot_glyph[slot] == glyph)
+        {
+            slot_used[slot] = glyph_clock;
+            return LCD_GLYPH_CODE(slot);
+        }
+        if (slot_used[slot] < slot_used[victim])
+        {
+            victim = slot; // Empty slots were never used, they go first
+        }
+    }
+
+    // Upload it over the least recently used one. A screen asks for all its
+    // glyphs when it is drawn, so that is never one on the screen.
+    pm_control_acquire(PM_LOCK_LCD);
+    lcd_send_command(LCD_CMD_SET_CGRAM | (victim << 3));
+    for (int row = 0; row < DISPLAY_GLYPH_ROWS; row++)
+    {
+        lcd_send_data(display_glyph_bitmaps[glyph][row]);
+    }
+    pm_control_release(PM_LOCK_LCD);
+    // The next draw sets its DDRAM address first
+    slot_glyph[victim] = glyph;
+    slot_used[victim] = glyph_clock;
+    return LCD_GLYPH_CODE(victim);
+}
+
+const DisplayBackend display_hd44780 = {
+    .rows = 2,
+    .cols = 16,
+    .bus_hz = 100000,
+    .clear_cost = 2, // One command, with a long execution time
+    .init = hd44780_init,
+    .resume = hd44780_resume,
+    .standby = hd44780_standby,
+    .set_backlight = hd44780_set_backlight,
+    .clear = hd44780_clear,
+    .draw = hd44780_draw,
+    .flush = hd44780_flush,
+    .set_cursor = hd44780_set_cursor,
+    .glyph = hd44780_glyph,
+};
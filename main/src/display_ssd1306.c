@@ -0,0 +1,295 @@
+#include "display_backend.h"
+#include "i2c_bus_control.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+
+// I2C address of the SSD1306 modules with SA0 low
+#define OLED_ADDR 0x3C
+
+#define OLED_WIDTH 128
+#define OLED_PAGES 8 // 8 pixel rows each, one text row
+#define OLED_CELL_WIDTH (OLED_WIDTH / DISPLAY_COLS)
+
+// First byte of every transfer: what the rest of it is
+#define OLED_CONTROL_COMMANDS 0x00
+#define OLED_CONTROL_DATA 0x40
+
+// Commands
+#define OLED_CMD_DISPLAY_OFF 0xAE
+#define OLED_CMD_DISPLAY_ON 0xAF
+#define OLED_CMD_ADDRESSING_MODE 0x20 // + 0: horizontal, wraps to the next page
+#define OLED_CMD_COLUMN_RANGE 0x21    // + first, last
+#define OLED_CMD_PAGE_RANGE 0x22      // + first, last
+
+// 5x7 font for 0x20-0x7E, one byte per pixel column, bit 0 at the top
+#define OLED_FONT_FIRST 0x20
+#define OLED_FONT_LAST 0x7E
+#define OLED_FONT_WIDTH 5
+
+// Glyph codes are 0x01-0x09, below the font
+#define OLED_GLYPH_CODE(glyph) (0x01 + (glyph))
+
+static const uint8_t font[OLED_FONT_LAST - OLED_FONT_FIRST + 1][OLED_FONT_WIDTH] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00},
+    {0x14, 0x7F, 0x14, 0x7F, 0x14}, {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},
+    {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00}, {0x00, 0x1C, 0x22, 0x41, 0x00},
+    {0x00, 0x41, 0x22, 0x1C, 0x00}, {0x14, 0x08, 0x3E, 0x08, 0x14}, {0x08, 0x08, 0x3E, 0x08, 0x08},
+    {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x60, 0x60, 0x00, 0x00},
+    {0x20, 0x10, 0x08, 0x04, 0x02}, {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00},
+    {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4B, 0x31}, {0x18, 0x14, 0x12, 0x7F, 0x10},
+    {0x27, 0x45, 0x45, 0x45, 0x39}, {0x3C, 0x4A, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1E}, {0x00, 0x36, 0x36, 0x00, 0x00},
+    {0x00, 0x56, 0x36, 0x00, 0x00}, {0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14},
+    {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06}, {0x32, 0x49, 0x79, 0x41, 0x3E},
+    {0x7E, 0x11, 0x11, 0x11, 0x7E}, {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22},
+    {0x7F, 0x41, 0x41, 0x22, 0x1C}, {0x7F, 0x49, 0x49, 0x49, 0x41}, {0x7F, 0x09, 0x09, 0x09, 0x01},
+    {0x3E, 0x41, 0x49, 0x49, 0x7A}, {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00},
+    {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41}, {0x7F, 0x40, 0x40, 0x40, 0x40},
+    {0x7F, 0x02, 0x0C, 0x02, 0x7F}, {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E},
+    {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E}, {0x7F, 0x09, 0x19, 0x29, 0x46},
+    {0x46, 0x49, 0x49, 0x49, 0x31}, {0x01, 0x01, 0x7F, 0x01, 0x01}, {0x3F, 0x40, 0x40, 0x40, 0x3F},
+    {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x3F, 0x40, 0x38, 0x40, 0x3F}, {0x63, 0x14, 0x08, 0x14, 0x63},
+    {0x07, 0x08, 0x70, 0x08, 0x07}, {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x00},
+    {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7F, 0x00}, {0x04, 0x02, 0x01, 0x02, 0x04},
+    {0x40, 0x40, 0x40, 0x40, 0x40}, {0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78},
+    {0x7F, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20}, {0x38, 0x44, 0x44, 0x48, 0x7F},
+    {0x38, 0x54, 0x54, 0x54, 0x18}, {0x08, 0x7E, 0x09, 0x01, 0x02}, {0x0C, 0x52, 0x52, 0x52, 0x3E},
+    {0x7F, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7D, 0x40, 0x00}, {0x20, 0x40, 0x44, 0x3D, 0x00},
+    {0x7F, 0x10, 0x28, 0x44, 0x00}, {0x00, 0x41, 0x7F, 0x40, 0x00}, {0x7C, 0x04, 0x18, 0x04, 0x78},
+    {0x7C, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38}, {0x7C, 0x14, 0x14, 0x14, 0x08},
+    {0x08, 0x14, 0x14, 0x18, 0x7C}, {0x7C, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20},
+    {0x04, 0x3F, 0x44, 0x40, 0x20}, {0x3C, 0x40, 0x40, 0x20, 0x7C}, {0x1C, 0x20, 0x40, 0x20, 0x1C},
+    {0x3C, 0x40, 0x30, 0x40, 0x3C}, {0x44, 0x28, 0x10, 0x28, 0x44}, {0x0C, 0x50, 0x50, 0x50, 0x3C},
+    {0x44, 0x64, 0x54, 0x4C, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00}, {0x00, 0x00, 0x7F, 0x00, 0x00},
+    {0x00, 0x41, 0x36, 0x08, 0x00}, {0x10, 0x08, 0x08, 0x10, 0x08},
+};
+
+// Power-on configuration of the common 128x64 modules (internal charge pump,
+// mounted with the flex cable below the glass)
+static const uint8_t init_commands[] = {
+    OLED_CMD_DISPLAY_OFF,
+    0xD5, 0x80, // Clock divider
+    0xA8, 0x3F, // 64 rows
+    0xD3, 0x00, // No vertical offset
+    0x40,       // Start line 0
+    0x8D, 0x14, // Charge pump on
+    OLED_CMD_ADDRESSING_MODE, 0x00,
+    0xA1,       // Column 127 on the left
+    0xC8,       // Scan from the bottom row up
+    0xDA, 0x12, // COM pins, alternative layout
+    0x81, 0xCF, // Contrast
+    0xD9, 0xF1, // Precharge
+    0xDB, 0x40, // VCOMH level
+    0xA4,       // Show the RAM
+    0xA6,       // Not inverted
+    OLED_CMD_DISPLAY_ON,
+};
+_Static_assert(sizeof(init_commands) <= I2C_BUS_CHUNK_BYTES, "The init commands would be split across chunks");
+
+// The whole screen in RAM, and per page the columns that differ from the
+// panel's (first > last: none). A flush sends each damaged page as one run.
+static uint8_t framebuffer[OLED_PAGES][OLED_WIDTH];
+static uint8_t damage_first[OLED_PAGES];
+static uint8_t damage_last[OLED_PAGES];
+
+// Characters in the cells, to draw one again under a moving cursor
+static char cells[OLED_PAGES][DISPLAY_COLS];
+static int cursor_row = -1;
+static DisplayCursor cursor = DISPLAY_CURSOR_OFF;
+
+static I2cBusDevice oled_device = I2C_BUS_DEVICE("oled", OLED_ADDR, I2C_BUS_PRIORITY_DISPLAY);
+
+// The control byte, then the commands or the pixel columns. A long run of
+// columns goes out in chunks, each with its own control byte; the panel's
+// address pointer carries on from one to the next. The init commands fit a
+// chunk, a command is never split from its arguments.
+static esp_err_t oled_send(uint8_t control, const uint8_t *bytes, size_t count)
+{
+    return i2c_bus_write(&oled_device, &control, 1, bytes, count);
+}
+
+static void oled_command(uint8_t command)
+{
+    oled_send(OLED_CONTROL_COMMANDS, &command, 1);
+}
+
+static void damage(int page, int first, int last)
+{
+    if (first < damage_first[page])
+    {
+        damage_first[page] = first;
+    }
+    if (last > damage_last[page])
+    {
+        damage_last[page] = last;
+    }
+}
+
+static void damage_reset(void)
+{
+    memset(damage_first, 0xFF, sizeof(damage_first));
+    memset(damage_last, 0, sizeof(damage_last));
+}
+
+// Pixel column x (0 to 7) of a glyph cell. Bars fill the whole cell, so
+// neighbours join up; the icons sit where the font's characters do.
+static uint8_t glyph_column(DisplayGlyph glyph, int x)
+{
+    if (glyph <= DISPLAY_GLYPH_BAR_5)
+    {
+        int fill = (glyph - DISPLAY_GLYPH_BAR_1 + 1) * OLED_CELL_WIDTH / 5;
+        return x < fill ? 0x7F : 0x00;
+    }
+    int bit = x - 1; // Font position, one blank column on the left
+    if (bit < 0 || bit >= OLED_FONT_WIDTH)
+    {
+        return 0x00;
+    }
+    uint8_t column = 0;
+    for (int row = 0; row < DISPLAY_GLYPH_ROWS; row++)
+    {
+        if (display_glyph_bitmaps[glyph][row] & (0x10 >> bit))
+        {
+            column |= 1 << row;
+        }
+    }
+    return column;
+}
+
+// Render a cell into the framebuffer, with the cursor if it is on it
+static void render_cell(int row, int col)
+{
+    uint8_t code = cells[row][col];
+    uint8_t *pixels = &framebuffer[row][col * OLED_CELL_WIDTH];
+    for (int x = 0; x < OLED_CELL_WIDTH; x++)
+    {
+        uint8_t column = 0x00;
+        if (code >= OLED_GLYPH_CODE(0) && code < OLED_GLYPH_CODE(DISPLAY_GLYPH_COUNT))
+        {
+            column = glyph_column(code - OLED_GLYPH_CODE(0), x);
+        }
+        else if (code >= OLED_FONT_FIRST && code <= OLED_FONT_LAST && x >= 1 && x <= OLED_FONT_WIDTH)
+        {
+            column = font[code - OLED_FONT_FIRST][x - 1];
+        }
+
+        if (row == cursor_row && col == 0 && cursor == DISPLAY_CURSOR_BLINK)
+        {
+            column = ~column;
+        }
+        else if (row == cursor_row && col == 0 && cursor == DISPLAY_CURSOR_LINE)
+        {
+            column |= 0x80;
+        }
+        pixels[x] = column;
+    }
+    damage(row, col * OLED_CELL_WIDTH, col * OLED_CELL_WIDTH + OLED_CELL_WIDTH - 1);
+}
+
+static void ssd1306_flush(void)
+{
+    for (int page = 0; page < OLED_PAGES; page++)
+    {
+        if (damage_first[page] > damage_last[page])
+        {
+            continue;
+        }
+        const uint8_t window[] = {OLED_CMD_COLUMN_RANGE, damage_first[page], damage_last[page],
+                                  OLED_CMD_PAGE_RANGE, page, page};
+        oled_send(OLED_CONTROL_COMMANDS, window, sizeof(window));
+        oled_send(OLED_CONTROL_DATA, &framebuffer[page][damage_first[page]],
+                  damage_last[page] - damage_first[page] + 1);
+    }
+    damage_reset();
+}
+
+static void ssd1306_clear(void)
+{
+    memset(framebuffer, 0, sizeof(framebuffer));
+    memset(cells, ' ', sizeof(cells));
+    for (int page = 0; page < OLED_PAGES; page++)
+    {
+        damage(page, 0, OLED_WIDTH - 1);
+    }
+    ssd1306_flush();
+}
+
+static void ssd1306_init(void)
+{
+    i2c_bus_add_device(&oled_device);
+    oled_send(OLED_CONTROL_COMMANDS, init_commands, sizeof(init_commands));
+    cursor_row = -1;
+    cursor = DISPLAY_CURSOR_OFF;
+    ssd1306_clear(); // The panel's RAM holds noise after power up
+}
+
+// The panel kept its RAM through deep sleep, the framebuffer did not: start
+// both over from blank
+static void ssd1306_resume(void)
+{
+    ssd1306_clear();
+    oled_command(OLED_CMD_DISPLAY_ON);
+}
+
+static void ssd1306_standby(void)
+{
+    oled_command(OLED_CMD_DISPLAY_OFF);
+}
+
+// No backlight, the pixels are the light
+static void ssd1306_set_backlight(bool on)
+{
+    oled_command(on ? OLED_CMD_DISPLAY_ON : OLED_CMD_DISPLAY_OFF);
+}
+
+static void ssd1306_draw(int row, int col, const char *text, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        cells[row][col + i] = text[i];
+        render_cell(row, col + i);
+    }
+}
+
+// No blinking in the controller: the selected row's first cell is inverted
+static void ssd1306_set_cursor(int row, DisplayCursor mode)
+{
+    int old_row = cursor_row;
+    if (row >= 0)
+    {
+        cursor_row = row;
+    }
+    cursor = mode;
+    if (old_row >= 0)
+    {
+        render_cell(old_row, 0);
+    }
+    if (cursor_row >= 0 && cursor_row != old_row)
+    {
+        render_cell(cursor_row, 0);
+    }
+    ssd1306_flush();
+}
+
+// Every glyph is always there, drawn from the shared bitmaps
+static char ssd1306_glyph(DisplayGlyph glyph)
+{
+    return OLED_GLYPH_CODE(glyph);
+}
+
+const DisplayBackend display_ssd1306 = {
+    .rows = OLED_PAGES,
+    .cols = DISPLAY_COLS,
+    .bus_hz = 400000,
+    .clear_cost = OLED_PAGES * DISPLAY_COLS, // Sends the whole screen
+    .init = ssd1306_init,
+    .resume = ssd1306_resume,
+    .standby = ssd1306_standby,
+    .set_backlight = ssd1306_set_backlight,
+    .clear = ssd1306_clear,
+    .draw = ssd1306_draw,
+    .flush = ssd1306_flush,
+    .set_cursor = ssd1306_set_cursor,
+    .glyph = ssd1306_glyph,
+};
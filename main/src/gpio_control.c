@@ -1,6 +1,36 @@
 #include "gpio_control.h"
 #include "driver/gpio.h"
 #include "esp_rom_sys.h"
+#include "esp_attr.h"
+#include "trace_control.h"
+#include "pm_control.h"
+#include "freertos/FreeRTOS.h"
+
+// Buttons whose interrupt fired and waits for the release to be re-armed
+static portMUX_TYPE button_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t disarmed_buttons = 0;
+static uint32_t ignored_buttons = 0; // Stuck down, see gpio_ignore_until_released()
+
+// Buttons are polled by the main loop, the interrupt timestamps the press and
+// wakes the loop. Only level interrupts wake the chip from light sleep, so the
+// pin is masked until gpio_get_button_state() sees the button released.
+static void IRAM_ATTR button_press_isr(void *arg)
+{
+    int gpio_num = (int)(intptr_t)arg;
+    gpio_intr_disable(gpio_num);
+    portENTER_CRITICAL_ISR(&button_lock);
+    disarmed_buttons |= 1UL << gpio_num;
+    portEXIT_CRITICAL_ISR(&button_lock);
+
+    trace_point(TRACE_BUTTON_EDGE);
+
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    pm_control_signal_work_from_isr(&higher_priority_task_woken);
+    if (higher_priority_task_woken)
+    {
+        portYIELD_FROM_ISR();
+    }
+}
 
 void gpio_init(void)
 {
@@ -12,14 +42,33 @@ void gpio_init(void)
     gpio_config(&io_conf_led);
 
     // Configure Button GPIOs as input with pull-up resistors
+    const int buttons[] = {
+        POWER_BUTTON_GPIO,
+#if CONFIG_SUPER_LIGHTS_DISPLAY
+        ENTER_BUTTON_GPIO, BACK_BUTTON_GPIO, UP_BUTTON_GPIO, DOWN_BUTTON_GPIO,
+#endif
+    };
+    uint64_t button_mask = 0;
+    for (int i = 0; i < (int)(sizeof(buttons) / sizeof(buttons[0])); i++)
+    {
+        button_mask |= 1ULL << buttons[i];
+    }
     gpio_config_t io_conf_button = {
-        .pin_bit_mask = (1ULL << POWER_BUTTON_GPIO) | (1ULL << ENTER_BUTTON_GPIO) |
-                        (1ULL << BACK_BUTTON_GPIO) | (1ULL << UP_BUTTON_GPIO) |
-                        (1ULL << DOWN_BUTTON_GPIO),
+        .pin_bit_mask = button_mask,
         .mode = GPIO_MODE_INPUT,
         .pull_up_en = GPIO_PULLUP_ENABLE,
+        .intr_type = GPIO_INTR_LOW_LEVEL, // Pressed, for the latency tracer and the light sleep wakeup
     };
     gpio_config(&io_conf_button);
+
+    // Per-pin interrupt handlers (IR sensor fast path) hang off the shared ISR service
+    gpio_install_isr_service(0);
+
+    for (int i = 0; i < (int)(sizeof(buttons) / sizeof(buttons[0])); i++)
+    {
+        gpio_wakeup_enable(buttons[i], GPIO_INTR_LOW_LEVEL);
+        gpio_isr_handler_add(buttons[i], button_press_isr, (void *)(intptr_t)buttons[i]);
+    }
 }
 
 void gpio_set_led(int state)
@@ -29,5 +78,27 @@ void gpio_set_led(int state)
 
 int gpio_get_button_state(int gpio_num)
 {
-    return gpio_get_level(gpio_num);
-}
\ No newline at end of file
+    int level = gpio_get_level(gpio_num);
+    if (level == 1 && (disarmed_buttons & (1UL << gpio_num)))
+    {
+        // Released: let the next press interrupt again
+        portENTER_CRITICAL(&button_lock);
+        disarmed_buttons &= ~(1UL << gpio_num);
+        portEXIT_CRITICAL(&button_lock);
+        gpio_intr_enable(gpio_num);
+    }
+    if (ignored_buttons & (1UL << gpio_num))
+    {
+        if (level == 0)
+        {
+            return 1;
+        }
+        ignored_buttons &= ~(1UL << gpio_num);
+    }
+    return level;
+}
+
+void gpio_ignore_until_released(int gpio_num)
+{
+    ignored_buttons |= 1UL << gpio_num;
+}
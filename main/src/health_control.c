@@ -0,0 +1,200 @@
+#include "health_control.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_task_wdt.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_attr.h"
+#include "log_control.h"
+#include "memory_plan.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+// Above every application task and esp_timer: a task spinning at high
+// priority must not keep the monitor from noticing
+#define HEALTH_TASK_PRIORITY 23
+#define HEALTH_CHECK_MS 500
+
+// Time a stalled task gets after its recovery hook ran. Past that the monitor
+// stops feeding the task's watchdog user, which resets the chip
+// CONFIG_ESP_TASK_WDT_TIMEOUT_S later.
+#define HEALTH_RECOVERY_MS 3000
+
+#define HEALTH_RESET_MAGIC 0x48454c54 // "HELT"
+
+// What the monitor saw before it let the watchdog reset the chip
+typedef struct {
+    uint32_t magic;
+    uint32_t task;
+    uint32_t silent_ms;
+    char where[16];
+} HealthResetRecord;
+
+static const char *const task_names[HEALTH_TASK_COUNT] = {"main", "led", "speaker", "us", "remote", "log", "profiler"};
+
+// Written by the tasks
+static atomic_uint last_beat_ms[HEALTH_TASK_COUNT];
+static const char *volatile beat_where[HEALTH_TASK_COUNT];
+static atomic_bool waiting[HEALTH_TASK_COUNT];
+
+// Set once by health_register()
+static uint32_t deadlines_ms[HEALTH_TASK_COUNT]; // 0 while the task is not watched
+static HealthRecovery recoveries[HEALTH_TASK_COUNT];
+static esp_task_wdt_user_handle_t wdt_users[HEALTH_TASK_COUNT];
+
+// Monitor task only
+static bool stalled[HEALTH_TASK_COUNT];
+static uint32_t stall_ms[HEALTH_TASK_COUNT]; // Longest silence of the current stall
+static bool recovery_ran[HEALTH_TASK_COUNT];
+static bool reset_pending = false;
+static HealthStats stats[HEALTH_TASK_COUNT];
+
+static RTC_NOINIT_ATTR HealthResetRecord reset_record;
+static HealthResetRecord previous_reset; // magic is 0 unless the last reset was ours
+
+static StackType_t health_task_stack[PLAN_STACK_HEALTH];
+static StaticTask_t health_task_tcb;
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+void health_beat(HealthTask task, const char *where)
+{
+    atomic_store_explicit(&last_beat_ms[task], now_ms(), memory_order_relaxed);
+    beat_where[task] = where;
+    atomic_store_explicit(&waiting[task], false, memory_order_release);
+}
+
+void health_wait(HealthTask task)
+{
+    atomic_store_explicit(&waiting[task], true, memory_order_release);
+}
+
+void health_register(HealthTask task, uint32_t deadline_ms, HealthRecovery recovery)
+{
+    health_beat(task, "start");
+    recoveries[task] = recovery;
+    ESP_ERROR_CHECK(esp_task_wdt_add_user(task_names[task], &wdt_users[task]));
+    deadlines_ms[task] = deadline_ms;
+}
+
+static void check_task(HealthTask task, uint32_t now)
+{
+    uint32_t beat = atomic_load_explicit(&last_beat_ms[task], memory_order_relaxed);
+    uint32_t silent_ms = atomic_load_explicit(&waiting[task], memory_order_acquire) ? 0 : now - beat;
+
+    if (silent_ms <= deadlines_ms[task])
+    {
+        if (stalled[task])
+        {
+            stalled[task] = false;
+            stats[task].recoveries += recovery_ran[task];
+            LOG_WARN("%s running again after %lu ms", task_names[task], (unsigned long)stall_ms[task]);
+        }
+        esp_task_wdt_reset_user(wdt_users[task]);
+        return;
+    }
+
+    if (silent_ms > stats[task].longest_ms)
+    {
+        stats[task].longest_ms = silent_ms;
+    }
+    if (stalled[task])
+    {
+        stall_ms[task] = silent_ms;
+    }
+    else
+    {
+        const char *where = beat_where[task];
+        stalled[task] = true;
+        stall_ms[task] = silent_ms;
+        recovery_ran[task] = false;
+        stats[task].stalls++;
+        snprintf(stats[task].last_where, sizeof(stats[task].last_where), "%s", where != NULL ? where : "?");
+        LOG_ERROR("%s stalled: no heartbeat for %lu ms, last at %s", task_names[task], (unsigned long)silent_ms,
+                  stats[task].last_where);
+        if (recoveries[task] != NULL)
+        {
+            recoveries[task]();
+            recovery_ran[task] = true;
+        }
+    }
+
+    if (silent_ms <= deadlines_ms[task] + HEALTH_RECOVERY_MS)
+    {
+        esp_task_wdt_reset_user(wdt_users[task]);
+    }
+    else if (!reset_pending)
+    {
+        // Starve the task's watchdog user, the next boot reports the stall
+        reset_pending = true;
+        reset_record.task = task;
+        reset_record.silent_ms = silent_ms;
+        memcpy(reset_record.where, stats[task].last_where, sizeof(reset_record.where));
+        reset_record.magic = HEALTH_RESET_MAGIC;
+        LOG_ERROR("%s did not recover, leaving it to the task watchdog", task_names[task]);
+    }
+}
+
+static void health_task(void *pvParameters)
+{
+    ESP_ERROR_CHECK(esp_task_wdt_add(NULL));
+    while (1)
+    {
+        // A plain delay, not a timer job: the monitor must keep running when the timer service does not
+        vTaskDelay(pdMS_TO_TICKS(HEALTH_CHECK_MS));
+        uint32_t now = now_ms();
+        for (int i = 0; i < HEALTH_TASK_COUNT; i++)
+        {
+            if (deadlines_ms[i] != 0)
+            {
+                check_task(i, now);
+            }
+        }
+        esp_task_wdt_reset();
+    }
+}
+
+void health_control_init(void)
+{
+    if (reset_record.magic == HEALTH_RESET_MAGIC && esp_reset_reason() == ESP_RST_TASK_WDT &&
+        reset_record.task < HEALTH_TASK_COUNT)
+    {
+        previous_reset = reset_record;
+        previous_reset.where[sizeof(previous_reset.where) - 1] = '\0';
+        LOG_ERROR("Reset by the task watchdog: %s stalled for %lu ms at %s", task_names[previous_reset.task],
+                  (unsigned long)previous_reset.silent_ms, previous_reset.where);
+    }
+    reset_record.magic = 0;
+
+    xTaskCreateStatic(health_task, "HealthTask", sizeof(health_task_stack), NULL, HEALTH_TASK_PRIORITY,
+                      health_task_stack, &health_task_tcb);
+}
+
+void health_get_stats(HealthTask task, HealthStats *task_stats)
+{
+    *task_stats = stats[task];
+}
+
+void health_print_report(void)
+{
+    printf("Health    deadline  stalls  recovered  longest  last stall at\n");
+    for (int i = 0; i < HEALTH_TASK_COUNT; i++)
+    {
+        if (deadlines_ms[i] == 0)
+        {
+            continue;
+        }
+        printf("%-8s  %5lu ms  %6lu  %9lu  %4lu ms  %s\n", task_names[i], (unsigned long)deadlines_ms[i],
+               (unsigned long)stats[i].stalls, (unsigned long)stats[i].recoveries, (unsigned long)stats[i].longest_ms,
+               stats[i].stalls > 0 ? stats[i].last_where : "-");
+    }
+    if (previous_reset.magic == HEALTH_RESET_MAGIC)
+    {
+        printf("Last reset: task watchdog, %s stalled for %lu ms at %s\n", task_names[previous_reset.task],
+               (unsigned long)previous_reset.silent_ms, previous_reset.where);
+    }
+}
@@ -0,0 +1,361 @@
+#include "i2c_bus_control.h"
+#include "board_control.h"
+#include "profiler_control.h"
+#include "driver/i2c.h"
+#include "driver/gpio.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <stdio.h>
+
+#define I2C_BUS_PORT I2C_NUM_0
+#define I2C_BUS_SDA_IO BOARD_LCD_SDA_GPIO
+#define I2C_BUS_SCL_IO BOARD_LCD_SCL_GPIO
+
+// A device holding SDA low lets go once it has clocked out the rest of its
+// byte, at most 9 clocks
+#define RECOVERY_PULSES 9
+#define RECOVERY_HALF_PERIOD_US 5 // 100 kHz
+
+static uint32_t bus_clock_hz = 0; // 0 until installed
+static uint32_t recoveries = 0;
+
+// Command link storage for the transaction on the bus, used by its owner only
+static uint8_t cmd_link_buffer[I2C_LINK_RECOMMENDED_SIZE(4)];
+
+static I2cBusDevice *devices[I2C_BUS_MAX_DEVICES];
+static int device_count = 0;
+
+// Who holds the bus. The owner can take it again (nested transactions of one
+// device), it goes to the next waiter when the last of them gives it back.
+static portMUX_TYPE bus_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t owner = NULL;
+static int owner_depth = 0; // 0 while the bus is free
+
+// Tasks queued for the bus. Each sleeps on its own slot's semaphore; the task
+// giving the bus back names the next owner and wakes it, so a waiter never
+// has to race for it. Task notifications are left alone, the main task
+// already takes them from the power manager.
+typedef struct {
+    TaskHandle_t task;
+    bool used;
+    SemaphoreHandle_t wake;
+    StaticSemaphore_t wake_buffer;
+} BusWaiter;
+
+static BusWaiter waiters[I2C_BUS_MAX_WAITERS];
+static uint8_t queue[I2C_BUS_PRIORITY_COUNT][I2C_BUS_MAX_WAITERS]; // Slots, in arrival order
+static uint8_t queue_head[I2C_BUS_PRIORITY_COUNT];
+static uint8_t queue_count[I2C_BUS_PRIORITY_COUNT];
+
+static const char *const priority_names[I2C_BUS_PRIORITY_COUNT] = {"sensor", "display"};
+
+static void bus_install(void)
+{
+    i2c_config_t conf = {
+        .mode = I2C_MODE_MASTER,
+        .sda_io_num = I2C_BUS_SDA_IO,
+        .scl_io_num = I2C_BUS_SCL_IO,
+        .sda_pullup_en = GPIO_PULLUP_ENABLE,
+        .scl_pullup_en = GPIO_PULLUP_ENABLE,
+        .master.clk_speed = bus_clock_hz,
+    };
+    i2c_param_config(I2C_BUS_PORT, &conf);
+    i2c_driver_install(I2C_BUS_PORT, conf.mode, 0, 0, 0);
+}
+
+void i2c_bus_init(uint32_t clock_hz)
+{
+    if (bus_clock_hz != 0)
+    {
+        // Every device on the bus has to keep up with the clock
+        if (clock_hz < bus_clock_hz)
+        {
+            bus_clock_hz = clock_hz;
+            i2c_driver_delete(I2C_BUS_PORT);
+            bus_install();
+        }
+        return;
+    }
+
+    for (int slot = 0; slot < I2C_BUS_MAX_WAITERS; slot++)
+    {
+        waiters[slot].wake = xSemaphoreCreateBinaryStatic(&waiters[slot].wake_buffer);
+    }
+    bus_clock_hz = clock_hz;
+    bus_install();
+}
+
+void i2c_bus_add_device(I2cBusDevice *device)
+{
+    for (int i = 0; i < device_count; i++)
+    {
+        if (devices[i] == device)
+        {
+            return;
+        }
+    }
+    if (device_count < I2C_BUS_MAX_DEVICES)
+    {
+        devices[device_count++] = device;
+    }
+}
+
+// Take the bus for device, queued behind the more urgent classes. Returns the
+// time spent waiting.
+static int64_t bus_acquire(I2cBusDevice *device)
+{
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    int slot = -1;
+    portENTER_CRITICAL(&bus_lock);
+    if (owner_depth == 0 || owner == self)
+    {
+        owner = self;
+        owner_depth++;
+        portEXIT_CRITICAL(&bus_lock);
+        return 0;
+    }
+    for (int i = 0; i < I2C_BUS_MAX_WAITERS; i++)
+    {
+        if (!waiters[i].used)
+        {
+            slot = i;
+            break;
+        }
+    }
+    configASSERT(slot >= 0); // More tasks on the bus than I2C_BUS_MAX_WAITERS
+    waiters[slot].used = true;
+    waiters[slot].task = self;
+    int priority = device->priority;
+    queue[priority][(queue_head[priority] + queue_count[priority]) % I2C_BUS_MAX_WAITERS] = slot;
+    queue_count[priority]++;
+    portEXIT_CRITICAL(&bus_lock);
+
+    int64_t start_time = esp_timer_get_time();
+    xSemaphoreTake(waiters[slot].wake, portMAX_DELAY); // The bus is ours when it comes
+    portENTER_CRITICAL(&bus_lock);
+    waiters[slot].used = false;
+    portEXIT_CRITICAL(&bus_lock);
+    return esp_timer_get_time() - start_time;
+}
+
+// Give the bus back, to the first waiter of the most urgent class
+static void bus_release(void)
+{
+    SemaphoreHandle_t wake = NULL;
+    portENTER_CRITICAL(&bus_lock);
+    if (--owner_depth == 0)
+    {
+        for (int priority = 0; priority < I2C_BUS_PRIORITY_COUNT; priority++)
+        {
+            if (queue_count[priority] > 0)
+            {
+                int slot = queue[priority][queue_head[priority]];
+                queue_head[priority] = (queue_head[priority] + 1) % I2C_BUS_MAX_WAITERS;
+                queue_count[priority]--;
+                owner = waiters[slot].task;
+                owner_depth = 1;
+                wake = waiters[slot].wake;
+                break;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&bus_lock);
+    if (wake != NULL)
+    {
+        xSemaphoreGive(wake);
+    }
+}
+
+// A more urgent class is waiting and the bus can change hands here
+static bool bus_wanted_before(I2cBusPriority priority)
+{
+    bool wanted = false;
+    portENTER_CRITICAL(&bus_lock);
+    for (I2cBusPriority i = 0; i < priority && owner_depth == 1; i++)
+    {
+        wanted = wanted || queue_count[i] > 0;
+    }
+    portEXIT_CRITICAL(&bus_lock);
+    return wanted;
+}
+
+static int64_t record_wait(I2cBusDevice *device, int64_t wait_us)
+{
+    device->stats.wait_us += wait_us;
+    if (wait_us > device->stats.max_wait_us)
+    {
+        device->stats.max_wait_us = wait_us;
+    }
+    return wait_us;
+}
+
+static void record_latency(I2cBusDevice *device, uint32_t latency_us)
+{
+    if (latency_us > device->stats.max_latency_us)
+    {
+        device->stats.max_latency_us = latency_us;
+    }
+}
+
+// Time on the wire for bytes at the bus clock: 9 clocks a byte with the ACK,
+// plus start and stop. Worked out rather than timed, a transaction that
+// needs no waiting reads no clock.
+static uint32_t bus_time_us(uint32_t bytes)
+{
+    return ((uint64_t)bytes * 9 + 2) * 1000000 / bus_clock_hz;
+}
+
+// Free a bus left with SDA held low (a device reset or a glitch mid byte):
+// clock it out of its byte, then send a STOP and start over with the driver
+static void bus_recover(void)
+{
+    recoveries++;
+    i2c_driver_delete(I2C_BUS_PORT);
+
+    gpio_set_pull_mode(I2C_BUS_SDA_IO, GPIO_PULLUP_ONLY);
+    gpio_set_pull_mode(I2C_BUS_SCL_IO, GPIO_PULLUP_ONLY);
+    gpio_set_level(I2C_BUS_SDA_IO, 1);
+    gpio_set_level(I2C_BUS_SCL_IO, 1);
+    gpio_set_direction(I2C_BUS_SDA_IO, GPIO_MODE_INPUT_OUTPUT_OD);
+    gpio_set_direction(I2C_BUS_SCL_IO, GPIO_MODE_INPUT_OUTPUT_OD);
+    for (int pulse = 0; pulse < RECOVERY_PULSES && gpio_get_level(I2C_BUS_SDA_IO) == 0; pulse++)
+    {
+        gpio_set_level(I2C_BUS_SCL_IO, 0);
+        esp_rom_delay_us(RECOVERY_HALF_PERIOD_US);
+        gpio_set_level(I2C_BUS_SCL_IO, 1);
+        esp_rom_delay_us(RECOVERY_HALF_PERIOD_US);
+    }
+
+    // STOP: SDA rises while SCL is high
+    gpio_set_level(I2C_BUS_SCL_IO, 0);
+    esp_rom_delay_us(RECOVERY_HALF_PERIOD_US);
+    gpio_set_level(I2C_BUS_SDA_IO, 0);
+    esp_rom_delay_us(RECOVERY_HALF_PERIOD_US);
+    gpio_set_level(I2C_BUS_SCL_IO, 1);
+    esp_rom_delay_us(RECOVERY_HALF_PERIOD_US);
+    gpio_set_level(I2C_BUS_SDA_IO, 1);
+    esp_rom_delay_us(RECOVERY_HALF_PERIOD_US);
+
+    bus_install(); // Takes the pins back
+}
+
+// One transaction on the bus, which the caller holds: write head and data,
+// then read into read_data if read_length is not 0. Returns the bus time in
+// *busy_us.
+static esp_err_t bus_transfer(I2cBusDevice *device, const uint8_t *head, size_t head_length, const uint8_t *data,
+                              size_t length, uint8_t *read_data, size_t read_length, uint32_t *busy_us)
+{
+    uint32_t bytes = 1 + head_length + length + (read_length > 0 ? 1 + read_length : 0);
+    esp_err_t ret = ESP_FAIL;
+    *busy_us = 0;
+    for (int attempt = 0; attempt < 2 && ret != ESP_OK; attempt++)
+    {
+        if (attempt > 0)
+        {
+            bus_recover();
+        }
+        i2c_cmd_handle_t cmd = i2c_cmd_link_create_static(cmd_link_buffer, sizeof(cmd_link_buffer));
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, (device->address << 1) | I2C_MASTER_WRITE, true);
+        if (head_length > 0)
+        {
+            i2c_master_write(cmd, head, head_length, true);
+        }
+        if (length > 0)
+        {
+            i2c_master_write(cmd, data, length, true);
+        }
+        if (read_length > 0)
+        {
+            i2c_master_start(cmd);
+            i2c_master_write_byte(cmd, (device->address << 1) | I2C_MASTER_READ, true);
+            i2c_master_read(cmd, read_data, read_length, I2C_MASTER_LAST_NACK);
+        }
+        i2c_master_stop(cmd);
+
+        ret = i2c_master_cmd_begin(I2C_BUS_PORT, cmd, pdMS_TO_TICKS(I2C_BUS_TIMEOUT_MS));
+        i2c_cmd_link_delete_static(cmd);
+        *busy_us += bus_time_us(bytes);
+        device->stats.busy_us += bus_time_us(bytes);
+
+        device->stats.transactions++;
+        device->stats.bytes += bytes;
+        device->stats.errors += ret != ESP_OK;
+        profiler_count(PROFILER_COUNTER_I2C_TRANSACTIONS, 1);
+        profiler_count(PROFILER_COUNTER_I2C_BYTES, bytes);
+    }
+    return ret;
+}
+
+esp_err_t i2c_bus_write(I2cBusDevice *device, const uint8_t *head, size_t head_length, const uint8_t *data,
+                        size_t length)
+{
+    int64_t latency_us = record_wait(device, bus_acquire(device));
+    esp_err_t ret = ESP_OK;
+    size_t sent = 0;
+    do
+    {
+        size_t chunk = length - sent > I2C_BUS_CHUNK_BYTES ? I2C_BUS_CHUNK_BYTES : length - sent;
+        uint32_t busy_us;
+        esp_err_t chunk_ret = bus_transfer(device, head, head_length, data + sent, chunk, NULL, 0, &busy_us);
+        ret = ret != ESP_OK ? ret : chunk_ret;
+        latency_us += busy_us;
+        sent += chunk;
+        if (sent < length && bus_wanted_before(device->priority))
+        {
+            bus_release(); // Someone more urgent goes first
+            latency_us += record_wait(device, bus_acquire(device));
+        }
+    } while (sent < length);
+    bus_release();
+    record_latency(device, latency_us);
+    return ret;
+}
+
+esp_err_t i2c_bus_write_read(I2cBusDevice *device, const uint8_t *command, size_t command_length, uint8_t *data,
+                             size_t length)
+{
+    int64_t latency_us = record_wait(device, bus_acquire(device));
+    uint32_t busy_us;
+    esp_err_t ret = bus_transfer(device, command, command_length, NULL, 0, data, length, &busy_us);
+    bus_release();
+    record_latency(device, latency_us + busy_us);
+    return ret;
+}
+
+void i2c_bus_lock(I2cBusDevice *device)
+{
+    record_wait(device, bus_acquire(device));
+}
+
+void i2c_bus_unlock(void)
+{
+    bus_release();
+}
+
+uint32_t i2c_bus_get_recoveries(void)
+{
+    return recoveries;
+}
+
+void i2c_bus_print_stats(void)
+{
+    int64_t uptime_us = esp_timer_get_time();
+    printf("I2C bus: %lu kHz, %lu recoveries\n", (unsigned long)(bus_clock_hz / 1000), (unsigned long)recoveries);
+    printf("Device   class     transfers    bytes   busy  wait avg  wait max  latency max  errors\n");
+    for (int i = 0; i < device_count; i++)
+    {
+        const I2cBusDevice *device = devices[i];
+        const I2cBusStats *stats = &device->stats;
+        uint32_t permille = uptime_us > 0 ? stats->busy_us * 1000 / uptime_us : 0;
+        uint32_t wait_avg_us = stats->transactions > 0 ? stats->wait_us / stats->transactions : 0;
+        printf("%-7s  %-7s  %10lu  %7lu  %2lu.%lu%%  %5lu us  %5lu us  %8lu us  %6lu\n", device->name,
+               priority_names[device->priority], (unsigned long)stats->transactions, (unsigned long)stats->bytes,
+               (unsigned long)(permille / 10), (unsigned long)(permille % 10), (unsigned long)wait_avg_us,
+               (unsigned long)stats->max_wait_us, (unsigned long)stats->max_latency_us,
+               (unsigned long)stats->errors);
+    }
+}
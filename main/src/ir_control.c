@@ -1,14 +1,85 @@
 #include "ir_control.h"
 #include "settings_control.h"
 #include "rgb_led_control.h"
+#include "trace_control.h"
+#include "profiler_control.h"
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_timer.h"
+#include "timer_control.h"
 #include <stdio.h>
-#include "menu_control.h"
 
-// GPIO pin for the IR sensor
-#define IR_SENSOR_GPIO GPIO_NUM_27
+// Length of one sensitivity "pulse": the signal has to stay high for
+// (required pulses - 1) of these before motion counts as confirmed
+#define IR_PULSE_MS 100
+
+static TimerJob ir_hold_job;
+static volatile int ir_hold_ms = 0; // Recomputed from the sensitivity setting by ir_sensor_control()
+static volatile int64_t ir_high_since_us = -1; // Rising edge of the current motion, -1 while low
+
+// Calculate the required pulses based on sensitivity (1-25 -> 1-100%)
+static int ir_required_pulses(const Settings *settings)
+{
+    return 25 - ((settings->sensitivity_ir - 1) * (25 - 1)) / (100 - 1);
+}
+
+// The IR signal stayed high for the whole hold window
+static void ir_hold_timer_callback(void *arg)
+{
+    if (gpio_get_level(IR_SENSOR_GPIO) == 1)
+    {
+        rgb_led_control_signal_presence(esp_timer_get_time());
+    }
+}
+
+// Runs on both edges of the IR signal. The pin is level triggered so that it
+// can wake the chip from light sleep: each interrupt arms the opposite level.
+static void ir_sensor_isr(void *arg)
+{
+    Settings *settings = settings_get();
+    int level = gpio_get_level(IR_SENSOR_GPIO);
+    gpio_set_intr_type(IR_SENSOR_GPIO, level ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL);
+
+    // Check if IR is enabled in the settings
+    if (settings->ir == 0)
+    {
+        return;
+    }
+
+    if (level == 1)
+    {
+        int64_t edge_time_us = esp_timer_get_time();
+        ir_high_since_us = edge_time_us;
+        profiler_count(PROFILER_COUNTER_IR_PULSES, 1);
+        if (settings->light == 0)
+        {
+            trace_point(TRACE_IR_EDGE); // Only edges that can turn the light on start a motion-to-light chain
+        }
+
+        if (ir_hold_ms == 0)
+        {
+            // At full sensitivity the edge itself qualifies, go straight to the LED task
+            BaseType_t higher_priority_task_woken = pdFALSE;
+            rgb_led_control_signal_presence_from_isr(edge_time_us, &higher_priority_task_woken);
+            if (higher_priority_task_woken)
+            {
+                portYIELD_FROM_ISR();
+            }
+        }
+        else
+        {
+            // (Re)arm the hold window, motion is confirmed if the signal is still high when it expires
+            timer_start_once(&ir_hold_job, ir_hold_ms);
+        }
+    }
+    else
+    {
+        // The signal dropped before it qualified
+        ir_high_since_us = -1;
+        timer_stop(&ir_hold_job);
+    }
+}
 
 // Initialize the IR sensor
 void ir_sensor_init(void)
@@ -19,77 +90,59 @@ void ir_sensor_init(void)
         .mode = GPIO_MODE_INPUT,                  // Set as input
         .pull_up_en = GPIO_PULLUP_DISABLE,
         .pull_down_en = GPIO_PULLDOWN_ENABLE, // Enable pull-down resistor
-        .intr_type = GPIO_INTR_DISABLE // No interrupts for now
+        .intr_type = GPIO_INTR_HIGH_LEVEL     // Wait for high; the ISR then flips between low and high levels
     };
     gpio_config(&io_conf);
+    gpio_wakeup_enable(IR_SENSOR_GPIO, GPIO_INTR_HIGH_LEVEL); // Motion wakes the chip
+
+    const TimerJobArgs hold_job_args = {
+        .name = "ir_hold",
+        .callback = ir_hold_timer_callback,
+    };
+    timer_job_init(&ir_hold_job, &hold_job_args);
+
+    ir_sensor_control(); // Compute the hold window before the first edge arrives
+    ESP_ERROR_CHECK(gpio_isr_handler_add(IR_SENSOR_GPIO, ir_sensor_isr, NULL));
 
    // printf("IR sensor initialized on GPIO %d\n", IR_SENSOR_GPIO);
 }
 
-// Control the IR sensor
+// Control the IR sensor. Detection itself happens in the interrupt, this only
+// keeps the hold window in line with the sensitivity setting.
 void ir_sensor_control(void)
 {
-    static int previous_ir_state = -1; // Initialize to an invalid state to detect the first run
-    static int pulse_count = 0;        // Count consecutive pulses
     Settings *settings = settings_get();
 
     // Check if IR is enabled in the settings
     if (settings->ir == 0)
     {
+        timer_stop(&ir_hold_job); // Drop any half-confirmed motion
+        ir_high_since_us = -1;
         return; // IR is disabled, do nothing
     }
 
-    // Read the current state of the IR sensor
-    int current_ir_state = gpio_get_level(IR_SENSOR_GPIO);
+    ir_hold_ms = (ir_required_pulses(settings) - 1) * IR_PULSE_MS;
+}
 
-    // Log the current and previous states
-    //printf("IR sensor state: current = %d, previous = %d\n", current_ir_state, previous_ir_state);
+// Raw PIR output, the sensor holds it high while it sees motion
+bool ir_sensor_is_occupied(void)
+{
+    return settings_get()->ir && gpio_get_level(IR_SENSOR_GPIO) == 1;
+}
 
-    // Check for state changes
-    if (current_ir_state != previous_ir_state)
+int ir_sensor_get_pulses(void)
+{
+    int64_t high_since_us = ir_high_since_us;
+    if (high_since_us < 0)
     {
-        //printf("IR sensor state changed: %d -> %d\n", previous_ir_state, current_ir_state);
-        previous_ir_state = current_ir_state; // Update the previous state
+        return 0;
     }
+    int required = ir_sensor_get_required_pulses();
+    int pulses = 1 + (esp_timer_get_time() - high_since_us) / (IR_PULSE_MS * 1000);
+    return pulses < required ? pulses : required;
+}
 
-    // If the sensor is tripped (motion detected)
-    if (current_ir_state == 1)
-    {
-        // Debounce: Check if the signal remains stable for 100ms
-        vTaskDelay(pdMS_TO_TICKS(100)); // Wait 100ms
-        if (gpio_get_level(IR_SENSOR_GPIO) == 1)
-        {
-            // Increment the pulse count
-            pulse_count++;
-            // printf("Pulse count: %d\n", pulse_count);
-
-            // Calculate the required pulses based on sensitivity (1-25 -> 1-100%)
-            int required_pulses = 25 - ((settings->sensitivity_ir - 1) * (25 - 1)) / (100 - 1);
-            //printf("Required pulses: %d\n", required_pulses);
-
-            // Check if the pulse count meets the threshold
-            if (pulse_count >= required_pulses)
-            {
-               // printf("Motion detected! Pulse count: %d\n", pulse_count);
-                // Turn on the light
-                settings->light = 1;
-                rgb_led_control_update(); // Update the LED state
-                // printf("Motion detected! Light turned on.\n");
-
-                // Reset the pulse count
-                pulse_count = 0;
-                menu_render(); // Update the menu display
-            }
-        }
-        else
-        {
-            // Reset the pulse count if the signal is not stable
-            pulse_count = 0;
-        }
-    }
-    else
-    {
-        // Reset the pulse count if the sensor is idle
-        pulse_count = 0;
-    }
+int ir_sensor_get_required_pulses(void)
+{
+    return ir_required_pulses(settings_get());
 }
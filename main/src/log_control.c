@@ -0,0 +1,522 @@
+#include "log_control.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "memory_plan.h"
+#include "health_control.h"
+#include "timer_control.h"
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+// Below everything that does real work, the console can wait
+#define LOG_TASK_PRIORITY 1
+#define LOG_HEALTH_DEADLINE_MS 2000 // A full ring through the console
+static StackType_t log_task_stack[PLAN_STACK_LOG];
+static StaticTask_t log_task_tcb;
+
+// How long a record waits for the drain at most, give or take the slack. The
+// task sleeps in between, which leaves the chip free to enter light sleep, and
+// the slack lets the drain share its wakeup with the other periodic jobs.
+#define LOG_DRAIN_PERIOD_MS 100
+#define LOG_DRAIN_SLACK_MS 20
+static TimerJob drain_job;
+
+// Records, must be a power of two. Bursts above this between two drains
+// overwrite the oldest records.
+#define LOG_RING_SIZE 64
+
+// Argument kinds, two bits each in LogSite.signature
+#define LOG_KIND_I32 0
+#define LOG_KIND_I64 1
+#define LOG_KIND_F64 2
+#define LOG_KIND_STR 3
+#define LOG_SIGNATURE_PARSED (1u << 31)
+#define LOG_SIGNATURE_COUNT(signature) (((signature) >> 16) & 0xF)
+#define LOG_SIGNATURE_KIND(signature, i) (((signature) >> (2 * (i))) & 0x3)
+
+// Length modifiers of a conversion, one letter each ("hh" is 'H', "ll" is 'q')
+typedef struct {
+    char length;
+    char conversion;
+} LogDirective;
+
+// One log statement as written by log_write(). seq is written last and tells
+// the reader the record is complete.
+typedef struct {
+    atomic_uint seq; // Ring position + 1 once published
+    const LogSite *site;
+    uint16_t suppressed;
+    uint8_t size;    // Bytes of args[] used
+    int64_t time_us;
+    uint8_t args[LOG_ARGS_SIZE];
+} LogRecord;
+
+// Multi-producer, single-consumer ring, same scheme as the trace rings
+static atomic_uint head;     // Next position to reserve
+static uint32_t tail;        // Next position to read, drain only
+static LogRecord records[LOG_RING_SIZE];
+
+static atomic_uint written;
+static atomic_uint suppressed;
+static uint32_t overwritten; // Drain only
+static uint32_t reported_overwritten;
+static uint32_t site_count;
+
+static SemaphoreHandle_t drain_mutex = NULL;
+static StaticSemaphore_t drain_mutex_storage;
+
+// Parse the directive after a '%', return what follows it
+static const char *scan_directive(const char *p, LogDirective *directive)
+{
+    while (*p != '\0' && strchr("-+ #0", *p) != NULL)
+    {
+        p++;
+    }
+    while ((*p >= '0' && *p <= '9') || *p == '.')
+    {
+        p++;
+    }
+
+    directive->length = 0;
+    if (*p == 'h' || *p == 'l')
+    {
+        directive->length = *p++;
+        if (*p == directive->length)
+        {
+            directive->length = directive->length == 'h' ? 'H' : 'q';
+            p++;
+        }
+    }
+    else if (*p == 'j' || *p == 'z' || *p == 't' || *p == 'L')
+    {
+        directive->length = *p++;
+    }
+
+    directive->conversion = *p;
+    return *p != '\0' ? p + 1 : p;
+}
+
+static int directive_kind(const LogDirective *directive)
+{
+    switch (directive->conversion)
+    {
+    case 's':
+        return LOG_KIND_STR;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        return LOG_KIND_F64;
+    case 'p':
+        return sizeof(void *) > 4 ? LOG_KIND_I64 : LOG_KIND_I32;
+    default:
+        break;
+    }
+    switch (directive->length)
+    {
+    case 'q':
+    case 'j':
+        return LOG_KIND_I64;
+    case 'l':
+        return sizeof(long) > 4 ? LOG_KIND_I64 : LOG_KIND_I32;
+    case 'z':
+    case 't':
+        return sizeof(size_t) > 4 ? LOG_KIND_I64 : LOG_KIND_I32;
+    default:
+        return LOG_KIND_I32;
+    }
+}
+
+static uint32_t parse_signature(const char *format)
+{
+    uint32_t signature = 0;
+    int count = 0;
+    const char *p = format;
+    while ((p = strchr(p, '%')) != NULL)
+    {
+        LogDirective directive;
+        p = scan_directive(p + 1, &directive);
+        if (directive.conversion == '%' || directive.conversion == '\0')
+        {
+            continue;
+        }
+        if (count < LOG_MAX_ARGS)
+        {
+            signature |= directive_kind(&directive) << (2 * count);
+            count++;
+        }
+    }
+    return signature | (count << 16) | LOG_SIGNATURE_PARSED;
+}
+
+void log_write(LogSite *site, ...)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    // Fixed one second windows. Two writers racing here can let one extra
+    // record through, which is not worth a lock.
+    if (site->rate != 0)
+    {
+        if (now_us - site->window_us >= 1000000)
+        {
+            site->window_us = now_us;
+            site->window_count = 0;
+        }
+        if (site->window_count >= site->rate)
+        {
+            site->suppressed++;
+            atomic_fetch_add_explicit(&suppressed, 1, memory_order_relaxed);
+            return;
+        }
+        site->window_count++;
+    }
+
+    // Parsing always gives the same result, a race only parses twice
+    uint32_t signature = site->signature;
+    if (signature == 0)
+    {
+        signature = parse_signature(site->format);
+        site->signature = signature;
+    }
+
+    uint32_t position = atomic_fetch_add_explicit(&head, 1, memory_order_relaxed);
+    LogRecord *record = &records[position & (LOG_RING_SIZE - 1)];
+    atomic_store_explicit(&record->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    record->site = site;
+    record->time_us = now_us;
+    record->suppressed = site->suppressed;
+    site->suppressed = 0;
+
+    // Copy the arguments as they are, the drain formats them
+    va_list args;
+    va_start(args, site);
+    size_t size = 0;
+    for (unsigned i = 0; i < LOG_SIGNATURE_COUNT(signature); i++)
+    {
+        int kind = LOG_SIGNATURE_KIND(signature, i);
+        if (kind == LOG_KIND_I32 && size + 4 <= LOG_ARGS_SIZE)
+        {
+            int32_t value = va_arg(args, int);
+            memcpy(&record->args[size], &value, 4);
+            size += 4;
+        }
+        else if (kind == LOG_KIND_I64 && size + 8 <= LOG_ARGS_SIZE)
+        {
+            int64_t value = va_arg(args, long long);
+            memcpy(&record->args[size], &value, 8);
+            size += 8;
+        }
+        else if (kind == LOG_KIND_F64 && size + 8 <= LOG_ARGS_SIZE)
+        {
+            double value = va_arg(args, double);
+            memcpy(&record->args[size], &value, 8);
+            size += 8;
+        }
+        else if (kind == LOG_KIND_STR && size + 1 < LOG_ARGS_SIZE)
+        {
+            const char *value = va_arg(args, const char *);
+            size_t length = value != NULL ? strnlen(value, LOG_MAX_STRING) : 0;
+            if (length > LOG_ARGS_SIZE - size - 1)
+            {
+                length = LOG_ARGS_SIZE - size - 1;
+            }
+            record->args[size++] = length;
+            memcpy(&record->args[size], value, length);
+            size += length;
+        }
+        else
+        {
+            break; // Out of room, the drain marks the rest as missing
+        }
+    }
+    va_end(args);
+    record->size = size;
+
+    atomic_store_explicit(&record->seq, position + 1, memory_order_release);
+    atomic_fetch_add_explicit(&written, 1, memory_order_relaxed);
+}
+
+// Copy out the oldest unread record. Returns false when the ring is empty or
+// the oldest record is still being written.
+static bool ring_peek(LogRecord *out)
+{
+    while (1)
+    {
+        uint32_t current_head = atomic_load_explicit(&head, memory_order_acquire);
+        if (tail == current_head)
+        {
+            return false;
+        }
+
+        // The writers lapped us, skip what was overwritten
+        if (current_head - tail > LOG_RING_SIZE)
+        {
+            overwritten += current_head - tail - LOG_RING_SIZE;
+            tail = current_head - LOG_RING_SIZE;
+        }
+
+        LogRecord *record = &records[tail & (LOG_RING_SIZE - 1)];
+        uint32_t seq = atomic_load_explicit(&record->seq, memory_order_acquire);
+        if (seq != tail + 1)
+        {
+            if (seq == 0 || (int32_t)(seq - (tail + 1)) < 0)
+            {
+                return false; // Reserved but not published yet
+            }
+            overwritten++; // Overwritten since we read head, move on
+            tail++;
+            continue;
+        }
+
+        out->site = record->site;
+        out->suppressed = record->suppressed;
+        out->size = record->size;
+        out->time_us = record->time_us;
+        memcpy(out->args, record->args, record->size);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&record->seq, memory_order_relaxed) != seq)
+        {
+            overwritten++; // Overwritten while we copied it
+            tail++;
+            continue;
+        }
+        return true;
+    }
+}
+
+#if CONFIG_SUPER_LIGHTS_LOG_BINARY
+static const char *file_name(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    return slash != NULL ? slash + 1 : path;
+}
+
+// "@logfmt <id> <level> <kinds> <file>:<line> <format>" once per site, then
+// "@log <time us> <id> <suppressed> <argument bytes in hex>" per record.
+// tools/log_decode.py turns them back into text.
+static void emit_record(const LogRecord *record, bool first)
+{
+    const LogSite *site = record->site;
+    if (first)
+    {
+        printf("@logfmt %u %u %lx %s:%u %s\n", site->id, site->level, (unsigned long)site->signature,
+               file_name(site->file), site->line, site->format);
+    }
+
+    char hex[2 * LOG_ARGS_SIZE + 2] = "-";
+    for (int i = 0; i < record->size; i++)
+    {
+        sprintf(&hex[2 * i], "%02x", record->args[i]);
+    }
+    printf("@log %lld %u %u %s\n", (long long)record->time_us, site->id, record->suppressed, hex);
+}
+
+static void emit_overwritten(uint32_t count)
+{
+    printf("@logdrop %lu\n", (unsigned long)count);
+}
+#else
+// Format one directive with the argument at *offset, advance the offset
+static int format_directive(char *out, size_t space, const char *spec, const LogDirective *directive,
+                            const LogRecord *record, size_t *offset)
+{
+    int kind = directive_kind(directive);
+    const uint8_t *arg = &record->args[*offset];
+    size_t left = record->size - *offset;
+
+    if (kind == LOG_KIND_STR && left >= 1 && left >= 1u + arg[0])
+    {
+        char value[LOG_ARGS_SIZE];
+        memcpy(value, arg + 1, arg[0]);
+        value[arg[0]] = '\0';
+        *offset += 1 + arg[0];
+        return snprintf(out, space, spec, value);
+    }
+    if (kind == LOG_KIND_F64 && left >= 8)
+    {
+        double value;
+        memcpy(&value, arg, 8);
+        *offset += 8;
+        return snprintf(out, space, spec, value);
+    }
+    if (kind == LOG_KIND_I64 && left >= 8)
+    {
+        int64_t value;
+        memcpy(&value, arg, 8);
+        *offset += 8;
+        switch (directive->conversion == 'p' ? 'p' : directive->length)
+        {
+        case 'p':
+            return snprintf(out, space, spec, (void *)(uintptr_t)value);
+        case 'l':
+            return snprintf(out, space, spec, (long)value);
+        case 'z':
+        case 't':
+            return snprintf(out, space, spec, (size_t)value);
+        default:
+            return snprintf(out, space, spec, (long long)value);
+        }
+    }
+    if (kind == LOG_KIND_I32 && left >= 4)
+    {
+        int32_t value;
+        memcpy(&value, arg, 4);
+        *offset += 4;
+        switch (directive->conversion == 'p' ? 'p' : directive->length)
+        {
+        case 'p':
+            return snprintf(out, space, spec, (void *)(uintptr_t)(uint32_t)value);
+        case 'l':
+            return snprintf(out, space, spec, (long)value);
+        case 'z':
+        case 't':
+            return snprintf(out, space, spec, (size_t)(uint32_t)value);
+        default:
+            return snprintf(out, space, spec, (int)value);
+        }
+    }
+    return snprintf(out, space, "?"); // Cut off, the record was full
+}
+
+// Plain text, as printf would have printed it
+static void emit_record(const LogRecord *record, bool first)
+{
+    const LogSite *site = record->site;
+    char line[160];
+    size_t length = 0;
+    size_t offset = 0;
+
+    for (const char *p = site->format; *p != '\0' && length < sizeof(line) - 1;)
+    {
+        if (*p != '%')
+        {
+            line[length++] = *p++;
+            continue;
+        }
+
+        LogDirective directive;
+        const char *end = scan_directive(p + 1, &directive);
+        if (directive.conversion == '%')
+        {
+            line[length++] = '%';
+        }
+        else if (directive.conversion != '\0' && end - p < 16)
+        {
+            char spec[16];
+            memcpy(spec, p, end - p);
+            spec[end - p] = '\0';
+            int n = format_directive(&line[length], sizeof(line) - length, spec, &directive, record, &offset);
+            if (n > 0)
+            {
+                length += (size_t)n < sizeof(line) - length ? (size_t)n : sizeof(line) - length - 1;
+            }
+        }
+        p = end;
+    }
+    line[length] = '\0';
+
+    if (record->suppressed > 0)
+    {
+        printf("%s (%u more suppressed)\n", line, record->suppressed);
+    }
+    else
+    {
+        printf("%s\n", line);
+    }
+}
+
+static void emit_overwritten(uint32_t count)
+{
+    printf("(%lu log records lost)\n", (unsigned long)count);
+}
+#endif
+
+void log_flush(void)
+{
+    if (drain_mutex != NULL)
+    {
+        xSemaphoreTake(drain_mutex, portMAX_DELAY);
+    }
+
+    LogRecord record;
+    bool printed = false;
+    while (ring_peek(&record))
+    {
+        if (overwritten != reported_overwritten)
+        {
+            emit_overwritten(overwritten - reported_overwritten);
+            reported_overwritten = overwritten;
+        }
+        LogSite *site = (LogSite *)record.site; // Only the drain writes the id
+        bool first = site->id == 0;
+        if (first)
+        {
+            site->id = ++site_count;
+        }
+        emit_record(&record, first);
+        tail++;
+        printed = true;
+    }
+    if (printed)
+    {
+        fflush(stdout);
+    }
+
+    if (drain_mutex != NULL)
+    {
+        xSemaphoreGive(drain_mutex);
+    }
+}
+
+static void log_task(void *arg)
+{
+    health_register(HEALTH_TASK_LOG, LOG_HEALTH_DEADLINE_MS, NULL);
+    while (1)
+    {
+        health_wait(HEALTH_TASK_LOG);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        health_beat(HEALTH_TASK_LOG, "drain");
+        log_flush();
+    }
+}
+
+void log_control_init(void)
+{
+    drain_mutex = xSemaphoreCreateMutexStatic(&drain_mutex_storage);
+    TaskHandle_t log_task_handle = xTaskCreateStatic(log_task, "LogTask", sizeof(log_task_stack), NULL,
+                                                     LOG_TASK_PRIORITY, log_task_stack, &log_task_tcb);
+    const TimerJobArgs drain_job_args = {
+        .name = "log_drain",
+        .owner = log_task_handle,
+        .slack_ms = LOG_DRAIN_SLACK_MS,
+    };
+    timer_job_init(&drain_job, &drain_job_args);
+    timer_start_periodic(&drain_job, LOG_DRAIN_PERIOD_MS);
+}
+
+void log_get_stats(LogStats *stats)
+{
+    stats->written = atomic_load_explicit(&written, memory_order_relaxed);
+    stats->suppressed = atomic_load_explicit(&suppressed, memory_order_relaxed);
+    stats->overwritten = overwritten;
+    stats->sites = site_count;
+}
+
+void log_print_stats(void)
+{
+    LogStats stats;
+    log_get_stats(&stats);
+    printf("Log: %lu records, %lu suppressed by the rate limits, %lu lost\n", (unsigned long)stats.written,
+           (unsigned long)stats.suppressed, (unsigned long)stats.overwritten);
+}
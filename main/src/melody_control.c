@@ -0,0 +1,302 @@
+#include "melody_control.h"
+#include <string.h>
+#include "esp_partition.h"
+#include "log_control.h"
+
+// RTTTL defaults for a header that leaves one out
+#define MELODY_DEFAULT_LENGTH 4
+#define MELODY_DEFAULT_OCTAVE 6
+#define MELODY_DEFAULT_TEMPO 63
+
+#define MELODY_MIN_OCTAVE 4
+#define MELODY_MAX_OCTAVE 7
+
+// The built-in signals, a few bytes each instead of a fixed tones[] array
+static const char *const builtin_melodies[MELODY_BUILTIN_COUNT] = {
+    "Beep:d=4,o=5,b=300:b",
+    "Double Beep:d=4,o=5,b=300:b,b",
+    "Chime:d=4,o=5,b=120:b4,f,a",
+    "Alarm:d=4,o=6,b=120:b,f#,b",
+    "Melody:d=4,o=5,b=200:g,b,d6,b",
+};
+
+// Lines of the mapped data partition
+static const char *user_melodies[MELODY_USER_MAX];
+static int user_count = 0;
+
+// Octave 7, in Hz: lower octaves halve it
+static const uint16_t octave7_hz[12] = {2093, 2217, 2349, 2489, 2637, 2794, 2960, 3136, 3322, 3520, 3729, 3951};
+
+// Semitone of each letter, a to g
+static const uint8_t letter_semitone[7] = {9, 11, 0, 2, 4, 5, 7};
+
+// A melody ends with its line, in a string or in the partition
+static bool at_end(char c)
+{
+    return c == '\0' || c == '\n' || c == '\r' || (uint8_t)c == 0xff;
+}
+
+static void skip_spaces(const char **at)
+{
+    while (**at == ' ')
+    {
+        (*at)++;
+    }
+}
+
+static int read_number(const char **at)
+{
+    int value = 0;
+    while (**at >= '0' && **at <= '9' && value < 10000)
+    {
+        value = value * 10 + (**at - '0');
+        (*at)++;
+    }
+    return value;
+}
+
+// Where the header (or the name) ends, NULL without one
+static const char *find_colon(const char *at)
+{
+    while (!at_end(*at) && *at != ':')
+    {
+        at++;
+    }
+    return *at == ':' ? at : NULL;
+}
+
+bool melody_begin(MelodyParser *parser, const char *melody)
+{
+    int length = MELODY_DEFAULT_LENGTH;
+    int octave = MELODY_DEFAULT_OCTAVE;
+    int tempo = MELODY_DEFAULT_TEMPO;
+
+    parser->at = "";
+    const char *at = find_colon(melody);
+    if (at == NULL || find_colon(at + 1) == NULL)
+    {
+        return false;
+    }
+    at++;
+
+    // d=, o= and b=, in any order
+    while (*at != ':')
+    {
+        skip_spaces(&at);
+        char key = *at;
+        if (at[1] != '=')
+        {
+            return false;
+        }
+        at += 2;
+        int value = read_number(&at);
+        switch (key)
+        {
+        case 'd':
+            length = value;
+            break;
+        case 'o':
+            octave = value;
+            break;
+        case 'b':
+            tempo = value;
+            break;
+        default:
+            return false;
+        }
+        skip_spaces(&at);
+        if (*at == ',')
+        {
+            at++;
+        }
+        else if (*at != ':')
+        {
+            return false;
+        }
+    }
+
+    if (length < 1 || length > 64 || octave < MELODY_MIN_OCTAVE || octave > MELODY_MAX_OCTAVE || tempo < 1)
+    {
+        return false;
+    }
+    parser->length = length;
+    parser->octave = octave;
+    parser->whole_ms = 4 * 60000 / tempo;
+    parser->at = at + 1;
+    return true;
+}
+
+bool melody_next(MelodyParser *parser, MelodyNote *note)
+{
+    const char *at = parser->at;
+    skip_spaces(&at);
+    if (at_end(*at))
+    {
+        return false;
+    }
+
+    int length = read_number(&at);
+    if (length == 0)
+    {
+        length = parser->length;
+    }
+
+    char letter = *at | 0x20; // Lower case
+    int semitone = -1;
+    if (letter >= 'a' && letter <= 'g')
+    {
+        semitone = letter_semitone[letter - 'a'];
+    }
+    else if (letter != 'p')
+    {
+        parser->at = "";
+        return false;
+    }
+    at++;
+    if (*at == '#')
+    {
+        semitone++;
+        at++;
+    }
+    bool dotted = false;
+    if (*at == '.')
+    {
+        dotted = true;
+        at++;
+    }
+    int octave = parser->octave;
+    if (*at >= '0' && *at <= '9')
+    {
+        octave = *at++ - '0';
+    }
+    if (*at == '.') // Some melodies put the dot after the octave
+    {
+        dotted = true;
+        at++;
+    }
+    skip_spaces(&at);
+    if (*at == ',')
+    {
+        at++;
+    }
+    else if (!at_end(*at))
+    {
+        parser->at = "";
+        return false;
+    }
+    parser->at = at;
+
+    if (length < 1 || length > 64 || octave < MELODY_MIN_OCTAVE || octave > MELODY_MAX_OCTAVE)
+    {
+        parser->at = "";
+        return false;
+    }
+
+    uint32_t duration_ms = parser->whole_ms / length;
+    if (dotted)
+    {
+        duration_ms += duration_ms / 2;
+    }
+    note->duration_ms = duration_ms > UINT16_MAX ? UINT16_MAX : duration_ms;
+    note->frequency = 0;
+    if (semitone >= 0)
+    {
+        if (semitone == 12) // b#
+        {
+            semitone = 0;
+            octave++;
+        }
+        int shift = MELODY_MAX_OCTAVE - octave;
+        note->frequency = shift >= 0 ? (octave7_hz[semitone] + (1 << shift) / 2) >> shift : octave7_hz[semitone] * 2;
+    }
+    return true;
+}
+
+void melody_get_name(const char *melody, char *name, size_t size)
+{
+    size_t n = 0;
+    while (!at_end(*melody) && *melody != ':' && n + 1 < size)
+    {
+        name[n++] = *melody++;
+    }
+    if (size > 0)
+    {
+        name[n] = '\0';
+    }
+}
+
+// Index the lines of the partition, which stays mapped: the melodies are read
+// from flash and take no RAM
+static void load_user_melodies(void)
+{
+    const esp_partition_t *partition =
+        esp_partition_find_first(ESP_PARTITION_TYPE_DATA, MELODY_PARTITION_SUBTYPE, MELODY_PARTITION_LABEL);
+    if (partition == NULL)
+    {
+        return;
+    }
+
+    const void *mapped;
+    esp_partition_mmap_handle_t handle;
+    esp_err_t err = esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &mapped, &handle);
+    if (err != ESP_OK)
+    {
+        LOG_ERROR("Could not map the melodies: %s", esp_err_to_name(err));
+        return;
+    }
+
+    const char *at = mapped;
+    const char *end = at + partition->size;
+    while (at < end && *at != '\0' && (uint8_t)*at != 0xff && user_count < MELODY_USER_MAX)
+    {
+        const char *line = at;
+        while (at < end && !at_end(*at))
+        {
+            at++;
+        }
+        if (at == end)
+        {
+            break; // No terminator before the end of the partition, the parser would run past it
+        }
+
+        MelodyParser parser;
+        if (line != at && melody_begin(&parser, line))
+        {
+            user_melodies[user_count++] = line;
+        }
+        else if (line != at)
+        {
+            LOG_WARN("Skipping a malformed melody at offset %d", (int)(line - (const char *)mapped));
+        }
+
+        while (at < end && (*at == '\n' || *at == '\r'))
+        {
+            at++;
+        }
+    }
+    LOG_INFO("%d user melodies", user_count);
+}
+
+void melody_control_init(void)
+{
+    load_user_melodies();
+}
+
+int melody_count(void)
+{
+    return MELODY_BUILTIN_COUNT + user_count;
+}
+
+const char *melody_get(int index)
+{
+    if (index >= 0 && index < MELODY_BUILTIN_COUNT)
+    {
+        return builtin_melodies[index];
+    }
+    index -= MELODY_BUILTIN_COUNT;
+    if (index >= 0 && index < user_count)
+    {
+        return user_melodies[index];
+    }
+    return NULL;
+}
@@ -2,6 +2,19 @@
 #include "display_control.h"
 #include "settings_control.h"
 #include "gpio_control.h"
+#include "trace_control.h"
+#include "pm_control.h"
+#include "log_control.h"
+#include "button_control.h"
+#include "health_control.h"
+#include "scene_control.h"
+#include "melody_control.h"
+#include "rgb_led_control.h"
+#include "ir_control.h"
+#include "us_control.h"
+#include "ambient_control.h"
+#include "esp_timer.h"
+#include <stdatomic.h>
 #include <stdio.h>
 #include <string.h>
 #include "freertos/FreeRTOS.h"
@@ -9,7 +22,7 @@
 
 // Track the scroll offset and cursor position
 static int scroll_offset = 0;   // Index of the first visible menu item
-static int cursor_position = 1; // 1 = Row 1, 2 = Row 2
+static int cursor_position = 1; // Row of the selection, from 1 to display_get_rows()
 
 // Menu item structure
 typedef struct MenuItem
@@ -17,78 +30,116 @@ typedef struct MenuItem
     const char *name;         // Name of the menu item
     struct MenuItem *submenu; // Pointer to the submenu (if any)
     void (*action)(void);     // Callback function for actions (if any)
+    int setting;              // SettingKey shown next to the name, or NO_SETTING
 } MenuItem;
 
+#define NO_SETTING -1
+
 // Current menu state
 static MenuItem *current_menu = NULL;
 static int current_selection = 0;
 bool is_in_special_mode = false; // Flag to turn off normal key presses
 bool is_in_special_mode_lr = false;
 
+// Deferred renders requested by the LED task when a sensor or timer flips the light
+static volatile bool render_requested = false;
+static int rendered_light_state = -1; // Light state shown by the last render
+
 // Parent menu stack
 #define MENU_STACK_SIZE 10
 static MenuItem *menu_stack[MENU_STACK_SIZE];
 static int menu_stack_index = -1;
 
+// Set by menu_recover(), the open editor leaves as if BACK was pressed
+static atomic_bool editor_cancel = false;
+
 // Forward declarations for actions
 void toggle_light(void);
 void toggle_us(void);
 void toggle_sound(void);
+void toggle_auto_brightness(void);
 void adjust_brightness(void);
 void adjust_ir_sensitivity(void);
 void adjust_us_sensitivity(void);
 void adjust_volume(void);
 void select_signal(void);
 void select_color(void);
+void adjust_hue(void);
+void adjust_saturation(void);
+void adjust_color_temp(void);
+void apply_scene(void);
+void save_scene(void);
+void dashboard_page(void);
 
 // Timings submenu
 MenuItem timings_menu[] = {
-    {"Auto unplug", NULL, toggle_auto_unplug},
-    {"IR Timing", NULL, NULL},
-    {"UR Timing", NULL, NULL},
-    {NULL, NULL, NULL} // End of menu
+    {"Auto unplug", NULL, toggle_auto_unplug, SETTING_LIGHT_AUTO_TURN_OFF},
+    {"IR Timing", NULL, NULL, SETTING_TIMING_IR},
+    {"UR Timing", NULL, NULL, SETTING_TIMING_UR},
+    {NULL, NULL, NULL, NO_SETTING} // End of menu
 };
 
 // Sensitivity submenu
 MenuItem sensitivity_menu[] = {
-    {"IR Sense", NULL, adjust_ir_sensitivity},
-    {"US distance", NULL, adjust_us_sensitivity},
-    {NULL, NULL, NULL} // End of menu
+    {"IR Sense", NULL, adjust_ir_sensitivity, SETTING_SENSITIVITY_IR},
+    {"US distance", NULL, adjust_us_sensitivity, SETTING_SENSITIVITY_UR},
+    {NULL, NULL, NULL, NO_SETTING} // End of menu
+};
+
+// Color submenu: a palette entry, a hue, or a white
+MenuItem color_menu[] = {
+    {"Palette", NULL, select_color, SETTING_COLOR},
+    {"Hue", NULL, adjust_hue, SETTING_HUE},
+    {"Saturation", NULL, adjust_saturation, SETTING_SATURATION},
+    {"White", NULL, adjust_color_temp, SETTING_COLOR_TEMP},
+    {NULL, NULL, NULL, NO_SETTING} // End of menu
 };
 
 // Light submenu
 MenuItem light_menu[] = {
-    {"Brightness", NULL, adjust_brightness},
-    {"Color", NULL, select_color},
-    {"IR", NULL, toggle_ir},
-    {"US", NULL, toggle_us},
-    {"Sensitivity", sensitivity_menu, NULL},
-    {"Timings", timings_menu, NULL},
-    {NULL, NULL, NULL} // End of menu
+    {"Brightness", NULL, adjust_brightness, SETTING_BRIGHTNESS},
+    {"Color", color_menu, NULL, SETTING_COLOR_MODE},
+    {"IR", NULL, toggle_ir, SETTING_IR},
+    {"US", NULL, toggle_us, SETTING_US},
+    {"Sensitivity", sensitivity_menu, NULL, NO_SETTING},
+    {"Timings", timings_menu, NULL, NO_SETTING},
+#if CONFIG_SUPER_LIGHTS_AMBIENT
+    {"Auto bright", NULL, toggle_auto_brightness, SETTING_AUTO_BRIGHTNESS},
+#endif
+    {NULL, NULL, NULL, NO_SETTING} // End of menu
 };
 
 // Audio submenu
 MenuItem audio_menu[] = {
-    {"Sound", NULL, toggle_sound},
-    {"Signal", NULL, select_signal},
-    {"Volume", NULL, adjust_volume},
-    {"Mode", NULL, NULL},
-    {NULL, NULL, NULL} // End of menu
+    {"Sound", NULL, toggle_sound, SETTING_SOUND},
+    {"Signal", NULL, select_signal, SETTING_SELECTED_SIGNAL},
+    {"Volume", NULL, adjust_volume, SETTING_VOLUME},
+    {"Mode", NULL, NULL, NO_SETTING},
+    {NULL, NULL, NULL, NO_SETTING} // End of menu
+};
+
+// Scenes submenu
+MenuItem scenes_menu[] = {
+    {"Apply scene", NULL, apply_scene, NO_SETTING},
+    {"Save scene", NULL, save_scene, NO_SETTING},
+    {NULL, NULL, NULL, NO_SETTING} // End of menu
 };
 
 // Settings submenu
 MenuItem settings_menu[] = {
-    {"Audio settings", audio_menu, NULL},
-    {"Light settings", light_menu, NULL},
-    {NULL, NULL, NULL} // End of menu
+    {"Audio settings", audio_menu, NULL, NO_SETTING},
+    {"Light settings", light_menu, NULL, NO_SETTING},
+    {NULL, NULL, NULL, NO_SETTING} // End of menu
 };
 
 // Top-level menu
 MenuItem main_menu[] = {
-    {"Light", NULL, toggle_light},
-    {"Settings", settings_menu, NULL},
-    {"About", NULL, about_page},
-    {NULL, NULL, NULL} // End of menu
+    {"Light", NULL, toggle_light, SETTING_LIGHT},
+    {"Settings", settings_menu, NULL, NO_SETTING},
+    {"Scenes", scenes_menu, NULL, NO_SETTING},
+    {"Sensors", NULL, dashboard_page, NO_SETTING},
+    {"About", NULL, about_page, NO_SETTING},
+    {NULL, NULL, NULL, NO_SETTING} // End of menu
 };
 
 // Initialize the menu
@@ -98,17 +149,32 @@ void menu_init(void)
     current_selection = 0;
     menu_stack_index = -1;
     scroll_offset = 0;   // Index of the first visible menu item
-    cursor_position = 1; // 1 = Row 1, 2 = Row 2
+    cursor_position = 1; // First row
     menu_render();
     display_highlight_row(1); // Highlight the first row
 }
 
+// One round of an editor loop: a heartbeat, then time for the buttons to settle
+static void editor_wait(const char *where)
+{
+    health_beat(HEALTH_TASK_MAIN, where);
+    vTaskDelay(pdMS_TO_TICKS(BUTTON_REPEAT_POLL_MS)); // Small delay to debounce buttons
+}
+
+// BACK, or menu_recover() cancelling the editor
+static bool editor_back_pressed(void)
+{
+    return gpio_get_button_state(BACK_BUTTON_GPIO) == 0 || atomic_exchange(&editor_cancel, false);
+}
+
 // Select the current menu item i.e enter the submenu or execute the action
 void menu_select(void)
 {
+    trace_point(TRACE_MENU_SELECT);
+
     MenuItem *selected_item = &current_menu[current_selection];
-    printf("Selected item: %s\n", selected_item->name);
-    printf("Current_selection: %d\n", current_selection);
+    LOG_INFO("Selected item: %s", selected_item->name);
+    LOG_DEBUG("Current_selection: %d", current_selection);
     if (selected_item->submenu != NULL)
     {
         // Push the current menu onto the stack
@@ -126,7 +192,12 @@ void menu_select(void)
     }
     else if (selected_item->action != NULL)
     {
+        // Interactive screens read ENTER themselves, the press that opened
+        // them must not count (the main loop now reacts within the press)
+        button_wait_release(ENTER_BUTTON_GPIO);
+
         // Execute the action
+        atomic_store(&editor_cancel, false);
         selected_item->action();
     }
 }
@@ -148,174 +219,85 @@ void menu_back(void)
     }
     else
     {
-        printf("Already at the top-level menu, cannot go back further.\n");
+        LOG_INFO("Already at the top-level menu, cannot go back further.");
     }
 }
 
-// Render the current menu
-void menu_render(void)
+// "Name: value" for items that show a setting, the name alone otherwise
+static void format_item(const MenuItem *item, char *line, size_t size)
 {
-    char line1[20];
-    char line2[20];
-
-    // Get the names of the two visible menu items
-    const char *item1_name = current_menu[scroll_offset].name;
-    const char *item2_name = (current_menu[scroll_offset + 1].name != NULL)
-                                 ? current_menu[scroll_offset + 1].name
-                                 : "";
-
-    // TODO: This is super-nasty, move to a helper method
-    // Check if the first item is "Light" and append its current setting
-    if (strcmp(item1_name, "Light") == 0)
-    {
-        Settings *settings = settings_get();
-        snprintf(line1, sizeof(line1), "Light: %s", settings->light ? "On" : "Off");
-    }
-    else if (strcmp(item1_name, "Brightness") == 0)
-    {
-        Settings *settings = settings_get();
-        snprintf(line1, sizeof(line1), "Brightness: %d%%", settings->brightness);
-    }
-    else if (strcmp(item1_name, "Color") == 0)
-    {
-        Settings *settings = settings_get();
-        const char **color_names = settings_get_color_names();
-        snprintf(line1, sizeof(line1), "Color: %s", color_names[settings->selected_color]);
-    }
-    else if (strcmp(item1_name, "Auto unplug") == 0)
-    {
-        Settings *settings = settings_get();
-        if (settings->light_auto_turn_off == 0)
-        {
-            snprintf(line1, sizeof(line1), "Auto unplug: Off");
-        }
-        else
-        {
-            snprintf(line1, sizeof(line1), "Auto unplug: %ds", settings->light_auto_turn_off);
-        }
-    }
-    else if (strcmp(item1_name, "IR") == 0) // Add IR setting
-    {
-        Settings *settings = settings_get();
-        snprintf(line1, sizeof(line1), "IR: %s", settings->ir ? "Active" : "Disabled");
-    }
-    else if (strcmp(item1_name, "IR Sense") == 0)
-    {
-        Settings *settings = settings_get();
-        snprintf(line1, sizeof(line1), "IR Sense: %d%%", settings->sensitivity_ir);
-    }
-    else if (strcmp(item1_name, "US") == 0) // Add US setting
-    {
-        Settings *settings = settings_get();
-        snprintf(line1, sizeof(line1), "US: %s", settings->us ? "Active" : "Disabled");
-    }
-    else if (strcmp(item1_name, "US distance") == 0)
-    {
-        Settings *settings = settings_get();
-        snprintf(line1, sizeof(line1), "US distance: %d cm", settings->sensitivity_ur);
-    }
-    else if (strcmp(item1_name, "UR Timing") == 0)
+    if (item->name == NULL)
     {
-        Settings *settings = settings_get();
-        snprintf(line1, sizeof(line1), "UR Timing: %dms", settings->timing_ur * 100);
+        line[0] = '\0';
+        return;
     }
-    else if (strcmp(item1_name, "Sound") == 0)
+    if (item->setting == NO_SETTING)
     {
-        Settings *settings = settings_get();
-        snprintf(line1, sizeof(line1), "Sound: %s", settings->sound_on ? "On" : "Off");
-    }
-    else if (strcmp(item1_name, "Signal") == 0)
-    {
-        Settings *settings = settings_get();
-        snprintf(line1, sizeof(line1), "Signal: %s", get_selected_signal()->name);
-    }
-    else if (strcmp(item1_name, "Volume") == 0)
-    {
-        Settings *settings = settings_get();
-        snprintf(line1, sizeof(line1), "Volume: %d%%", settings->volume);
-    }
-    else
-    {
-        snprintf(line1, sizeof(line1), "%s", item1_name);
+        snprintf(line, size, "%s", item->name);
+        return;
     }
+    char value[16];
+    settings_format(item->setting, value, sizeof(value));
+    snprintf(line, size, "%s: %s", item->name, value);
+}
 
-    // Check if the second item is "Light" and append its current setting
-    if (strcmp(item2_name, "Light") == 0)
-    {
-        Settings *settings = settings_get();
-        snprintf(line2, sizeof(line2), "Light: %s", settings->light ? "On" : "Off");
-    }
-    else if (strcmp(item2_name, "Brightness") == 0)
-    {
-        Settings *settings = settings_get();
-        snprintf(line2, sizeof(line2), "Brightness: %d%%", settings->brightness);
-    }
-    else if (strcmp(item2_name, "Color") == 0)
-    {
-        Settings *settings = settings_get();
-        const char **color_names = settings_get_color_names();
-        snprintf(line2, sizeof(line2), "Color: %s", color_names[settings->selected_color]);
-    }
-    else if (strcmp(item2_name, "Auto unplug") == 0)
+// Render the current menu, as many items as the panel has rows
+void menu_render(void)
+{
+    char text[DISPLAY_ROWS_MAX][20];
+    const char *lines[DISPLAY_ROWS_MAX];
+    int rows = display_get_rows();
+
+    bool ended = false;
+    for (int row = 0; row < rows; row++)
     {
-        Settings *settings = settings_get();
-        if (settings->light_auto_turn_off == 0)
+        const MenuItem *item = &current_menu[scroll_offset + row];
+        ended = ended || item->name == NULL; // Nothing to read past the terminator
+        text[row][0] = '\0';
+        if (!ended)
         {
-            snprintf(line2, sizeof(line2), "Auto unplug: Off");
+            format_item(item, text[row], sizeof(text[row]));
         }
-        else
-        {
-            snprintf(line2, sizeof(line2), "Auto unplug: %ds", settings->light_auto_turn_off);
-        }
-    }
-    else if (strcmp(item2_name, "IR") == 0) // Add IR setting
-    {
-        Settings *settings = settings_get();
-        snprintf(line2, sizeof(line2), "IR: %s", settings->ir ? "Active" : "Disabled");
-    }
-    else if (strcmp(item2_name, "IR Sense") == 0)
-    {
-        Settings *settings = settings_get();
-        snprintf(line2, sizeof(line2), "IR Sense: %d%%", settings->sensitivity_ir);
-    }
-    else if (strcmp(item2_name, "US") == 0) // Add US setting
-    {
-        Settings *settings = settings_get();
-        snprintf(line2, sizeof(line2), "US: %s", settings->us ? "Active" : "Disabled");
-    }
-    else if (strcmp(item2_name, "US distance") == 0)
-    {
-        Settings *settings = settings_get();
-        snprintf(line2, sizeof(line2), "US distance: %d cm", settings->sensitivity_ur);
+        lines[row] = text[row];
     }
-    else if (strcmp(item2_name, "UR Timing") == 0)
-    {
-        Settings *settings = settings_get();
-        snprintf(line2, sizeof(line2), "UR Timing: %dms", settings->timing_ur * 100);
-    }
-    else if (strcmp(item2_name, "Sound") == 0)
-    {
-        Settings *settings = settings_get();
-        snprintf(line2, sizeof(line2), "Sound: %s", settings->sound_on ? "On" : "Off");
-    }
-    else if (strcmp(item2_name, "Signal") == 0)
-    {
-        Settings *settings = settings_get();
-        snprintf(line2, sizeof(line2), "Signal: %s", get_selected_signal()->name);
-    }
-    else if (strcmp(item2_name, "Volume") == 0)
+
+    // Render the menu with the selected row highlighted
+    rendered_light_state = settings_get()->light;
+    display_render_lines(lines, rows);
+    display_highlight_row(cursor_position); // Highlight the selected row
+}
+
+// Ask for a re-render from the task that owns the display
+void menu_request_render(void)
+{
+    render_requested = true;
+    pm_control_signal_work(); // The main loop may be waiting for a button
+}
+
+// Called from the main loop: redraw if the light changed behind the menu's back
+void menu_render_if_requested(void)
+{
+    if (!render_requested)
     {
-        Settings *settings = settings_get();
-        snprintf(line2, sizeof(line2), "Volume: %d%%", settings->volume);
+        return;
     }
-    else
+    render_requested = false;
+
+    if (rendered_light_state != settings_get()->light)
     {
-        snprintf(line2, sizeof(line2), "%s", item2_name);
+        menu_render();
     }
+}
 
-    // Render the menu with the selected row highlighted
-    display_render(line1, line2);
-    display_highlight_row(cursor_position); // Highlight the selected row (1 or 2)
+// Soft recovery when the main task stalls, runs in the health monitor task:
+// an editor waiting for input gives up, the LCD starts over and the main loop
+// redraws the menu once it gets going again
+void menu_recover(void)
+{
+    atomic_store(&editor_cancel, true);
+    display_reinit();
+    rendered_light_state = -1;
+    menu_request_render();
 }
 
 void menu_scroll_down(void)
@@ -326,14 +308,15 @@ void menu_scroll_down(void)
         current_selection++; // Move to the next item
 
         // Adjust scroll offset if needed
-        if (cursor_position == 1)
+        int rows = display_get_rows();
+        if (cursor_position < rows)
         {
-            cursor_position = 2; // Move cursor to the second row
+            cursor_position++; // Move cursor to the next row
         }
-        else if (cursor_position == 2)
+        else
         {
             // Scroll down if there are more items below
-            if (current_menu[scroll_offset + 2].name != NULL)
+            if (current_menu[scroll_offset + rows].name != NULL)
             {
                 scroll_offset++; // Scroll down
             }
@@ -341,7 +324,7 @@ void menu_scroll_down(void)
     }
     else
     {
-        printf("Oh noes, you can't go any further down! \n");
+        LOG_INFO("Oh noes, you can't go any further down!");
     }
 
     // Re-render the menu
@@ -356,11 +339,11 @@ void menu_scroll_up(void)
         current_selection--; // Move to the previous item
 
         // Adjust scroll offset if needed
-        if (cursor_position == 2)
+        if (cursor_position > 1)
         {
-            cursor_position = 1; // Move cursor to the first row
+            cursor_position--; // Move cursor to the previous row
         }
-        else if (cursor_position == 1)
+        else
         {
             // Scroll up if there are more items above
             if (scroll_offset > 0)
@@ -371,7 +354,7 @@ void menu_scroll_up(void)
     }
     else
     {
-        printf("Oh noes, you can't go any further up \n");
+        LOG_INFO("Oh noes, you can't go any further up");
     }
 
     // Re-render the menu
@@ -393,6 +376,13 @@ void toggle_sound(void)
     menu_render();
 }
 
+void toggle_auto_brightness(void)
+{
+    Settings *settings = settings_get();
+    settings->auto_brightness = !settings->auto_brightness; // The strip follows on the next frame
+    menu_render();
+}
+
 void toggle_ir(void)
 {
     Settings *settings = settings_get();
@@ -422,7 +412,7 @@ void about_page(void)
         "  amazing app!",
         NULL // End of text
     };
-    printf("entering about Page\n");
+    LOG_INFO("entering about Page");
     vTaskDelay(pdMS_TO_TICKS(100));
     is_in_special_mode = true; // Set the flag to disable normal key presses
     int scroll_offset = 0;
@@ -435,9 +425,9 @@ void about_page(void)
                             : "";
 
     // Debug: Log the about page rendering
-    printf("About Page:\n");
-    printf("Line 1: %s\n", line1);
-    printf("Line 2: %s\n", line2);
+    LOG_INFO("About Page:");
+    LOG_INFO("Line 1: %s", line1);
+    LOG_INFO("Line 2: %s", line2);
 
     // Render the lines without highlighting
     display_render(line1, line2);
@@ -451,47 +441,43 @@ void about_page(void)
                                 : "";
 
         // Debug: Log the about page rendering
-        printf("About Page:\n");
-        printf("Line 1: %s\n", line1);
-        printf("Line 2: %s\n", line2);
+        LOG_INFO("About Page:");
+        LOG_INFO("Line 1: %s", line1);
+        LOG_INFO("Line 2: %s", line2);
 
         // Render the lines without highlighting
 
         // Handle button presses for scrolling
         if (gpio_get_button_state(DOWN_BUTTON_GPIO) == 0 && about_text[scroll_offset + 1] != NULL)
         {
-            printf("Scrolling down\n");
+            LOG_INFO("Scrolling down");
             scroll_offset++; // Scroll down
             display_render(line1, line2);
-            while (gpio_get_button_state(DOWN_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            button_wait_release(DOWN_BUTTON_GPIO);
         }
         else if (gpio_get_button_state(UP_BUTTON_GPIO) == 0 && scroll_offset > 0)
         {
-            printf("Scrolling up\n");
+            LOG_INFO("Scrolling up");
             scroll_offset--; // Scroll up
             display_render(line1, line2);
-            while (gpio_get_button_state(UP_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            button_wait_release(UP_BUTTON_GPIO);
         }
         else if (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
         {
             // Exit the about page
-            printf("Enter button pressed, should exit about page\n");
-            while (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            LOG_INFO("Enter button pressed, should exit about page");
+            button_wait_release(ENTER_BUTTON_GPIO);
             break;
         }
-        else if (gpio_get_button_state(BACK_BUTTON_GPIO) == 0)
+        else if (editor_back_pressed())
         {
             // Exit the about page
-            printf("Exiting about page\n");
-            while (gpio_get_button_state(BACK_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            LOG_INFO("Exiting about page");
+            button_wait_release(BACK_BUTTON_GPIO);
             break;
         }
 
-        vTaskDelay(pdMS_TO_TICKS(100)); // Small delay to debounce buttons
+        editor_wait(__func__);
     }
     is_in_special_mode = false; // Reset the flag to enable normal key presses
     display_enable_cursor();    // Re-enable the cursor
@@ -499,96 +485,152 @@ void about_page(void)
     menu_render(); // Re-render the menu after exiting the about page
 }
 
-// Action: Adjust brightness
-void adjust_brightness(void)
-{
-    vTaskDelay(pdMS_TO_TICKS(100)); // Small delay to wait for enter button release
+// The sensor dashboard redraws at most this often
+#define DASHBOARD_REFRESH_MS 100
 
-    Settings *settings = settings_get();
-    int original_brightness = settings->brightness; // Save the original brightness
-    int brightness = settings->brightness;          // Current brightness value
-
-    is_in_special_mode_lr = true; // Enable special mode for left-right behavior
-    display_disable_cursor();     // Disable the cursor
+// Live readings for tuning the sensitivities, e.g.
+//
+//   US 84cm IR 3/25    filtered distance, IR pulses against the required count
+//   Occ Yes Off 598s   PIR occupancy, auto unplug countdown
+static void format_dashboard(char *line1, char *line2, size_t size)
+{
+    char distance[4] = "---";
+    float distance_cm = us_sensor_get_filtered_distance();
+    if (settings_get()->us && distance_cm >= 0)
+    {
+        snprintf(distance, sizeof(distance), "%3d", distance_cm > 999 ? 999 : (int)(distance_cm + 0.5f));
+    }
+    snprintf(line1, size, "US%scm IR%2d/%-2d", distance, ir_sensor_get_pulses(), ir_sensor_get_required_pulses());
 
-    // Render the initial brightness adjustment screen
-    char slider[18];                                 // 16 characters for the display + 2 for null terminator
-    snprintf(slider, sizeof(slider), "[%-14s]", ""); // Empty slider with stoppers
-    int slider_position = (brightness * 14) / 100;   // Map brightness to slider position
-    for (int i = 0; i < slider_position; i++)
+    char countdown[5] = " -- ";
+    int remaining_s = auto_turn_off_remaining_s();
+    if (remaining_s >= 0)
     {
-        slider[i + 1] = '|'; // Fill the slider between the stoppers
+        snprintf(countdown, sizeof(countdown), "%3ds", remaining_s > 999 ? 999 : remaining_s);
     }
+    snprintf(line2, size, "Occ %s Off %s", ir_sensor_is_occupied() ? "Yes" : " No", countdown);
+}
 
-    display_render("Adjust Brightness", slider);
+// Action: Live sensor dashboard. The labels stay put and the rows are brought
+// up to date in place, so a refresh only sends the digits that changed and
+// the sensor tasks never wait on a full redraw.
+void dashboard_page(void)
+{
+    vTaskDelay(pdMS_TO_TICKS(100)); // Small delay to wait for enter button release
 
+    is_in_special_mode = true; // Set the flag to disable normal key presses
+    display_disable_cursor();
+    display_clear();
+
+    int64_t next_refresh_us = 0;
     while (1)
     {
-        // Handle button presses for adjusting brightness
-        if (gpio_get_button_state(DOWN_BUTTON_GPIO) == 0 && brightness < 100) // DOWN acts as RIGHT
+        int64_t now_us = esp_timer_get_time();
+        if (now_us >= next_refresh_us)
         {
-            brightness += 100 / 14; // Increment brightness by one tick
-            if (brightness > 100)
-                brightness = 100; // Cap at 100%
-
-            // Update the slider
-            slider_position = (brightness * 14) / 100;
-            snprintf(slider, sizeof(slider), "[%-14s]", "");
-            for (int i = 0; i < slider_position; i++)
+            char line1[20];
+            char line2[20];
+            format_dashboard(line1, line2, sizeof(line1));
+            display_write_row(0, line1);
+            display_write_row(1, line2);
+            if (display_get_rows() > 2)
             {
-                slider[i + 1] = '|';
+                // A taller panel has room for what the sensors lead to
+                snprintf(line1, sizeof(line1), "Light %-3s %3d%%", settings_get()->light ? "On" : "Off",
+                         settings_get()->brightness);
+                display_write_row(3, line1);
+
+                // Ambient level on the ADC's 12 bit scale, and the share of the brightness it leaves
+                char level[5] = "----";
+                int ambient = ambient_get_level();
+                if (ambient >= 0)
+                {
+                    ambient = ambient > AMBIENT_LEVEL_MAX ? AMBIENT_LEVEL_MAX : ambient;
+                    snprintf(level, sizeof(level), "%4d", ambient >> AMBIENT_EXTRA_BITS); // At most 4095
+                }
+                snprintf(line1, sizeof(line1), "Amb %s %3d%%", level, ambient_scale_brightness(100));
+                display_write_row(4, line1);
             }
+            next_refresh_us = now_us + DASHBOARD_REFRESH_MS * 1000LL;
+        }
 
-            display_render("Adjust Brightness", slider);
-
-            while (gpio_get_button_state(DOWN_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+        if (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
+        {
+            button_wait_release(ENTER_BUTTON_GPIO);
+            break;
         }
-        else if (gpio_get_button_state(UP_BUTTON_GPIO) == 0 && brightness > 0) // UP acts as LEFT
+        else if (editor_back_pressed())
         {
-            brightness -= 100 / 14; // Decrement brightness by one tick
-            if (brightness < 0)
-                brightness = 0; // Cap at 0%
-
-            // Update the slider
-            slider_position = (brightness * 14) / 100;
-            snprintf(slider, sizeof(slider), "[%-14s]", "");
-            for (int i = 0; i < slider_position; i++)
-            {
-                slider[i + 1] = '|';
-            }
+            button_wait_release(BACK_BUTTON_GPIO);
+            break;
+        }
 
-            display_render("Adjust Brightness", slider);
+        editor_wait(__func__);
+    }
 
-            while (gpio_get_button_state(UP_BUTTON_GPIO) == 0)
-                ; // Wait for button release
-        }
-        else if (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
+    is_in_special_mode = false; // Reset the flag to enable normal key presses
+    display_enable_cursor();    // Re-enable the cursor
+    menu_render();
+}
+
+// Slider for a setting, in place: the title stays and the bar moves by
+// one character cell at a time. Holding UP or DOWN repeats, faster the longer
+// it is held. The value is kept on ENTER.
+static void adjust_slider(SettingKey key, const char *title, DisplayGlyph icon)
+{
+    vTaskDelay(pdMS_TO_TICKS(100)); // Small delay to wait for enter button release
+
+    int min = settings_get_min(key);
+    int max = settings_get_max(key);
+    int value = settings_get_int(key);
+    ButtonRepeat repeat;
+    button_repeat_init(&repeat, max - min);
+
+    is_in_special_mode_lr = true; // Enable special mode for left-right behavior
+    display_disable_cursor();     // Disable the cursor
+
+    // Title, padded to put the icon in the last column
+    char header[DISPLAY_COLS + 1];
+    snprintf(header, sizeof(header), "%-*.*s%c", DISPLAY_COLS - 1, DISPLAY_COLS - 1, title, display_glyph(icon));
+    display_slider(header, (value - min) * DISPLAY_BAR_STEPS / (max - min));
+
+    while (1)
+    {
+        int steps = button_repeat_steps(&repeat, DOWN_BUTTON_GPIO) - button_repeat_steps(&repeat, UP_BUTTON_GPIO);
+        if (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
         {
-            // Save the current brightness and exit
-            settings->brightness = brightness;
-            printf("Brightness set to %d%%\n", brightness);
-            while (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            // Save the current value and exit
+            settings_update(key, value);
+            LOG_INFO("%s set to %d", settings_get_id(key), value);
+            button_wait_release(ENTER_BUTTON_GPIO);
             break;
         }
-        else if (gpio_get_button_state(BACK_BUTTON_GPIO) == 0)
+        else if (editor_back_pressed())
         {
-            // Restore the original brightness and exit
-            settings->brightness = original_brightness;
-            printf("Brightness reverted to %d%%\n", original_brightness);
-            while (gpio_get_button_state(BACK_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            // Leave the setting as it was and exit
+            LOG_INFO("%s left at %d", settings_get_id(key), settings_get_int(key));
+            button_wait_release(BACK_BUTTON_GPIO);
             break;
         }
+        else if (steps != 0) // DOWN acts as RIGHT, UP as LEFT
+        {
+            value += steps;
+            value = value < min ? min : value > max ? max : value;
+            display_slider(header, (value - min) * DISPLAY_BAR_STEPS / (max - min));
+        }
 
-        vTaskDelay(pdMS_TO_TICKS(100)); // Small delay to debounce buttons
+        editor_wait(__func__);
     }
 
     is_in_special_mode_lr = false; // Disable special mode
     display_enable_cursor();       // Re-enable the cursor
     menu_render();                 // Re-render the menu after exiting
-    printf("Exiting brightness adjustment\n");
+}
+
+// Action: Adjust brightness
+void adjust_brightness(void)
+{
+    adjust_slider(SETTING_BRIGHTNESS, "Set Brightness", DISPLAY_GLYPH_SUN);
 }
 
 void select_color(void)
@@ -621,8 +663,7 @@ void select_color(void)
             snprintf(display_line, sizeof(display_line), "< %s >", colors[color_index]);
             display_render("Select Color", display_line);
 
-            while (gpio_get_button_state(DOWN_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            button_wait_release(DOWN_BUTTON_GPIO);
         }
         else if (gpio_get_button_state(UP_BUTTON_GPIO) == 0 && color_index > 0) // UP acts as LEFT
         {
@@ -632,35 +673,117 @@ void select_color(void)
             snprintf(display_line, sizeof(display_line), "< %s >", colors[color_index]);
             display_render("Select Color", display_line);
 
-            while (gpio_get_button_state(UP_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            button_wait_release(UP_BUTTON_GPIO);
         }
         else if (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
         {
             // Save the selected color and exit
             settings->selected_color = color_index;
-            printf("Color set to: %s\n", colors[color_index]);
-            while (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            settings->color_mode = SETTINGS_COLOR_MODE_PALETTE;
+            LOG_INFO("Color set to: %s", colors[color_index]);
+            button_wait_release(ENTER_BUTTON_GPIO);
             break;
         }
-        else if (gpio_get_button_state(BACK_BUTTON_GPIO) == 0)
+        else if (editor_back_pressed())
         {
             // Restore the original color and exit
             settings->selected_color = original_color_index;
-            printf("Color reverted to: %s\n", colors[original_color_index]);
-            while (gpio_get_button_state(BACK_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            LOG_INFO("Color reverted to: %s", colors[original_color_index]);
+            button_wait_release(BACK_BUTTON_GPIO);
             break;
         }
 
-        vTaskDelay(pdMS_TO_TICKS(100)); // Small delay to debounce buttons
+        editor_wait(__func__);
     }
 
     is_in_special_mode_lr = false; // Disable special mode
     display_enable_cursor();       // Re-enable the cursor
     menu_render();                 // Re-render the menu after exiting
-    printf("Exiting color selection\n");
+    LOG_INFO("Exiting color selection");
+}
+
+// Edit a color setting with a live preview: the light switches to the color
+// mode the setting belongs to while it is edited, BACK restores both. Holding
+// UP or DOWN repeats, faster the longer it is held; unit is one step.
+static void edit_color_setting(SettingKey key, int mode, const char *title, int unit)
+{
+    vTaskDelay(pdMS_TO_TICKS(100)); // Small delay to wait for enter button release
+
+    int original_value = settings_get_int(key);
+    int original_mode = settings_get_int(SETTING_COLOR_MODE);
+    int min = settings_get_min(key);
+    int max = settings_get_max(key);
+    int value = original_value;
+    ButtonRepeat repeat;
+    button_repeat_init(&repeat, (max - min) / unit);
+
+    is_in_special_mode_lr = true; // Enable special mode for left-right behavior
+    display_disable_cursor();     // Disable the cursor
+
+    settings_update(SETTING_COLOR_MODE, mode);
+    rgb_led_control_request_update();
+
+    char value_text[14];
+    char display_line[20];
+    settings_format(key, value_text, sizeof(value_text));
+    snprintf(display_line, sizeof(display_line), "< %s >", value_text);
+    display_render(title, display_line);
+
+    while (1)
+    {
+        int steps = button_repeat_steps(&repeat, DOWN_BUTTON_GPIO) - button_repeat_steps(&repeat, UP_BUTTON_GPIO);
+        if (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
+        {
+            LOG_INFO("%s set to %d", settings_get_id(key), value);
+            button_wait_release(ENTER_BUTTON_GPIO);
+            break;
+        }
+        else if (editor_back_pressed())
+        {
+            // Restore the original value and color mode and exit
+            settings_update(key, original_value);
+            settings_update(SETTING_COLOR_MODE, original_mode);
+            rgb_led_control_request_update();
+            LOG_INFO("%s reverted to %d", settings_get_id(key), original_value);
+            button_wait_release(BACK_BUTTON_GPIO);
+            break;
+        }
+        else if (steps != 0) // DOWN acts as RIGHT, UP as LEFT
+        {
+            value += steps * unit;
+            value = value < min ? min : value > max ? max : value;
+            settings_update(key, value);
+            rgb_led_control_request_update();
+
+            settings_format(key, value_text, sizeof(value_text));
+            snprintf(display_line, sizeof(display_line), "< %s >", value_text);
+            display_write_row(1, display_line); // The title stays
+        }
+
+        editor_wait(__func__);
+    }
+
+    is_in_special_mode_lr = false; // Disable special mode
+    display_enable_cursor();       // Re-enable the cursor
+    menu_render();                 // Re-render the menu after exiting
+}
+
+// Action: Adjust the hue, in degrees
+void adjust_hue(void)
+{
+    edit_color_setting(SETTING_HUE, SETTINGS_COLOR_MODE_HUE, "Adjust Hue", 1);
+}
+
+// Action: Adjust the saturation of the hue
+void adjust_saturation(void)
+{
+    edit_color_setting(SETTING_SATURATION, SETTINGS_COLOR_MODE_HUE, "Adjust Saturation", 1);
+}
+
+// Action: Adjust the color temperature of the white, in 100 K steps
+void adjust_color_temp(void)
+{
+    edit_color_setting(SETTING_COLOR_TEMP, SETTINGS_COLOR_MODE_WHITE, "Adjust White", 100);
 }
 
 // Action: Toggle auto unplug setting
@@ -729,32 +852,28 @@ void toggle_auto_unplug(void)
         {
             current_index++; // Move to the next option
             button_pressed = true;
-            while (gpio_get_button_state(DOWN_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            button_wait_release(DOWN_BUTTON_GPIO);
         }
         else if (gpio_get_button_state(UP_BUTTON_GPIO) == 0 && current_index > 0) // UP acts as LEFT
         {
             current_index--; // Move to the previous option
             button_pressed = true;
-            while (gpio_get_button_state(UP_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            button_wait_release(UP_BUTTON_GPIO);
         }
         else if (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
         {
             // Save the selected value and exit
             settings->light_auto_turn_off = options[current_index];
-            printf("Auto unplug set to: %d\n", options[current_index]);
-            while (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            LOG_INFO("Auto unplug set to: %d", options[current_index]);
+            button_wait_release(ENTER_BUTTON_GPIO);
             break;
         }
-        else if (gpio_get_button_state(BACK_BUTTON_GPIO) == 0)
+        else if (editor_back_pressed())
         {
             // Restore the original value and exit
             settings->light_auto_turn_off = options[original_index];
-            printf("Auto unplug reverted to: %d\n", options[original_index]);
-            while (gpio_get_button_state(BACK_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            LOG_INFO("Auto unplug reverted to: %d", options[original_index]);
+            button_wait_release(BACK_BUTTON_GPIO);
             break;
         }
 
@@ -764,195 +883,31 @@ void toggle_auto_unplug(void)
             render_view();
         }
 
-        vTaskDelay(pdMS_TO_TICKS(100)); // Small delay to debounce buttons
+        editor_wait(__func__);
     }
 
     is_in_special_mode_lr = false; // Disable special mode
     display_enable_cursor();       // Re-enable the cursor
     menu_render();                 // Re-render the menu after exiting
-    printf("Exiting auto unplug selection\n");
+    LOG_INFO("Exiting auto unplug selection");
 }
 
 void adjust_ir_sensitivity(void)
 {
-    vTaskDelay(pdMS_TO_TICKS(100)); // Small delay to wait for enter button release
-
-    Settings *settings = settings_get();
-    int original_sensitivity = settings->sensitivity_ir; // Save the original sensitivity
-    int sensitivity = settings->sensitivity_ir;          // Current sensitivity value
-
-    is_in_special_mode_lr = true; // Enable special mode for left-right behavior
-    display_disable_cursor();     // Disable the cursor
-
-    // Render the initial sensitivity adjustment screen
-    char slider[18];                                 // 16 characters for the display + 2 for null terminator
-    snprintf(slider, sizeof(slider), "[%-14s]", ""); // Empty slider with stoppers
-    int slider_position = (sensitivity * 14) / 100;  // Map sensitivity to slider position
-    for (int i = 0; i < slider_position; i++)
-    {
-        slider[i + 1] = '|'; // Fill the slider between the stoppers
-    }
-
-    display_render("Adjust IR Sens.", slider);
-
-    while (1)
-    {
-        // Handle button presses for adjusting sensitivity
-        if (gpio_get_button_state(DOWN_BUTTON_GPIO) == 0 && sensitivity < 100) // DOWN acts as RIGHT
-        {
-            sensitivity += 100 / 14; // Increment sensitivity by one tick
-            if (sensitivity > 100)
-                sensitivity = 100; // Cap at 100%
-
-            // Update the slider
-            slider_position = (sensitivity * 14) / 100;
-            snprintf(slider, sizeof(slider), "[%-14s]", "");
-            for (int i = 0; i < slider_position; i++)
-            {
-                slider[i + 1] = '|';
-            }
-
-            display_render("Adjust IR Sens.", slider);
-
-            while (gpio_get_button_state(DOWN_BUTTON_GPIO) == 0)
-                ; // Wait for button release
-        }
-        else if (gpio_get_button_state(UP_BUTTON_GPIO) == 0 && sensitivity > 0) // UP acts as LEFT
-        {
-            sensitivity -= 100 / 14; // Decrement sensitivity by one tick
-            if (sensitivity < 0)
-                sensitivity = 0; // Cap at 0%
-
-            // Update the slider
-            slider_position = (sensitivity * 14) / 100;
-            snprintf(slider, sizeof(slider), "[%-14s]", "");
-            for (int i = 0; i < slider_position; i++)
-            {
-                slider[i + 1] = '|';
-            }
-
-            display_render("Adjust IR Sens.", slider);
-
-            while (gpio_get_button_state(UP_BUTTON_GPIO) == 0)
-                ; // Wait for button release
-        }
-        else if (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
-        {
-            // Save the current sensitivity and exit
-            settings->sensitivity_ir = sensitivity;
-            printf("IR Sensitivity set to %d%%\n", sensitivity);
-            while (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
-                ; // Wait for button release
-            break;
-        }
-        else if (gpio_get_button_state(BACK_BUTTON_GPIO) == 0)
-        {
-            // Restore the original sensitivity and exit
-            settings->sensitivity_ir = original_sensitivity;
-            printf("IR Sensitivity reverted to %d%%\n", original_sensitivity);
-            while (gpio_get_button_state(BACK_BUTTON_GPIO) == 0)
-                ; // Wait for button release
-            break;
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(100)); // Small delay to debounce buttons
-    }
-
-    is_in_special_mode_lr = false; // Disable special mode
-    display_enable_cursor();       // Re-enable the cursor
-    menu_render();                 // Re-render the menu after exiting
-    printf("Exiting IR sensitivity adjustment\n");
+    adjust_slider(SETTING_SENSITIVITY_IR, "Set IR Sense", DISPLAY_GLYPH_EYE);
 }
 
 void adjust_us_sensitivity(void)
 {
-    vTaskDelay(pdMS_TO_TICKS(100)); // Small delay to wait for enter button release
-
-    Settings *settings = settings_get();
-    int original_sensitivity = settings->sensitivity_ur; // Save the original sensitivity
-    int sensitivity = settings->sensitivity_ur;          // Current sensitivity value
-
-    is_in_special_mode_lr = true; // Enable special mode for left-right behavior
-    display_disable_cursor();     // Disable the cursor
-
-    // Render the initial sensitivity adjustment screen
-    char slider[18];                                 // 16 characters for the display + 2 for null terminator
-    snprintf(slider, sizeof(slider), "[%-14s]", ""); // Empty slider with stoppers
-    int slider_position = ((sensitivity - 2) * 14) / (400 - 2); // Map sensitivity to slider position
-    for (int i = 0; i < slider_position; i++)
-    {
-        slider[i + 1] = '|'; // Fill the slider between the stoppers
-    }
-
-    display_render("Adjust US Sens.", slider);
-
-    while (1)
-    {
-        // Handle button presses for adjusting sensitivity
-        if (gpio_get_button_state(DOWN_BUTTON_GPIO) == 0 && sensitivity < 400) // DOWN acts as RIGHT
-        {
-            sensitivity += (400 - 2) / 14; // Increment sensitivity by one tick
-            if (sensitivity > 400)
-                sensitivity = 400; // Cap at 400 cm
-
-            // Update the slider
-            slider_position = ((sensitivity - 2) * 14) / (400 - 2);
-            snprintf(slider, sizeof(slider), "[%-14s]", "");
-            for (int i = 0; i < slider_position; i++)
-            {
-                slider[i + 1] = '|';
-            }
-
-            display_render("Adjust US Sens.", slider);
-
-            while (gpio_get_button_state(DOWN_BUTTON_GPIO) == 0)
-                ; // Wait for button release
-        }
-        else if (gpio_get_button_state(UP_BUTTON_GPIO) == 0 && sensitivity > 2) // UP acts as LEFT
-        {
-            sensitivity -= (400 - 2) / 14; // Decrement sensitivity by one tick
-            if (sensitivity < 2)
-                sensitivity = 2; // Cap at 2 cm
-
-            // Update the slider
-            slider_position = ((sensitivity - 2) * 14) / (400 - 2);
-            snprintf(slider, sizeof(slider), "[%-14s]", "");
-            for (int i = 0; i < slider_position; i++)
-            {
-                slider[i + 1] = '|';
-            }
-
-            display_render("Adjust US Sens.", slider);
-
-            while (gpio_get_button_state(UP_BUTTON_GPIO) == 0)
-                ; // Wait for button release
-        }
-        else if (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
-        {
-            // Save the current sensitivity and exit
-            settings->sensitivity_ur = sensitivity;
-            printf("US Sensitivity set to %d cm\n", sensitivity);
-            while (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
-                ; // Wait for button release
-            break;
-        }
-        else if (gpio_get_button_state(BACK_BUTTON_GPIO) == 0)
-        {
-            // Restore the original sensitivity and exit
-            settings->sensitivity_ur = original_sensitivity;
-            printf("US Sensitivity reverted to %d cm\n", original_sensitivity);
-            while (gpio_get_button_state(BACK_BUTTON_GPIO) == 0)
-                ; // Wait for button release
-            break;
-        }
-
-        vTaskDelay(pdMS_TO_TICKS(100)); // Small delay to debounce buttons
-    }
+    adjust_slider(SETTING_SENSITIVITY_UR, "Set US distance", DISPLAY_GLYPH_WAVE);
+}
 
-    is_in_special_mode_lr = false; // Disable special mode
-    display_enable_cursor();       // Re-enable the cursor
-    menu_render();                 // Re-render the menu after exiting
-    printf("Exiting US sensitivity adjustment\n");
+// Name of a signal, valid until the next call
+static const char *signal_name(int index)
+{
+    static char name[MELODY_NAME_LEN];
+    melody_get_name(melody_get(index), name, sizeof(name));
+    return name;
 }
 
 void select_signal(void)
@@ -963,22 +918,15 @@ void select_signal(void)
     int original_signal_index = settings->selected_signal; // Save the original signal index
     int signal_index = settings->selected_signal;          // Current signal index
 
-    // Fetch the list of signals from settings
-    const char **signals = settings_get_signal_names();
-
-    // Calculate the number of signals
-    int num_signals = 0;
-    while (signals[num_signals] != NULL)
-    {
-        num_signals++;
-    }
+    // Built-in signals and the melodies of the data partition
+    int num_signals = melody_count();
 
     is_in_special_mode_lr = true; // Enable special mode for left-right behavior
     display_disable_cursor();     // Disable the cursor
 
     // Render the initial signal selection screen
     char display_line[20];
-    snprintf(display_line, sizeof(display_line), "< %s >", signals[signal_index]);
+    snprintf(display_line, sizeof(display_line), "< %s >", signal_name(signal_index));
     display_render("Select Signal", display_line);
 
     while (1)
@@ -989,141 +937,125 @@ void select_signal(void)
             signal_index = (signal_index + 1) % num_signals; // Move to the next signal (cyclical)
 
             // Update the display
-            snprintf(display_line, sizeof(display_line), "< %s >", signals[signal_index]);
+            snprintf(display_line, sizeof(display_line), "< %s >", signal_name(signal_index));
             display_render("Select Signal", display_line);
 
-            while (gpio_get_button_state(DOWN_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            button_wait_release(DOWN_BUTTON_GPIO);
         }
         else if (gpio_get_button_state(UP_BUTTON_GPIO) == 0) // UP acts as LEFT
         {
             signal_index = (signal_index - 1 + num_signals) % num_signals; // Move to the previous signal (cyclical)
 
             // Update the display
-            snprintf(display_line, sizeof(display_line), "< %s >", signals[signal_index]);
+            snprintf(display_line, sizeof(display_line), "< %s >", signal_name(signal_index));
             display_render("Select Signal", display_line);
 
-            while (gpio_get_button_state(UP_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            button_wait_release(UP_BUTTON_GPIO);
         }
         else if (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
         {
             // Save the selected signal and exit
             settings->selected_signal = signal_index;
-            printf("Signal set to: %s\n", signals[signal_index]);
-            while (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            LOG_INFO("Signal set to: %s", signal_name(signal_index));
+            button_wait_release(ENTER_BUTTON_GPIO);
             break;
         }
-        else if (gpio_get_button_state(BACK_BUTTON_GPIO) == 0)
+        else if (editor_back_pressed())
         {
             // Restore the original signal and exit
             settings->selected_signal = original_signal_index;
-            printf("Signal reverted to: %s\n", signals[original_signal_index]);
-            while (gpio_get_button_state(BACK_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            LOG_INFO("Signal reverted to: %s", signal_name(original_signal_index));
+            button_wait_release(BACK_BUTTON_GPIO);
             break;
         }
 
-        vTaskDelay(pdMS_TO_TICKS(100)); // Small delay to debounce buttons
+        editor_wait(__func__);
     }
 
     is_in_special_mode_lr = false; // Disable special mode
     display_enable_cursor();       // Re-enable the cursor
     menu_render();                 // Re-render the menu after exiting
-    printf("Exiting signal selection\n");
+    LOG_INFO("Exiting signal selection");
 }
 
 void adjust_volume(void)
+{
+    adjust_slider(SETTING_VOLUME, "Set Volume", DISPLAY_GLYPH_SPEAKER);
+}
+
+
+
+
+
+// Pick a scene with UP/DOWN, starting at the active one. -1 for BACK.
+static int pick_scene(const char *title)
 {
     vTaskDelay(pdMS_TO_TICKS(100)); // Small delay to wait for enter button release
 
-    Settings *settings = settings_get();
-    int original_volume = settings->volume; // Save the original volume
-    int volume = settings->volume;          // Current volume value
+    int scene_index = scene_get_active() >= 0 ? scene_get_active() : 0;
+    int picked = -1;
 
     is_in_special_mode_lr = true; // Enable special mode for left-right behavior
     display_disable_cursor();     // Disable the cursor
 
-    // Render the initial volume adjustment screen
-    char slider[18];                                 // 16 characters for the display + 2 for null terminator
-    snprintf(slider, sizeof(slider), "[%-14s]", ""); // Empty slider with stoppers
-    int slider_position = (volume * 14) / 100;       // Map volume to slider position
-    for (int i = 0; i < slider_position; i++)
-    {
-        slider[i + 1] = '|'; // Fill the slider between the stoppers
-    }
-
-    display_render("Adjust Volume", slider);
+    char display_line[20];
+    snprintf(display_line, sizeof(display_line), "< %s >", scene_get_name(scene_index));
+    display_render(title, display_line);
 
     while (1)
     {
-        // Handle button presses for adjusting volume
-        if (gpio_get_button_state(DOWN_BUTTON_GPIO) == 0 && volume < 100) // DOWN acts as RIGHT
+        if (gpio_get_button_state(DOWN_BUTTON_GPIO) == 0) // DOWN acts as RIGHT
         {
-            volume += 100 / 14; // Increment volume by one tick
-            if (volume > 100)
-                volume = 100; // Cap at 100%
-
-            // Update the slider
-            slider_position = (volume * 14) / 100;
-            snprintf(slider, sizeof(slider), "[%-14s]", "");
-            for (int i = 0; i < slider_position; i++)
-            {
-                slider[i + 1] = '|';
-            }
-
-            display_render("Adjust Volume", slider);
-
-            while (gpio_get_button_state(DOWN_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            scene_index = (scene_index + 1) % SCENE_COUNT;
+            snprintf(display_line, sizeof(display_line), "< %s >", scene_get_name(scene_index));
+            display_render(title, display_line);
+            button_wait_release(DOWN_BUTTON_GPIO);
         }
-        else if (gpio_get_button_state(UP_BUTTON_GPIO) == 0 && volume > 0) // UP acts as LEFT
+        else if (gpio_get_button_state(UP_BUTTON_GPIO) == 0) // UP acts as LEFT
         {
-            volume -= 100 / 14; // Decrement volume by one tick
-            if (volume < 0)
-                volume = 0; // Cap at 0%
-
-            // Update the slider
-            slider_position = (volume * 14) / 100;
-            snprintf(slider, sizeof(slider), "[%-14s]", "");
-            for (int i = 0; i < slider_position; i++)
-            {
-                slider[i + 1] = '|';
-            }
-
-            display_render("Adjust Volume", slider);
-
-            while (gpio_get_button_state(UP_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            scene_index = (scene_index - 1 + SCENE_COUNT) % SCENE_COUNT;
+            snprintf(display_line, sizeof(display_line), "< %s >", scene_get_name(scene_index));
+            display_render(title, display_line);
+            button_wait_release(UP_BUTTON_GPIO);
         }
         else if (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
         {
-            // Save the current volume and exit
-            settings->volume = volume;
-            printf("Volume set to %d%%\n", volume);
-            while (gpio_get_button_state(ENTER_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            picked = scene_index;
+            button_wait_release(ENTER_BUTTON_GPIO);
             break;
         }
-        else if (gpio_get_button_state(BACK_BUTTON_GPIO) == 0)
+        else if (editor_back_pressed())
         {
-            // Restore the original volume and exit
-            settings->volume = original_volume;
-            printf("Volume reverted to %d%%\n", original_volume);
-            while (gpio_get_button_state(BACK_BUTTON_GPIO) == 0)
-                ; // Wait for button release
+            button_wait_release(BACK_BUTTON_GPIO);
             break;
         }
 
-        vTaskDelay(pdMS_TO_TICKS(100)); // Small delay to debounce buttons
+        editor_wait(__func__);
     }
 
     is_in_special_mode_lr = false; // Disable special mode
     display_enable_cursor();       // Re-enable the cursor
-    menu_render();                 // Re-render the menu after exiting
+    return picked;
 }
 
+// Action: apply a scene, all its settings at once
+void apply_scene(void)
+{
+    int scene_index = pick_scene("Apply scene");
+    if (scene_index >= 0 && !scene_apply(scene_index))
+    {
+        LOG_INFO("Scene %s is empty", scene_get_name(scene_index));
+    }
+    menu_render(); // Re-render the menu after exiting
+}
 
-
-
+// Action: store the current settings in a scene slot
+void save_scene(void)
+{
+    int scene_index = pick_scene("Save scene as");
+    if (scene_index >= 0)
+    {
+        scene_save(scene_index);
+    }
+    menu_render(); // Re-render the menu after exiting
+}
@@ -0,0 +1,196 @@
+#include "pm_control.h"
+#include "freertos/task.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "memory_plan.h"
+#include <stdio.h>
+
+// Lowest clock of the frequency scaling. The APB peripherals still run there;
+// whoever needs more (I2C, RMT, I2S drivers, the PmLocks) raises it.
+#define PM_MIN_FREQ_MHZ 40
+
+static const char *const lock_names[PM_LOCK_COUNT] = {"lcd", "led", "audio", "remote"};
+static const char *const state_names[PM_STATE_COUNT] = {"active", "idle", "light sleep"};
+static const uint32_t state_current_ua[PM_STATE_COUNT] = {PM_CURRENT_ACTIVE_UA, PM_CURRENT_IDLE_UA,
+                                                          PM_CURRENT_LIGHT_SLEEP_UA};
+
+#if CONFIG_PM_ENABLE
+_Static_assert(PM_LOCK_COUNT <= PLAN_PM_LOCKS, "PLAN_PM_LOCKS in memory_plan.h is out of date");
+static esp_pm_lock_handle_t locks[PM_LOCK_COUNT];
+#endif
+
+static portMUX_TYPE pm_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t held[PM_LOCK_COUNT];
+static uint32_t held_total = 0; // Non-zero while the chip counts as active
+static uint32_t lock_count[PM_LOCK_COUNT];
+static int64_t init_time_us = 0;
+static int64_t active_since_us = 0;
+static uint64_t active_us = 0;
+static uint64_t sleep_us = 0;
+static uint32_t sleep_count = 0;
+
+static TaskHandle_t work_task = NULL;
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+// Runs on the way out of every automatic light sleep, interrupts still off
+static esp_err_t IRAM_ATTR pm_light_sleep_exit(int64_t slept_us, void *arg)
+{
+    portENTER_CRITICAL_SAFE(&pm_lock);
+    sleep_us += slept_us;
+    sleep_count++;
+    portEXIT_CRITICAL_SAFE(&pm_lock);
+    return ESP_OK;
+}
+#endif
+
+void pm_control_init(void)
+{
+    init_time_us = esp_timer_get_time();
+
+#if CONFIG_PM_ENABLE
+    esp_pm_config_t config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = PM_MIN_FREQ_MHZ,
+#if CONFIG_FREERTOS_USE_TICKLESS_IDLE
+        .light_sleep_enable = true, // Whenever both cores idle longer than CONFIG_FREERTOS_IDLE_TIME_BEFORE_SLEEP
+#endif
+    };
+    ESP_ERROR_CHECK(esp_pm_configure(&config));
+
+    for (int i = 0; i < PM_LOCK_COUNT; i++)
+    {
+        ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, lock_names[i], &locks[i]));
+    }
+#endif
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    static esp_pm_sleep_cbs_register_config_t sleep_callbacks = {
+        .exit_cb = pm_light_sleep_exit,
+    };
+    ESP_ERROR_CHECK(esp_pm_light_sleep_register_cbs(&sleep_callbacks));
+#endif
+
+    // Buttons and the PIR arm their pins with gpio_wakeup_enable(), the
+    // ultrasonic sampler and the other esp_timer alarms wake the chip by themselves
+    ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
+}
+
+void pm_control_acquire(PmLock lock)
+{
+#if CONFIG_PM_ENABLE
+    if (locks[lock] != NULL)
+    {
+        esp_pm_lock_acquire(locks[lock]);
+    }
+#endif
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&pm_lock);
+    held[lock]++;
+    lock_count[lock]++;
+    if (held_total++ == 0)
+    {
+        active_since_us = now_us;
+    }
+    portEXIT_CRITICAL(&pm_lock);
+}
+
+void pm_control_release(PmLock lock)
+{
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&pm_lock);
+    if (held[lock] > 0)
+    {
+        held[lock]--;
+        if (--held_total == 0)
+        {
+            active_us += now_us - active_since_us;
+        }
+    }
+    portEXIT_CRITICAL(&pm_lock);
+#if CONFIG_PM_ENABLE
+    if (locks[lock] != NULL)
+    {
+        esp_pm_lock_release(locks[lock]);
+    }
+#endif
+}
+
+void pm_control_wait_for_work(uint32_t timeout_ms)
+{
+    work_task = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, timeout_ms == PM_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms));
+}
+
+void pm_control_signal_work(void)
+{
+    if (work_task != NULL)
+    {
+        xTaskNotifyGive(work_task);
+    }
+}
+
+void IRAM_ATTR pm_control_signal_work_from_isr(BaseType_t *higher_priority_task_woken)
+{
+    if (work_task != NULL)
+    {
+        vTaskNotifyGiveFromISR(work_task, higher_priority_task_woken);
+    }
+}
+
+void pm_control_get_report(PmReport *report)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&pm_lock);
+    report->state_us[PM_STATE_ACTIVE] = active_us + (held_total > 0 ? now_us - active_since_us : 0);
+    report->state_us[PM_STATE_LIGHT_SLEEP] = sleep_us;
+    report->sleep_count = sleep_count;
+    for (int i = 0; i < PM_LOCK_COUNT; i++)
+    {
+        report->lock_count[i] = lock_count[i];
+    }
+    portEXIT_CRITICAL(&pm_lock);
+
+    // Whatever is neither active nor asleep was spent idling at the low clock
+    report->total_us = now_us - init_time_us;
+    uint64_t accounted_us = report->state_us[PM_STATE_ACTIVE] + report->state_us[PM_STATE_LIGHT_SLEEP];
+    report->state_us[PM_STATE_IDLE] = report->total_us > accounted_us ? report->total_us - accounted_us : 0;
+
+    uint64_t charge = 0; // µA·µs
+    for (int i = 0; i < PM_STATE_COUNT; i++)
+    {
+        charge += report->state_us[i] * state_current_ua[i];
+    }
+    report->average_ua = report->total_us > 0 ? charge / report->total_us : 0;
+}
+
+void pm_control_print_report(void)
+{
+    PmReport report;
+    pm_control_get_report(&report);
+
+    printf("Power states over %llu ms:\n", (unsigned long long)(report.total_us / 1000));
+    printf("State         time ms   share   est. mA\n");
+    for (int i = 0; i < PM_STATE_COUNT; i++)
+    {
+        uint32_t permille = report.total_us > 0 ? report.state_us[i] * 1000 / report.total_us : 0;
+        printf("%-12s %8llu  %3lu.%lu%%  %4lu.%lu\n", state_names[i], (unsigned long long)(report.state_us[i] / 1000),
+               (unsigned long)(permille / 10), (unsigned long)(permille % 10),
+               (unsigned long)(state_current_ua[i] / 1000), (unsigned long)(state_current_ua[i] % 1000 / 100));
+    }
+    printf("Light sleeps: %lu, locks taken:", (unsigned long)report.sleep_count);
+    for (int i = 0; i < PM_LOCK_COUNT; i++)
+    {
+        printf(" %s %lu", lock_names[i], (unsigned long)report.lock_count[i]);
+    }
+    printf("\n");
+    printf("Estimated average current: %lu.%02lu mA (chip only)\n", (unsigned long)(report.average_ua / 1000),
+           (unsigned long)(report.average_ua % 1000 / 10));
+#if CONFIG_PM_PROFILING
+    esp_pm_dump_locks(stdout); // Per-mode times as the PM implementation sees them
+#endif
+}
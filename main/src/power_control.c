@@ -1,12 +1,49 @@
 #include "power_control.h"
 #include "gpio_control.h"
+#include "ir_control.h"
+#include "display_control.h"
+#include "rgb_led_control.h"
+#include "speaker_control.h"
+#include "settings_control.h"
+#include "log_control.h"
+#include "health_control.h"
+#include "driver/rtc_io.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include <stdio.h>
 
+// Marks the RTC copy of the state as written by power_control_enter_standby()
+#define POWER_RTC_MAGIC 0x53544232 // "STB2", Settings became one byte per field
+
+// Survives deep sleep, zeroed on power-on
+typedef struct {
+    uint32_t magic;
+    Settings settings;
+    PowerStats stats;
+} PowerRtcState;
+
+static RTC_DATA_ATTR PowerRtcState rtc_state;
+
 static int power_state = 0; // 0 = OFF, 1 = ON
+static bool resuming = false;
 
 void power_control_init(void)
 {
     gpio_set_led(power_state); // Initialize LED to OFF
+
+    rtc_state.stats.boot_count++;
+    rtc_state.stats.wake_cause = esp_sleep_get_wakeup_cause();
+    resuming = esp_reset_reason() == ESP_RST_DEEPSLEEP && rtc_state.magic == POWER_RTC_MAGIC;
+    rtc_state.magic = 0; // Any later reset boots normally
+    if (resuming)
+    {
+        rtc_state.stats.resume_count++;
+        printf("Resuming from standby (wakeup cause %d)\n", rtc_state.stats.wake_cause);
+    }
 }
 
 void power_control_toggle(void)
@@ -17,10 +54,90 @@ void power_control_toggle(void)
     // Print power status
     if (power_state)
     {
-        printf("Power ON\n");
+        LOG_INFO("Power ON");
+    }
+    else
+    {
+        LOG_INFO("Power OFF");
+    }
+}
+
+bool power_control_is_resuming(void)
+{
+    return resuming;
+}
+
+void power_control_restore_settings(void)
+{
+    *settings_get() = rtc_state.settings;
+}
+
+void power_control_resume_done(void)
+{
+    // The PIR woke us, so the motion is already confirmed
+    if (rtc_state.stats.wake_cause == ESP_SLEEP_WAKEUP_EXT1 && settings_get()->ir)
+    {
+        rgb_led_control_signal_presence(esp_timer_get_time());
     }
     else
     {
-        printf("Power OFF\n");
+        rgb_led_control_request_update(); // Back to the saved light state
     }
-}
\ No newline at end of file
+
+    // esp_timer starts with the application, the ROM and bootloader time comes on top
+    int64_t resume_us = esp_timer_get_time();
+    rtc_state.stats.last_resume_us = resume_us;
+    if (resume_us > rtc_state.stats.max_resume_us)
+    {
+        rtc_state.stats.max_resume_us = resume_us;
+    }
+    printf("Resumed in %lld us\n", (long long)resume_us);
+}
+
+void power_control_enter_standby(void)
+{
+    printf("Entering standby\n");
+
+    settings_save(); // RTC memory does not survive a power cycle
+    rtc_state.settings = *settings_get();
+    rtc_state.magic = POWER_RTC_MAGIC;
+
+    rgb_led_control_standby();
+    speaker_standby();
+    display_standby();
+    power_state = 0;
+    gpio_set_led(power_state);
+
+    // The held button would wake the chip right away. Deep sleep follows
+    // however long that takes, nothing for the stall detector to see.
+    health_wait(HEALTH_TASK_MAIN);
+    while (gpio_get_button_state(POWER_BUTTON_GPIO) == 0)
+    {
+        vTaskDelay(1);
+    }
+
+    // The other buttons are not RTC GPIOs, and EXT1 cannot wake on a low level
+    // on the ESP32: POWER wakes through EXT0, the PIR through EXT1
+    ESP_ERROR_CHECK(esp_sleep_enable_ext0_wakeup(POWER_BUTTON_GPIO, 0));
+    rtc_gpio_pullup_en(POWER_BUTTON_GPIO);
+    rtc_gpio_pulldown_dis(POWER_BUTTON_GPIO);
+    ESP_ERROR_CHECK(esp_sleep_enable_ext1_wakeup(1ULL << IR_SENSOR_GPIO, ESP_EXT1_WAKEUP_ANY_HIGH));
+    rtc_gpio_pullup_dis(IR_SENSOR_GPIO);
+    rtc_gpio_pulldown_en(IR_SENSOR_GPIO);
+
+    log_flush(); // Whatever is still in the ring would be lost
+    esp_deep_sleep_start();
+}
+
+void power_control_get_stats(PowerStats *stats)
+{
+    *stats = rtc_state.stats;
+}
+
+void power_control_print_stats(void)
+{
+    PowerStats stats = rtc_state.stats;
+    printf("Boots: %lu, standby resumes: %lu, last resume %lld us, max %lld us, wakeup cause %d\n",
+           (unsigned long)stats.boot_count, (unsigned long)stats.resume_count, (long long)stats.last_resume_us,
+           (long long)stats.max_resume_us, stats.wake_cause);
+}
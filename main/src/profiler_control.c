@@ -0,0 +1,288 @@
+#include "profiler_control.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "esp_attr.h"
+#include "sdkconfig.h"
+#include "memory_plan.h"
+#include "health_control.h"
+#include "timer_control.h"
+#include "remote_control.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+// Above the main loop and the speaker so the windows stay regular, below the
+// LED task. Sampling takes well under a millisecond per second.
+#define PROFILER_TASK_PRIORITY 3
+#define PROFILER_HEALTH_DEADLINE_MS 1000 // One snapshot
+#define PROFILER_SAMPLE_SLACK_MS 50      // The window length goes into the snapshot anyway
+static StackType_t profiler_task_stack[PLAN_STACK_PROFILER];
+static StaticTask_t profiler_task_tcb;
+
+// Room for every task of the system, uxTaskGetSystemState() fails if it is too small
+#define PROFILER_STATUS_CAPACITY 24
+
+typedef struct {
+    uint32_t count;
+    uint64_t total_us;
+    uint32_t max_us;
+} TimingAccumulator;
+
+// Run time counter of a task at the previous sample
+typedef struct {
+    TaskHandle_t handle;
+    uint32_t run_time;
+} TaskRunTime;
+
+static const char *counter_names[PROFILER_COUNTER_COUNT] = {
+    "I2C transactions", "I2C bytes", "US timeouts", "IR pulses", "LED refreshes", "I2S underruns"};
+static const char *timing_names[PROFILER_TIMING_COUNT] = {"Main loop", "US ranging", "LCD render", "Timer late"};
+
+static _Atomic uint32_t counters[PROFILER_COUNTER_COUNT];
+static TimingAccumulator timings[PROFILER_TIMING_COUNT];
+static portMUX_TYPE profiler_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static volatile uint32_t period_ms = PROFILER_DEFAULT_PERIOD_MS;
+static ProfilerSnapshotSink snapshot_sink = NULL;
+static TimerJob sample_job;
+static bool sample_job_ready = false;
+
+static ProfilerSnapshot latest_snapshot;
+static size_t latest_size = 0;
+
+// Sampler state, only touched by the profiler task
+static TaskStatus_t task_status[PROFILER_STATUS_CAPACITY];
+static TaskRunTime previous_run_times[PROFILER_STATUS_CAPACITY];
+static int previous_count = 0;
+static uint32_t previous_total_run_time = 0;
+static int64_t previous_sample_us = 0;
+static uint32_t previous_cost_us = 0;
+
+void IRAM_ATTR profiler_count(ProfilerCounter counter, uint32_t amount)
+{
+    atomic_fetch_add_explicit(&counters[counter], amount, memory_order_relaxed);
+}
+
+void IRAM_ATTR profiler_time(ProfilerTiming timing, uint32_t duration_us)
+{
+    portENTER_CRITICAL_SAFE(&profiler_lock);
+    TimingAccumulator *accumulator = &timings[timing];
+    accumulator->count++;
+    accumulator->total_us += duration_us;
+    if (duration_us > accumulator->max_us)
+    {
+        accumulator->max_us = duration_us;
+    }
+    portEXIT_CRITICAL_SAFE(&profiler_lock);
+}
+
+// Share of the window a task ran for, from the difference of its run time counter
+static uint16_t task_cpu_permille(TaskHandle_t handle, uint32_t run_time, uint32_t window)
+{
+    uint32_t previous = 0;
+    for (int i = 0; i < previous_count; i++)
+    {
+        if (previous_run_times[i].handle == handle)
+        {
+            previous = previous_run_times[i].run_time;
+            break;
+        }
+    }
+    if (window == 0)
+    {
+        return 0;
+    }
+    // Unsigned differences survive the 32-bit counter wrapping
+    return (uint64_t)(run_time - previous) * 1000 / ((uint64_t)window * portNUM_PROCESSORS);
+}
+
+static int sample_tasks(ProfilerSnapshot *snapshot)
+{
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY
+    uint32_t total_run_time = 0;
+    int count = uxTaskGetSystemState(task_status, PROFILER_STATUS_CAPACITY, &total_run_time);
+    uint32_t window = total_run_time - previous_total_run_time;
+
+    for (int i = 0; i < count && i < PROFILER_MAX_TASKS; i++)
+    {
+        strncpy(snapshot->tasks[i].name, task_status[i].pcTaskName, PROFILER_TASK_NAME_LEN);
+        snapshot->tasks[i].priority = task_status[i].uxCurrentPriority;
+        snapshot->tasks[i].stack_free = task_status[i].usStackHighWaterMark;
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        snapshot->tasks[i].cpu_permille = task_cpu_permille(task_status[i].xHandle, task_status[i].ulRunTimeCounter, window);
+#endif
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        previous_run_times[i].handle = task_status[i].xHandle;
+        previous_run_times[i].run_time = task_status[i].ulRunTimeCounter;
+    }
+    previous_count = count;
+    previous_total_run_time = total_run_time;
+    return count < PROFILER_MAX_TASKS ? count : PROFILER_MAX_TASKS;
+#else
+    return 0; // Per-task figures need CONFIG_FREERTOS_USE_TRACE_FACILITY
+#endif
+}
+
+// Take a snapshot, publish it and start the next window
+static void profiler_sample(void)
+{
+    int64_t start_us = esp_timer_get_time();
+    int64_t window_us = start_us - previous_sample_us;
+    ProfilerSnapshot snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+
+    snapshot.version = PROFILER_SNAPSHOT_VERSION;
+    snapshot.period_ms = window_us / 1000;
+    snapshot.uptime_ms = start_us / 1000;
+    snapshot.heap_free = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    snapshot.heap_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+    snapshot.dma_free = heap_caps_get_free_size(MALLOC_CAP_DMA);
+    snapshot.dma_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_DMA);
+    snapshot.overhead_ppm = window_us > 0 ? (uint64_t)previous_cost_us * 1000000 / window_us : 0;
+
+    for (int i = 0; i < PROFILER_COUNTER_COUNT; i++)
+    {
+        snapshot.counters[i] = atomic_load_explicit(&counters[i], memory_order_relaxed);
+    }
+
+    // Timings describe the window only, start over for the next one
+    TimingAccumulator window_timings[PROFILER_TIMING_COUNT];
+    portENTER_CRITICAL(&profiler_lock);
+    memcpy(window_timings, timings, sizeof(timings));
+    memset(timings, 0, sizeof(timings));
+    portEXIT_CRITICAL(&profiler_lock);
+    for (int i = 0; i < PROFILER_TIMING_COUNT; i++)
+    {
+        uint32_t count = window_timings[i].count;
+        snapshot.timings[i].count = count < UINT16_MAX ? count : UINT16_MAX;
+        snapshot.timings[i].avg_us = count > 0 ? window_timings[i].total_us / count : 0;
+        snapshot.timings[i].max_us = window_timings[i].max_us;
+    }
+
+    for (int i = 0; i < ALLOC_TAG_COUNT; i++)
+    {
+        AllocStats stats;
+        alloc_get_stats(i, &stats);
+        snapshot.allocs[i].count = stats.steady_count;
+        snapshot.allocs[i].bytes = stats.steady_bytes;
+    }
+
+    snapshot.task_count = sample_tasks(&snapshot);
+    size_t size = offsetof(ProfilerSnapshot, tasks) + snapshot.task_count * sizeof(snapshot.tasks[0]);
+
+    portENTER_CRITICAL(&profiler_lock);
+    latest_snapshot = snapshot;
+    latest_size = size;
+    portEXIT_CRITICAL(&profiler_lock);
+
+    if (snapshot_sink != NULL)
+    {
+        snapshot_sink((const uint8_t *)&snapshot, size);
+    }
+
+    previous_sample_us = start_us;
+    previous_cost_us = esp_timer_get_time() - start_us;
+}
+
+static void profiler_task(void *pvParameters)
+{
+    health_register(HEALTH_TASK_PROFILER, PROFILER_HEALTH_DEADLINE_MS, NULL);
+    while (1)
+    {
+        // One notification per period from the sample job
+        health_wait(HEALTH_TASK_PROFILER);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        health_beat(HEALTH_TASK_PROFILER, "sample");
+        profiler_sample();
+    }
+}
+
+// Initialize the profiler
+void profiler_init(void)
+{
+    previous_sample_us = esp_timer_get_time();
+    TaskHandle_t profiler_task_handle = xTaskCreateStatic(profiler_task, "ProfilerTask", sizeof(profiler_task_stack),
+                                                          NULL, PROFILER_TASK_PRIORITY, profiler_task_stack,
+                                                          &profiler_task_tcb);
+    const TimerJobArgs sample_job_args = {
+        .name = "profiler",
+        .owner = profiler_task_handle,
+        .slack_ms = PROFILER_SAMPLE_SLACK_MS,
+    };
+    timer_job_init(&sample_job, &sample_job_args);
+    sample_job_ready = true;
+#if CONFIG_SUPER_LIGHTS_REMOTE
+    profiler_set_sink(remote_control_send_snapshot);
+#endif
+    profiler_set_period(period_ms);
+}
+
+void profiler_set_period(uint32_t new_period_ms)
+{
+    period_ms = new_period_ms;
+    if (!sample_job_ready)
+    {
+        return;
+    }
+    if (new_period_ms > 0)
+    {
+        timer_start_periodic(&sample_job, new_period_ms);
+    }
+    else
+    {
+        timer_stop(&sample_job);
+    }
+}
+
+void profiler_set_sink(ProfilerSnapshotSink sink)
+{
+    snapshot_sink = sink;
+}
+
+size_t profiler_get_snapshot(ProfilerSnapshot *snapshot)
+{
+    portENTER_CRITICAL(&profiler_lock);
+    *snapshot = latest_snapshot;
+    size_t size = latest_size;
+    portEXIT_CRITICAL(&profiler_lock);
+    return size;
+}
+
+void profiler_dump(void)
+{
+    ProfilerSnapshot snapshot;
+    if (profiler_get_snapshot(&snapshot) == 0)
+    {
+        printf("No profiler snapshot yet\n");
+        return;
+    }
+
+    printf("Profiler: uptime %lu ms, window %lu ms, overhead %u.%03u%%\n", (unsigned long)snapshot.uptime_ms,
+           (unsigned long)snapshot.period_ms, snapshot.overhead_ppm / 10000, (snapshot.overhead_ppm / 10) % 1000);
+    printf("Heap: %lu free (min %lu), DMA: %lu free (min %lu)\n", (unsigned long)snapshot.heap_free,
+           (unsigned long)snapshot.heap_min_free, (unsigned long)snapshot.dma_free, (unsigned long)snapshot.dma_min_free);
+
+    printf("Task      Prio   CPU%%  Stack free\n");
+    for (int i = 0; i < snapshot.task_count; i++)
+    {
+        printf("%-8.8s  %4u  %3u.%u  %10u\n", snapshot.tasks[i].name, snapshot.tasks[i].priority,
+               snapshot.tasks[i].cpu_permille / 10, snapshot.tasks[i].cpu_permille % 10, snapshot.tasks[i].stack_free);
+    }
+
+    printf("Timing        count   avg us   max us\n");
+    for (int i = 0; i < PROFILER_TIMING_COUNT; i++)
+    {
+        printf("%-12s %6u %8lu %8lu\n", timing_names[i], snapshot.timings[i].count,
+               (unsigned long)snapshot.timings[i].avg_us, (unsigned long)snapshot.timings[i].max_us);
+    }
+
+    for (int i = 0; i < PROFILER_COUNTER_COUNT; i++)
+    {
+        printf("%s: %lu\n", counter_names[i], (unsigned long)snapshot.counters[i]);
+    }
+}
@@ -0,0 +1,606 @@
+#include "remote_control.h"
+#include "settings_control.h"
+#include "rgb_led_control.h"
+#include "speaker_control.h"
+#include "ir_control.h"
+#include "us_control.h"
+#include "pm_control.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "memory_plan.h"
+#include "health_control.h"
+#include "profiler_control.h"
+#include "esp_timer.h"
+#include "esp_sleep.h"
+#include <stdio.h>
+#include <string.h>
+
+// Above the sensors and the speaker, so an answer does not wait for a signal
+// to be synthesized; below the LED fast path
+#define REMOTE_TASK_PRIORITY 4
+#define REMOTE_HEALTH_DEADLINE_MS 1000 // One request or one round of telemetry
+static StackType_t remote_task_stack[PLAN_STACK_REMOTE];
+static StaticTask_t remote_task_tcb;
+
+// The chip stays out of light sleep this long after the last byte from the
+// controller, and for as long as a stream is subscribed. A sleeping chip loses
+// the first bytes of a frame, the client wakes it with a few 0x00 bytes (empty
+// frames) first; REMOTE_WAKEUP_EDGES of their edges bring it back.
+#define REMOTE_AWAKE_MS 2000
+#define REMOTE_WAKEUP_EDGES 3
+
+// Worst case COBS overhead for a payload plus its CRC, and the delimiter
+#define REMOTE_MAX_ENCODED (REMOTE_MAX_PAYLOAD + 2 + (REMOTE_MAX_PAYLOAD + 2) / 254 + 2)
+
+// A GET of every setting has to fit one response: type, seq, status, then 5 bytes a setting
+_Static_assert(3 + 5 * SETTING_COUNT <= REMOTE_MAX_PAYLOAD, "REMOTE_GET of all settings does not fit a frame");
+
+static QueueHandle_t uart_queue = NULL;
+
+static uint8_t rx_frame[REMOTE_MAX_ENCODED]; // Encoded bytes of the frame being received
+static int rx_length = 0;
+static bool rx_overrun = false; // Dropping bytes until the next delimiter
+
+static bool awake = false; // PM_LOCK_REMOTE held
+static int64_t last_rx_us = 0;
+
+typedef struct {
+    volatile uint16_t period_ms; // 0 when not subscribed
+    uint8_t seq;
+    int64_t next_us;
+} StreamState;
+
+static StreamState streams[REMOTE_STREAM_COUNT];
+
+static RemoteStats stats;
+static portMUX_TYPE stats_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// CRC-16/CCITT-FALSE: polynomial 0x1021, initial value 0xFFFF, no reflection
+static uint16_t crc16(const uint8_t *data, int length)
+{
+    uint16_t crc = 0xFFFF;
+    for (int i = 0; i < length; i++)
+    {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+// COBS: every 0x00 is replaced by the distance to the next one, so the frame
+// itself never contains the delimiter. Returns the encoded length.
+static int cobs_encode(const uint8_t *in, int length, uint8_t *out)
+{
+    int code_index = 0;
+    int out_index = 1;
+    uint8_t code = 1;
+    for (int i = 0; i < length; i++)
+    {
+        if (in[i] == 0)
+        {
+            out[code_index] = code;
+            code_index = out_index++;
+            code = 1;
+            continue;
+        }
+        out[out_index++] = in[i];
+        if (++code == 0xFF)
+        {
+            out[code_index] = code;
+            code_index = out_index++;
+            code = 1;
+        }
+    }
+    out[code_index] = code;
+    return out_index;
+}
+
+// Returns the decoded length, -1 for an invalid encoding
+static int cobs_decode(const uint8_t *in, int length, uint8_t *out, int max)
+{
+    int out_index = 0;
+    int i = 0;
+    while (i < length)
+    {
+        uint8_t code = in[i++];
+        if (code == 0 || i + code - 1 > length)
+        {
+            return -1;
+        }
+        for (int j = 1; j < code; j++)
+        {
+            if (out_index == max)
+            {
+                return -1;
+            }
+            out[out_index++] = in[i++];
+        }
+        if (code != 0xFF && i < length)
+        {
+            if (out_index == max)
+            {
+                return -1;
+            }
+            out[out_index++] = 0;
+        }
+    }
+    return out_index;
+}
+
+static void put_u16(uint8_t *out, uint16_t value)
+{
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static void put_u32(uint8_t *out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        out[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+static uint16_t get_u16(const uint8_t *in)
+{
+    return in[0] | (in[1] << 8);
+}
+
+static int32_t get_i32(const uint8_t *in)
+{
+    return (int32_t)(in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24));
+}
+
+// Append the CRC, encode and write one frame. payload needs room for the CRC.
+static void send_frame(uint8_t *payload, int length)
+{
+    uint8_t encoded[REMOTE_MAX_ENCODED];
+    put_u16(payload + length, crc16(payload, length));
+    int encoded_length = cobs_encode(payload, length + 2, encoded);
+    encoded[encoded_length++] = 0x00;
+    uart_write_bytes(REMOTE_UART_NUM, encoded, encoded_length);
+}
+
+static uint32_t uptime_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+// Settings changed behind the menu's back: the LED task applies them (and
+// passes a light change on to auto-off, the sampler, the menu and the
+// speaker), the main loop picks up the IR settings
+static void apply_settings(void)
+{
+    rgb_led_control_request_update();
+    pm_control_signal_work();
+}
+
+// Fill in the response body (after the status byte), returns its status
+static RemoteStatus handle_request(uint8_t type, const uint8_t *body, int length, uint8_t *out, int *out_length)
+{
+    *out_length = 0;
+    switch (type)
+    {
+    case REMOTE_PING:
+        out[0] = REMOTE_PROTOCOL_VERSION;
+        out[1] = SETTING_COUNT;
+        put_u32(out + 2, uptime_ms());
+        *out_length = 6;
+        return REMOTE_OK;
+
+    case REMOTE_GET:
+    {
+        uint8_t all[SETTING_COUNT];
+        if (length == 0)
+        {
+            for (int key = 0; key < SETTING_COUNT; key++)
+            {
+                all[key] = key;
+            }
+            body = all;
+            length = SETTING_COUNT;
+        }
+        if (length > SETTING_COUNT)
+        {
+            return REMOTE_ERR_LENGTH;
+        }
+        for (int i = 0; i < length; i++)
+        {
+            if (body[i] >= SETTING_COUNT)
+            {
+                return REMOTE_ERR_KEY;
+            }
+            out[5 * i] = body[i];
+            put_u32(out + 5 * i + 1, (uint32_t)settings_get_int(body[i]));
+        }
+        *out_length = 5 * length;
+        return REMOTE_OK;
+    }
+
+    case REMOTE_SET:
+    {
+        if (length == 0 || length % 5 != 0 || length / 5 > SETTING_COUNT)
+        {
+            return REMOTE_ERR_LENGTH;
+        }
+        SettingKey keys[SETTING_COUNT];
+        int values[SETTING_COUNT];
+        int count = length / 5;
+        for (int i = 0; i < count; i++)
+        {
+            if (body[5 * i] >= SETTING_COUNT)
+            {
+                return REMOTE_ERR_KEY;
+            }
+            keys[i] = body[5 * i];
+            values[i] = get_i32(body + 5 * i + 1);
+        }
+        if (!settings_update_batch(keys, values, count))
+        {
+            return REMOTE_ERR_VALUE;
+        }
+        apply_settings();
+        return REMOTE_OK;
+    }
+
+    case REMOTE_SIGNAL:
+    {
+        if (length != 1)
+        {
+            return REMOTE_ERR_LENGTH;
+        }
+#if !CONFIG_SUPER_LIGHTS_AUDIO
+        return REMOTE_ERR_ABSENT;
+#endif
+        const char *melody = settings_get_signal(body[0]);
+        if (melody == NULL)
+        {
+            return REMOTE_ERR_KEY;
+        }
+        speaker_request_signal(melody);
+        return REMOTE_OK;
+    }
+
+    case REMOTE_EFFECT:
+        if (length != 1)
+        {
+            return REMOTE_ERR_LENGTH;
+        }
+        if (body[0] >= RGB_LED_EFFECT_COUNT)
+        {
+            return REMOTE_ERR_KEY;
+        }
+        rgb_led_control_play_effect(body[0]);
+        return REMOTE_OK;
+
+    case REMOTE_SUBSCRIBE:
+    {
+        if (length != 3)
+        {
+            return REMOTE_ERR_LENGTH;
+        }
+        if (body[0] >= REMOTE_STREAM_COUNT)
+        {
+            return REMOTE_ERR_KEY;
+        }
+#if !CONFIG_SUPER_LIGHTS_ULTRASONIC
+        if (body[0] == REMOTE_STREAM_DISTANCE)
+        {
+            return REMOTE_ERR_ABSENT;
+        }
+#endif
+        uint16_t period_ms = get_u16(body + 1);
+        uint16_t min_period_ms =
+            body[0] == REMOTE_STREAM_PROFILER ? REMOTE_MIN_PROFILER_PERIOD_MS : REMOTE_MIN_PERIOD_MS;
+        if (period_ms != 0 && period_ms < min_period_ms)
+        {
+            return REMOTE_ERR_VALUE;
+        }
+        StreamState *stream = &streams[body[0]];
+        stream->period_ms = period_ms;
+        stream->next_us = esp_timer_get_time(); // First sample right after the response
+        if (body[0] == REMOTE_STREAM_PROFILER)
+        {
+            profiler_set_period(period_ms != 0 ? period_ms : PROFILER_DEFAULT_PERIOD_MS);
+        }
+        return REMOTE_OK;
+    }
+
+    default:
+        return REMOTE_ERR_TYPE;
+    }
+}
+
+static void handle_frame(int64_t received_us)
+{
+    uint8_t payload[REMOTE_MAX_PAYLOAD + 2];
+    int length = cobs_decode(rx_frame, rx_length, payload, sizeof(payload));
+    if (length < 0 || length < 4 || crc16(payload, length - 2) != get_u16(payload + length - 2))
+    {
+        portENTER_CRITICAL(&stats_lock);
+        stats.crc_errors++;
+        portEXIT_CRITICAL(&stats_lock);
+        return;
+    }
+    length -= 2;
+
+    uint8_t response[REMOTE_MAX_PAYLOAD + 2];
+    int body_length = 0;
+    RemoteStatus status = handle_request(payload[0], payload + 2, length - 2, response + 3, &body_length);
+    response[0] = payload[0] | REMOTE_RESPONSE;
+    response[1] = payload[1];
+    response[2] = status;
+    send_frame(response, 3 + body_length);
+
+    int64_t service_us = esp_timer_get_time() - received_us;
+    portENTER_CRITICAL(&stats_lock);
+    stats.requests++;
+    stats.last_service_us = service_us;
+    if (service_us > stats.max_service_us)
+    {
+        stats.max_service_us = service_us;
+    }
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+static void receive(size_t size)
+{
+    uint8_t chunk[64];
+    while (size > 0)
+    {
+        int count = uart_read_bytes(REMOTE_UART_NUM, chunk, size < sizeof(chunk) ? size : sizeof(chunk), 0);
+        if (count <= 0)
+        {
+            break;
+        }
+        size -= count;
+
+        int64_t now_us = esp_timer_get_time();
+        for (int i = 0; i < count; i++)
+        {
+            if (chunk[i] == 0x00)
+            {
+                if (!rx_overrun && rx_length > 0)
+                {
+                    handle_frame(now_us);
+                }
+                rx_length = 0;
+                rx_overrun = false;
+            }
+            else if (rx_length == sizeof(rx_frame))
+            {
+                if (!rx_overrun)
+                {
+                    portENTER_CRITICAL(&stats_lock);
+                    stats.overruns++;
+                    portEXIT_CRITICAL(&stats_lock);
+                }
+                rx_overrun = true;
+            }
+            else if (!rx_overrun)
+            {
+                rx_frame[rx_length++] = chunk[i];
+            }
+        }
+    }
+}
+
+static void send_sample(RemoteStream index, StreamState *stream, int64_t now_us)
+{
+    uint8_t frame[16];
+    int length = 0;
+    frame[length++] = REMOTE_TELEMETRY;
+    frame[length++] = stream->seq++;
+    frame[length++] = index;
+    put_u32(frame + length, (uint32_t)(now_us / 1000));
+    length += 4;
+
+    switch (index)
+    {
+    case REMOTE_STREAM_OCCUPANCY:
+        frame[length++] = ir_sensor_is_occupied();
+        break;
+    case REMOTE_STREAM_DISTANCE:
+    {
+        float distance_cm = us_sensor_get_last_distance();
+        int mm = distance_cm < 0 ? -1 : (int)(distance_cm * 10);
+        put_u16(frame + length, (uint16_t)(int16_t)(mm > INT16_MAX ? INT16_MAX : mm));
+        length += 2;
+        break;
+    }
+    case REMOTE_STREAM_LIGHT:
+    {
+        Settings *settings = settings_get();
+        frame[length++] = settings->light;
+        frame[length++] = settings->brightness;
+        frame[length++] = settings->selected_color;
+        break;
+    }
+    default:
+        return;
+    }
+    send_frame(frame, length);
+
+    portENTER_CRITICAL(&stats_lock);
+    stats.telemetry++;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+// Send what is due, returns the time of the next sample (INT64_MAX for none)
+static int64_t send_due_samples(int64_t now_us)
+{
+    int64_t next_us = INT64_MAX;
+    for (int i = 0; i < REMOTE_STREAM_COUNT; i++)
+    {
+        StreamState *stream = &streams[i];
+        if (stream->period_ms == 0 || i == REMOTE_STREAM_PROFILER)
+        {
+            continue; // The profiler sends its snapshots itself
+        }
+        if (stream->next_us <= now_us)
+        {
+            send_sample(i, stream, now_us);
+            stream->next_us += stream->period_ms * 1000LL;
+            if (stream->next_us <= now_us)
+            {
+                stream->next_us = now_us + stream->period_ms * 1000LL; // Fell behind, skip rather than burst
+            }
+        }
+        if (stream->next_us < next_us)
+        {
+            next_us = stream->next_us;
+        }
+    }
+    return next_us;
+}
+
+static void set_awake(bool wanted)
+{
+    if (wanted && !awake)
+    {
+        pm_control_acquire(PM_LOCK_REMOTE);
+    }
+    else if (!wanted && awake)
+    {
+        pm_control_release(PM_LOCK_REMOTE);
+    }
+    awake = wanted;
+}
+
+static void remote_task(void *pvParameters)
+{
+    health_register(HEALTH_TASK_REMOTE, REMOTE_HEALTH_DEADLINE_MS, NULL);
+    while (1)
+    {
+        health_beat(HEALTH_TASK_REMOTE, "remote task");
+        int64_t now_us = esp_timer_get_time();
+        int64_t next_us = send_due_samples(now_us);
+
+        bool streaming = next_us != INT64_MAX || streams[REMOTE_STREAM_PROFILER].period_ms != 0;
+        int64_t awake_until_us = last_rx_us + REMOTE_AWAKE_MS * 1000LL;
+        set_awake(streaming || (awake && now_us < awake_until_us));
+        if (awake && !streaming)
+        {
+            next_us = awake_until_us;
+        }
+
+        TickType_t wait = portMAX_DELAY;
+        if (next_us != INT64_MAX)
+        {
+            int64_t wait_ms = next_us > now_us ? (next_us - now_us + 999) / 1000 : 0;
+            wait = pdMS_TO_TICKS(wait_ms);
+            if (wait == 0 && wait_ms > 0)
+            {
+                wait = 1;
+            }
+        }
+
+        uart_event_t event;
+        health_wait(HEALTH_TASK_REMOTE);
+        if (xQueueReceive(uart_queue, &event, wait) != pdTRUE)
+        {
+            continue;
+        }
+        last_rx_us = esp_timer_get_time();
+        set_awake(true);
+
+        switch (event.type)
+        {
+        case UART_DATA:
+            receive(event.size);
+            break;
+        case UART_FIFO_OVF:
+        case UART_BUFFER_FULL:
+            // Whatever is buffered is part of a broken frame
+            uart_flush_input(REMOTE_UART_NUM);
+            xQueueReset(uart_queue);
+            rx_length = 0;
+            rx_overrun = true;
+            portENTER_CRITICAL(&stats_lock);
+            stats.overruns++;
+            portEXIT_CRITICAL(&stats_lock);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void remote_control_init(void)
+{
+    const uart_config_t uart_config = {
+        .baud_rate = REMOTE_BAUD_RATE,
+        .data_bits = UART_DATA_8_BITS,
+        .parity = UART_PARITY_DISABLE,
+        .stop_bits = UART_STOP_BITS_1,
+        .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+        .source_clk = UART_SCLK_DEFAULT,
+    };
+    ESP_ERROR_CHECK(uart_driver_install(REMOTE_UART_NUM, PLAN_UART_RX_BYTES, 0, PLAN_UART_EVENT_QUEUE_LENGTH, &uart_queue, 0));
+    ESP_ERROR_CHECK(uart_param_config(REMOTE_UART_NUM, &uart_config));
+    ESP_ERROR_CHECK(uart_set_pin(REMOTE_UART_NUM, REMOTE_TX_GPIO, REMOTE_RX_GPIO, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+
+    // Activity on RX wakes the chip from light sleep
+    ESP_ERROR_CHECK(uart_set_wakeup_threshold(REMOTE_UART_NUM, REMOTE_WAKEUP_EDGES));
+    ESP_ERROR_CHECK(esp_sleep_enable_uart_wakeup(REMOTE_UART_NUM));
+
+    xTaskCreateStatic(remote_task, "RemoteTask", sizeof(remote_task_stack), NULL,
+                      REMOTE_TASK_PRIORITY, remote_task_stack, &remote_task_tcb);
+
+    printf("Remote control initialized (UART %d, TX: GPIO %d, RX: GPIO %d, %d baud)\n", REMOTE_UART_NUM,
+           REMOTE_TX_GPIO, REMOTE_RX_GPIO, REMOTE_BAUD_RATE);
+}
+
+// Runs in the profiler task. The driver writes each frame in one piece, so the
+// pieces do not mix with the remote task's frames.
+void remote_control_send_snapshot(const uint8_t *data, size_t size)
+{
+    StreamState *stream = &streams[REMOTE_STREAM_PROFILER];
+    if (stream->period_ms == 0)
+    {
+        return;
+    }
+
+    uint32_t now_ms = uptime_ms();
+    for (size_t offset = 0; offset < size; offset += REMOTE_PROFILER_PIECE)
+    {
+        size_t piece = size - offset < REMOTE_PROFILER_PIECE ? size - offset : REMOTE_PROFILER_PIECE;
+        uint8_t frame[REMOTE_MAX_PAYLOAD + 2];
+        int length = 0;
+        frame[length++] = REMOTE_TELEMETRY;
+        frame[length++] = stream->seq++;
+        frame[length++] = REMOTE_STREAM_PROFILER;
+        put_u32(frame + length, now_ms);
+        length += 4;
+        put_u16(frame + length, (uint16_t)offset);
+        length += 2;
+        put_u16(frame + length, (uint16_t)size);
+        length += 2;
+        memcpy(frame + length, data + offset, piece);
+        send_frame(frame, length + piece);
+
+        portENTER_CRITICAL(&stats_lock);
+        stats.telemetry++;
+        portEXIT_CRITICAL(&stats_lock);
+    }
+}
+
+void remote_control_get_stats(RemoteStats *out)
+{
+    portENTER_CRITICAL(&stats_lock);
+    *out = stats;
+    portEXIT_CRITICAL(&stats_lock);
+}
+
+void remote_control_print_stats(void)
+{
+    RemoteStats snapshot;
+    remote_control_get_stats(&snapshot);
+    printf("Remote: %lu requests, %lu samples, %lu CRC errors, %lu overruns, service last %lld us, max %lld us\n",
+           (unsigned long)snapshot.requests, (unsigned long)snapshot.telemetry, (unsigned long)snapshot.crc_errors,
+           (unsigned long)snapshot.overruns, (long long)snapshot.last_service_us, (long long)snapshot.max_service_us);
+}
@@ -2,14 +2,280 @@
 #include "led_strip.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_timer.h"
 #include "settings_control.h"
+#include "menu_control.h"
+#include "speaker_control.h"
+#include "trace_control.h"
+#include "profiler_control.h"
+#include "pm_control.h"
+#include "us_control.h"
+#include "ambient_control.h"
+#include "board_control.h"
+#include "memory_plan.h"
+#include "health_control.h"
 #include <stdio.h>
+#include <string.h>
 
 // GPIO pin for the RGB LED signal
-#define RGB_LED_GPIO GPIO_NUM_13
-#define LED_COUNT 8 // Number of LEDs in the module
+#define RGB_LED_GPIO BOARD_LED_STRIP_GPIO
+
+// The LED task sits above everything the application owns, so a presence event
+// only waits for the IDF system tasks before the strip is refreshed.
+// Kept below the esp_timer task (22) which delivers the IR confirmation.
+#define RGB_LED_TASK_PRIORITY 20
+#define RGB_LED_HEALTH_DEADLINE_MS 1000 // One round: a frame, or an effect step
+static StackType_t led_task_stack[PLAN_STACK_LED];
+static StaticTask_t led_task_tcb;
+
+// Notification bits understood by the LED task
+#define RGB_LED_EVENT_UPDATE (1 << 0)   // Re-apply the settings
+#define RGB_LED_EVENT_PRESENCE (1 << 1) // Motion confirmed, turn the light on now
+#define RGB_LED_EVENT_STANDBY (1 << 2)  // Dark strip for deep sleep, then stop
+#define RGB_LED_EVENT_EFFECT (1 << 3)   // Play pending_effect
+
+// Effect timings
+#define RGB_LED_BLINK_COUNT 3
+#define RGB_LED_BLINK_MS 150
+#define RGB_LED_PULSE_STEPS 10 // Brightness steps each way
+#define RGB_LED_PULSE_MS 1000
 
 static led_strip_handle_t led_strip;
+static TaskHandle_t led_task_handle = NULL;
+
+// Timestamp of the presence event that is waiting for the strip (written before the notification)
+static volatile int64_t pending_presence_time_us = -1;
+static FastPathStats fast_path_stats = {0};
+
+// Last frame pushed to the strip, used to skip redundant refreshes
+static RgbFrame last_frame;
+static int last_light_state = -1;
+
+static bool frame_stale = false; // An effect overwrote the strip, refresh even if nothing changed
+
+static volatile bool parked = false; // The strip is dark and the LED task stopped for standby
+static volatile RgbLedEffect pending_effect = RGB_LED_EFFECT_BLINK;
+
+// Turn off the RGB LEDs
+static void rgb_led_control_turn_off(void)
+{
+    pm_control_acquire(PM_LOCK_LED);
+    trace_point(TRACE_LED_REFRESH_ISSUE);
+    ESP_ERROR_CHECK(led_strip_clear(led_strip)); // Turn off all LEDs
+    trace_point(TRACE_LED_REFRESH_DONE);
+    pm_control_release(PM_LOCK_LED);
+    profiler_count(PROFILER_COUNTER_LED_REFRESHES, 1);
+}
+
+// Record how long a presence event took to reach the strip
+static void record_fast_path_latency(int64_t presence_time_us)
+{
+    int64_t latency_us = esp_timer_get_time() - presence_time_us;
+
+    fast_path_stats.count++;
+    fast_path_stats.last_us = latency_us;
+    if (latency_us > fast_path_stats.max_us)
+    {
+        fast_path_stats.max_us = latency_us;
+    }
+    if (latency_us > RGB_LED_FAST_PATH_BUDGET_US)
+    {
+        fast_path_stats.over_budget++;
+    }
+}
+
+// Fill the frame with one color scaled to a brightness (0-100%)
+static void fill_frame(RgbFrame *frame, Color color, int brightness)
+{
+    // Scale the RGB values based on brightness
+    uint8_t red = (color.r * brightness) / 100;
+    uint8_t green = (color.g * brightness) / 100;
+    uint8_t blue = (color.b * brightness) / 100;
+
+    // Set the color for all LEDs
+    for (int i = 0; i < RGB_LED_COUNT; i++)
+    {
+        frame->rgb[i][0] = red;
+        frame->rgb[i][1] = green;
+        frame->rgb[i][2] = blue;
+    }
+}
+
+// Compute the pixels for the current settings
+void rgb_led_control_compute_frame(RgbFrame *frame)
+{
+    // Get the brightness and color settings, the brightness as the ambient light has it. Both from
+    // the same side of a batch, so a scene being applied shows either before or after, never a mix.
+    Settings *settings = settings_get();
+    Color color;
+    int brightness;
+    unsigned generation;
+    do
+    {
+        generation = settings_read_begin();
+        color = settings_color_of(settings);
+        brightness = settings->brightness;
+    } while (settings_read_retry(generation));
+    fill_frame(frame, color, ambient_scale_brightness(brightness));
+}
+
+// Send one frame to the strip
+static void push_frame(const RgbFrame *frame)
+{
+    pm_control_acquire(PM_LOCK_LED);
+    for (int i = 0; i < RGB_LED_COUNT; i++)
+    {
+        ESP_ERROR_CHECK(led_strip_set_pixel(led_strip, i, frame->rgb[i][0], frame->rgb[i][1], frame->rgb[i][2]));
+    }
+
+    // Refresh the LED strip to apply changes
+    trace_point(TRACE_LED_REFRESH_ISSUE);
+    ESP_ERROR_CHECK(led_strip_refresh(led_strip));
+    trace_point(TRACE_LED_REFRESH_DONE);
+    pm_control_release(PM_LOCK_LED);
+    profiler_count(PROFILER_COUNTER_LED_REFRESHES, 1);
+}
+
+// Push the current settings to the strip. Only ever called from the LED task.
+static void rgb_led_apply_settings(int64_t presence_time_us)
+{
+    Settings *settings = settings_get();
+
+    // If the light is off, turn off the LEDs
+    if (!settings->light)
+    {
+        if (last_light_state != 0 || frame_stale)
+        {
+            rgb_led_control_turn_off();
+            frame_stale = false;
+        }
+        return;
+    }
+
+    RgbFrame frame;
+    rgb_led_control_compute_frame(&frame);
+
+    // Nothing changed since the last refresh
+    if (last_light_state == 1 && !frame_stale && memcmp(&frame, &last_frame, sizeof(frame)) == 0)
+    {
+        return;
+    }
+
+    // The refresh starts the RMT transfer right after, so this is where the first bit goes out
+    if (presence_time_us >= 0)
+    {
+        record_fast_path_latency(presence_time_us);
+    }
+
+    push_frame(&frame);
+    last_frame = frame;
+    frame_stale = false;
+}
+
+// Play an effect over whatever the strip shows. Returns the events that came
+// in meanwhile: presence, standby or another effect cut it short, updates wait.
+static uint32_t run_effect(RgbLedEffect effect)
+{
+    const uint32_t urgent = RGB_LED_EVENT_PRESENCE | RGB_LED_EVENT_STANDBY | RGB_LED_EVENT_EFFECT;
+    Color color = settings_get_color();
+    RgbFrame frame;
+    uint32_t events = 0;
+    frame_stale = true; // The settings have to be re-applied afterwards
+
+    for (int step = 0; (events & urgent) == 0; step++)
+    {
+        int delay_ms;
+        if (effect == RGB_LED_EFFECT_BLINK)
+        {
+            if (step == 2 * RGB_LED_BLINK_COUNT)
+            {
+                break;
+            }
+            fill_frame(&frame, color, step % 2 == 0 ? 100 : 0);
+            delay_ms = RGB_LED_BLINK_MS;
+        }
+        else
+        {
+            if (step > 2 * RGB_LED_PULSE_STEPS)
+            {
+                break;
+            }
+            int level = step <= RGB_LED_PULSE_STEPS ? step : 2 * RGB_LED_PULSE_STEPS - step;
+            fill_frame(&frame, color, level * 100 / RGB_LED_PULSE_STEPS);
+            delay_ms = RGB_LED_PULSE_MS / (2 * RGB_LED_PULSE_STEPS);
+        }
+        push_frame(&frame);
+        health_beat(HEALTH_TASK_LED, "effect");
+
+        uint32_t received = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &received, pdMS_TO_TICKS(delay_ms));
+        events |= received;
+    }
+    return events;
+}
+
+// High priority task that owns the strip. Everything slower than the RMT
+// transfer (LCD, audio) is handed off to lower priority tasks.
+static void rgb_led_task(void *pvParameters)
+{
+    uint32_t events = 0;
+    health_register(HEALTH_TASK_LED, RGB_LED_HEALTH_DEADLINE_MS, NULL);
+    while (1)
+    {
+        if (events == 0)
+        {
+            health_wait(HEALTH_TASK_LED);
+            xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
+        }
+        health_beat(HEALTH_TASK_LED, "led task");
+
+        if (events & RGB_LED_EVENT_STANDBY)
+        {
+            rgb_led_control_turn_off();
+            parked = true;
+            health_wait(HEALTH_TASK_LED);
+            vTaskSuspend(NULL); // Deep sleep follows, nothing may light the strip again
+        }
+
+        Settings *settings = settings_get();
+        int64_t presence_time_us = -1;
+
+        if (events & RGB_LED_EVENT_PRESENCE)
+        {
+            presence_time_us = pending_presence_time_us;
+            pending_presence_time_us = -1;
+            settings->light = 1; // Motion detected, turn on the light
+        }
+
+        // An effect only runs when nothing more urgent came with it, whatever
+        // arrives while it plays is handled in the next round. An update that
+        // came with it is not urgent, the settings are applied after it.
+        uint32_t handled = events;
+        events = 0;
+        if ((handled & RGB_LED_EVENT_EFFECT) && !(handled & (RGB_LED_EVENT_PRESENCE | RGB_LED_EVENT_STANDBY)))
+        {
+            events = run_effect(pending_effect);
+            if (events != 0)
+            {
+                continue;
+            }
+        }
+
+        rgb_led_apply_settings(presence_time_us);
+
+        // Let the display and the speaker catch up in their own time, the
+        // light-dependent timers follow right away
+        if (settings->light != last_light_state)
+        {
+            last_light_state = settings->light;
+            auto_turn_off_update();
+            us_sensor_update_sampling();
+            ambient_update_sampling();
+            menu_request_render();
+            speaker_request_update();
+        }
+    }
+}
 
 // Initialize the RGB LED control
 void rgb_led_control_init(void)
@@ -17,7 +283,7 @@ void rgb_led_control_init(void)
     // Configure the LED strip
     led_strip_config_t strip_config = {
         .strip_gpio_num = RGB_LED_GPIO,
-        .max_leds = LED_COUNT,                    // Number of LEDs in the strip
+        .max_leds = RGB_LED_COUNT,                // Number of LEDs in the strip
         .led_pixel_format = LED_PIXEL_FORMAT_GRB, // WS2812 uses GRB format
         .led_model = LED_MODEL_WS2812,
         .flags.invert_out = false,
@@ -33,43 +299,73 @@ void rgb_led_control_init(void)
     // Clear the LED strip
     ESP_ERROR_CHECK(led_strip_clear(led_strip));
 
+    led_task_handle = xTaskCreateStatic(rgb_led_task, "RgbLedTask", sizeof(led_task_stack), NULL,
+                                        RGB_LED_TASK_PRIORITY, led_task_stack, &led_task_tcb);
+}
 
-
+// Ask the LED task to re-apply the settings
+void rgb_led_control_request_update(void)
+{
+    if (led_task_handle != NULL)
+    {
+        xTaskNotify(led_task_handle, RGB_LED_EVENT_UPDATE, eSetBits);
+    }
 }
 
-// Update the RGB LED state based on settings
-void rgb_led_control_update(void)
+// Play an effect, then go back to what the settings ask for
+void rgb_led_control_play_effect(RgbLedEffect effect)
 {
-    Settings *settings = settings_get();
+    if (led_task_handle != NULL && effect < RGB_LED_EFFECT_COUNT)
+    {
+        pending_effect = effect;
+        xTaskNotify(led_task_handle, RGB_LED_EVENT_EFFECT, eSetBits);
+    }
+}
 
-    // If the light is off, turn off the LEDs
-    if (!settings->light)
+// Turn the strip off and stop the LED task, returns once the strip is dark
+void rgb_led_control_standby(void)
+{
+    if (led_task_handle == NULL)
     {
-        rgb_led_control_turn_off();
         return;
     }
+    xTaskNotify(led_task_handle, RGB_LED_EVENT_STANDBY, eSetBits);
+    while (!parked)
+    {
+        vTaskDelay(1);
+    }
+}
 
-    // Get the brightness and color settings
-    int brightness = settings->brightness; // 0-100%
-    Color color = settings_get_color();
-
-    // Scale the RGB values based on brightness
-    uint8_t red = (color.r * brightness) / 100;
-    uint8_t green = (color.g * brightness) / 100;
-    uint8_t blue = (color.b * brightness) / 100;
+// Fast path: motion confirmed outside of an interrupt (e.g. from an esp_timer callback)
+void rgb_led_control_signal_presence(int64_t event_time_us)
+{
+    if (led_task_handle != NULL)
+    {
+        pending_presence_time_us = event_time_us;
+        xTaskNotify(led_task_handle, RGB_LED_EVENT_PRESENCE, eSetBits);
+    }
+}
 
-    // Set the color for all LEDs
-    for (int i = 0; i < LED_COUNT; i++)
+// Fast path: motion confirmed directly in the GPIO interrupt
+void rgb_led_control_signal_presence_from_isr(int64_t event_time_us, BaseType_t *higher_priority_task_woken)
+{
+    if (led_task_handle != NULL)
     {
-        ESP_ERROR_CHECK(led_strip_set_pixel(led_strip, i, red, green, blue));
+        pending_presence_time_us = event_time_us;
+        xTaskNotifyFromISR(led_task_handle, RGB_LED_EVENT_PRESENCE, eSetBits, higher_priority_task_woken);
     }
+}
 
-    // Refresh the LED strip to apply changes
-    ESP_ERROR_CHECK(led_strip_refresh(led_strip));
+// Copy out the sensor-to-strip latency figures
+void rgb_led_control_get_fast_path_stats(FastPathStats *stats)
+{
+    *stats = fast_path_stats;
 }
 
-// Turn off the RGB LEDs
-void rgb_led_control_turn_off(void)
+// Print the sensor-to-strip latency figures
+void rgb_led_control_print_fast_path_stats(void)
 {
-    ESP_ERROR_CHECK(led_strip_clear(led_strip)); // Turn off all LEDs
-}
\ No newline at end of file
+    printf("Presence fast path: %lu events, last %lld us, max %lld us, %lu over the %d us budget\n",
+           (unsigned long)fast_path_stats.count, (long long)fast_path_stats.last_us, (long long)fast_path_stats.max_us,
+           (unsigned long)fast_path_stats.over_budget, RGB_LED_FAST_PATH_BUDGET_US);
+}
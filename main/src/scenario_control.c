@@ -0,0 +1,511 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scenario_control.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "driver/i2c.h"
+#include "driver/i2s_std.h"
+#include "driver/uart.h"
+#include "led_strip.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+#include "esp_attr.h"
+#include "gpio_control.h"
+#include "board_control.h"
+#include "i2c_bus_control.h"
+#include "memory_plan.h"
+
+// Pins the scenarios drive, same wiring as the board
+#define SCENARIO_IR_GPIO BOARD_IR_GPIO
+#define SCENARIO_TRIG_GPIO BOARD_US_TRIG_GPIO
+#define SCENARIO_ECHO_GPIO BOARD_US_ECHO_GPIO
+
+// HC-SR04 timing, matches the host model
+#define ECHO_START_DELAY_US 450
+#define SOUND_SPEED_CM_PER_US 0.0343f
+#define IDLE_ECHO_DISTANCE_CM 200.0f
+
+#define I2C_BIT_TIME_US 10 // 100 kHz bus, 9 clocks per byte with the ACK
+#define LED_BIT_TIME_NS 1250
+#define LED_RESET_US 280
+#define MAX_LEDS 64
+// One chunk of an I2C bus write with its head (an address byte and a control
+// byte or register address of up to MAX_I2C_HEAD_BYTES). Longer transactions
+// are cut and the line says how many bytes are missing.
+#define MAX_I2C_HEAD_BYTES 3
+#define MAX_I2C_BYTES (1 + MAX_I2C_HEAD_BYTES + I2C_BUS_CHUNK_BYTES)
+
+#define STIMULUS_UART UART_NUM_0
+#define STIMULUS_RX_BUFFER 2048
+#define SCENARIO_TASK_PRIORITY 21 // Just below the presence task, stimulus must land on time
+static StackType_t scenario_task_stack[PLAN_STACK_SCENARIO];
+static StaticTask_t scenario_task_tcb;
+
+typedef enum {
+    STIMULUS_GPIO,
+    STIMULUS_ECHO,
+    STIMULUS_I2C_FAIL,
+    STIMULUS_END,
+} StimulusKind;
+
+typedef struct {
+    StimulusKind kind;
+    int gpio_num;
+    int level;
+    float distance_cm;
+    int fail_count;
+} Stimulus;
+
+// Linker-provided originals of the wrapped functions
+int __real_gpio_get_level(gpio_num_t gpio_num);
+esp_err_t __real_gpio_set_level(gpio_num_t gpio_num, uint32_t level);
+esp_err_t __real_gpio_config(const gpio_config_t *config);
+esp_err_t __real_gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args);
+esp_err_t __real_i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool ack_en);
+esp_err_t __real_i2c_master_write(i2c_cmd_handle_t cmd_handle, const uint8_t *data, size_t data_len, bool ack_en);
+
+static int8_t input_override[GPIO_NUM_MAX]; // -1 where the real pad is read
+static gpio_int_type_t intr_type[GPIO_NUM_MAX];
+static gpio_isr_t isr_handler[GPIO_NUM_MAX];
+static void *isr_arg[GPIO_NUM_MAX];
+
+static volatile float echo_distance_cm = IDLE_ECHO_DISTANCE_CM;
+static volatile int64_t trig_fall_us = -1;
+
+// Only the owner of the bus builds a command link, one at a time
+static uint8_t i2c_bytes[MAX_I2C_BYTES];
+static int i2c_byte_count = 0;
+static int i2c_dropped = 0; // Bytes past MAX_I2C_BYTES in the transaction
+static volatile int i2c_fail_count = 0; // Transactions left to fail
+
+static uint8_t led_pixels[MAX_LEDS][3];
+static uint32_t led_count = 0;
+static uint8_t led_strip_token; // Stands in for the RMT strip object
+
+static uint8_t i2s_channel_token;
+static uint32_t i2s_sample_rate = 44100;
+static uint32_t i2s_ring_frames = 0;
+static int64_t i2s_play_until_us = 0;
+
+static TaskHandle_t scenario_task_handle = NULL;
+static esp_timer_handle_t stimulus_timer = NULL;
+static Stimulus pending;
+
+// ---------------------------------------------------------------------------
+// Inputs
+
+static bool IRAM_ATTR edge_matches(gpio_int_type_t type, int old_level, int new_level)
+{
+    switch (type)
+    {
+    case GPIO_INTR_POSEDGE:
+        return old_level == 0 && new_level == 1;
+    case GPIO_INTR_NEGEDGE:
+        return old_level == 1 && new_level == 0;
+    case GPIO_INTR_ANYEDGE:
+        return old_level != new_level;
+    case GPIO_INTR_LOW_LEVEL:
+        return new_level == 0;
+    case GPIO_INTR_HIGH_LEVEL:
+        return new_level == 1;
+    default:
+        return false;
+    }
+}
+
+// Applies the pending stimulus in interrupt context, like a real edge would arrive
+static void IRAM_ATTR stimulus_timer_callback(void *arg)
+{
+    if (pending.kind == STIMULUS_GPIO)
+    {
+        int old_level = input_override[pending.gpio_num];
+        input_override[pending.gpio_num] = pending.level;
+        if (isr_handler[pending.gpio_num] != NULL && edge_matches(intr_type[pending.gpio_num], old_level, pending.level))
+        {
+            isr_handler[pending.gpio_num](isr_arg[pending.gpio_num]);
+        }
+    }
+    else if (pending.kind == STIMULUS_ECHO)
+    {
+        echo_distance_cm = pending.distance_cm;
+    }
+    else if (pending.kind == STIMULUS_I2C_FAIL)
+    {
+        i2c_fail_count = pending.fail_count;
+    }
+
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    vTaskNotifyGiveFromISR(scenario_task_handle, &higher_priority_task_woken);
+    if (higher_priority_task_woken)
+    {
+        esp_timer_isr_dispatch_need_yield();
+    }
+}
+
+int __wrap_gpio_get_level(gpio_num_t gpio_num)
+{
+    if (gpio_num == SCENARIO_ECHO_GPIO)
+    {
+        // The echo pulse follows the falling TRIG edge, its width is the round trip
+        float distance_cm = echo_distance_cm;
+        int64_t fall_us = trig_fall_us;
+        if (fall_us < 0 || distance_cm < 0.0f)
+        {
+            return 0;
+        }
+        int64_t start_us = fall_us + ECHO_START_DELAY_US;
+        int64_t width_us = (int64_t)(distance_cm * 2.0f / SOUND_SPEED_CM_PER_US);
+        int64_t now_us = esp_timer_get_time();
+        return now_us >= start_us && now_us < start_us + width_us;
+    }
+    if (gpio_num >= 0 && gpio_num < GPIO_NUM_MAX && input_override[gpio_num] >= 0)
+    {
+        return input_override[gpio_num];
+    }
+    return __real_gpio_get_level(gpio_num);
+}
+
+esp_err_t __wrap_gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (gpio_num == SCENARIO_TRIG_GPIO && level == 0)
+    {
+        trig_fall_us = esp_timer_get_time();
+    }
+    return __real_gpio_set_level(gpio_num, level);
+}
+
+esp_err_t __wrap_gpio_config(const gpio_config_t *config)
+{
+    for (int i = 0; i < GPIO_NUM_MAX; i++)
+    {
+        if (config->pin_bit_mask & (1ULL << i))
+        {
+            intr_type[i] = config->intr_type;
+        }
+    }
+    return __real_gpio_config(config);
+}
+
+// Level-triggered pins flip their trigger level in the ISR. The emulated level
+// never reaches the pad, so the pad keeps the type it was configured with
+// (which it does not meet) instead of firing forever.
+esp_err_t __wrap_gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t type)
+{
+    intr_type[gpio_num] = type;
+    return ESP_OK;
+}
+
+esp_err_t __wrap_gpio_wakeup_enable(gpio_num_t gpio_num, gpio_int_type_t type)
+{
+    intr_type[gpio_num] = type;
+    return ESP_OK;
+}
+
+esp_err_t __wrap_gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t handler, void *args)
+{
+    isr_handler[gpio_num] = handler;
+    isr_arg[gpio_num] = args;
+    return __real_gpio_isr_handler_add(gpio_num, handler, args);
+}
+
+// ---------------------------------------------------------------------------
+// Outputs
+
+esp_err_t __wrap_i2c_master_write_byte(i2c_cmd_handle_t cmd_handle, uint8_t data, bool ack_en)
+{
+    if (i2c_byte_count < MAX_I2C_BYTES)
+    {
+        i2c_bytes[i2c_byte_count++] = data;
+    }
+    else
+    {
+        i2c_dropped++;
+    }
+    return __real_i2c_master_write_byte(cmd_handle, data, ack_en);
+}
+
+esp_err_t __wrap_i2c_master_write(i2c_cmd_handle_t cmd_handle, const uint8_t *data, size_t data_len, bool ack_en)
+{
+    for (size_t i = 0; i < data_len; i++)
+    {
+        if (i2c_byte_count < MAX_I2C_BYTES)
+        {
+            i2c_bytes[i2c_byte_count++] = data[i];
+        }
+        else
+        {
+            i2c_dropped++;
+        }
+    }
+    return __real_i2c_master_write(cmd_handle, data, data_len, ack_en);
+}
+
+// Nothing answers on the emulated bus: print the transaction and take the bus time
+esp_err_t __wrap_i2c_master_cmd_begin(i2c_port_t i2c_num, i2c_cmd_handle_t cmd_handle, TickType_t ticks_to_wait)
+{
+    if (i2c_fail_count > 0)
+    {
+        // A stuck bus: nothing goes out, the driver gives up after the address
+        i2c_fail_count--;
+        esp_rom_delay_us(11 * I2C_BIT_TIME_US);
+        i2c_byte_count = 0;
+        i2c_dropped = 0;
+        return ESP_ERR_TIMEOUT;
+    }
+
+    char line[16 + 2 * MAX_I2C_BYTES];
+    int length = 0;
+    for (int i = 1; i < i2c_byte_count; i++)
+    {
+        length += snprintf(line + length, sizeof(line) - length, "%02x", i2c_bytes[i]);
+    }
+    line[length] = '\0';
+    if (i2c_dropped > 0)
+    {
+        printf("@i2c %lld %02x %s +%d\n", (long long)esp_timer_get_time(), i2c_bytes[0] >> 1, line, i2c_dropped);
+    }
+    else
+    {
+        printf("@i2c %lld %02x %s\n", (long long)esp_timer_get_time(), i2c_bytes[0] >> 1, line);
+    }
+
+    esp_rom_delay_us(((i2c_byte_count + i2c_dropped) * 9 + 2) * I2C_BIT_TIME_US); // Plus start and stop
+    i2c_byte_count = 0;
+    i2c_dropped = 0;
+    return ESP_OK;
+}
+
+esp_err_t __wrap_led_strip_new_rmt_device(const led_strip_config_t *led_config, const led_strip_rmt_config_t *rmt_config,
+                                          led_strip_handle_t *ret_strip)
+{
+    led_count = led_config->max_leds < MAX_LEDS ? led_config->max_leds : MAX_LEDS;
+    *ret_strip = (led_strip_handle_t)&led_strip_token;
+    return ESP_OK;
+}
+
+esp_err_t __wrap_led_strip_set_pixel(led_strip_handle_t strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue)
+{
+    if (index >= led_count)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    led_pixels[index][0] = red;
+    led_pixels[index][1] = green;
+    led_pixels[index][2] = blue;
+    return ESP_OK;
+}
+
+esp_err_t __wrap_led_strip_refresh(led_strip_handle_t strip)
+{
+    printf("@led %lld", (long long)esp_timer_get_time());
+    for (uint32_t i = 0; i < led_count; i++)
+    {
+        printf(" %02x%02x%02x", led_pixels[i][0], led_pixels[i][1], led_pixels[i][2]);
+    }
+    printf("\n");
+
+    esp_rom_delay_us(led_count * 24 * LED_BIT_TIME_NS / 1000 + LED_RESET_US);
+    return ESP_OK;
+}
+
+esp_err_t __wrap_led_strip_clear(led_strip_handle_t strip)
+{
+    memset(led_pixels, 0, sizeof(led_pixels));
+    return __wrap_led_strip_refresh(strip);
+}
+
+esp_err_t __wrap_i2s_new_channel(const i2s_chan_config_t *chan_cfg, i2s_chan_handle_t *ret_tx_handle,
+                                 i2s_chan_handle_t *ret_rx_handle)
+{
+    i2s_ring_frames = chan_cfg->dma_desc_num * chan_cfg->dma_frame_num;
+    *ret_tx_handle = (i2s_chan_handle_t)&i2s_channel_token;
+    return ESP_OK;
+}
+
+esp_err_t __wrap_i2s_channel_init_std_mode(i2s_chan_handle_t handle, const i2s_std_config_t *std_cfg)
+{
+    i2s_sample_rate = std_cfg->clk_cfg.sample_rate_hz;
+    return ESP_OK;
+}
+
+esp_err_t __wrap_i2s_channel_register_event_callback(i2s_chan_handle_t handle, const i2s_event_callbacks_t *callbacks,
+                                                     void *user_data)
+{
+    return ESP_OK; // The emulated ring never runs dry on its own
+}
+
+esp_err_t __wrap_i2s_channel_enable(i2s_chan_handle_t handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t __wrap_i2s_channel_disable(i2s_chan_handle_t handle)
+{
+    i2s_play_until_us = 0;
+    return ESP_OK;
+}
+
+// Accepts samples while the DMA ring has room and blocks for the rest, like the driver
+esp_err_t __wrap_i2s_channel_write(i2s_chan_handle_t handle, const void *src, size_t size, size_t *bytes_written,
+                                   uint32_t timeout_ms)
+{
+    const int16_t *samples = src;
+    size_t count = size / sizeof(int16_t);
+    int peak = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        int magnitude = abs(samples[i]);
+        if (magnitude > peak)
+        {
+            peak = magnitude;
+        }
+    }
+    int64_t now_us = esp_timer_get_time();
+    printf("@pcm %lld %u %d\n", (long long)now_us, (unsigned)count, peak);
+
+    if (i2s_play_until_us < now_us)
+    {
+        i2s_play_until_us = now_us;
+    }
+    i2s_play_until_us += (int64_t)count * 1000000 / i2s_sample_rate;
+    int64_t backlog_us = i2s_play_until_us - now_us - (int64_t)i2s_ring_frames * 1000000 / i2s_sample_rate;
+    if (backlog_us > 0)
+    {
+        vTaskDelay(pdMS_TO_TICKS(backlog_us / 1000) + 1);
+    }
+
+    if (bytes_written != NULL)
+    {
+        *bytes_written = size;
+    }
+    return ESP_OK;
+}
+
+// ---------------------------------------------------------------------------
+// Stimulus reader
+
+static bool read_line(char *line, size_t size)
+{
+    size_t length = 0;
+    while (1)
+    {
+        char c;
+        if (uart_read_bytes(STIMULUS_UART, &c, 1, portMAX_DELAY) != 1)
+        {
+            continue;
+        }
+        if (c == '\r')
+        {
+            continue;
+        }
+        if (c == '\n')
+        {
+            line[length] = '\0';
+            return true;
+        }
+        if (length + 1 < size)
+        {
+            line[length++] = c;
+        }
+    }
+}
+
+// Parses "<time_ms> gpio <pin> <level>", "<time_ms> echo <cm>", "<time_ms> i2c_fail <count>"
+// or "<time_ms> end"
+static bool parse_stimulus(const char *line, int64_t *at_us, Stimulus *stimulus)
+{
+    double time_ms;
+    char command[16];
+    char arg1[16] = "", arg2[16] = "";
+    int fields = sscanf(line, "%lf %15s %15s %15s", &time_ms, command, arg1, arg2);
+    if (fields < 2)
+    {
+        return false;
+    }
+    *at_us = (int64_t)(time_ms * 1000.0);
+
+    if (strcmp(command, "gpio") == 0 && fields == 4 && atoi(arg1) >= 0 && atoi(arg1) < GPIO_NUM_MAX)
+    {
+        stimulus->kind = STIMULUS_GPIO;
+        stimulus->gpio_num = atoi(arg1);
+        stimulus->level = atoi(arg2) ? 1 : 0;
+        return true;
+    }
+    if (strcmp(command, "echo") == 0 && fields == 3)
+    {
+        stimulus->kind = STIMULUS_ECHO;
+        stimulus->distance_cm = atof(arg1);
+        return true;
+    }
+    if (strcmp(command, "i2c_fail") == 0 && fields == 3)
+    {
+        stimulus->kind = STIMULUS_I2C_FAIL;
+        stimulus->fail_count = atoi(arg1);
+        return true;
+    }
+    if (strcmp(command, "end") == 0)
+    {
+        stimulus->kind = STIMULUS_END;
+        return true;
+    }
+    return false;
+}
+
+// Applies each stimulus line at its boot-relative time, in order
+static void scenario_task(void *arg)
+{
+    char line[64];
+    printf("@ready %lld\n", (long long)esp_timer_get_time());
+
+    while (read_line(line, sizeof(line)))
+    {
+        int64_t at_us;
+        Stimulus stimulus;
+        if (!parse_stimulus(line, &at_us, &stimulus))
+        {
+            printf("@error bad stimulus \"%s\"\n", line);
+            continue;
+        }
+
+        int64_t delay_us = at_us - esp_timer_get_time();
+        if (delay_us < 0)
+        {
+            printf("@late %lld %s\n", (long long)-delay_us, line);
+            delay_us = 0;
+        }
+        pending = stimulus;
+        ESP_ERROR_CHECK(esp_timer_start_once(stimulus_timer, delay_us));
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        if (stimulus.kind == STIMULUS_END)
+        {
+            printf("@end %lld\n", (long long)esp_timer_get_time());
+        }
+    }
+}
+
+void scenario_init(void)
+{
+    memset(input_override, -1, sizeof(input_override));
+
+    // Idle hardware: buttons released, no motion, nothing in front of the sensor
+    const gpio_num_t buttons[] = {POWER_BUTTON_GPIO, ENTER_BUTTON_GPIO, BACK_BUTTON_GPIO, UP_BUTTON_GPIO, DOWN_BUTTON_GPIO};
+    for (size_t i = 0; i < sizeof(buttons) / sizeof(buttons[0]); i++)
+    {
+        input_override[buttons[i]] = 1;
+    }
+    input_override[SCENARIO_IR_GPIO] = 0;
+
+    esp_timer_create_args_t timer_args = {
+        .callback = stimulus_timer_callback,
+        .dispatch_method = ESP_TIMER_ISR,
+        .name = "scenario",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &stimulus_timer));
+
+    ESP_ERROR_CHECK(uart_driver_install(STIMULUS_UART, STIMULUS_RX_BUFFER, 0, 0, NULL, 0));
+    scenario_task_handle = xTaskCreateStatic(scenario_task, "Scenario", sizeof(scenario_task_stack), NULL,
+                                             SCENARIO_TASK_PRIORITY, scenario_task_stack, &scenario_task_tcb);
+}
@@ -0,0 +1,237 @@
+#include "scene_control.h"
+#include <stdio.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "nvs.h"
+#include "rgb_led_control.h"
+#include "log_control.h"
+
+#define SCENE_NVS_NAMESPACE "scenes"
+
+// Color indexes of the settings_control.c table
+#define SCENE_COLOR_WHITE 1
+
+// What the slots hold until a scene is saved over them
+static const Scene builtin_scenes[SCENE_COUNT] = {
+    {"Day", 7,
+     {SETTING_BRIGHTNESS, SETTING_COLOR_MODE, SETTING_COLOR, SETTING_IR, SETTING_US, SETTING_SOUND, SETTING_VOLUME},
+     {100, SETTINGS_COLOR_MODE_PALETTE, SCENE_COLOR_WHITE, 1, 1, 1, 80}},
+    {"Evening", 5,
+     {SETTING_BRIGHTNESS, SETTING_COLOR_MODE, SETTING_COLOR_TEMP, SETTING_SOUND, SETTING_VOLUME},
+     {60, SETTINGS_COLOR_MODE_WHITE, 2700, 1, 40}},
+    {"Night", 4,
+     {SETTING_BRIGHTNESS, SETTING_COLOR_MODE, SETTING_COLOR_TEMP, SETTING_SOUND},
+     {10, SETTINGS_COLOR_MODE_WHITE, COLOR_KELVIN_MIN, 0}},
+    {"Custom", 0, {0}, {0}},
+};
+
+static Scene scenes[SCENE_COUNT];
+static bool scenes_loaded = false;
+static int active_scene = -1;
+
+static nvs_handle_t nvs = 0;
+static bool nvs_ready = false;
+
+static bool scene_nvs_open(void)
+{
+    if (nvs_ready)
+    {
+        return true;
+    }
+    if (!settings_storage_init())
+    {
+        return false;
+    }
+    esp_err_t err = nvs_open(SCENE_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK)
+    {
+        LOG_ERROR("Scene storage unavailable: %s", esp_err_to_name(err));
+        return false;
+    }
+    nvs_ready = true;
+    return true;
+}
+
+static void scene_nvs_key(int index, char *key, size_t size)
+{
+    snprintf(key, size, "scene%d", index);
+}
+
+size_t scene_pack(const Scene *scene, uint8_t *blob, size_t size)
+{
+    size_t length = 1 + (SCENE_NAME_LEN - 1);
+    if (size < length)
+    {
+        return 0;
+    }
+    blob[0] = SCENE_BLOB_VERSION;
+    // Zero padded, a full length name goes without terminator and unpack adds it
+    size_t name_len = strnlen(scene->name, SCENE_NAME_LEN - 1);
+    memcpy(blob + 1, scene->name, name_len);
+    memset(blob + 1 + name_len, 0, (SCENE_NAME_LEN - 1) - name_len);
+
+    for (int i = 0; i < scene->count; i++)
+    {
+        size_t value_size = settings_get_size(scene->keys[i]);
+        if (length + 1 + value_size > size)
+        {
+            return 0;
+        }
+        blob[length++] = scene->keys[i];
+        uint32_t value = scene->values[i];
+        for (size_t byte = 0; byte < value_size; byte++)
+        {
+            blob[length++] = value >> (8 * byte);
+        }
+    }
+    return length;
+}
+
+bool scene_unpack(const uint8_t *blob, size_t length, Scene *scene)
+{
+    if (length < 1 + (SCENE_NAME_LEN - 1) || blob[0] != SCENE_BLOB_VERSION)
+    {
+        return false;
+    }
+    memcpy(scene->name, blob + 1, SCENE_NAME_LEN - 1);
+    scene->name[SCENE_NAME_LEN - 1] = '\0';
+    scene->count = 0;
+
+    size_t at = 1 + (SCENE_NAME_LEN - 1);
+    while (at < length)
+    {
+        SettingKey key = blob[at++];
+        size_t value_size = settings_get_size(key); // 0 for a key this build does not know
+        if (value_size == 0 || at + value_size > length || scene->count == SETTING_COUNT)
+        {
+            return false;
+        }
+        uint32_t value = 0;
+        for (size_t byte = 0; byte < value_size; byte++)
+        {
+            value |= (uint32_t)blob[at++] << (8 * byte);
+        }
+        scene->keys[scene->count] = key;
+        scene->values[scene->count] = value;
+        scene->count++;
+    }
+    return true;
+}
+
+void scene_control_init(void)
+{
+    scenes_loaded = true;
+    memcpy(scenes, builtin_scenes, sizeof(scenes));
+    if (!scene_nvs_open())
+    {
+        return;
+    }
+
+    for (int i = 0; i < SCENE_COUNT; i++)
+    {
+        char key[NVS_KEY_NAME_MAX_SIZE];
+        uint8_t blob[SCENE_BLOB_MAX];
+        size_t length = sizeof(blob);
+        scene_nvs_key(i, key, sizeof(key));
+        if (nvs_get_blob(nvs, key, blob, &length) != ESP_OK)
+        {
+            continue; // Never saved
+        }
+        Scene scene;
+        if (!scene_unpack(blob, length, &scene))
+        {
+            LOG_WARN("Ignoring stored scene %d", i);
+            continue;
+        }
+        scenes[i] = scene;
+    }
+}
+
+static void scenes_load_once(void)
+{
+    if (!scenes_loaded)
+    {
+        scene_control_init();
+    }
+}
+
+const char *scene_get_name(int index)
+{
+    scenes_load_once();
+    return index >= 0 && index < SCENE_COUNT ? scenes[index].name : NULL;
+}
+
+bool scene_apply(int index)
+{
+    scenes_load_once();
+    if (index < 0 || index >= SCENE_COUNT || scenes[index].count == 0)
+    {
+        return false;
+    }
+
+    int64_t start = esp_timer_get_time();
+    const Scene *scene = &scenes[index];
+    if (!settings_update_batch(scene->keys, scene->values, scene->count))
+    {
+        LOG_WARN("Scene %s has a value out of range", scene->name);
+        return false;
+    }
+    // The NVS write follows from settings_save_if_due() once the settings settle
+    rgb_led_control_request_update();
+    active_scene = index;
+    LOG_INFO("Scene %s applied in %lld us", scene->name, (long long)(esp_timer_get_time() - start));
+    return true;
+}
+
+int scene_apply_next(void)
+{
+    for (int step = 1; step <= SCENE_COUNT; step++)
+    {
+        int index = (active_scene + step) % SCENE_COUNT;
+        if (scene_apply(index))
+        {
+            return index;
+        }
+    }
+    return -1;
+}
+
+bool scene_save(int index)
+{
+    if (index < 0 || index >= SCENE_COUNT)
+    {
+        return false;
+    }
+
+    scenes_load_once();
+    Scene *scene = &scenes[index];
+    scene->count = 0;
+    for (SettingKey key = 0; key < SETTING_COUNT; key++)
+    {
+        if (settings_is_persistent(key))
+        {
+            scene->keys[scene->count] = key;
+            scene->values[scene->count] = settings_get_int(key);
+            scene->count++;
+        }
+    }
+    active_scene = index;
+
+    uint8_t blob[SCENE_BLOB_MAX];
+    size_t length = scene_pack(scene, blob, sizeof(blob));
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    scene_nvs_key(index, key, sizeof(key));
+    if (length == 0 || !scene_nvs_open() || nvs_set_blob(nvs, key, blob, length) != ESP_OK ||
+        nvs_commit(nvs) != ESP_OK)
+    {
+        LOG_ERROR("Could not store scene %s", scene->name);
+        return false;
+    }
+    LOG_INFO("Scene %s saved (%u bytes)", scene->name, (unsigned)length);
+    return true;
+}
+
+int scene_get_active(void)
+{
+    return active_scene;
+}
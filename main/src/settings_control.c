@@ -1,12 +1,22 @@
 #include "settings_control.h"
 #include <stdio.h>
 #include <string.h>
+#include <stdatomic.h>
 #include "freertos/FreeRTOS.h"
-#include "freertos/timers.h"
 #include "rgb_led_control.h"
-
-// Timer handle for auto turn-off
-static TimerHandle_t auto_turn_off_timer = NULL;
+#include "timer_control.h"
+#include "trace_control.h"
+#include "log_control.h"
+#include "melody_control.h"
+#include "color_control.h"
+#include "pm_control.h"
+#include "nvs_flash.h"
+#include "nvs.h"
+
+// Timer job for auto turn-off. The delay is in whole seconds, so it can share
+// a wakeup with whatever else is due around then.
+#define AUTO_TURN_OFF_SLACK_MS 60
+static TimerJob auto_turn_off_job;
 
 // Predefined colors with names and RGB values
 static const Color colors[] = {
@@ -18,44 +28,98 @@ static const Color colors[] = {
     {"Cyan", 0, 255, 255},
     {"Magenta", 255, 0, 255}};
 
-static const Signal signals[] = {
-    {"Beep", {{1000, 200}}, 1},                                        // A single beep at 1 kHz for 200 ms
-    {"Double Beep", {{1000, 200}, {1000, 200}}, 2},                    // Two short beeps
-    {"Chime", {{500, 500}, {700, 500}, {900, 500}}, 3},                // A chime with rising tones
-    {"Alarm", {{2000, 500}, {1500, 500}, {2000, 500}}, 3},             // Alternating alarm tones
-    {"Melody", {{800, 300}, {1000, 300}, {1200, 300}, {1000, 300}}, 4} // A simple melody
-};
+#define SETTINGS_NVS_NAMESPACE "settings"
 
 // Settings instance
 static Settings settings;
+static portMUX_TYPE settings_lock = portMUX_INITIALIZER_UNLOCKED; // Batch writes
+static atomic_uint settings_generation; // Odd while a batch is being written, readers retry then
 
-// Callback function for the timer
-static void auto_turn_off_callback(TimerHandle_t xTimer)
+// Callback function for the timer job
+static void auto_turn_off_callback(void *arg)
 {
     Settings *settings = settings_get();
 
     // Turn off the light
     settings->light = 0;
-    rgb_led_control_update(); // Update the LED state
-    printf("Light turned off due to auto unplug timer.\n");
+    rgb_led_control_request_update(); // Update the LED state
+    LOG_INFO("Light turned off due to auto unplug timer.");
+}
+
+// What the schema says about one setting, indexed by SettingKey
+typedef struct {
+    const char *name;
+    const char *id;
+    int min;
+    int max;
+    int default_value;
+    SettingFormat format;
+    bool persist;
+    uint8_t offset; // Of the field in Settings
+    uint8_t size;
+} SettingInfo;
+
+static const SettingInfo setting_info[SETTING_COUNT] = {
+#define SETTING_INFO(key, field, type, min_, max_, default_, name_, id_, format_, persist_)                          \
+    [SETTING_##key] = {.name = name_, .id = id_, .min = min_, .max = max_, .default_value = default_,                 \
+                       .format = format_, .persist = persist_, .offset = offsetof(Settings, field),                   \
+                       .size = sizeof(type)},
+    SETTINGS_SCHEMA(SETTING_INFO)
+#undef SETTING_INFO
+};
+
+// Catch a schema entry that does not fit its own type at build time
+#define SETTING_CHECK(key, field, type, min_, max_, default_, ...)                                                 \
+    _Static_assert((type)-1 > 0, "SETTING_" #key ": the type must be unsigned");                                  \
+    _Static_assert(sizeof(type) <= sizeof(uint32_t), "SETTING_" #key ": the type is too wide");                   \
+    _Static_assert((min_) >= 0 && (min_) <= (max_) && (uint64_t)(max_) <= (type)-1,                                \
+                   "SETTING_" #key ": the range does not fit the type");                                          \
+    _Static_assert((default_) >= (min_) && (default_) <= (max_), "SETTING_" #key ": the default is out of range");
+SETTINGS_SCHEMA(SETTING_CHECK)
+#undef SETTING_CHECK
+_Static_assert(sizeof(colors) / sizeof(colors[0]) == SETTINGS_COLOR_COUNT, "SETTINGS_COLOR_COUNT is off");
+_Static_assert(MELODY_COUNT_MAX == SETTINGS_SIGNAL_COUNT, "SETTINGS_SIGNAL_COUNT is off");
+_Static_assert(sizeof(Settings) <= 255, "SettingInfo.offset is a byte");
+
+// Fields are single loads and stores of their own size, a reader never sees half a value
+static uint32_t field_read(const Settings *from, SettingKey key)
+{
+    const uint8_t *field = (const uint8_t *)from + setting_info[key].offset;
+    switch (setting_info[key].size)
+    {
+    case 1:
+        return *field;
+    case 2:
+        return *(const uint16_t *)field;
+    default:
+        return *(const uint32_t *)field;
+    }
+}
+
+static void field_write(Settings *to, SettingKey key, uint32_t value)
+{
+    uint8_t *field = (uint8_t *)to + setting_info[key].offset;
+    switch (setting_info[key].size)
+    {
+    case 1:
+        *field = value;
+        break;
+    case 2:
+        *(uint16_t *)field = value;
+        break;
+    default:
+        *(uint32_t *)field = value;
+        break;
+    }
 }
 
 // Initialize settings with default values
 void settings_init(void)
 {
-    settings.brightness = 50;         // 10% brightness
-    settings.selected_color = 5;      // Default to "Red"
-    settings.sensitivity_ir = 90;     // 90% IR sensitivity
-    settings.sensitivity_ur = 50;     // 50% UR sensitivity
-    settings.timing_ir = 50;          // 50% IR timing
-    settings.timing_ur = 50;          // 50% UR timing
-    settings.light = 0;               // Light OFF
-    settings.light_auto_turn_off = 0; // No auto turn off
-    settings.ir = 1;                  // IR ON
-    settings.us = 1;                  // US ON
-    settings.sound_on = 1;            // Sound OFF
-    settings.volume = 100;            // Volume 50%
-    settings.selected_signal = 2;     // Default signal
+    for (SettingKey key = 0; key < SETTING_COUNT; key++)
+    {
+        field_write(&settings, key, setting_info[key].default_value);
+    }
 }
 
 // Get a pointer to the settings structure
@@ -67,149 +131,267 @@ Settings *settings_get(void)
 // Fetch the name of a setting by key
 const char *settings_get_name(SettingKey key)
 {
-    switch (key)
-    {
-    case SETTING_SOUND:
-        return "Sound";
-    case SETTING_BRIGHTNESS:
-        return "Brightness";
-    case SETTING_COLOR:
-        return "Color";
-    case SETTING_SENSITIVITY_IR:
-        return "IR Sensitivity";
-    case SETTING_SENSITIVITY_UR:
-        return "UR Sensitivity";
-    case SETTING_TIMING_IR:
-        return "IR Timing";
-    case SETTING_TIMING_UR:
-        return "UR Timing";
-    case SETTING_LIGHT:
-        return "Light";
-    case SETTING_LIGHT_AUTO_TURN_OFF:
-        return "Auto unplug";
-    case SETTING_IR:
-        return "IR";
-    case SETTING_US:
-        return "US";
-    case SETTING_VOLUME:
-        return "Volume";
-    case SETTING_SELECTED_SIGNAL:
-        return "Signal";
+    return key < SETTING_COUNT ? setting_info[key].name : "Unknown";
+}
 
-    default:
-        return "Unknown";
+const char *settings_get_id(SettingKey key)
+{
+    return key < SETTING_COUNT ? setting_info[key].id : "unknown";
+}
+
+bool settings_is_persistent(SettingKey key)
+{
+    return key < SETTING_COUNT && setting_info[key].persist;
+}
+
+size_t settings_get_size(SettingKey key)
+{
+    return key < SETTING_COUNT ? setting_info[key].size : 0;
+}
+
+int settings_get_min(SettingKey key)
+{
+    return key < SETTING_COUNT ? setting_info[key].min : 0;
+}
+
+int settings_get_max(SettingKey key)
+{
+    return key < SETTING_COUNT ? setting_info[key].max : 0;
+}
+
+// The value, or text when NULL, then the suffix, cut to fit. Cheaper than
+// snprintf() for the console and menu, which format on every redraw.
+static void format_text(int value, const char *text, const char *suffix, char *buffer, size_t size)
+{
+    char digits[12];
+    if (text == NULL)
+    {
+        char *p = digits + sizeof(digits) - 1;
+        unsigned int v = value;
+        *p = '\0';
+        do
+        {
+            *--p = '0' + v % 10;
+            v /= 10;
+        } while (v != 0);
+        text = p;
+    }
+
+    size_t n = 0;
+    while (*text != '\0' && n + 1 < size)
+    {
+        buffer[n++] = *text++;
+    }
+    while (*suffix != '\0' && n + 1 < size)
+    {
+        buffer[n++] = *suffix++;
+    }
+    if (size > 0)
+    {
+        buffer[n] = '\0';
+    }
+}
+
+static void format_percent(int value, char *buffer, size_t size)
+{
+    format_text(value, NULL, "%", buffer, size);
+}
+
+static void format_cm(int value, char *buffer, size_t size)
+{
+    format_text(value, NULL, " cm", buffer, size);
+}
+
+static void format_seconds(int value, char *buffer, size_t size)
+{
+    format_text(value, value == 0 ? "Off" : NULL, value == 0 ? "" : "s", buffer, size);
+}
+
+static void format_switch(int value, char *buffer, size_t size)
+{
+    format_text(value, value ? "On" : "Off", "", buffer, size);
+}
+
+static void format_color(int value, char *buffer, size_t size)
+{
+    format_text(value, colors[value].name, "", buffer, size);
+}
+
+static void format_signal(int value, char *buffer, size_t size)
+{
+    const char *melody = melody_get(value);
+    if (melody == NULL)
+    {
+        format_text(value, "?", "", buffer, size);
+        return;
+    }
+    melody_get_name(melody, buffer, size);
+}
+
+static void format_color_mode(int value, char *buffer, size_t size)
+{
+    static const char *const modes[] = {"Palette", "Hue", "White"};
+    format_text(value, modes[value], "", buffer, size);
+}
+
+static void format_degrees(int value, char *buffer, size_t size)
+{
+    format_text(value, NULL, " deg", buffer, size);
+}
+
+static void format_kelvin(int value, char *buffer, size_t size)
+{
+    format_text(value, NULL, "K", buffer, size);
+}
+
+static void (*const formatters[])(int value, char *buffer, size_t size) = {
+    [SETTING_FORMAT_PERCENT] = format_percent,
+    [SETTING_FORMAT_CM] = format_cm,
+    [SETTING_FORMAT_SECONDS] = format_seconds,
+    [SETTING_FORMAT_SWITCH] = format_switch,
+    [SETTING_FORMAT_COLOR] = format_color,
+    [SETTING_FORMAT_SIGNAL] = format_signal,
+    [SETTING_FORMAT_COLOR_MODE] = format_color_mode,
+    [SETTING_FORMAT_DEGREES] = format_degrees,
+    [SETTING_FORMAT_KELVIN] = format_kelvin,
+};
+
+void settings_format(SettingKey key, char *buffer, size_t size)
+{
+    if (key >= SETTING_COUNT)
+    {
+        format_text(0, "Unknown", "", buffer, size);
+        return;
     }
+    formatters[setting_info[key].format](field_read(&settings, key), buffer, size);
 }
 
 // Fetch the value of a setting by key as a string
 const char *settings_get_value(SettingKey key)
 {
     static char value_str[32]; // Buffer for the value string
+    settings_format(key, value_str, sizeof(value_str));
+    return value_str;
+}
 
-    switch (key)
-    {
-    case SETTING_BRIGHTNESS:
-        snprintf(value_str, sizeof(value_str), "%d%%", settings.brightness);
-        return value_str;
-    case SETTING_COLOR:
-        return colors[settings.selected_color].name;
-    case SETTING_SENSITIVITY_IR:
-        snprintf(value_str, sizeof(value_str), "%d%%", settings.sensitivity_ir);
-        return value_str;
-    case SETTING_SENSITIVITY_UR:
-        snprintf(value_str, sizeof(value_str), "%d cm", settings.sensitivity_ur);
-        return value_str;
-    case SETTING_TIMING_IR:
-        snprintf(value_str, sizeof(value_str), "%d%%", settings.timing_ir);
-        return value_str;
-    case SETTING_TIMING_UR:
-        snprintf(value_str, sizeof(value_str), "%d%%", settings.timing_ur);
-        return value_str;
-    case SETTING_LIGHT:
-        return settings.light ? "On" : "Off";
-    case SETTING_LIGHT_AUTO_TURN_OFF:
-        if (settings.light_auto_turn_off == 0)
-            return "Off";
-        snprintf(value_str, sizeof(value_str), "%d sec", settings.light_auto_turn_off);
-        return value_str;
-    case SETTING_IR:
-        return settings.ir ? "On" : "Off";
-    case SETTING_US:
-        return settings.us ? "On" : "Off";
-    case SETTING_SOUND:
-        return settings.sound_on ? "On" : "Off";
-    case SETTING_VOLUME:
-        snprintf(value_str, sizeof(value_str), "%d%%", settings.volume);
-        return value_str;
-    case SETTING_SELECTED_SIGNAL:
-        return signals[settings.selected_signal].name;
+// Fetch the RGB values of the selected color, in whichever color mode
+Color settings_color_of(const Settings *from)
+{
+    uint8_t rgb[3];
+    switch (from->color_mode)
+    {
+    case SETTINGS_COLOR_MODE_HUE:
+        color_hsv_to_rgb(COLOR_HUE_FROM_DEGREES(from->hue), from->saturation * 255 / 100, 255, rgb);
+        return (Color){"Hue", rgb[0], rgb[1], rgb[2]};
+    case SETTINGS_COLOR_MODE_WHITE:
+        color_kelvin_to_rgb(from->color_temp, rgb);
+        return (Color){"White", rgb[0], rgb[1], rgb[2]};
     default:
-        return "Unknown";
+        return colors[from->selected_color];
     }
 }
 
-// Fetch the RGB values of the selected color
+// The mode and the values it reads come from the same side of a batch
 Color settings_get_color(void)
 {
-    return colors[settings.selected_color];
+    Color color;
+    unsigned generation;
+    do
+    {
+        generation = settings_read_begin();
+        color = settings_color_of(&settings);
+    } while (settings_read_retry(generation));
+    return color;
 }
 
-// Update a setting by key
+// Lock-free for the readers, the LED task reads this way every frame
+unsigned settings_read_begin(void)
+{
+    while (1)
+    {
+        unsigned generation = atomic_load_explicit(&settings_generation, memory_order_acquire);
+        if ((generation & 1) == 0)
+        {
+            return generation;
+        }
+        // A batch is half way through, it only takes a few stores
+    }
+}
+
+bool settings_read_retry(unsigned generation)
+{
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&settings_generation, memory_order_relaxed) != generation;
+}
+
+// Whether a value is in range for a setting (switches take any value)
+bool settings_is_valid(SettingKey key, int value)
+{
+    if (key >= SETTING_COUNT)
+    {
+        return false;
+    }
+    const SettingInfo *info = &setting_info[key];
+    if (info->format == SETTING_FORMAT_SIGNAL && value >= melody_count())
+    {
+        return false; // A user melody slot the data partition does not fill
+    }
+    return info->format == SETTING_FORMAT_SWITCH || (value >= info->min && value <= info->max);
+}
+
+// Write a value that passed settings_is_valid()
+static void settings_store(SettingKey key, int value)
+{
+    if (setting_info[key].format == SETTING_FORMAT_SWITCH)
+    {
+        value = value ? 1 : 0;
+    }
+    field_write(&settings, key, value);
+}
+
+// Update a setting by key, out of range values are ignored
 void settings_update(SettingKey key, int value)
 {
-    switch (key)
+    if (settings_is_valid(key, value))
     {
-    case SETTING_BRIGHTNESS:
-        if (value >= 0 && value <= 100)
-            settings.brightness = value;
-        break;
-    case SETTING_COLOR:
-        if (value >= 0 && value < (int)(sizeof(colors) / sizeof(colors[0])))
-            settings.selected_color = value;
-        break;
-    case SETTING_SENSITIVITY_IR:
-        if (value >= 1 && value <= 100)
-            settings.sensitivity_ir = value;
-        break;
-    case SETTING_SENSITIVITY_UR:
-        if (value >= 1 && value <= 100)
-            settings.sensitivity_ur = value;
-        break;
-    case SETTING_TIMING_IR:
-        if (value >= 0 && value <= 100)
-            settings.timing_ir = value;
-        break;
-    case SETTING_TIMING_UR:
-        if (value >= 0 && value <= 100)
-            settings.timing_ur = value;
-        break;
-    case SETTING_LIGHT:
-        settings.light = value ? 1 : 0;
-        break;
-    case SETTING_LIGHT_AUTO_TURN_OFF: // New case
-        if (value >= 0 && value <= 60)
-            settings.light_auto_turn_off = value;
-        break;
-    case SETTING_IR:
-        settings.ir = value ? 1 : 0;
-        break;
-    case SETTING_US:
-        settings.us = value ? 1 : 0;
-        break;
-    case SETTING_SOUND:
-        settings.sound_on = value ? 1 : 0;
-        break;
-    case SETTING_VOLUME:
-        if (value >= 0 && value <= 100)
-            settings.volume = value;
-        break;
-    case SETTING_SELECTED_SIGNAL:
-        if (value >= 0 && value < (int)(sizeof(signals) / sizeof(signals[0])))
-            settings.selected_signal = value;
-        break;
-    default:
-        break;
+        settings_store(key, value);
+    }
+
+    trace_point(TRACE_SETTINGS_UPDATE);
+}
+
+// All or nothing: nothing is written unless every value is valid, and the
+// writes happen in one critical section that settings_read_retry() can detect
+bool settings_update_batch(const SettingKey *keys, const int *values, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (!settings_is_valid(keys[i], values[i]))
+        {
+            return false;
+        }
+    }
+
+    // The lock orders the writers, plain stores of the generation will do
+    portENTER_CRITICAL(&settings_lock);
+    unsigned generation = atomic_load_explicit(&settings_generation, memory_order_relaxed);
+    atomic_store_explicit(&settings_generation, generation + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (int i = 0; i < count; i++)
+    {
+        settings_store(keys[i], values[i]);
     }
+    atomic_store_explicit(&settings_generation, generation + 2, memory_order_release);
+    portEXIT_CRITICAL(&settings_lock);
+
+    trace_point(TRACE_SETTINGS_UPDATE);
+    return true;
+}
+
+// Fetch the value of a setting by key as a number, -1 for an unknown key
+int settings_get_int(SettingKey key)
+{
+    return key < SETTING_COUNT ? (int)field_read(&settings, key) : -1;
 }
 
 // get all the color names
@@ -231,28 +413,217 @@ const char **settings_get_color_names(void)
     return color_names;
 }
 
-const char **settings_get_signal_names(void)
+// Reset all settings to default values
+void settings_reset(void)
 {
-    static const char *signal_names[sizeof(signals) / sizeof(signals[0]) + 1]; // +1 for NULL terminator
-    static int initialized = 0;
+    settings_init();
+}
 
-    if (!initialized)
+// NVS, opened by settings_load() or on the first save
+static nvs_handle_t nvs = 0;
+static bool nvs_ready = false;
+
+// Debounced saves: saved is what NVS holds, seen what the main loop saw last
+static Settings saved;
+static Settings seen;
+static bool save_baseline = false;
+static volatile bool save_due = false;
+static TimerJob save_job;
+
+static void save_job_callback(void *arg)
+{
+    save_due = true;
+    pm_control_signal_work(); // Get the main loop to do the write
+}
+
+bool settings_storage_init(void)
+{
+    static bool flash_ready = false;
+    if (flash_ready)
+    {
+        return true;
+    }
+
+    esp_err_t err = nvs_flash_init();
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        // The partition is full or was written by a newer layout: start over
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        err = nvs_flash_init();
+    }
+    if (err != ESP_OK)
+    {
+        LOG_ERROR("NVS unavailable: %s", esp_err_to_name(err));
+        return false;
+    }
+    flash_ready = true;
+    return true;
+}
+
+static bool settings_nvs_open(void)
+{
+    if (nvs_ready)
+    {
+        return true;
+    }
+    if (!settings_storage_init())
+    {
+        return false;
+    }
+
+    esp_err_t err = nvs_open(SETTINGS_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK)
+    {
+        LOG_ERROR("Settings storage unavailable: %s", esp_err_to_name(err));
+        return false;
+    }
+    nvs_ready = true;
+    return true;
+}
+
+static esp_err_t nvs_read(SettingKey key, uint32_t *value)
+{
+    const char *id = setting_info[key].id;
+    esp_err_t err;
+    switch (setting_info[key].size)
+    {
+    case 1: {
+        uint8_t v = 0;
+        err = nvs_get_u8(nvs, id, &v);
+        *value = v;
+        break;
+    }
+    case 2: {
+        uint16_t v = 0;
+        err = nvs_get_u16(nvs, id, &v);
+        *value = v;
+        break;
+    }
+    default:
+        err = nvs_get_u32(nvs, id, value);
+        break;
+    }
+    return err;
+}
+
+static esp_err_t nvs_write(SettingKey key, uint32_t value)
+{
+    const char *id = setting_info[key].id;
+    switch (setting_info[key].size)
+    {
+    case 1:
+        return nvs_set_u8(nvs, id, value);
+    case 2:
+        return nvs_set_u16(nvs, id, value);
+    default:
+        return nvs_set_u32(nvs, id, value);
+    }
+}
+
+void settings_load(void)
+{
+    if (!settings_nvs_open())
+    {
+        return;
+    }
+
+    int loaded = 0;
+    for (SettingKey key = 0; key < SETTING_COUNT; key++)
     {
-        for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++)
+        uint32_t value;
+        if (!setting_info[key].persist || nvs_read(key, &value) != ESP_OK)
         {
-            signal_names[i] = signals[i].name; // Fetch the name from the signals array
+            continue; // Never saved, keep the default
         }
-        signal_names[sizeof(signals) / sizeof(signals[0])] = NULL; // Add NULL terminator
-        initialized = 1;
+        // A stored value from an older schema may no longer be in range
+        if (value > INT32_MAX || !settings_is_valid(key, value))
+        {
+            LOG_WARN("Ignoring stored %s = %lu", setting_info[key].id, (unsigned long)value);
+            continue;
+        }
+        settings_store(key, value);
+        loaded++;
+    }
+    LOG_INFO("Loaded %d settings from NVS", loaded);
+}
+
+// Write the persisted settings that differ from what NVS holds
+static void settings_write_changes(void)
+{
+    if (!settings_nvs_open())
+    {
+        return;
     }
 
-    return signal_names;
+    int written = 0;
+    for (SettingKey key = 0; key < SETTING_COUNT; key++)
+    {
+        uint32_t value = field_read(&settings, key);
+        if (!setting_info[key].persist || value == field_read(&saved, key))
+        {
+            continue;
+        }
+        if (nvs_write(key, value) != ESP_OK)
+        {
+            LOG_ERROR("Could not save %s", setting_info[key].id);
+            continue;
+        }
+        field_write(&saved, key, value);
+        written++;
+    }
+    if (written > 0)
+    {
+        ESP_ERROR_CHECK(nvs_commit(nvs));
+        LOG_INFO("Saved %d settings to NVS", written);
+    }
 }
 
-// Reset all settings to default values
-void settings_reset(void)
+void settings_save_if_due(void)
 {
-    settings_init();
+    if (!save_baseline)
+    {
+        // The settings loaded at boot (or kept over standby) are what NVS holds
+        const TimerJobArgs job_args = {
+            .name = "settings_save",
+            .callback = save_job_callback,
+            .slack_ms = SETTINGS_SAVE_SLACK_MS,
+        };
+        timer_job_init(&save_job, &job_args);
+        saved = settings;
+        seen = settings;
+        save_baseline = true;
+        return;
+    }
+
+    // Every further change pushes the write back, so scrolling through a value
+    // costs one flash write instead of one per step
+    for (SettingKey key = 0; key < SETTING_COUNT; key++)
+    {
+        if (setting_info[key].persist && field_read(&settings, key) != field_read(&seen, key))
+        {
+            seen = settings;
+            timer_start_once(&save_job, SETTINGS_SAVE_DELAY_MS);
+            break;
+        }
+    }
+
+    if (save_due)
+    {
+        save_due = false;
+        settings_write_changes();
+    }
+}
+
+void settings_save(void)
+{
+    if (!save_baseline)
+    {
+        return; // Nothing changed since boot
+    }
+    timer_stop(&save_job);
+    save_due = false;
+    seen = settings;
+    settings_write_changes();
 }
 
 void settings_print_all(void)
@@ -265,35 +636,29 @@ void settings_print_all(void)
     }
 }
 
-const Signal *get_selected_signal(void)
+const char *get_selected_signal(void)
 {
-    return &signals[settings.selected_signal];
+    return melody_get(settings.selected_signal);
 }
 
-// Should be its own file, but CBA to do that right now
+// Fetch a signal by index, NULL if there is no such signal
+const char *settings_get_signal(int index)
+{
+    return melody_get(index);
+}
 
-// Forward declaration of function
-void auto_turn_off_task(void *pvParameters);
+// Should be its own file, but CBA to do that right now
 
 // Initialize the auto turn-off system
 void auto_turn_off_init(void)
 {
-    // Create the timer (one-shot timer)
-    auto_turn_off_timer = xTimerCreate(
-        "AutoTurnOffTimer",    // Timer name
-        pdMS_TO_TICKS(1000),   // Dummy period (will be updated dynamically)
-        pdFALSE,               // One-shot timer
-        (void *)0,             // Timer ID (not used)
-        auto_turn_off_callback // Callback function
-    );
-
-    if (auto_turn_off_timer == NULL)
-    {
-        printf("Failed to create auto turn-off timer.\n");
-    }
-
-    // Create the background task
-    xTaskCreate(auto_turn_off_task, "AutoTurnOffTask", 2048, NULL, 5, NULL);
+    // One-shot job, started whenever the light turns on
+    const TimerJobArgs job_args = {
+        .name = "auto_off",
+        .callback = auto_turn_off_callback,
+        .slack_ms = AUTO_TURN_OFF_SLACK_MS,
+    };
+    timer_job_init(&auto_turn_off_job, &job_args);
 }
 
 void auto_turn_off_start(void)
@@ -303,63 +668,45 @@ void auto_turn_off_start(void)
     // Stop the timer if the value is 0
     if (settings->light_auto_turn_off == 0)
     {
-        if (xTimerIsTimerActive(auto_turn_off_timer))
+        if (timer_is_active(&auto_turn_off_job))
         {
-            xTimerStop(auto_turn_off_timer, 0);
-            printf("Auto turn-off timer stopped.\n");
+            timer_stop(&auto_turn_off_job);
+            LOG_INFO("Auto turn-off timer stopped.");
         }
         return;
     }
 
     // Start the timer with the specified duration
-    TickType_t timer_period = pdMS_TO_TICKS(settings->light_auto_turn_off * 1000);
-    xTimerChangePeriod(auto_turn_off_timer, timer_period, 0);
-    xTimerStart(auto_turn_off_timer, 0);
-    printf("Auto turn-off timer started for %d seconds.\n", settings->light_auto_turn_off);
+    timer_start_once(&auto_turn_off_job, settings->light_auto_turn_off * 1000);
+    LOG_INFO("Auto turn-off timer started for %d seconds.", settings->light_auto_turn_off);
 }
 
-// Background task to monitor the light setting
-void auto_turn_off_task(void *pvParameters)
+// Follow the light state, called by the LED task whenever the light turns on or off
+void auto_turn_off_update(void)
 {
     static int has_started = 0; // Tracks whether the timer has started
+    Settings *settings = settings_get();
 
-    while (1)
+    // Check if the light is on and the timer hasn't started
+    if (settings->light == 1 && has_started == 0)
     {
-        Settings *settings = settings_get();
-
-        // Check if the light is on and the timer hasn't started
-        if (settings->light == 1 && has_started == 0)
-        {
-            auto_turn_off_start(); // Start the timer
-            has_started = 1;       // Mark the timer as started
-        }
-        // Check if the light is off and the timer was running
-        else if (settings->light == 0 && has_started == 1)
+        auto_turn_off_start(); // Start the timer
+        has_started = 1;       // Mark the timer as started
+    }
+    // Check if the light is off and the timer was running
+    else if (settings->light == 0 && has_started == 1)
+    {
+        if (timer_is_active(&auto_turn_off_job))
         {
-            if (xTimerIsTimerActive(auto_turn_off_timer))
-            {
-                xTimerStop(auto_turn_off_timer, 0); // Stop the timer
-                printf("Auto turn-off timer stopped because the light was turned off.\n");
-            }
-            has_started = 0; // Reset the flag
+            timer_stop(&auto_turn_off_job); // Stop the timer
+            LOG_INFO("Auto turn-off timer stopped because the light was turned off.");
         }
-
-        vTaskDelay(pdMS_TO_TICKS(100)); // Check every 100ms
+        has_started = 0; // Reset the flag
     }
 }
 
-void play_signal(const Signal *signal)
+int auto_turn_off_remaining_s(void)
 {
-    for (int i = 0; i < signal->tone_count; i++)
-    {
-        int frequency = signal->tones[i].frequency;
-        int duration = signal->tones[i].duration;
-
-        // Play the tone (replace with your hardware-specific function)
-        printf("Playing tone: Frequency = %d Hz, Duration = %d ms\n", frequency, duration);
-        // Example: audio_play_tone(frequency, duration);
-
-        // Delay for the duration of the tone
-        vTaskDelay(pdMS_TO_TICKS(duration));
-    }
+    int32_t remaining_ms = timer_get_remaining_ms(&auto_turn_off_job);
+    return remaining_ms < 0 ? -1 : (remaining_ms + 999) / 1000;
 }
\ No newline at end of file
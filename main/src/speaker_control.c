@@ -5,25 +5,83 @@
 #include "driver/i2s_std.h"
 #include "speaker_control.h"
 #include "settings_control.h"
+#include "trace_control.h"
+#include "profiler_control.h"
+#include "pm_control.h"
+#include "log_control.h"
+#include "esp_attr.h"
+#include "board_control.h"
+#include "memory_plan.h"
+#include "health_control.h"
+#include "melody_control.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
-#define SPEAKER_DIN_PIN GPIO_NUM_33 // Audio Data (DIN)
-#define SPEAKER_BCK_PIN GPIO_NUM_25 // Bit Clock (BCK)
-#define SPEAKER_LCK_PIN GPIO_NUM_32 // Left/Right Clock (LCK)
+#define SPEAKER_DIN_PIN BOARD_I2S_DIN_GPIO // Audio Data (DIN)
+#define SPEAKER_BCK_PIN BOARD_I2S_BCK_GPIO // Bit Clock (BCK)
+#define SPEAKER_LCK_PIN BOARD_I2S_LCK_GPIO // Left/Right Clock (LCK)
 
-#define SAMPLE_RATE 44100 // Audio sample rate
+#define SAMPLE_RATE BOARD_AUDIO_SAMPLE_RATE // Audio sample rate
+#define SPEAKER_MIN_FREQUENCY ((SAMPLE_RATE + PLAN_TONE_SAMPLES - 1) / PLAN_TONE_SAMPLES) // 44 Hz at 44.1 kHz
+
+// Signals are played from their own task so they never hold up the LEDs or the menu
+#define SPEAKER_TASK_PRIORITY 2
+#define SPEAKER_HEALTH_DEADLINE_MS 1000 // One cycle of a tone into the DMA ring
+static StackType_t speaker_task_stack[PLAN_STACK_SPEAKER];
+static StaticTask_t speaker_task_tcb;
+
+// Notification bits understood by the speaker task
+#define SPEAKER_EVENT_UPDATE (1 << 0) // The light may have changed
+#define SPEAKER_EVENT_SIGNAL (1 << 1) // Play pending_signal
 
 static i2s_chan_handle_t tx_channel; // Handle for the TX channel
 static bool is_i2s_channel_enabled = false; 
+static TaskHandle_t speaker_task_handle = NULL;
+static volatile bool is_playing = false; // A tone is being written, an empty DMA queue is an underrun
+static const char *volatile pending_signal = NULL; // Melody
+
+// One cycle of the tone being played. Only the speaker task synthesizes tones.
+static int16_t tone_cycle[PLAN_TONE_SAMPLES];
+
+// The DMA ran out of samples. An idle, enabled channel does this all the time,
+// so only count it while a tone is being fed.
+static bool IRAM_ATTR speaker_underrun_callback(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    if (is_playing)
+    {
+        profiler_count(PROFILER_COUNTER_I2S_UNDERRUNS, 1);
+    }
+    return false;
+}
+
+// Waits for light changes reported by the LED task and plays the matching
+// signal, or plays the signal someone asked for
+static void speaker_task(void *pvParameters)
+{
+    health_register(HEALTH_TASK_SPEAKER, SPEAKER_HEALTH_DEADLINE_MS, NULL);
+    while (1)
+    {
+        uint32_t events = 0;
+        health_wait(HEALTH_TASK_SPEAKER);
+        xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
+        health_beat(HEALTH_TASK_SPEAKER, "speaker task");
+        if (events & SPEAKER_EVENT_UPDATE)
+        {
+            speaker_update();
+        }
+        if ((events & SPEAKER_EVENT_SIGNAL) && pending_signal != NULL)
+        {
+            speaker_play_signal(pending_signal);
+        }
+    }
+}
 
 // This is black magic to me, so no questions please. 
 // But I'm fairly sure that it initiates the I2S driver in a way that it works -- lol.
 void speaker_init(void)
 {
-    is_i2s_channel_enabled = true;
     // Configure the I2S clock using the default macro
     i2s_std_clk_config_t clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(SAMPLE_RATE);
 
@@ -41,12 +99,13 @@ void speaker_init(void)
         .din = I2S_GPIO_UNUSED,
     };
 
-    // Create the TX channel
+    // Create the TX channel. On the ESP32 the continuous ADC mode runs on I2S0's
+    // DMA (ambient_control.c), the speaker keeps to I2S1.
     i2s_chan_config_t chan_cfg = {
-        .id = I2S_NUM_0,
+        .id = I2S_NUM_1,
         .role = I2S_ROLE_MASTER,
-        .dma_desc_num = 16,
-        .dma_frame_num = 1024,
+        .dma_desc_num = PLAN_I2S_DMA_DESC_NUM,
+        .dma_frame_num = PLAN_I2S_DMA_FRAME_NUM,
         .auto_clear = true,
     };
 
@@ -60,14 +119,23 @@ void speaker_init(void)
     };
     ESP_ERROR_CHECK(i2s_channel_init_std_mode(tx_channel, &std_cfg));
 
-    // Enable the I2S channel
-    ESP_ERROR_CHECK(i2s_channel_enable(tx_channel));
+    // Callbacks have to be registered while the channel is still disabled
+    i2s_event_callbacks_t callbacks = {
+        .on_send_q_ovf = speaker_underrun_callback,
+    };
+    ESP_ERROR_CHECK(i2s_channel_register_event_callback(tx_channel, &callbacks, NULL));
+
+    // The channel is only enabled while a signal plays: the driver holds a
+    // power management lock for as long as it is, which rules out light sleep
 
     printf("Speaker initialized (DIN: GPIO 33, BCK: GPIO 25, LCK: GPIO 32)\n");
+
+    speaker_task_handle = xTaskCreateStatic(speaker_task, "SpeakerTask", sizeof(speaker_task_stack), NULL,
+                                            SPEAKER_TASK_PRIORITY, speaker_task_stack, &speaker_task_tcb);
 }
 
 // Generate a sine wave for a given frequency and amplitude
-static void generate_sine_wave(int16_t *buffer, int samples_per_cycle, int amplitude)
+void speaker_generate_sine_wave(int16_t *buffer, int samples_per_cycle, int amplitude)
 {
     for (int i = 0; i < samples_per_cycle; i++)
     {
@@ -84,10 +152,10 @@ void speaker_play_tone(int frequency, int duration_ms)
         is_i2s_channel_enabled = true; // Update the flag
     }
 
-    // Validate input parameters
-    if (frequency <= 0 || duration_ms <= 0)
+    // Validate input parameters, one cycle of the tone has to fit tone_cycle
+    if (frequency < SPEAKER_MIN_FREQUENCY || duration_ms <= 0)
     {
-        printf("Invalid tone parameters: Frequency = %d, Duration = %d ms\n", frequency, duration_ms);
+        LOG_WARN("Invalid tone parameters: Frequency = %d, Duration = %d ms", frequency, duration_ms);
         return;
     }
 
@@ -95,48 +163,75 @@ void speaker_play_tone(int frequency, int duration_ms)
     const int max_amplitude = 3000; // Maximum amplitude of the sine wave
     int amplitude = (max_amplitude * settings->volume) / 100; // Scale amplitude by volume (0-100%)
     const int samples_per_cycle = SAMPLE_RATE / frequency;
-    int16_t sine_wave[samples_per_cycle];
 
-    printf("Generating sine wave: Frequency = %d Hz, Amplitude = %d\n", frequency, amplitude);
-    generate_sine_wave(sine_wave, samples_per_cycle, amplitude);
+    LOG_DEBUG("Generating sine wave: Frequency = %d Hz, Amplitude = %d", frequency, amplitude);
+    speaker_generate_sine_wave(tone_cycle, samples_per_cycle, amplitude);
 
     // Play the sine wave for the specified duration
     int total_samples = (SAMPLE_RATE * duration_ms) / 1000;
     int samples_played = 0;
 
-    printf("Playing tone: Frequency = %d Hz, Duration = %d ms, Volume = %d%%\n", frequency, duration_ms, settings->volume);
+    LOG_DEBUG("Playing tone: Frequency = %d Hz, Duration = %d ms, Volume = %d%%", frequency, duration_ms, settings->volume);
 
+    is_playing = true;
     while (samples_played < total_samples)
     {
         size_t bytes_written;
-        esp_err_t err = i2s_channel_write(tx_channel, sine_wave, sizeof(sine_wave), &bytes_written, pdMS_TO_TICKS(100));
+        if (samples_played == 0)
+        {
+            trace_point(TRACE_I2S_FIRST_SAMPLE);
+        }
+        esp_err_t err = i2s_channel_write(tx_channel, tone_cycle, samples_per_cycle * sizeof(int16_t), &bytes_written, pdMS_TO_TICKS(100));
         if (err != ESP_OK)
         {
-            printf("I2S write error: %s\n", esp_err_to_name(err));
+            LOG_ERROR("I2S write error: %s", esp_err_to_name(err));
             break; 
         }
 
         samples_played += samples_per_cycle;
+        health_beat(HEALTH_TASK_SPEAKER, "tone");
 
         // Print progress every 100 iterations
         if (samples_played % (samples_per_cycle * 100) == 0)
         {
-            printf("Progress: %d/%d samples played\n", samples_played, total_samples);
+            LOG_DEBUG("Progress: %d/%d samples played", samples_played, total_samples);
         }
 
         vTaskDelay(pdMS_TO_TICKS(1));
     }
+    is_playing = false;
 
-    printf("Finished playing tone: Frequency = %d Hz, Duration = %d ms\n", frequency, duration_ms);
+    LOG_DEBUG("Finished playing tone: Frequency = %d Hz, Duration = %d ms", frequency, duration_ms);
 }
 
-// Play the currently selected signal
-void speaker_play_signal(const Signal *signal)
+// Play a melody, parsed note by note while it plays
+void speaker_play_signal(const char *melody)
 {
-    for (int i = 0; i < signal->tone_count; i++)
+    MelodyParser parser;
+    MelodyNote note;
+    if (melody == NULL || !melody_begin(&parser, melody))
     {
-        speaker_play_tone(signal->tones[i].frequency, signal->tones[i].duration);
+        LOG_WARN("Not a melody: %s", melody != NULL ? melody : "(none)");
+        return;
     }
+
+    pm_control_acquire(PM_LOCK_AUDIO);
+    while (melody_next(&parser, &note))
+    {
+        if (note.frequency == 0)
+        {
+            // Rest: the channel plays silence once the DMA ring runs dry
+            vTaskDelay(pdMS_TO_TICKS(note.duration_ms));
+            health_beat(HEALTH_TASK_SPEAKER, "rest");
+            continue;
+        }
+        speaker_play_tone(note.frequency, note.duration_ms);
+    }
+    if (is_i2s_channel_enabled)
+    {
+        speaker_stop(); // Let the chip sleep again
+    }
+    pm_control_release(PM_LOCK_AUDIO);
 }
 
 // Stop any ongoing audio playback
@@ -146,11 +241,20 @@ void speaker_stop(void)
     {
         ESP_ERROR_CHECK(i2s_channel_disable(tx_channel));
         is_i2s_channel_enabled = false; // Update the flag
-        printf("Speaker playback stopped\n");
+        LOG_DEBUG("Speaker playback stopped");
     }
     else
     {
-        printf("Speaker stop called, but I2S channel is not enabled.\n");
+        LOG_DEBUG("Speaker stop called, but I2S channel is not enabled.");
+    }
+}
+
+// Make sure the I2S channel is off ahead of deep sleep
+void speaker_standby(void)
+{
+    if (is_i2s_channel_enabled)
+    {
+        speaker_stop();
     }
 }
 
@@ -159,7 +263,6 @@ void speaker_update(void)
 {
     static int previous_light_state = -1; // Initialize to an invalid state
     //printf("Previous light state: %d\n", previous_light_state);
-    static bool is_playing_signal = false; // Track if a signal is currently playing
     Settings *settings = settings_get(); // Get the current settings
 
     int current_light_state = settings->light; // Get the current light state
@@ -167,23 +270,33 @@ void speaker_update(void)
     // Check if the light state has changed
     if (current_light_state != previous_light_state)
     {
-        printf("Light state changed: %d -> %d\n", previous_light_state, current_light_state);
+        LOG_INFO("Light state changed: %d -> %d", previous_light_state, current_light_state);
 
-        // Stop the current signal if it's playing
-        if (is_playing_signal)
-        {
-            speaker_stop();
-            is_playing_signal = false;
-        }
-
-        // Play the new signal if sound is enabled
+        // Play the new signal if sound is enabled, it stops the channel when done
         if (settings->sound_on)
         {
-            const Signal *current_signal = get_selected_signal();
-            speaker_play_signal(current_signal); // Play the selected signal
-            is_playing_signal = true; // Mark that a signal is now playing
+            speaker_play_signal(get_selected_signal()); // Play the selected signal
         }
 
         previous_light_state = current_light_state; // Update the previous state
     }
-}
\ No newline at end of file
+}
+
+// Ask the speaker task to check the light state
+void speaker_request_update(void)
+{
+    if (speaker_task_handle != NULL)
+    {
+        xTaskNotify(speaker_task_handle, SPEAKER_EVENT_UPDATE, eSetBits);
+    }
+}
+
+// Ask the speaker task to play a signal, regardless of the sound setting
+void speaker_request_signal(const char *melody)
+{
+    if (speaker_task_handle != NULL)
+    {
+        pending_signal = melody;
+        xTaskNotify(speaker_task_handle, SPEAKER_EVENT_SIGNAL, eSetBits);
+    }
+}
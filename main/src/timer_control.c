@@ -0,0 +1,444 @@
+#include "timer_control.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_err.h"
+#include "profiler_control.h"
+#include <stdio.h>
+
+// Wheel geometry: 1 ms ticks, four levels of 64 slots. Level n holds the jobs
+// due within 64^(n+1) ticks; when time reaches one of its slots, the jobs in
+// it move down to the level that fits them now. Jobs further out than the
+// top level (4.6 h) wait in it and are placed again when their slot comes up.
+#define TIMER_TICK_US 1000
+#define TIMER_LEVELS 4
+#define TIMER_LEVEL_BITS 6
+#define TIMER_SLOTS (1 << TIMER_LEVEL_BITS)
+#define TIMER_RANGE_TICKS (1u << (TIMER_LEVELS * TIMER_LEVEL_BITS))
+#define TIMER_LEVEL_DUE 0xff // On the due list, waiting for dispatch
+
+// Ticks are compared by difference, keep every deadline well within half the range of a uint32_t
+#define TIMER_MAX_DELAY_MS (1u << 30)
+
+// A job can only join an earlier wakeup from level 0, longer slack is cut
+#define TIMER_MAX_SLACK_TICKS (TIMER_SLOTS - 1)
+
+static TimerJob *wheel[TIMER_LEVELS][TIMER_SLOTS];
+static uint64_t occupied[TIMER_LEVELS]; // Bit per non-empty slot
+static uint32_t slot_min_tick[TIMER_LEVELS][TIMER_SLOTS]; // Earliest job of a higher slot, stale after removals
+static TimerJob *due_head = NULL;
+static uint32_t wheel_tick = 0;         // Every slot up to this tick has been handled
+
+static esp_timer_handle_t wheel_timer = NULL;
+static bool wheel_timer_armed = false;
+static uint32_t armed_tick = 0;
+
+static TimerJob *jobs = NULL;
+static TimerStats stats;
+static portMUX_TYPE timer_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static inline uint32_t tick_of(int64_t time_us)
+{
+    return (uint32_t)(time_us / TIMER_TICK_US);
+}
+
+// Ticks wrap after 49 days
+static inline bool tick_after(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b) > 0;
+}
+
+// A job may run anywhere from the first tick at or after its deadline up to
+// the end of its slack; it sits in the wheel at the latest of those ticks
+static void IRAM_ATTR set_ticks(TimerJob *job)
+{
+    uint32_t slack_ticks = job->args.slack_ms * 1000 / TIMER_TICK_US;
+    if (slack_ticks > TIMER_MAX_SLACK_TICKS)
+    {
+        slack_ticks = TIMER_MAX_SLACK_TICKS;
+    }
+    job->due_tick = tick_of(job->due_us + TIMER_TICK_US - 1);
+    job->tick = job->due_tick + slack_ticks;
+}
+
+static void IRAM_ATTR push_job(TimerJob **head, TimerJob *job)
+{
+    job->next = *head;
+    if (*head != NULL)
+    {
+        (*head)->prev = &job->next;
+    }
+    *head = job;
+    job->prev = head;
+}
+
+static void IRAM_ATTR unlink_job(TimerJob *job)
+{
+    if (job->prev == NULL)
+    {
+        return;
+    }
+    *job->prev = job->next;
+    if (job->next != NULL)
+    {
+        job->next->prev = job->prev;
+    }
+    if (job->level < TIMER_LEVELS && wheel[job->level][job->slot] == NULL)
+    {
+        occupied[job->level] &= ~(1ULL << job->slot);
+    }
+    job->next = NULL;
+    job->prev = NULL;
+}
+
+// Put a job into the first slot that comes up at or before its tick
+static void IRAM_ATTR place_job(TimerJob *job)
+{
+    if (!tick_after(job->tick, wheel_tick))
+    {
+        job->level = TIMER_LEVEL_DUE;
+        push_job(&due_head, job);
+        return;
+    }
+
+    uint32_t delta = job->tick - wheel_tick;
+    uint32_t tick = job->tick;
+    if (delta >= TIMER_RANGE_TICKS)
+    {
+        delta = TIMER_RANGE_TICKS - 1;
+        tick = wheel_tick + delta;
+    }
+    int level = 0;
+    while (delta >= (1u << ((level + 1) * TIMER_LEVEL_BITS)))
+    {
+        level++;
+    }
+    job->level = level;
+    job->slot = (tick >> (level * TIMER_LEVEL_BITS)) & (TIMER_SLOTS - 1);
+    if (wheel[level][job->slot] == NULL || tick_after(slot_min_tick[level][job->slot], tick))
+    {
+        slot_min_tick[level][job->slot] = tick;
+    }
+    push_job(&wheel[level][job->slot], job);
+    occupied[level] |= 1ULL << job->slot;
+}
+
+// Nearest tick with work: a level 0 slot to expire or a higher one to move
+// down. With `expiry`, the earliest job of a higher slot instead of the tick
+// it moves down at, so that moving it down needs no wakeup of its own.
+static bool IRAM_ATTR next_event(uint32_t *event_tick, bool expiry)
+{
+    bool found = false;
+    for (int level = 0; level < TIMER_LEVELS; level++)
+    {
+        if (occupied[level] == 0)
+        {
+            continue;
+        }
+        int shift = level * TIMER_LEVEL_BITS;
+        uint32_t block = (wheel_tick >> shift) + 1;
+        unsigned start = block & (TIMER_SLOTS - 1);
+        uint64_t rotated = start == 0 ? occupied[level]
+                                      : (occupied[level] >> start) | (occupied[level] << (TIMER_SLOTS - start));
+        uint32_t tick = (block + __builtin_ctzll(rotated)) << shift;
+        if (expiry && level > 0)
+        {
+            tick = slot_min_tick[level][(block + __builtin_ctzll(rotated)) & (TIMER_SLOTS - 1)];
+        }
+        if (!found || tick_after(*event_tick, tick))
+        {
+            *event_tick = tick;
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Handle every slot up to `now`, jumping over the empty ones. Expired jobs go
+// to the due list.
+static void IRAM_ATTR advance_wheel(uint32_t now)
+{
+    uint32_t event;
+    while (next_event(&event, false) && !tick_after(event, now))
+    {
+        wheel_tick = event;
+        for (int level = TIMER_LEVELS - 1; level > 0; level--)
+        {
+            int shift = level * TIMER_LEVEL_BITS;
+            if ((event & ((1u << shift) - 1)) != 0)
+            {
+                continue;
+            }
+            int slot = (event >> shift) & (TIMER_SLOTS - 1);
+            TimerJob *job = wheel[level][slot];
+            wheel[level][slot] = NULL;
+            occupied[level] &= ~(1ULL << slot);
+            while (job != NULL)
+            {
+                TimerJob *next = job->next;
+                job->prev = NULL;
+                place_job(job);
+                stats.cascades++;
+                job = next;
+            }
+        }
+
+        int slot = event & (TIMER_SLOTS - 1);
+        while (wheel[0][slot] != NULL)
+        {
+            TimerJob *job = wheel[0][slot];
+            unlink_job(job);
+            job->level = TIMER_LEVEL_DUE;
+            push_job(&due_head, job);
+        }
+    }
+    if (tick_after(now, wheel_tick))
+    {
+        wheel_tick = now;
+    }
+}
+
+// Jobs whose slack window is already open share this wakeup
+static void collect_open_jobs(uint32_t now)
+{
+    uint64_t slots = occupied[0];
+    while (slots != 0)
+    {
+        int slot = __builtin_ctzll(slots);
+        slots &= slots - 1;
+        TimerJob *job = wheel[0][slot];
+        while (job != NULL)
+        {
+            TimerJob *next = job->next;
+            if (!tick_after(job->due_tick, now))
+            {
+                unlink_job(job);
+                job->level = TIMER_LEVEL_DUE;
+                push_job(&due_head, job);
+            }
+            job = next;
+        }
+    }
+}
+
+// Point the esp_timer at the next event, unless it already fires earlier
+static void IRAM_ATTR arm_wheel_timer(int64_t now_us)
+{
+    uint32_t now = tick_of(now_us);
+    uint32_t event = now;
+    if (due_head == NULL && !next_event(&event, true))
+    {
+        return; // Nothing to do, a pending expiry only finds an empty wheel
+    }
+    if (wheel_timer_armed && !tick_after(armed_tick, event))
+    {
+        return;
+    }
+
+    int64_t delay_us = 0;
+    if (tick_after(event, now))
+    {
+        delay_us = (int64_t)(event - now) * TIMER_TICK_US - now_us % TIMER_TICK_US;
+    }
+    esp_timer_stop(wheel_timer);
+    esp_timer_start_once(wheel_timer, delay_us);
+    wheel_timer_armed = true;
+    armed_tick = event;
+}
+
+// Hand the due jobs to their callbacks or owners, one at a time so that a
+// callback may start or stop any job
+static void dispatch_due_jobs(void)
+{
+    bool first = true;
+    while (1)
+    {
+        portENTER_CRITICAL(&timer_lock);
+        TimerJob *job = due_head;
+        if (job == NULL)
+        {
+            portEXIT_CRITICAL(&timer_lock);
+            return;
+        }
+        unlink_job(job);
+
+        int64_t now_us = esp_timer_get_time();
+        uint32_t late_us = now_us > job->due_us ? (uint32_t)(now_us - job->due_us) : 0;
+        job->stats.runs++;
+        job->late_total_us += late_us;
+        job->stats.late_avg_us = job->late_total_us / job->stats.runs;
+        if (late_us > job->stats.late_max_us)
+        {
+            job->stats.late_max_us = late_us;
+        }
+        stats.dispatched++;
+        stats.shared += !first;
+        first = false;
+
+        if (job->period_ms > 0)
+        {
+            // Deadlines stay on the period grid unless the job fell a whole period behind
+            int64_t period_us = (int64_t)job->period_ms * 1000;
+            job->due_us += period_us;
+            if (job->due_us <= now_us)
+            {
+                job->stats.overruns += (now_us - job->due_us) / period_us + 1;
+                job->due_us = now_us + period_us;
+            }
+            set_ticks(job);
+            place_job(job);
+        }
+        else
+        {
+            job->active = false;
+        }
+        TimerJobArgs args = job->args;
+        portEXIT_CRITICAL(&timer_lock);
+
+        profiler_time(PROFILER_TIMING_TIMER_LATE, late_us);
+        if (args.owner != NULL)
+        {
+            xTaskNotifyGive(args.owner);
+        }
+        else
+        {
+            args.callback(args.arg);
+        }
+    }
+}
+
+static void wheel_timer_callback(void *arg)
+{
+    portENTER_CRITICAL(&timer_lock);
+    wheel_timer_armed = false;
+    stats.wakeups++;
+    uint32_t now = tick_of(esp_timer_get_time());
+    advance_wheel(now);
+    collect_open_jobs(now);
+    portEXIT_CRITICAL(&timer_lock);
+
+    dispatch_due_jobs();
+
+    portENTER_CRITICAL(&timer_lock);
+    arm_wheel_timer(esp_timer_get_time());
+    portEXIT_CRITICAL(&timer_lock);
+}
+
+void timer_control_init(void)
+{
+    const esp_timer_create_args_t wheel_timer_args = {
+        .callback = wheel_timer_callback,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "timer_wheel",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&wheel_timer_args, &wheel_timer));
+    wheel_tick = tick_of(esp_timer_get_time());
+}
+
+void timer_job_init(TimerJob *job, const TimerJobArgs *args)
+{
+    *job = (TimerJob){.args = *args};
+    portENTER_CRITICAL(&timer_lock);
+    job->next_job = jobs;
+    jobs = job;
+    portEXIT_CRITICAL(&timer_lock);
+}
+
+static void IRAM_ATTR start_job(TimerJob *job, uint32_t delay_ms, uint32_t period_ms)
+{
+    if (delay_ms > TIMER_MAX_DELAY_MS)
+    {
+        delay_ms = TIMER_MAX_DELAY_MS;
+    }
+    int64_t now_us = esp_timer_get_time();
+
+    portENTER_CRITICAL_SAFE(&timer_lock);
+    unlink_job(job);
+    // Catch the wheel up first, so the job lands in the lowest level that fits
+    advance_wheel(tick_of(now_us));
+    job->due_us = now_us + (int64_t)delay_ms * 1000;
+    job->period_ms = period_ms;
+    set_ticks(job);
+    job->active = true;
+    place_job(job);
+    arm_wheel_timer(now_us);
+    portEXIT_CRITICAL_SAFE(&timer_lock);
+}
+
+void IRAM_ATTR timer_start_once(TimerJob *job, uint32_t delay_ms)
+{
+    start_job(job, delay_ms, 0);
+}
+
+void IRAM_ATTR timer_start_periodic(TimerJob *job, uint32_t period_ms)
+{
+    if (period_ms == 0)
+    {
+        period_ms = 1;
+    }
+    if (period_ms > TIMER_MAX_DELAY_MS)
+    {
+        period_ms = TIMER_MAX_DELAY_MS;
+    }
+    start_job(job, period_ms, period_ms);
+}
+
+// The esp_timer stays armed, an early wakeup finds nothing to do
+void IRAM_ATTR timer_stop(TimerJob *job)
+{
+    portENTER_CRITICAL_SAFE(&timer_lock);
+    unlink_job(job);
+    job->active = false;
+    portEXIT_CRITICAL_SAFE(&timer_lock);
+}
+
+bool timer_is_active(const TimerJob *job)
+{
+    return job->active;
+}
+
+int32_t timer_get_remaining_ms(const TimerJob *job)
+{
+    portENTER_CRITICAL(&timer_lock);
+    bool active = job->active;
+    int64_t due_us = job->due_us;
+    portEXIT_CRITICAL(&timer_lock);
+    if (!active)
+    {
+        return -1;
+    }
+    int64_t remaining_us = due_us - esp_timer_get_time();
+    return remaining_us > 0 ? (int32_t)((remaining_us + 999) / 1000) : 0;
+}
+
+void timer_get_job_stats(const TimerJob *job, TimerJobStats *job_stats)
+{
+    portENTER_CRITICAL(&timer_lock);
+    *job_stats = job->stats;
+    portEXIT_CRITICAL(&timer_lock);
+}
+
+void timer_get_stats(TimerStats *timer_stats)
+{
+    portENTER_CRITICAL(&timer_lock);
+    *timer_stats = stats;
+    portEXIT_CRITICAL(&timer_lock);
+}
+
+void timer_print_report(void)
+{
+    TimerStats totals;
+    timer_get_stats(&totals);
+    printf("Timers: %lu wakeups for %lu expiries (%lu shared a wakeup), %lu moved down the wheel\n",
+           (unsigned long)totals.wakeups, (unsigned long)totals.dispatched, (unsigned long)totals.shared,
+           (unsigned long)totals.cascades);
+    printf("Job          period  slack    runs  overruns  late avg  late max\n");
+    for (TimerJob *job = jobs; job != NULL; job = job->next_job)
+    {
+        TimerJobStats job_stats;
+        timer_get_job_stats(job, &job_stats);
+        printf("%-11s  %6lu  %5lu  %6lu  %8lu  %5lu us  %5lu us\n", job->args.name,
+               (unsigned long)job->period_ms, (unsigned long)job->args.slack_ms,
+               (unsigned long)job_stats.runs, (unsigned long)job_stats.overruns, (unsigned long)job_stats.late_avg_us,
+               (unsigned long)job_stats.late_max_us);
+    }
+}
@@ -0,0 +1,276 @@
+#include "trace_control.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// Records per core, must be a power of two. An idle main loop drains the rings
+// only every MAIN_LOOP_IDLE_MS (1 s); a pulsing strip, ultrasonic ranging and
+// the dashboard make about 70 events in that time, a ring holds 3.5 s of them.
+#define TRACE_RING_SIZE 256
+
+// Histogram layout: exact below 16 us, then 8 buckets per power of two
+// (12.5% resolution) up to 16.7 s. Larger values land in the last bucket.
+#define TRACE_HIST_SUB_BITS 3
+#define TRACE_HIST_SUB_COUNT (1 << TRACE_HIST_SUB_BITS)
+#define TRACE_HIST_LINEAR (2 * TRACE_HIST_SUB_COUNT)
+#define TRACE_HIST_MAX_EXP 23
+#define TRACE_HIST_BUCKETS (TRACE_HIST_LINEAR + (TRACE_HIST_MAX_EXP - TRACE_HIST_SUB_BITS) * TRACE_HIST_SUB_COUNT)
+
+// One tracepoint. seq is written last and tells the reader the record is complete.
+typedef struct {
+    atomic_uint seq;  // Ring position + 1 once published
+    uint8_t event;
+    int64_t time_us;  // esp_timer time, comparable across cores
+} TraceRecord;
+
+// Multi-producer (tasks and ISRs of one core), single-consumer ring
+typedef struct {
+    atomic_uint head;  // Next position to reserve
+    uint32_t tail;     // Next position to read, consumer only
+    uint32_t dropped;  // Records overwritten before they were read
+    TraceRecord records[TRACE_RING_SIZE];
+} TraceRing;
+
+// A reaction measured from its first stage to its last
+typedef struct {
+    const char *name;
+    TraceEvent start;
+    TraceEvent end;
+    uint32_t window_us; // Longer gaps are unrelated events, not latencies
+} TraceChain;
+
+typedef struct {
+    bool pending;             // A start is waiting for its end
+    int64_t start_us;         // Time of the latest unmatched start
+    uint32_t count;
+    uint32_t max_us;
+    uint32_t buckets[TRACE_HIST_BUCKETS];
+} TraceHistogram;
+
+static const TraceChain chains[TRACE_CHAIN_COUNT] = {
+    {"button-to-lcd", TRACE_BUTTON_EDGE, TRACE_DISPLAY_RENDER_END, 1000000},
+    {"motion-to-light", TRACE_IR_EDGE, TRACE_LED_REFRESH_DONE, 3000000},
+    {"light-to-sound", TRACE_LED_REFRESH_DONE, TRACE_I2S_FIRST_SAMPLE, 1000000},
+    {"settings-to-light", TRACE_SETTINGS_UPDATE, TRACE_LED_REFRESH_DONE, 500000},
+    {"lcd-render", TRACE_DISPLAY_RENDER_START, TRACE_DISPLAY_RENDER_END, 200000},
+    {"led-refresh", TRACE_LED_REFRESH_ISSUE, TRACE_LED_REFRESH_DONE, 50000},
+};
+
+static TraceRing rings[portNUM_PROCESSORS];
+static TraceHistogram histograms[TRACE_CHAIN_COUNT];
+
+void IRAM_ATTR trace_point(TraceEvent event)
+{
+    TraceRing *ring = &rings[xPortGetCoreID()];
+
+    // Reserving the slot is the only shared write, an interrupt that lands
+    // between here and the publish simply gets the next slot
+    uint32_t position = atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+    TraceRecord *record = &ring->records[position & (TRACE_RING_SIZE - 1)];
+
+    atomic_store_explicit(&record->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    record->event = event;
+    record->time_us = esp_timer_get_time();
+    atomic_store_explicit(&record->seq, position + 1, memory_order_release);
+}
+
+// Copy out the oldest unread record of a ring. Returns false when the ring is
+// empty or the oldest record is still being written.
+static bool ring_peek(TraceRing *ring, TraceRecord *out)
+{
+    while (1)
+    {
+        uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (ring->tail == head)
+        {
+            return false;
+        }
+
+        // The writers lapped us, skip what was overwritten
+        if (head - ring->tail > TRACE_RING_SIZE)
+        {
+            ring->dropped += head - ring->tail - TRACE_RING_SIZE;
+            ring->tail = head - TRACE_RING_SIZE;
+        }
+
+        TraceRecord *record = &ring->records[ring->tail & (TRACE_RING_SIZE - 1)];
+        uint32_t seq = atomic_load_explicit(&record->seq, memory_order_acquire);
+        if (seq != ring->tail + 1)
+        {
+            if (seq == 0 || (int32_t)(seq - (ring->tail + 1)) < 0)
+            {
+                return false; // Reserved but not published yet
+            }
+            ring->dropped++; // Overwritten since we read head, move on
+            ring->tail++;
+            continue;
+        }
+
+        out->event = record->event;
+        out->time_us = record->time_us;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&record->seq, memory_order_relaxed) != seq)
+        {
+            ring->dropped++; // Overwritten while we copied it
+            ring->tail++;
+            continue;
+        }
+        return true;
+    }
+}
+
+static int hist_bucket(uint32_t value_us)
+{
+    if (value_us < TRACE_HIST_LINEAR)
+    {
+        return value_us;
+    }
+    int exponent = 31 - __builtin_clz(value_us);
+    if (exponent > TRACE_HIST_MAX_EXP)
+    {
+        return TRACE_HIST_BUCKETS - 1;
+    }
+    int mantissa = (value_us >> (exponent - TRACE_HIST_SUB_BITS)) & (TRACE_HIST_SUB_COUNT - 1);
+    return TRACE_HIST_LINEAR + (exponent - TRACE_HIST_SUB_BITS - 1) * TRACE_HIST_SUB_COUNT + mantissa;
+}
+
+// Largest value that falls into a bucket
+static uint32_t hist_bucket_upper(int bucket)
+{
+    if (bucket < TRACE_HIST_LINEAR)
+    {
+        return bucket;
+    }
+    int exponent = (bucket - TRACE_HIST_LINEAR) / TRACE_HIST_SUB_COUNT + TRACE_HIST_SUB_BITS + 1;
+    int mantissa = (bucket - TRACE_HIST_LINEAR) % TRACE_HIST_SUB_COUNT;
+    uint32_t lower = (uint32_t)(TRACE_HIST_SUB_COUNT + mantissa) << (exponent - TRACE_HIST_SUB_BITS);
+    return lower + (1u << (exponent - TRACE_HIST_SUB_BITS)) - 1;
+}
+
+static uint32_t hist_percentile(const TraceHistogram *histogram, int percent)
+{
+    if (histogram->count == 0)
+    {
+        return 0;
+    }
+    uint32_t rank = (histogram->count * (uint64_t)percent + 99) / 100; // Nearest-rank
+    uint32_t seen = 0;
+    for (int i = 0; i < TRACE_HIST_BUCKETS; i++)
+    {
+        seen += histogram->buckets[i];
+        if (seen >= rank)
+        {
+            uint32_t upper = hist_bucket_upper(i);
+            return upper < histogram->max_us ? upper : histogram->max_us;
+        }
+    }
+    return histogram->max_us;
+}
+
+// Feed one record, in time order, to every chain it belongs to
+static void analyse_record(const TraceRecord *record)
+{
+    for (int i = 0; i < TRACE_CHAIN_COUNT; i++)
+    {
+        TraceHistogram *histogram = &histograms[i];
+
+        // Check the end first, a chain may start where another one ends
+        if (record->event == chains[i].end && histogram->pending)
+        {
+            int64_t latency_us = record->time_us - histogram->start_us;
+            histogram->pending = false;
+            if (latency_us >= 0 && latency_us <= chains[i].window_us)
+            {
+                histogram->count++;
+                histogram->buckets[hist_bucket(latency_us)]++;
+                if (latency_us > histogram->max_us)
+                {
+                    histogram->max_us = latency_us;
+                }
+            }
+        }
+        if (record->event == chains[i].start)
+        {
+            histogram->pending = true;
+            histogram->start_us = record->time_us; // The latest start is the one that caused the end
+        }
+    }
+}
+
+void trace_process(void)
+{
+    // Merge the per-core rings by timestamp
+    TraceRecord next[portNUM_PROCESSORS];
+    bool has_next[portNUM_PROCESSORS];
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        has_next[core] = ring_peek(&rings[core], &next[core]);
+    }
+
+    while (1)
+    {
+        int oldest = -1;
+        for (int core = 0; core < portNUM_PROCESSORS; core++)
+        {
+            if (has_next[core] && (oldest < 0 || next[core].time_us < next[oldest].time_us))
+            {
+                oldest = core;
+            }
+        }
+        if (oldest < 0)
+        {
+            break;
+        }
+
+        analyse_record(&next[oldest]);
+        rings[oldest].tail++;
+        has_next[oldest] = ring_peek(&rings[oldest], &next[oldest]);
+    }
+}
+
+void trace_get_chain_stats(int chain, TraceChainStats *stats)
+{
+    const TraceHistogram *histogram = &histograms[chain];
+
+    stats->name = chains[chain].name;
+    stats->count = histogram->count;
+    stats->p50_us = hist_percentile(histogram, 50);
+    stats->p99_us = hist_percentile(histogram, 99);
+    stats->max_us = histogram->max_us;
+}
+
+void trace_dump(void)
+{
+    trace_process();
+
+    printf("Latency (us)          count      p50      p99      max\n");
+    for (int i = 0; i < TRACE_CHAIN_COUNT; i++)
+    {
+        TraceChainStats stats;
+        trace_get_chain_stats(i, &stats);
+        printf("%-18s %8lu %8lu %8lu %8lu\n", stats.name, (unsigned long)stats.count,
+               (unsigned long)stats.p50_us, (unsigned long)stats.p99_us, (unsigned long)stats.max_us);
+    }
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        if (rings[core].dropped > 0)
+        {
+            printf("Core %d dropped %lu trace records\n", core, (unsigned long)rings[core].dropped);
+        }
+    }
+}
+
+void trace_reset(void)
+{
+    trace_process(); // Consume what is in flight so it does not count afterwards
+    memset(histograms, 0, sizeof(histograms));
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        rings[core].dropped = 0;
+    }
+}
@@ -1,18 +1,53 @@
 #include "us_control.h"
 #include "settings_control.h"
 #include "rgb_led_control.h"
+#include "trace_control.h"
+#include "profiler_control.h"
+#include "log_control.h"
 #include "driver/gpio.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_timer.h"
+#include "timer_control.h"
 #include "esp_rom_sys.h"
+#include "board_control.h"
+#include "memory_plan.h"
+#include "health_control.h"
 #include <stdio.h>
-#include "menu_control.h"
 
-#define TRIG_PIN GPIO_NUM_26
-#define ECHO_PIN GPIO_NUM_5
+#define TRIG_PIN BOARD_US_TRIG_GPIO
+#define ECHO_PIN BOARD_US_ECHO_GPIO
 #define SOUND_SPEED_CM_PER_US 0.0343 // Speed of sound in cm/µs
 
+// Ranging only matters while the light is on, a periodic timer job wakes the
+// sampler task for it so nothing polls while the light is off
+#define US_SAMPLE_PERIOD_MS 100
+#define US_SAMPLE_SLACK_MS 10
+#define US_TASK_PRIORITY 1
+#define US_HEALTH_DEADLINE_MS 500 // One measurement, the echo times out well before
+#define US_FILTER_SHIFT 2 // Each result moves the filtered distance a quarter of the way
+static StackType_t sample_task_stack[PLAN_STACK_US];
+static StaticTask_t sample_task_tcb;
+
+static TimerJob sample_job;
+static bool sample_job_ready = false;
+static TaskHandle_t sample_task_handle = NULL;
+static volatile float last_distance_cm = -1; // Latest ranging result, -1 for none
+static volatile float filtered_distance_cm = -1; // Exponential average of the good results
+
+// One measurement per timer period
+static void us_sample_task(void *pvParameters)
+{
+    health_register(HEALTH_TASK_US, US_HEALTH_DEADLINE_MS, NULL);
+    while (1)
+    {
+        health_wait(HEALTH_TASK_US);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        health_beat(HEALTH_TASK_US, "ranging");
+        us_sensor_control();
+    }
+}
+
 // Initialize the ultrasonic sensor
 void us_sensor_init(void)
 {
@@ -34,12 +69,25 @@ void us_sensor_init(void)
         .intr_type = GPIO_INTR_DISABLE};
     gpio_config(&echo_config);
 
+    sample_task_handle = xTaskCreateStatic(us_sample_task, "UsSampleTask", sizeof(sample_task_stack), NULL,
+                                           US_TASK_PRIORITY, sample_task_stack, &sample_task_tcb);
+    const TimerJobArgs sample_job_args = {
+        .name = "us_sample",
+        .owner = sample_task_handle,
+        .slack_ms = US_SAMPLE_SLACK_MS,
+    };
+    timer_job_init(&sample_job, &sample_job_args);
+    sample_job_ready = true;
+    us_sensor_update_sampling();
+
     printf("Ultrasonic sensor initialized (TRIG: GPIO %d, ECHO: GPIO %d)\n", TRIG_PIN, ECHO_PIN);
 }
 
 // Measure distance using the ultrasonic sensor
 float us_sensor_get_distance(void)
 {
+    int64_t ranging_start = esp_timer_get_time();
+
     // Send a 10µs pulse on the TRIG pin
     gpio_set_level(TRIG_PIN, 1);
     esp_rom_delay_us(10); // Use esp_rom_delay_us instead of ets_delay_us
@@ -52,7 +100,9 @@ float us_sensor_get_distance(void)
     {
         if (esp_timer_get_time() > timeout)
         {
-            printf("Timeout waiting for ECHO to go HIGH\n");
+            LOG_AT(LOG_LEVEL_WARN, 1, "Timeout waiting for ECHO to go HIGH");
+            profiler_count(PROFILER_COUNTER_US_TIMEOUTS, 1);
+            profiler_time(PROFILER_TIMING_US_RANGING, esp_timer_get_time() - ranging_start);
             return -1; // Return error
         }
     }
@@ -64,7 +114,9 @@ float us_sensor_get_distance(void)
     {
         if (esp_timer_get_time() > timeout)
         {
-            printf("Timeout waiting for ECHO to go LOW\n");
+            LOG_AT(LOG_LEVEL_WARN, 1, "Timeout waiting for ECHO to go LOW");
+            profiler_count(PROFILER_COUNTER_US_TIMEOUTS, 1);
+            profiler_time(PROFILER_TIMING_US_RANGING, esp_timer_get_time() - ranging_start);
             return -1; // Return error
         }
     }
@@ -72,6 +124,8 @@ float us_sensor_get_distance(void)
     // Calculate the duration in microseconds
     int64_t end_time = esp_timer_get_time();
     int64_t duration_us = end_time - start_time;
+    trace_point(TRACE_US_ECHO);
+    profiler_time(PROFILER_TIMING_US_RANGING, end_time - ranging_start);
 
     // Calculate the distance in cm
     float distance_cm = (duration_us * SOUND_SPEED_CM_PER_US) / 2.0;
@@ -93,26 +147,59 @@ void us_sensor_control(void)
 
     // Measure the distance
     float distance = us_sensor_get_distance();
+    last_distance_cm = distance;
     if (distance < 0)
     {
-        printf("Failed to measure distance\n");
+        LOG_AT(LOG_LEVEL_WARN, 1, "Failed to measure distance");
         return; // Skip further processing if measurement failed
     }
+    float filtered = filtered_distance_cm;
+    filtered_distance_cm = filtered < 0 ? distance : filtered + (distance - filtered) / (1 << US_FILTER_SHIFT);
 
     //printf("Measured distance: %.2f cm\n", distance);
 
     // Check if the distance is greater than the sensitivity threshold and the light is ON
     if (distance < settings->sensitivity_ur && settings->light == 1)
     {
-        printf("Distance > sensitivity, turning off light\n");
-        settings->light = 0;      // Turn off the light
-        rgb_led_control_update(); // Update the LED state
-        printf("Light turned off due to ultrasonic sensor (distance > sensitivity).\n");
+        LOG_DEBUG("Distance > sensitivity, turning off light");
+        settings->light = 0;               // Turn off the light
+        rgb_led_control_request_update(); // The LED task updates the strip and flags the menu
+        LOG_INFO("Light turned off due to ultrasonic sensor (distance > sensitivity).");
         light_turned_off = 1;
-        menu_render();
     }
     else if (distance <= settings->sensitivity_ur && light_turned_off)
     {
         light_turned_off = 0; // Reset the flag when the object moves closer
     }
-}
\ No newline at end of file
+}
+
+// Sample while the light is on, stop the timer job otherwise
+void us_sensor_update_sampling(void)
+{
+    if (!sample_job_ready)
+    {
+        return;
+    }
+
+    bool running = timer_is_active(&sample_job);
+    if (settings_get()->light == 1 && !running)
+    {
+        timer_start_periodic(&sample_job, US_SAMPLE_PERIOD_MS);
+    }
+    else if (settings_get()->light == 0 && running)
+    {
+        timer_stop(&sample_job);
+        filtered_distance_cm = -1; // Start over with the next sampling
+    }
+}
+
+// Latest ranging result in cm, -1 if the last one failed or none was made yet
+float us_sensor_get_last_distance(void)
+{
+    return last_distance_cm;
+}
+
+float us_sensor_get_filtered_distance(void)
+{
+    return filtered_distance_cm;
+}
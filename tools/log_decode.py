@@ -0,0 +1,154 @@
+#!/usr/bin/env python3
+"""Turns the binary log records of the console back into text.
+
+With CONFIG_SUPER_LIGHTS_LOG_BINARY the log task prints, once per call site,
+
+    @logfmt <id> <level> <kinds> <file>:<line> <format>
+
+and then one line per record:
+
+    @log <time_us> <id> <suppressed> <argument bytes in hex, "-" for none>
+    @logdrop <count>                  records the drain lost to a full ring
+
+Every other line (boot messages, the diagnostic dumps, the scenario shim
+records) is passed through unchanged. The site numbers are handed out by the
+drain in order of first use, so they start over with every boot.
+
+    tools/log_decode.py console.log
+    qemu-system-xtensa ... -serial stdio | tools/log_decode.py
+    tools/log_decode.py --port /dev/ttyUSB0        (needs pyserial)
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+LEVELS = {1: "E", 2: "W", 3: "I", 4: "D"}
+
+# Argument kinds, two bits each in the signature (log_control.c)
+KIND_I32, KIND_I64, KIND_F64, KIND_STR = range(4)
+
+DIRECTIVE = re.compile(r"%([-+ #0]*)(\d*)((?:\.\d*)?)(hh|h|ll|l|j|z|t|L)?([a-zA-Z%])")
+
+
+class Site:
+    def __init__(self, level, signature, location, fmt):
+        self.level = level
+        self.location = location
+        self.format = fmt
+        count = (signature >> 16) & 0xF
+        self.kinds = [(signature >> (2 * i)) & 0x3 for i in range(count)]
+
+
+def unpack_args(kinds, data):
+    """Argument values in order, as many as the record had room for."""
+    values, offset = [], 0
+    for kind in kinds:
+        if kind == KIND_I32 and offset + 4 <= len(data):
+            values.append(struct.unpack_from("<i", data, offset)[0])
+            offset += 4
+        elif kind == KIND_I64 and offset + 8 <= len(data):
+            values.append(struct.unpack_from("<q", data, offset)[0])
+            offset += 8
+        elif kind == KIND_F64 and offset + 8 <= len(data):
+            values.append(struct.unpack_from("<d", data, offset)[0])
+            offset += 8
+        elif kind == KIND_STR and offset + 1 <= len(data) and offset + 1 + data[offset] <= len(data):
+            length = data[offset]
+            values.append(data[offset + 1:offset + 1 + length].decode("utf-8", "replace"))
+            offset += 1 + length
+        else:
+            break
+    return values
+
+
+def format_message(site, values):
+    """printf() of the firmware, in Python."""
+    args = iter(zip(site.kinds, values))
+
+    def directive(match):
+        flags, width, precision, length, conversion = match.groups()
+        if conversion == "%":
+            return "%"
+        try:
+            kind, value = next(args)
+        except StopIteration:
+            return "?"  # Cut off, the record was full
+        bits = 32 if kind == KIND_I32 else 64
+        if conversion in "uxXo":
+            value &= (1 << bits) - 1
+        if conversion == "p":
+            return "0x%x" % (value & ((1 << bits) - 1))
+        if conversion == "c":
+            return chr(value & 0xFF)
+        if conversion in "ui":
+            conversion = "d"
+        return ("%" + flags + width + precision + conversion) % value
+
+    return DIRECTIVE.sub(directive, site.format)
+
+
+class Decoder:
+    def __init__(self, output):
+        self.output = output
+        self.sites = {}
+
+    def line(self, line):
+        if line.startswith("@logfmt "):
+            fields = line.rstrip("\n").split(" ", 5)
+            self.sites[int(fields[1])] = Site(int(fields[2]), int(fields[3], 16), fields[4], fields[5])
+        elif line.startswith("@log "):
+            fields = line.split()
+            time_us, site_id, suppressed = int(fields[1]), int(fields[2]), int(fields[3])
+            site = self.sites.get(site_id)
+            if site is None:
+                self.output.write("[%12.6f] ? unknown log site %d (started mid-boot?)\n" % (time_us / 1e6, site_id))
+                return
+            data = bytes.fromhex(fields[4]) if len(fields) > 4 and fields[4] != "-" else b""
+            message = format_message(site, unpack_args(site.kinds, data))
+            more = " (%d more suppressed)" % suppressed if suppressed else ""
+            self.output.write("[%12.6f] %s %s %s%s\n" % (time_us / 1e6, LEVELS.get(site.level, "?"), site.location,
+                                                         message, more))
+        elif line.startswith("@logdrop "):
+            self.output.write("(%s log records lost)\n" % line.split()[1])
+        else:
+            self.output.write(line)
+
+
+def serial_lines(port, baud):
+    import serial  # pyserial, only needed for live decoding
+    with serial.Serial(port, baud) as connection:
+        while True:
+            yield connection.readline().decode("utf-8", "replace")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("files", nargs="*", help="console captures (default: standard input)")
+    parser.add_argument("--port", help="read a serial port instead")
+    parser.add_argument("--baud", type=int, default=115200)
+    options = parser.parse_args()
+
+    decoder = Decoder(sys.stdout)
+    try:
+        if options.port:
+            for line in serial_lines(options.port, options.baud):
+                decoder.line(line)
+                sys.stdout.flush()
+        elif options.files:
+            for path in options.files:
+                with open(path, errors="replace") as f:
+                    for line in f:
+                        decoder.line(line)
+        else:
+            for line in sys.stdin:
+                decoder.line(line)
+                sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
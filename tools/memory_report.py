@@ -0,0 +1,221 @@
+#!/usr/bin/env python3
+"""Memory report of a linked image, checked against a budget.
+
+Adds up the input sections of a GNU ld map file per component (the archive an
+object came from, "main" for libmain.a) and per region:
+
+    dram   static data in internal RAM (.dram0.*, .noinit)
+    iram   code and data in instruction RAM (.iram0.*)
+    flash  code and constants in flash (.flash.*)
+    rtc    RTC fast and slow memory (.rtc*)
+
+The drivers allocate their buffers at init; main/include/memory_plan.h lists
+them as PLAN_DMA_<NAME>_BYTES and PLAN_HEAP_<NAME>_BYTES. The compiler
+evaluates those against the build's sdkconfig.h, so features that are compiled
+out count as 0. They make up the dma and heap regions.
+
+    tools/memory_report.py --map build/super_lights.map \\
+        --plan main/include/memory_plan.h --cc xtensa-esp32-elf-gcc \\
+        --include build/config --include main/include \\
+        --budget main/memory_budget.json
+
+Exits with 1 if a region or a component is over its budget. The ESP-IDF build
+runs this after every link (see CMakeLists.txt); the host build has a
+`memory_report` target that prints the same report for the simulator, whose
+sections map to .text/.rodata (flash) and .data/.bss (dram).
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+REGIONS = ["dram", "iram", "flash", "rtc"]
+PLAN_REGIONS = ["dma", "heap"]
+
+# Output section prefixes, ESP32 first and then a hosted ELF
+SECTION_REGIONS = [
+    (".dram0.", "dram"), (".noinit", "dram"),
+    (".iram0.", "iram"),
+    (".flash.", "flash"),
+    (".rtc", "rtc"),
+    (".text", "flash"), (".rodata", "flash"), (".data", "dram"), (".bss", "dram"), (".tbss", "dram"),
+]
+
+OUTPUT_SECTION = re.compile(r"^(\.\S+)(?:\s+0x[0-9a-f]+\s+0x[0-9a-f]+.*)?$")
+INPUT_SECTION = re.compile(r"^ (\S+)(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*))?$")
+CONTINUATION = re.compile(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+ARCHIVE = re.compile(r"(?:^|/)lib([^/]+)\.a\((.+)\)$")
+PLAN_ENTRY = re.compile(r"^#define (PLAN_(DMA|HEAP)_(\w+)_BYTES)\b", re.M)
+
+
+def region_of(section):
+    for prefix, region in SECTION_REGIONS:
+        if section.startswith(prefix):
+            return region
+    return None
+
+
+def component_of(source):
+    """Archive name without lib and .a, the file name for a loose object."""
+    match = ARCHIVE.search(source)
+    if match:
+        return match.group(1), match.group(2)
+    return "(" + os.path.basename(source) + ")", os.path.basename(source)
+
+
+def parse_map(path):
+    """{component: {region: bytes}} and [(bytes, region, component, object, input section)]."""
+    usage = {}
+    sections = []
+    with open(path) as map_file:
+        lines = iter(map_file.read().splitlines())
+    for line in lines:
+        if line.startswith("Linker script and memory map"):
+            break
+    region = None
+    pending = None  # Input section whose address and size are on the next line
+    for line in lines:
+        if not line.strip():
+            continue
+        if line[0] != " ":
+            match = OUTPUT_SECTION.match(line)
+            region = region_of(match.group(1)) if match else None
+            pending = None
+            continue
+        if region is None:
+            continue
+        if pending is not None:
+            match = CONTINUATION.match(line)
+            name, pending = pending, None
+            if match:
+                add_input(usage, sections, region, name, int(match.group(2), 16), match.group(3))
+                continue
+        match = INPUT_SECTION.match(line)
+        if not match or match.group(1).startswith("*") and match.group(1) != "*fill*":
+            continue  # Linker script patterns
+        name, _, size, source = match.groups()
+        if size is None:
+            pending = name
+        else:
+            add_input(usage, sections, region, name, int(size, 16), source)
+    return usage, sections
+
+
+def add_input(usage, sections, region, name, size, source):
+    if size == 0:
+        return
+    if name == "*fill*":
+        component, obj = "(padding)", ""
+    else:
+        component, obj = component_of(source.strip())
+    usage.setdefault(component, dict.fromkeys(REGIONS, 0))[region] += size
+    sections.append((size, region, component, obj, name))
+
+
+def evaluate_plan(plan, compiler, includes):
+    """{(region, name): bytes} for the driver buffers in the memory plan."""
+    with open(plan) as plan_file:
+        # A macro defined in both branches of an #if shows up twice
+        entries = sorted(set(PLAN_ENTRY.findall(plan_file.read())))
+    if not entries:
+        return {}
+    with tempfile.TemporaryDirectory() as scratch:
+        source = os.path.join(scratch, "plan.c")
+        with open(source, "w") as out:
+            out.write('#include "%s"\n' % os.path.abspath(plan))
+            for macro, _, _ in entries:
+                out.write('"%s" %s\n' % (macro, macro))
+        command = [compiler, "-E", "-P"] + ["-I" + path for path in includes] + [source]
+        expanded = subprocess.run(command, check=True, capture_output=True, text=True).stdout
+    values = {}
+    for line in expanded.splitlines():
+        match = re.match(r'^"(\w+)" (.*)$', line.strip())
+        if match:
+            # Integer arithmetic only, drop C suffixes (16U, 1ULL)
+            expression = re.sub(r"\b(\d+)[uUlL]+\b", r"\1", match.group(2)).replace("/", "//")
+            values[match.group(1)] = int(eval(expression, {"__builtins__": {}}))
+    return {(kind.lower(), name): values[macro] for macro, kind, name in entries}
+
+
+def kib(size):
+    return "%7.1fK" % (size / 1024) if size else "       0"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--map", required=True, help="GNU ld map file of the image")
+    parser.add_argument("--plan", help="memory_plan.h with the driver buffers")
+    parser.add_argument("--cc", default="cc", help="C compiler that evaluates the plan")
+    parser.add_argument("--include", action="append", default=[], help="include directory for the plan")
+    parser.add_argument("--budget", help="JSON budget to check against")
+    parser.add_argument("--output", help="write the figures as JSON")
+    parser.add_argument("--top", type=int, default=10, help="largest input sections to list")
+    options = parser.parse_args()
+
+    usage, sections = parse_map(options.map)
+    plan = evaluate_plan(options.plan, options.cc, options.include) if options.plan else {}
+
+    totals = dict.fromkeys(REGIONS + PLAN_REGIONS, 0)
+    for regions in usage.values():
+        for region, size in regions.items():
+            totals[region] += size
+    for (region, _), size in plan.items():
+        totals[region] += size
+
+    print("Memory report for %s" % os.path.basename(options.map))
+    print()
+    print("%-24s" % "component" + " ".join("%8s" % region for region in REGIONS))
+    for component in sorted(usage, key=lambda name: -sum(usage[name].values())):
+        print("%-24s" % component + " ".join(kib(usage[component][region]) for region in REGIONS))
+    print("%-24s" % "total" + " ".join(kib(totals[region]) for region in REGIONS))
+
+    if plan:
+        print()
+        print("Driver buffers, allocated at init (%s)" % os.path.basename(options.plan))
+        for (region, name), size in sorted(plan.items()):
+            print("  %-5s %-20s %7d" % (region, name.lower(), size))
+        peak = totals["dram"] + totals["dma"] + totals["heap"]
+        print("Internal RAM at peak: %d static + %d heap + %d DMA = %d bytes"
+              % (totals["dram"], totals["heap"], totals["dma"], peak))
+
+    if options.top:
+        print()
+        print("Largest input sections")
+        for size, region, component, obj, name in sorted(sections, reverse=True)[:options.top]:
+            print("  %7d %-5s %-12s %-28s %s" % (size, region, component, obj, name))
+
+    failures = []
+    if options.budget:
+        with open(options.budget) as budget_file:
+            budget = json.load(budget_file)
+        print()
+        print("Budget (%s)" % os.path.basename(options.budget))
+        checks = [("total", region, totals[region], limit) for region, limit in budget.get("regions", {}).items()]
+        for component, limits in budget.get("components", {}).items():
+            for region, limit in limits.items():
+                checks.append((component, region, usage.get(component, {}).get(region, 0), limit))
+        for owner, region, used, limit in checks:
+            over = used > limit
+            print("  %-12s %-5s %8d of %8d  %3d%%%s"
+                  % (owner, region, used, limit, 100 * used // limit if limit else 100, "  OVER BUDGET" if over else ""))
+            if over:
+                failures.append("%s %s" % (owner, region))
+
+    if options.output:
+        with open(options.output, "w") as out:
+            json.dump({"components": usage, "totals": totals,
+                       "plan": {"%s_%s" % key: size for key, size in plan.items()},
+                       "over_budget": failures}, out, indent=2)
+
+    if failures:
+        print("error: over budget: %s" % ", ".join(failures), file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,371 @@
+#!/usr/bin/env python3
+"""Reference client for the remote UART protocol (main/include/remote_control.h).
+
+Frames are COBS encoded, end with a 0x00 byte and carry
+
+    [type] [seq] [body ...] [CRC-16/CCITT-FALSE, little endian]
+
+Every request gets one response (type | 0x80, same seq, status byte first).
+Telemetry frames (type 0xC0) arrive on their own once a stream is subscribed.
+
+    tools/remote_client.py --port /dev/ttyUSB0 ping --count 20
+    tools/remote_client.py --port /dev/ttyUSB0 get brightness light
+    tools/remote_client.py --port /dev/ttyUSB0 set light=1 brightness=40 color=2
+    tools/remote_client.py --port /dev/ttyUSB0 effect pulse
+    tools/remote_client.py --port /dev/ttyUSB0 subscribe distance 100 --seconds 5
+    tools/remote_client.py --port /dev/ttyUSB0 subscribe profiler 1000 --seconds 10
+
+Against the host build, start the simulator with a socket instead of a port:
+
+    ./build-host/super_lights_sim --duration-ms 600000 --uart-socket /tmp/lights.sock &
+    tools/remote_client.py --socket /tmp/lights.sock ping
+
+--port needs pyserial. The module can also be imported, see RemoteClient.
+"""
+
+import argparse
+import socket
+import struct
+import sys
+import time
+
+BAUD_RATE = 460800
+PROTOCOL_VERSION = 1
+
+PING, GET, SET, SIGNAL, EFFECT, SUBSCRIBE = range(1, 7)
+RESPONSE = 0x80
+TELEMETRY = 0xC0
+
+STATUS = ["ok", "unknown request", "bad length", "no such key", "value out of range", "not in this build"]
+
+# Ids of SETTINGS_SCHEMA, in SettingKey order (settings_schema.h)
+SETTINGS = ["brightness", "color", "ir", "us", "sensitivity_ir", "sensitivity_ur", "timing_ir", "timing_ur",
+            "light", "auto_turn_off", "sound", "volume", "signal", "color_mode", "hue", "saturation", "color_temp",
+            "auto_bright"]
+EFFECTS = ["blink", "pulse"]
+STREAMS = ["occupancy", "distance", "light", "profiler"]
+PROFILER_STREAM = 3
+
+# Head of a ProfilerSnapshot (profiler_control.h), version 4
+SNAPSHOT_HEAD = struct.Struct("<BBIIIIIIH")
+
+# The firmware lets the chip sleep REMOTE_AWAKE_MS after the last byte it got;
+# past this much silence the client sends a wake preamble before a request
+IDLE_BEFORE_WAKE_S = 1.5
+WAKE_PREAMBLE = b"\x00" * 4
+WAKE_SETTLE_S = 0.002
+
+
+class RemoteError(Exception):
+    pass
+
+
+def crc16(data):
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else crc << 1
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_encode(data):
+    out = bytearray([0])
+    code_index, code = 0, 1
+    for byte in data:
+        if byte == 0:
+            out[code_index] = code
+            code_index, code = len(out), 1
+            out.append(0)
+            continue
+        out.append(byte)
+        code += 1
+        if code == 0xFF:
+            out[code_index] = code
+            code_index, code = len(out), 1
+            out.append(0)
+    out[code_index] = code
+    return bytes(out)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        i += 1
+        if code == 0 or i + code - 1 > len(data):
+            raise ValueError("bad COBS encoding")
+        out += data[i:i + code - 1]
+        i += code - 1
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def encode_frame(payload):
+    return cobs_encode(payload + struct.pack("<H", crc16(payload))) + b"\x00"
+
+
+class SerialTransport:
+    def __init__(self, port, baud=BAUD_RATE):
+        import serial  # pyserial, only needed for a real port
+        self.connection = serial.Serial(port, baud, timeout=0)
+
+    def write(self, data):
+        self.connection.write(data)
+
+    def read(self, timeout):
+        self.connection.timeout = timeout
+        first = self.connection.read(1)
+        return first + self.connection.read(self.connection.in_waiting) if first else b""
+
+
+class SocketTransport:
+    def __init__(self, path):
+        self.connection = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.connection.connect(path)
+
+    def write(self, data):
+        self.connection.sendall(data)
+
+    def read(self, timeout):
+        self.connection.settimeout(max(timeout, 0.0001))
+        try:
+            return self.connection.recv(4096)
+        except socket.timeout:
+            return b""
+
+
+class Sample:
+    def __init__(self, stream, seq, time_ms, values):
+        self.stream, self.seq, self.time_ms, self.values = stream, seq, time_ms, values
+
+    def __str__(self):
+        name = STREAMS[self.stream] if self.stream < len(STREAMS) else str(self.stream)
+        return "%10.3f s %-9s #%-3d %s" % (self.time_ms / 1000, name, self.seq, " ".join(map(str, self.values)))
+
+
+def parse_sample(body):
+    stream, time_ms = struct.unpack_from("<BI", body)
+    data = body[5:]
+    if stream == 0:
+        values = [data[0]]
+    elif stream == 1:
+        values = list(struct.unpack_from("<h", data))
+    elif stream == PROFILER_STREAM:
+        offset, size = struct.unpack_from("<HH", data)
+        values = [offset, size, data[4:]]
+    else:
+        values = list(data[:3])
+    return stream, time_ms, values
+
+
+class SnapshotAssembler:
+    """Puts the pieces of profiler snapshots back together."""
+
+    def __init__(self):
+        self.data = bytearray()
+
+    def add(self, sample):
+        """Returns a whole snapshot once its last piece is in, None before."""
+        offset, size, piece = sample.values
+        if offset == 0:
+            self.data = bytearray()
+        if offset != len(self.data):
+            self.data = bytearray()  # A piece went missing, wait for the next snapshot
+            return None
+        self.data += piece
+        if len(self.data) < size:
+            return None
+        snapshot, self.data = bytes(self.data), bytearray()
+        return snapshot
+
+
+def describe_snapshot(time_ms, snapshot):
+    (version, tasks, period_ms, uptime_ms, heap_free, heap_min_free, dma_free, dma_min_free,
+     overhead_ppm) = SNAPSHOT_HEAD.unpack_from(snapshot)
+    return ("%10.3f s profiler  v%d, %d bytes, window %d ms, up %.3f s, heap %d free (min %d), "
+            "DMA %d free (min %d), %d tasks, overhead %.3f%%"
+            % (time_ms / 1000, version, len(snapshot), period_ms, uptime_ms / 1000, heap_free, heap_min_free,
+               dma_free, dma_min_free, tasks, overhead_ppm / 10000))
+
+
+class RemoteClient:
+    def __init__(self, transport, timeout=0.05, retries=3):
+        self.transport = transport
+        self.timeout = timeout
+        self.retries = retries
+        self.seq = 0
+        self.rx = bytearray()
+        self.last_traffic = 0.0
+        self.samples = []  # Telemetry that arrived while waiting for responses
+        self.crc_errors = 0
+
+    def _frames(self, timeout):
+        """Decoded payloads (CRC checked and stripped) read within timeout."""
+        data = self.transport.read(timeout)
+        self.rx += data
+        frames = []
+        while b"\x00" in self.rx:
+            encoded, _, rest = self.rx.partition(b"\x00")
+            self.rx = bytearray(rest)
+            if not encoded:
+                continue
+            try:
+                frame = cobs_decode(bytes(encoded))
+            except ValueError:
+                self.crc_errors += 1
+                continue
+            if len(frame) < 4 or crc16(frame[:-2]) != struct.unpack_from("<H", frame, len(frame) - 2)[0]:
+                self.crc_errors += 1
+                continue
+            frames.append(frame[:-2])
+        return frames
+
+    def _handle_unsolicited(self, frame):
+        if frame[0] == TELEMETRY:
+            stream, time_ms, values = parse_sample(frame[2:])
+            self.samples.append(Sample(stream, frame[1], time_ms, values))
+
+    def request(self, kind, body=b""):
+        """Send a request, returns the response body after the status byte."""
+        for _ in range(self.retries):
+            if time.monotonic() - self.last_traffic > IDLE_BEFORE_WAKE_S:
+                self.transport.write(WAKE_PREAMBLE)
+                time.sleep(WAKE_SETTLE_S)
+            self.seq = (self.seq + 1) & 0xFF
+            self.transport.write(encode_frame(bytes([kind, self.seq]) + body))
+            self.last_traffic = time.monotonic()
+
+            deadline = time.monotonic() + self.timeout
+            response = None
+            while response is None and time.monotonic() < deadline:
+                for frame in self._frames(deadline - time.monotonic()):
+                    if frame[0] == kind | RESPONSE and frame[1] == self.seq:
+                        response = frame
+                    else:
+                        self._handle_unsolicited(frame)
+            if response is not None:
+                status = response[2]
+                if status != 0:
+                    raise RemoteError(STATUS[status] if status < len(STATUS) else "status %d" % status)
+                return response[3:]
+        raise RemoteError("no response after %d tries" % self.retries)
+
+    def ping(self):
+        version, settings, uptime_ms = struct.unpack("<BBI", self.request(PING))
+        return version, settings, uptime_ms
+
+    def get(self, keys=()):
+        body = self.request(GET, bytes(keys))
+        return {body[i]: struct.unpack_from("<i", body, i + 1)[0] for i in range(0, len(body), 5)}
+
+    def set(self, values):
+        self.request(SET, b"".join(struct.pack("<Bi", key, value) for key, value in values.items()))
+
+    def signal(self, index):
+        self.request(SIGNAL, bytes([index]))
+
+    def effect(self, effect):
+        self.request(EFFECT, bytes([effect]))
+
+    def subscribe(self, stream, period_ms):
+        self.request(SUBSCRIBE, struct.pack("<BH", stream, period_ms))
+
+    def poll(self, timeout):
+        """Telemetry received within timeout, plus any that came in with responses."""
+        for frame in self._frames(timeout):
+            self._handle_unsolicited(frame)
+        samples, self.samples = self.samples, []
+        return samples
+
+
+def lookup(names, text, what):
+    if text.isdigit():
+        return int(text)
+    try:
+        return names.index(text)
+    except ValueError:
+        raise SystemExit("unknown %s %r, one of: %s" % (what, text, ", ".join(names)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    link = parser.add_mutually_exclusive_group(required=True)
+    link.add_argument("--port", help="serial port wired to the remote UART")
+    link.add_argument("--socket", help="Unix socket of super_lights_sim --uart-socket")
+    parser.add_argument("--baud", type=int, default=BAUD_RATE)
+    parser.add_argument("--timeout-ms", type=float, default=50, help="response timeout per try")
+    commands = parser.add_subparsers(dest="command", required=True)
+    ping = commands.add_parser("ping", help="round-trip time")
+    ping.add_argument("--count", type=int, default=10)
+    get = commands.add_parser("get", help="read settings (all by default)")
+    get.add_argument("keys", nargs="*")
+    set_ = commands.add_parser("set", help="write settings at once: key=value ...")
+    set_.add_argument("assignments", nargs="+")
+    signal = commands.add_parser("signal", help="play a signal")
+    signal.add_argument("index", type=int)
+    effect = commands.add_parser("effect", help="play an LED effect")
+    effect.add_argument("effect", help="|".join(EFFECTS))
+    subscribe = commands.add_parser("subscribe", help="print a telemetry stream")
+    subscribe.add_argument("stream", help="|".join(STREAMS))
+    subscribe.add_argument("period_ms", type=int)
+    subscribe.add_argument("--seconds", type=float, default=10)
+    options = parser.parse_args()
+
+    transport = SerialTransport(options.port, options.baud) if options.port else SocketTransport(options.socket)
+    client = RemoteClient(transport, timeout=options.timeout_ms / 1000)
+
+    try:
+        if options.command == "ping":
+            times = []
+            for _ in range(options.count):
+                start = time.perf_counter()
+                version, settings, uptime_ms = client.ping()
+                times.append((time.perf_counter() - start) * 1000)
+            print("protocol %d, %d settings, up %.3f s" % (version, settings, uptime_ms / 1000))
+            print("round trip over %d pings: min %.2f ms, avg %.2f ms, max %.2f ms"
+                  % (len(times), min(times), sum(times) / len(times), max(times)))
+        elif options.command == "get":
+            keys = [lookup(SETTINGS, key, "setting") for key in options.keys]
+            for key, value in client.get(keys).items():
+                print("%-15s %d" % (SETTINGS[key] if key < len(SETTINGS) else key, value))
+        elif options.command == "set":
+            values = {}
+            for assignment in options.assignments:
+                key, _, value = assignment.partition("=")
+                values[lookup(SETTINGS, key, "setting")] = int(value)
+            client.set(values)
+        elif options.command == "signal":
+            client.signal(options.index)
+        elif options.command == "effect":
+            client.effect(lookup(EFFECTS, options.effect, "effect"))
+        elif options.command == "subscribe":
+            stream = lookup(STREAMS, options.stream, "stream")
+            client.subscribe(stream, options.period_ms)
+            end = time.monotonic() + options.seconds
+            snapshots = SnapshotAssembler()
+            try:
+                while time.monotonic() < end:
+                    for sample in client.poll(min(0.1, end - time.monotonic())):
+                        if sample.stream == PROFILER_STREAM:
+                            snapshot = snapshots.add(sample)
+                            if snapshot is not None:
+                                print(describe_snapshot(sample.time_ms, snapshot))
+                        else:
+                            print(sample)
+                        sys.stdout.flush()
+            finally:
+                client.subscribe(stream, 0)
+    except RemoteError as error:
+        print("error: %s" % error, file=sys.stderr)
+        return 1
+    except KeyboardInterrupt:
+        pass
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,515 @@
+#!/usr/bin/env python3
+"""Runs end-to-end scenarios against the firmware and checks their timing bounds.
+
+A scenario is a text file of "<time_ms> <command> [arguments]" lines, times
+counted from boot, '#' starts a comment. Pins are GPIO numbers or POWER, ENTER,
+BACK, UP, DOWN, IR.
+
+    8000 press DOWN 150               press a button, hold it 150 ms (default)
+    9000 gpio IR 1                    drive an input level
+    9500 echo 30                      HC-SR04 distance in cm, negative for no echo
+    10000 i2c_fail 3                  the next 3 I2C transactions time out
+    11000 light 3200                  ambient light sensor, raw ADC level 0-4095
+    11000 light_curve dusk.curve      replay "<ms> <raw>" lines from then on, the
+                                      file next to the scenario
+    9000 expect led on within 50      condition must hold within 50 ms of 9000
+    9000 expect led off between 9000 11000
+                                      ... becomes true 9 to 11 s after 9000
+    9000 expect allocs 0 per frame    at most 0 heap allocations per LED frame
+                                      from 9000 to the end (also: per press,
+                                      per sample, an ultrasonic trigger)
+    9000 expect fastpath              every presence event of the run reached the
+                                      strip within the firmware's fast path budget
+                                      (RGB_LED_FAST_PATH_BUDGET_US), at least one did
+    20000 end                         stop here (default: last bound + 1 s)
+
+Conditions: "led on", "led off", "led <rrggbb>" (every pixel), "lcd <text>"
+(text shown on either row, a custom character as the number of its lit pixel
+columns, so a full bar is 5555...) and "sound" (a non-silent I2S write). Allocation
+budgets need the allocation tracker and are only checked on the host backend,
+which records every allocation the firmware makes after boot. So is the fast
+path budget: the host backend reads the firmware's FastPathStats at the end of
+the run, QEMU's timing says nothing about the chip's. The QEMU image
+has no ambient light sensor, scenarios that drive one are skipped there.
+
+Backends:
+    --host DIR   super_lights_sim from a host build (cmake -S host -B DIR)
+    --qemu DIR   an IDF build made with sdkconfig.qemu, run in qemu-system-xtensa.
+                 The scenario shim in the image takes the stimulus over the
+                 console UART and prints the LCD I2C, LED and I2S traffic.
+"""
+
+import argparse
+import json
+import os
+import re
+import shlex
+import subprocess
+import sys
+import tempfile
+import time
+
+# Reference wiring, the ESP32-DevKitC board profile (main/Kconfig.projbuild)
+PIN_NAMES = {"POWER": 12, "ENTER": 15, "BACK": 18, "UP": 19, "DOWN": 21, "IR": 27}
+DEFAULT_HOLD_MS = 150
+END_MARGIN_MS = 1000
+
+# Stimulus the QEMU shim cannot give, the scenario only runs on the host
+HOST_ONLY_STIMULUS = ("light", "light_curve")
+
+LCD_ADDR = 0x27
+PCF_RS = 0x01
+PCF_EN = 0x04
+
+
+class ScenarioError(Exception):
+    pass
+
+
+def parse_pin(text):
+    if text.isdigit():
+        return int(text)
+    return PIN_NAMES.get(text.upper())
+
+
+def parse_scenario(path):
+    """Returns (stimulus, expectations, end_ms); stimulus lines keep the sim syntax."""
+    stimulus, expectations, end_ms = [], [], None
+    with open(path) as f:
+        for number, raw in enumerate(f, 1):
+            line = raw.split("#", 1)[0].strip()
+            if not line:
+                continue
+            fields = line.split()
+            where = "%s:%d" % (path, number)
+            if len(fields) < 2:
+                raise ScenarioError("%s: expected \"<time_ms> <command>\"" % where)
+            at_ms, command, args = float(fields[0]), fields[1], fields[2:]
+
+            if command in ("press", "gpio"):
+                if not args or parse_pin(args[0]) is None:
+                    raise ScenarioError("%s: unknown pin" % where)
+                stimulus.append((at_ms, command, args))
+            elif command in ("echo", "i2c_fail", "light") and len(args) == 1:
+                stimulus.append((at_ms, command, args))
+            elif command == "light_curve" and len(args) == 1:
+                curve = os.path.join(os.path.dirname(os.path.abspath(path)), args[0])
+                if not os.path.isfile(curve):
+                    raise ScenarioError("%s: no light curve %s" % (where, curve))
+                stimulus.append((at_ms, command, [curve]))
+            elif command == "expect" and args and args[0] == "allocs":
+                expectations.append(parse_alloc_budget(at_ms, args, where))
+            elif command == "expect" and args == ["fastpath"]:
+                expectations.append({"start_ms": at_ms, "kind": "fastpath", "value": "", "min_ms": 0.0,
+                                     "max_ms": 0.0, "text": "fastpath"})
+            elif command == "expect":
+                expectations.append(parse_expectation(at_ms, args, where))
+            elif command == "end":
+                end_ms = at_ms
+            else:
+                raise ScenarioError("%s: cannot parse \"%s\"" % (where, line))
+
+    if end_ms is None:
+        latest = [e["start_ms"] + e["max_ms"] for e in expectations] + [s[0] for s in stimulus]
+        end_ms = max(latest, default=0) + END_MARGIN_MS
+    return stimulus, expectations, end_ms
+
+
+def parse_expectation(at_ms, args, where):
+    text = " ".join(args)
+    match = re.match(r"^(.*?)\s+(within\s+(\d+(?:\.\d+)?)|between\s+(\d+(?:\.\d+)?)\s+(\d+(?:\.\d+)?))$", text)
+    if match is None:
+        raise ScenarioError("%s: expected \"expect <condition> within <ms>\" or \"... between <ms> <ms>\"" % where)
+    condition = match.group(1).split(None, 1)
+    if match.group(3) is not None:
+        min_ms, max_ms = 0.0, float(match.group(3))
+    else:
+        min_ms, max_ms = float(match.group(4)), float(match.group(5))
+
+    kind = condition[0]
+    value = condition[1] if len(condition) > 1 else ""
+    if kind == "led" and not (value in ("on", "off") or re.match(r"^[0-9a-fA-F]{6}$", value)):
+        raise ScenarioError("%s: led expects on, off or rrggbb" % where)
+    if kind not in ("led", "lcd", "sound") or (kind == "lcd" and not value):
+        raise ScenarioError("%s: unknown condition \"%s\"" % (where, match.group(1)))
+    return {"start_ms": at_ms, "kind": kind, "value": value.lower() if kind == "led" else value,
+            "min_ms": min_ms, "max_ms": max_ms, "text": "%s %s" % (kind, value) if value else kind}
+
+
+ALLOC_EVENTS = {"frame": "frames", "press": "presses", "sample": "samples"}
+
+
+def parse_alloc_budget(at_ms, args, where):
+    if len(args) != 4 or args[2] != "per" or args[3] not in ALLOC_EVENTS:
+        raise ScenarioError("%s: expected \"expect allocs <max> per frame|press|sample\"" % where)
+    try:
+        max_per = float(args[1])
+    except ValueError:
+        raise ScenarioError("%s: allocation budget is not a number" % where)
+    return {"start_ms": at_ms, "kind": "allocs", "value": args[3], "max_per": max_per,
+            "min_ms": 0.0, "max_ms": 0.0, "text": "allocs per %s" % args[3]}
+
+
+# ---------------------------------------------------------------------------
+# What the firmware produced: lists of (time_us, payload)
+
+class Timeline:
+    def __init__(self):
+        self.lcd = []   # (t, (row0, row1))
+        self.led = []   # (t, ["rrggbb", ...])
+        self.pcm = []   # (t, samples, peak)
+        self.samples = []  # t of every ultrasonic trigger
+        self.presses = []  # t of every button press in the stimulus
+        self.allocs = None  # (t, subsystem, bytes) after boot, None when the backend cannot tell
+        self.fast_path = None  # (events, over budget, max_us, budget_us) at the end, same
+
+
+class Hd44780:
+    """Same decoding as the host model in host/src/host_i2c.c."""
+
+    def __init__(self, timeline):
+        self.timeline = timeline
+        self.four_bit = False
+        self.high = None
+        self.last_port = 0
+        self.address = 0
+        self.cgram = False
+        self.cgram_bytes = [0] * 64
+        self.ddram = [" "] * 0x80
+        self.visible = ("", "")
+
+    def port_write(self, t, port):
+        falling = (self.last_port & PCF_EN) and not (port & PCF_EN)
+        latched, self.last_port = self.last_port, port
+        if not falling:
+            return
+        nibble = latched & 0xF0
+        if not self.four_bit:
+            value, self.high = nibble, None
+        elif self.high is None:
+            self.high = nibble
+            return
+        else:
+            value, self.high = self.high | (nibble >> 4), None
+        if latched & PCF_RS:
+            self.data(t, value)
+        else:
+            self.instruction(t, value)
+
+    def instruction(self, t, value):
+        if value & 0x80:
+            self.address, self.cgram = value & 0x7F, False
+        elif value & 0x40:
+            self.address, self.cgram = value & 0x3F, True
+        elif value & 0x20:
+            self.four_bit = not (value & 0x10)
+        elif value == 0x01:
+            self.ddram = [" "] * 0x80
+            self.address, self.cgram = 0, False
+            self.refresh(t)
+        elif value & 0xFE == 0x02:
+            self.address, self.cgram = 0, False
+
+    def data(self, t, value):
+        if self.cgram:
+            self.cgram_bytes[self.address & 0x3F] = value & 0x1F
+            self.address = (self.address + 1) & 0x3F
+            return
+        if value < 0x10:
+            self.ddram[self.address & 0x7F] = value  # A custom character, shown by refresh()
+        else:
+            self.ddram[self.address & 0x7F] = chr(value) if 0x20 <= value < 0x7F else "?"
+        self.address = (self.address + 1) & 0x7F
+        self.refresh(t)
+
+    def glyph(self, code):
+        """A custom character shows as the number of its lit pixel columns: a bar reads as digits."""
+        columns = 0
+        for row in self.cgram_bytes[(code & 0x07) * 8:(code & 0x07) * 8 + 8]:
+            columns |= row
+        return str(bin(columns).count("1"))
+
+    def row(self, start):
+        return "".join(self.glyph(c) if isinstance(c, int) else c for c in self.ddram[start:start + 16])
+
+    def refresh(self, t):
+        visible = (self.row(0), self.row(0x40))
+        if visible != self.visible:
+            self.visible = visible
+            self.timeline.lcd.append((t, visible))
+
+
+def read_host_captures(directory):
+    timeline = Timeline()
+    with open(os.path.join(directory, "lcd.log")) as f:
+        for line in f:
+            # "<t>|<row0>|<row1>", rows are fixed width and may contain '|' themselves
+            t, rows = line.rstrip("\n").split("|", 1)
+            timeline.lcd.append((int(t), (rows[0:16], rows[17:33])))
+    with open(os.path.join(directory, "led.log")) as f:
+        for line in f:
+            fields = line.split()
+            timeline.led.append((int(fields[0]), fields[1:]))
+    pcm_log = os.path.join(directory, "pcm.log")
+    if os.path.exists(pcm_log):
+        with open(pcm_log) as f:
+            for line in f:
+                t, samples, peak = line.split()
+                timeline.pcm.append((int(t), int(samples), int(peak)))
+    echo_log = os.path.join(directory, "echo.log")
+    if os.path.exists(echo_log):
+        with open(echo_log) as f:
+            timeline.samples = [int(line) for line in f if line.strip()]
+    alloc_log = os.path.join(directory, "alloc.log")
+    if os.path.exists(alloc_log):
+        with open(alloc_log) as f:
+            timeline.allocs = [(int(t), tag, int(size)) for t, tag, size in (line.split() for line in f)]
+    fast_path_log = os.path.join(directory, "fastpath.log")
+    if os.path.exists(fast_path_log):
+        with open(fast_path_log) as f:
+            timeline.fast_path = tuple(int(field) for field in f.read().split())
+    return timeline
+
+
+def parse_shim_record(line, timeline, lcd):
+    """Feeds one "@" line of the QEMU scenario shim into the timeline."""
+    fields = line.split()
+    if fields[0] == "@i2c" and len(fields) == 5 and fields[4].startswith("+"):
+        raise ScenarioError("the shim cut an I2C transaction short by %s bytes: %s" % (fields[4][1:], line.strip()))
+    if fields[0] == "@i2c" and len(fields) >= 3 and int(fields[2], 16) == LCD_ADDR and len(fields) == 4:
+        t = int(fields[1])
+        for i in range(0, len(fields[3]), 2):
+            lcd.port_write(t, int(fields[3][i:i + 2], 16))
+    elif fields[0] == "@led":
+        timeline.led.append((int(fields[1]), fields[2:]))
+    elif fields[0] == "@pcm":
+        timeline.pcm.append((int(fields[1]), int(fields[2]), int(fields[3])))
+
+
+# ---------------------------------------------------------------------------
+# Backends
+
+def run_host(build_dir, stimulus, end_ms, work_dir):
+    sim = os.path.join(build_dir, "super_lights_sim")
+    script = os.path.join(work_dir, "stimulus.script")
+    with open(script, "w") as f:
+        for at_ms, command, args in stimulus:
+            f.write("%g %s %s\n" % (at_ms, command, " ".join(args)))
+    with open(os.path.join(work_dir, "console.log"), "w") as console:
+        subprocess.run([sim, "--duration-ms", "%g" % end_ms, "--script", script, "--capture", work_dir],
+                       stdout=console, check=True)
+    return read_host_captures(work_dir)
+
+
+def expand_stimulus(stimulus, end_ms):
+    """Presses become two level changes; the shim only knows gpio, echo, i2c_fail and end."""
+    lines = []
+    for at_ms, command, args in stimulus:
+        if command == "press":
+            pin = parse_pin(args[0])
+            hold_ms = float(args[1]) if len(args) > 1 else DEFAULT_HOLD_MS
+            lines.append((at_ms, "gpio %d 0" % pin))
+            lines.append((at_ms + hold_ms, "gpio %d 1" % pin))
+        elif command == "gpio":
+            lines.append((at_ms, "gpio %d %d" % (parse_pin(args[0]), int(args[1]))))
+        else:
+            lines.append((at_ms, "%s %s" % (command, args[0])))
+    lines.sort(key=lambda item: item[0])
+    lines.append((end_ms, "end"))
+    return ["%g %s\n" % line for line in lines]
+
+
+def merge_flash_image(build_dir):
+    with open(os.path.join(build_dir, "flasher_args.json")) as f:
+        flash_size = json.load(f)["flash_settings"]["flash_size"]
+    image = os.path.join(build_dir, "qemu_flash.bin")
+    subprocess.run([sys.executable, "-m", "esptool", "--chip", "esp32", "merge_bin", "--fill-flash-size", flash_size,
+                    "-o", image, "@flash_args"], cwd=build_dir, check=True, stdout=subprocess.DEVNULL)
+    return image
+
+
+def run_qemu(build_dir, stimulus, end_ms, work_dir, qemu, extra_args):
+    image = merge_flash_image(build_dir)
+    command = [qemu, "-machine", "esp32", "-display", "none", "-monitor", "none", "-serial", "stdio",
+               "-drive", "file=%s,if=mtd,format=raw" % image, "-nic", "none"] + extra_args
+    timeline = Timeline()
+    lcd = Hd44780(timeline)
+    deadline = time.monotonic() + end_ms / 1000.0 * 4 + 60  # Emulation runs slower than the chip
+
+    with open(os.path.join(work_dir, "console.log"), "w") as console:
+        process = subprocess.Popen(command, stdin=subprocess.PIPE, stdout=subprocess.PIPE, text=True, bufsize=1)
+        try:
+            for line in process.stdout:
+                console.write(line)
+                if line.startswith("@ready"):
+                    process.stdin.writelines(expand_stimulus(stimulus, end_ms))
+                    process.stdin.flush()
+                elif line.startswith("@end"):
+                    break
+                elif line.startswith("@"):
+                    parse_shim_record(line, timeline, lcd)
+                if time.monotonic() > deadline:
+                    raise ScenarioError("QEMU run did not reach the end of the scenario, see %s/console.log" % work_dir)
+            else:
+                raise ScenarioError("QEMU exited early, see %s/console.log" % work_dir)
+        finally:
+            process.kill()
+            process.wait()
+    return timeline
+
+
+# ---------------------------------------------------------------------------
+# Checking
+
+def holds_at(expectation, timeline, t):
+    """Whether a state condition is true at time t (the latest record at or before t counts)."""
+    kind, value = expectation["kind"], expectation["value"]
+    if kind == "led":
+        frame = next((pixels for when, pixels in reversed(timeline.led) if when <= t), [])
+        lit = any(pixel != "000000" for pixel in frame)
+        if value == "on":
+            return lit
+        if value == "off":
+            return not lit
+        return bool(frame) and all(pixel == value for pixel in frame)
+    rows = next((rows for when, rows in reversed(timeline.lcd) if when <= t), ("", ""))
+    return any(value in row for row in rows)
+
+
+def first_time(expectation, timeline):
+    """When the condition first holds after the start; "between" waits for it to become true."""
+    start_us = int(expectation["start_ms"] * 1000)
+    if expectation["kind"] == "sound":
+        return next((t for t, samples, peak in timeline.pcm if t >= start_us and peak > 0), None)
+    held = holds_at(expectation, timeline, start_us)
+    if held and expectation["min_ms"] == 0:
+        return start_us
+    records = timeline.led if expectation["kind"] == "led" else timeline.lcd
+    for t, _ in records:
+        if t <= start_us:
+            continue
+        holds = holds_at(expectation, timeline, t)
+        if holds and not held:
+            return t
+        held = holds
+    return None
+
+
+def check_allocs(expectation, timeline):
+    """Allocations per event from the start to the end of the run, None when not recorded."""
+    if timeline.allocs is None:
+        return None
+    start_us = expectation["start_ms"] * 1000
+    events = {"frame": [t for t, _ in timeline.led], "press": timeline.presses, "sample": timeline.samples}
+    count = sum(1 for t in events[expectation["value"]] if t >= start_us)
+    allocs = [(tag, size) for t, tag, size in timeline.allocs if t >= start_us]
+    by_tag = {}
+    for tag, size in allocs:
+        count_bytes = by_tag.setdefault(tag, [0, 0])
+        count_bytes[0] += 1
+        count_bytes[1] += size
+    ok = count > 0 and len(allocs) <= expectation["max_per"] * count
+    observed = "%d in %d %s" % (len(allocs), count, ALLOC_EVENTS[expectation["value"]])
+    details = ["%s: %d (%d bytes)" % (tag, n, size) for tag, (n, size) in sorted(by_tag.items())]
+    return ok, observed, details
+
+
+def check_fast_path(timeline):
+    """Presence events against the fast path budget, None when not recorded."""
+    if timeline.fast_path is None:
+        return None
+    events, over_budget, max_us, budget_us = timeline.fast_path
+    ok = events > 0 and over_budget == 0 and max_us <= budget_us
+    observed = "%d events, max %d us, %d over" % (events, max_us, over_budget)
+    return ok, "<= %d us" % budget_us, observed
+
+
+def check(expectations, timeline):
+    failures = 0
+    for expectation in expectations:
+        if expectation["kind"] == "fastpath":
+            result = check_fast_path(timeline)
+            if result is None:
+                print("  SKIP  @%g ms  %-28s %-16s host backend only" % (expectation["start_ms"], expectation["text"],
+                                                                        ""))
+                continue
+            ok, bounds, observed = result
+            failures += not ok
+            print("  %s  @%g ms  %-28s %-16s observed %s" % ("PASS" if ok else "FAIL", expectation["start_ms"],
+                                                            expectation["text"], bounds, observed))
+            continue
+        if expectation["kind"] == "allocs":
+            bounds = "<= %g each" % expectation["max_per"]
+            result = check_allocs(expectation, timeline)
+            if result is None:
+                print("  SKIP  @%g ms  %-28s %-16s host backend only" % (expectation["start_ms"], expectation["text"],
+                                                                        bounds))
+                continue
+            ok, observed, details = result
+            failures += not ok
+            print("  %s  @%g ms  %-28s %-16s observed %s" % ("PASS" if ok else "FAIL", expectation["start_ms"],
+                                                            expectation["text"], bounds, observed))
+            for line in details:
+                print("        %s" % line)
+            continue
+        t = first_time(expectation, timeline)
+        start_us = expectation["start_ms"] * 1000
+        bounds = "%g..%g ms" % (expectation["min_ms"], expectation["max_ms"])
+        if t is None:
+            ok, observed = False, "never"
+        else:
+            latency_ms = (t - start_us) / 1000.0
+            ok = expectation["min_ms"] <= latency_ms <= expectation["max_ms"]
+            observed = "%.1f ms" % latency_ms
+        failures += not ok
+        print("  %s  @%g ms  %-28s %-16s observed %s" % ("PASS" if ok else "FAIL", expectation["start_ms"],
+                                                        expectation["text"], bounds, observed))
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("scenarios", nargs="+", help="scenario files")
+    backend = parser.add_mutually_exclusive_group(required=True)
+    backend.add_argument("--host", metavar="DIR", help="host build directory")
+    backend.add_argument("--qemu", metavar="DIR", help="IDF build directory of the sdkconfig.qemu image")
+    parser.add_argument("--qemu-binary", default="qemu-system-xtensa")
+    parser.add_argument("--qemu-args", default="", help="extra QEMU arguments, e.g. \"-icount shift=3\"")
+    parser.add_argument("--keep", metavar="DIR", help="keep captures and console logs under DIR")
+    options = parser.parse_args()
+
+    failed = 0
+    for path in options.scenarios:
+        name = os.path.splitext(os.path.basename(path))[0]
+        print("%s:" % name)
+        try:
+            stimulus, expectations, end_ms = parse_scenario(path)
+            if options.qemu and any(command in HOST_ONLY_STIMULUS for _, command, _ in stimulus):
+                print("  SKIP  drives the ambient light sensor, host backend only")
+                continue
+            if options.keep:
+                work_dir = os.path.join(options.keep, name)
+                os.makedirs(work_dir, exist_ok=True)
+                context = None
+            else:
+                context = tempfile.TemporaryDirectory()
+                work_dir = context.name
+            if options.host:
+                timeline = run_host(options.host, stimulus, end_ms, work_dir)
+            else:
+                timeline = run_qemu(options.qemu, stimulus, end_ms, work_dir, options.qemu_binary,
+                                    shlex.split(options.qemu_args))
+            timeline.presses = [int(at_ms * 1000) for at_ms, command, _ in stimulus if command == "press"]
+            failed += check(expectations, timeline) > 0
+            if context is not None:
+                context.cleanup()
+        except (ScenarioError, OSError, subprocess.CalledProcessError) as error:
+            print("  ERROR %s" % error)
+            failed += 1
+
+    print("%d of %d scenarios passed" % (len(options.scenarios) - failed, len(options.scenarios)))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())